@@ -0,0 +1,139 @@
+/**
+ * File: AccessLog.cpp
+ *
+ * Implementation of the AccessLog class.
+ * See the associated header file (AccessLog.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+// C standard library
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+
+#include "AccessLog.hpp"
+
+using std::string;
+
+// a thread's lines are written out once there are this many bytes of them
+static const size_t FLUSH_SIZE = 16384;
+
+// lines (and the formatted time) collected by the current thread
+static thread_local string pending_lines;
+static thread_local time_t last_flush = 0;
+static thread_local time_t formatted_second = 0;
+static thread_local char formatted_time[40];
+
+AccessLog::AccessLog(const string& path) {
+	log_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (log_fd < 0) {
+		perror("Opening the access log failed");
+		exit(1);
+	}
+}
+
+AccessLog::~AccessLog() {
+	flush(pending_lines);
+	close(log_fd);
+}
+
+void AccessLog::record(uint32_t address, const HttpRequest& request, int status, long num_bytes) {
+	time_t now = time(nullptr);
+
+	// the time only needs formatting once a second
+	if (now != formatted_second) {
+		struct tm utc;
+		gmtime_r(&now, &utc);
+		strftime(formatted_time, sizeof(formatted_time), "[%d/%b/%Y:%H:%M:%S +0000]", &utc);
+		formatted_second = now;
+	}
+
+	// clients without an address (unix domain ones) are logged as "-"
+	char client[INET_ADDRSTRLEN] = "-";
+	if (address != 0) {
+		inet_ntop(AF_INET, &address, client, sizeof(client));
+	}
+
+	string& lines = pending_lines;
+	lines += client;
+	lines += " - - ";
+	lines += formatted_time;
+
+	if (request.resource.empty()) {
+		lines += " \"-\" ";
+	}
+	else {
+		lines += " \"GET ";
+		lines += request.resource;
+		if (!request.query.empty()) {
+			lines += '?';
+			lines += request.query;
+		}
+		lines += " HTTP/1.";
+		lines += char('0' + request.minor_version);
+		lines += "\" ";
+	}
+
+	lines += std::to_string(status);
+	lines += num_bytes < 0 ? " -\n" : " " + std::to_string(num_bytes) + "\n";
+
+	if (lines.size() >= FLUSH_SIZE || now != last_flush) {
+		flush(lines);
+		last_flush = now;
+	}
+}
+
+void AccessLog::flush(string& lines) {
+	if (lines.empty()) return;
+
+	// a single O_APPEND write keeps other threads' lines from cutting in
+	if (write(log_fd, lines.data(), lines.size()) < 0) {
+		perror("Writing the access log failed");
+	}
+	lines.clear();
+}
+
+std::vector<string> AccessLog::mostRequested(const string& path, size_t count) {
+	std::unordered_map<string, size_t> counts;
+
+	std::ifstream log(path);
+	string line;
+	while (std::getline(log, line)) {
+		// the request line is between the first pair of quotes, followed by
+		// the status code
+		size_t open_quote = line.find("\"GET ");
+		if (open_quote == string::npos) continue;
+		size_t close_quote = line.find('"', open_quote + 1);
+		if (close_quote == string::npos || line.compare(close_quote + 1, 5, " 200 ") != 0) continue;
+
+		size_t resource_start = open_quote + 5;
+		size_t resource_end = line.find_first_of(" ?", resource_start);
+		if (resource_end == string::npos || resource_end > close_quote) continue;
+
+		counts[line.substr(resource_start, resource_end - resource_start)]++;
+	}
+
+	std::vector<std::pair<size_t, string>> ranked;
+	for (auto& [resource, times] : counts) {
+		ranked.push_back({times, resource});
+	}
+	count = std::min(count, ranked.size());
+	std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+			[](const auto& a, const auto& b) { return a.first > b.first; });
+
+	std::vector<string> resources;
+	for (size_t i = 0; i < count; i++) {
+		resources.push_back(std::move(ranked[i].second));
+	}
+	return resources;
+}
@@ -0,0 +1,69 @@
+#ifndef ACCESSLOG_HPP
+#define ACCESSLOG_HPP
+
+/**
+ * File: AccessLog.hpp
+ *
+ * Header file for the AccessLog class.
+ */
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "HttpRequest.hpp"
+
+/**
+ * Class that appends a line per request to a log file, in the Common Log
+ * Format (the one Apache and nginx use by default):
+ *
+ *   127.0.0.1 - - [18/Oct/2026:15:52:01 +0000] "GET /index.html HTTP/1.0" 200 265
+ *
+ * Each thread collects its lines in a buffer of its own and writes them out
+ * (with a single O_APPEND write) once the buffer fills up or a second has
+ * passed, so logging never takes a lock or a system call per request. The
+ * flip side is that up to a second's worth of lines per thread is lost if the
+ * server is killed.
+ */
+class AccessLog {
+	public:
+		/**
+		 * Opens (or creates) the log file, exiting with an error message if
+		 * that isn't possible.
+		 *
+		 * @param path Path of the log file.
+		 */
+		AccessLog(const std::string& path);
+		~AccessLog();
+
+		AccessLog(const AccessLog&) = delete;
+		void operator=(const AccessLog&) = delete;
+
+		/**
+		 * Logs a request and the response it got.
+		 *
+		 * @param address The client's IPv4 address (as in sin_addr.s_addr).
+		 * @param request The request (with an empty resource if it was bad).
+		 * @param status The status code of the response.
+		 * @param num_bytes Size of the response body, or -1 if unknown.
+		 */
+		void record(uint32_t address, const HttpRequest& request, int status, long num_bytes);
+
+		/**
+		 * Reads a log in the Common Log Format and finds the resources that
+		 * were most often served successfully (with a 200).
+		 *
+		 * @param path Path of the log file.
+		 * @param count How many resources to return, at most.
+		 * @return The resources, most requested first (empty if the log can't
+		 * be read).
+		 */
+		static std::vector<std::string> mostRequested(const std::string& path, size_t count);
+
+	private:
+		int log_fd;
+
+		void flush(std::string& lines);
+};
+#endif
@@ -0,0 +1,159 @@
+/**
+ * File: AsyncSocket.cpp
+ *
+ * Implementation of the AsyncSocket class.
+ * See the associated header file (AsyncSocket.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+// C++ standard libraries
+#include <cerrno>
+#include <algorithm>
+#include <system_error>
+
+#include "AsyncSocket.hpp"
+#include "LargeFile.hpp"
+
+/**
+ * Tells whether the last system call failed only because it would have had
+ * to block.
+ */
+static bool wouldBlock() {
+	return errno == EAGAIN || errno == EWOULDBLOCK;
+}
+
+static void throwSystemError(const char* what) {
+	std::error_code ec(errno, std::generic_category());
+	throw std::system_error(ec, what);
+}
+
+AsyncSocket::AsyncSocket(int fd, Scheduler& scheduler, uint32_t events) :
+		fd(fd), scheduler(scheduler) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	scheduler.watch(fd, &waiters, events);
+}
+
+void AsyncSocket::close() {
+	clearDeadline();
+	scheduler.unwatch(fd);
+	::close(fd);
+}
+
+void AsyncSocket::setDeadline(Scheduler::Clock::time_point deadline) {
+	clearDeadline();
+	deadline_timer = scheduler.startTimer(deadline, &waiters);
+	has_deadline = true;
+}
+
+void AsyncSocket::clearDeadline() {
+	if (has_deadline && !waiters.timed_out) {
+		scheduler.stopTimer(deadline_timer);
+	}
+	has_deadline = false;
+	waiters.timed_out = false;
+}
+
+Task<size_t> AsyncSocket::receive(std::span<char> buffer) {
+	while (true) {
+		ssize_t num_bytes_received = recv(fd, buffer.data(), buffer.size(), 0);
+		if (num_bytes_received >= 0) {
+			co_return num_bytes_received;
+		}
+
+		if (errno == EINTR) continue;
+		if (!wouldBlock()) throwSystemError("recv failed");
+
+		co_await readable();
+		if (waiters.timed_out) {
+			errno = ETIMEDOUT;
+			throwSystemError("recv timed out");
+		}
+	}
+}
+
+Task<size_t> AsyncSocket::send(std::span<const char> data) {
+	size_t total_bytes_sent = 0;
+
+	while (total_bytes_sent < data.size()) {
+		ssize_t num_bytes_sent = ::send(fd, data.data() + total_bytes_sent,
+				data.size() - total_bytes_sent, MSG_NOSIGNAL);
+		if (num_bytes_sent >= 0) {
+			total_bytes_sent += num_bytes_sent;
+			continue;
+		}
+
+		if (errno == EINTR) continue;
+		if (!wouldBlock()) throwSystemError("send failed");
+
+		co_await writable();
+	}
+
+	co_return total_bytes_sent;
+}
+
+Task<size_t> AsyncSocket::send(std::span<const char> first, std::span<const char> second) {
+	size_t total_size = first.size() + second.size();
+	size_t total_bytes_sent = 0;
+
+	while (total_bytes_sent < total_size) {
+		struct iovec iov[2];
+		int iov_count = 0;
+		if (total_bytes_sent < first.size()) {
+			iov[iov_count].iov_base = const_cast<char*>(first.data()) + total_bytes_sent;
+			iov[iov_count].iov_len = first.size() - total_bytes_sent;
+			iov_count++;
+		}
+		size_t second_sent = total_bytes_sent - std::min(total_bytes_sent, first.size());
+		if (second_sent < second.size()) {
+			iov[iov_count].iov_base = const_cast<char*>(second.data()) + second_sent;
+			iov[iov_count].iov_len = second.size() - second_sent;
+			iov_count++;
+		}
+
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_count;
+
+		ssize_t num_bytes_sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (num_bytes_sent >= 0) {
+			total_bytes_sent += num_bytes_sent;
+			continue;
+		}
+
+		if (errno == EINTR) continue;
+		if (!wouldBlock()) throwSystemError("sendmsg failed");
+
+		co_await writable();
+	}
+
+	co_return total_bytes_sent;
+}
+
+Task<size_t> AsyncSocket::sendFile(int file_fd, off_t offset, size_t length, bool drop_behind) {
+	size_t total_bytes_sent = 0;
+
+	while (total_bytes_sent < length) {
+		off_t old_offset = offset;
+		ssize_t num_bytes_sent = sendfile(fd, file_fd, &offset, length - total_bytes_sent);
+		if (num_bytes_sent > 0) {
+			if (drop_behind) dropPassedPages(file_fd, old_offset, offset);
+			total_bytes_sent += num_bytes_sent;
+			continue;
+		}
+		if (num_bytes_sent == 0) break; // file shrank
+
+		if (errno == EINTR) continue;
+		if (!wouldBlock()) throwSystemError("sendfile failed");
+
+		co_await writable();
+	}
+
+	co_return total_bytes_sent;
+}
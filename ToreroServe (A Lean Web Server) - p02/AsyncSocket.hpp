@@ -0,0 +1,101 @@
+#ifndef ASYNCSOCKET_HPP
+#define ASYNCSOCKET_HPP
+
+/**
+ * File: AsyncSocket.hpp
+ *
+ * Header file for the AsyncSocket class.
+ */
+
+#include <span>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/epoll.h>
+
+#include "Coroutines.hpp"
+#include "Scheduler.hpp"
+
+/**
+ * Non-blocking socket whose operations are awaited from coroutines, so that
+ * a connection can be handled in the same step-by-step style as with the
+ * blocking ClientSocket without tying up a thread while waiting.
+ *
+ * Like ClientSocket, operations throw std::system_error when they fail.
+ */
+class AsyncSocket {
+	public:
+		static const uint32_t CLIENT_EVENTS = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+
+		/**
+		 * Makes fd non-blocking and starts watching it with the scheduler.
+		 * The socket must not be moved afterwards (it is meant to live in a
+		 * coroutine frame).
+		 *
+		 * @param fd The socket to use.
+		 * @param scheduler The scheduler of the current thread.
+		 * @param events The epoll events to watch for.
+		 */
+		AsyncSocket(int fd, Scheduler& scheduler, uint32_t events = CLIENT_EVENTS);
+
+		AsyncSocket(const AsyncSocket&) = delete;
+		void operator=(const AsyncSocket&) = delete;
+
+		/**
+		 * Stops watching the socket and closes it.
+		 */
+		void close();
+
+		/**
+		 * Makes receive give up once deadline passes, throwing
+		 * std::system_error with ETIMEDOUT, until clearDeadline is called.
+		 */
+		void setDeadline(Scheduler::Clock::time_point deadline);
+		void clearDeadline();
+
+		/**
+		 * Receives whatever data is available, waiting until there is some
+		 * (or until the deadline, if one is set).
+		 *
+		 * @param buffer Where to put the data.
+		 * @return The number of bytes received (0 if the peer closed).
+		 */
+		Task<size_t> receive(std::span<char> buffer);
+
+		/**
+		 * Sends all of the given data, waiting for the socket to drain as
+		 * needed.
+		 *
+		 * @return The number of bytes sent.
+		 */
+		Task<size_t> send(std::span<const char> data);
+
+		/**
+		 * Sends two pieces of data back to back (e.g. a header and a body),
+		 * in a single system call unless the socket fills up.
+		 *
+		 * @return The number of bytes sent.
+		 */
+		Task<size_t> send(std::span<const char> first, std::span<const char> second);
+
+		/**
+		 * Sends length bytes of the given file, starting at offset, dropping
+		 * the sent pages from the page cache if asked to (see LargeFile.hpp).
+		 *
+		 * @return The number of bytes sent (less than length if the file
+		 * turned out to be shorter).
+		 */
+		Task<size_t> sendFile(int file_fd, off_t offset, size_t length, bool drop_behind = false);
+
+		IOReady readable() { return IOReady{&waiters, false}; }
+		IOReady writable() { return IOReady{&waiters, true}; }
+
+		int getFd() const { return fd; }
+
+	private:
+		int fd;
+		Scheduler& scheduler;
+		IOWaiters waiters;
+		Scheduler::Timer deadline_timer;
+		bool has_deadline = false;
+};
+#endif
@@ -0,0 +1,93 @@
+/**
+ * File: BodySource.cpp
+ *
+ * Implementation of the ChunkedBody and UnchunkedBody classes.
+ */
+
+// C standard library
+#include <cstdio>
+#include <cctype>
+
+// C++ standard library
+#include <algorithm>
+
+#include "BodySource.hpp"
+
+void ChunkedBody::appendChunk(std::string& out, const std::string& data) {
+	// a zero-length chunk would end the body early, so skip empty pieces
+	if (data.empty()) return;
+
+	char size_line[32];
+	int size_line_length = snprintf(size_line, sizeof(size_line), "%zx\r\n", data.size());
+
+	out.append(size_line, size_line_length);
+	out += data;
+	out += "\r\n";
+}
+
+bool ChunkedBody::next(std::string& out) {
+	if (finished) return false;
+
+	piece.clear();
+	if (inner->next(piece)) {
+		appendChunk(out, piece);
+	}
+	else {
+		out += "0\r\n\r\n";
+		finished = true;
+	}
+	return true;
+}
+
+bool UnchunkedBody::next(std::string& out) {
+	// a piece may be nothing but framing, so keep going until some contents
+	// turn up
+	size_t old_size = out.size();
+	while (out.size() == old_size) {
+		piece.clear();
+		if (!inner || !inner->next(piece)) return false;
+		decode(piece, out);
+	}
+	return true;
+}
+
+void UnchunkedBody::decode(std::string_view data, std::string& out) {
+	for (size_t i = 0; i < data.size() && state != State::Done; i++) {
+		char c = data[i];
+		switch (state) {
+			case State::Size:
+				if (isxdigit(static_cast<unsigned char>(c))) {
+					chunk_size = chunk_size * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+				}
+				else if (c == ';') {
+					state = State::Extension;
+				}
+				else if (c == '\n') {
+					state = chunk_size == 0 ? State::Done : State::Data;
+				}
+				break;
+
+			case State::Extension:
+				if (c == '\n') {
+					state = chunk_size == 0 ? State::Done : State::Data;
+				}
+				break;
+
+			case State::Data: {
+				size_t num_taken = std::min(chunk_size, data.size() - i);
+				out.append(data.data() + i, num_taken);
+				chunk_size -= num_taken;
+				i += num_taken - 1;
+				if (chunk_size == 0) state = State::DataEnd;
+				break;
+			}
+
+			case State::DataEnd:
+				if (c == '\n') state = State::Size;
+				break;
+
+			case State::Done:
+				break;
+		}
+	}
+}
@@ -0,0 +1,103 @@
+#ifndef BODYSOURCE_HPP
+#define BODYSOURCE_HPP
+
+/**
+ * File: BodySource.hpp
+ *
+ * Interface for response bodies that are produced a piece at a time, while
+ * they are being sent, instead of being built up front.
+ */
+
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <string_view>
+
+class UpstreamBody;
+
+class BodySource {
+	public:
+		virtual ~BodySource() = default;
+
+		/**
+		 * Produces the next piece of the body.
+		 *
+		 * @param out String that the next piece is appended to.
+		 * @return false if the body is finished (out is left untouched), true
+		 * otherwise.
+		 */
+		virtual bool next(std::string& out) = 0;
+
+		/**
+		 * Makes next() return right away when the next piece isn't ready
+		 * yet, instead of waiting for it: it then returns true without
+		 * appending anything, and should be called again once the returned
+		 * descriptor is readable. This is for event loops, which mustn't
+		 * block.
+		 *
+		 * @return The descriptor to wait on, or -1 for a body that never has
+		 * to wait (which this doesn't change).
+		 */
+		virtual int makeNonBlocking() { return -1; }
+
+		/**
+		 * @return This body as an UpstreamBody, if it is one that can be
+		 * spliced instead of read (see ReverseProxy.hpp), or nullptr.
+		 */
+		virtual UpstreamBody* spliceable() { return nullptr; }
+};
+
+/**
+ * Wraps another body source, framing each of its pieces with the
+ * "Transfer-Encoding: chunked" format and adding the final zero-length chunk
+ * at the end.
+ */
+class ChunkedBody : public BodySource {
+	public:
+		ChunkedBody(std::unique_ptr<BodySource> inner) : inner(std::move(inner)) {};
+
+		bool next(std::string& out) override;
+
+		/**
+		 * Appends data to out as a single chunk.
+		 */
+		static void appendChunk(std::string& out, const std::string& data);
+
+	private:
+		std::unique_ptr<BodySource> inner;
+		std::string piece; // reused between calls to avoid reallocating
+		bool finished = false;
+};
+
+/**
+ * The reverse of ChunkedBody: takes a body in the "Transfer-Encoding:
+ * chunked" format apart again and hands out only the contents of its chunks
+ * (for HTTP/2, which frames bodies itself). Chunk extensions and trailers
+ * are dropped.
+ */
+class UnchunkedBody : public BodySource {
+	public:
+		/**
+		 * @param inner The rest of the chunked body, or nullptr if decode is
+		 * given all of it.
+		 */
+		UnchunkedBody(std::unique_ptr<BodySource> inner) : inner(std::move(inner)) {};
+
+		bool next(std::string& out) override;
+
+		/**
+		 * Appends the chunk contents in data, the next part of the chunked
+		 * body, to out.
+		 */
+		void decode(std::string_view data, std::string& out);
+
+	private:
+		// where in the chunked format the next byte is
+		enum class State { Size, Extension, Data, DataEnd, Done };
+
+		std::unique_ptr<BodySource> inner;
+		std::string piece; // reused between calls to avoid reallocating
+		State state = State::Size;
+		size_t chunk_size = 0;
+};
+#endif
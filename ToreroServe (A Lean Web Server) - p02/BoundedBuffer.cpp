@@ -6,16 +6,21 @@
 #include <cstdio>
 
 #include "BoundedBuffer.hpp"
+#include "Profiler.hpp"
 #include <mutex>
+#include <algorithm>
 
 /**
  * Constructor that sets capacity to the given value. The buffer itself is
  * initialized to en empty queue.
  *
  * @param max_size The desired capacity for the buffer.
+ * @param items_per_consumer How many items a consumer takes at once, which
+ * decides how many consumers a batch wakes up.
  */
-BoundedBuffer::BoundedBuffer(int max_size) {
+BoundedBuffer::BoundedBuffer(int max_size, std::size_t items_per_consumer) {
 	capacity = std::size_t(max_size);
+	this->items_per_consumer = std::max<std::size_t>(items_per_consumer, 1);
 	std::mutex *shared_mutex = new std::mutex();
 	std::condition_variable *data_available = new std::condition_variable();
 	std::condition_variable *space_available = new std::condition_variable();
@@ -34,30 +39,99 @@ BoundedBuffer::BoundedBuffer(int max_size) {
  * @return The value taken from the front of the buffer.
  */
 ClientSocket BoundedBuffer::getItem() {
-	std::unique_lock<std::mutex> lock(*shared_mutex);
+	TimedLock lock(*shared_mutex);
 
 	while (buffer.size() == 0) {
-		data_available->wait(lock);
+		num_waiting_consumers++;
+		lock.wait(*data_available);
+		num_waiting_consumers--;
 	}
 
 	ClientSocket item = this->buffer.front(); // "this" refers to the calling object...
 	buffer.pop(); // ... but like Java it is optional (no this in front of buffer on this line)
+
+	space_available->notify_one();
 	return item;
 }
 
+/**
+ * Gets up to max_items items from the front of the buffer then removes them.
+ * Waits until at least one item is available, but never waits for more.
+ *
+ * @param max_items The most items to take at once.
+ * @return The values taken from the front of the buffer, in order.
+ */
+std::vector<ClientSocket> BoundedBuffer::getItems(std::size_t max_items) {
+	TimedLock lock(*shared_mutex);
+
+	while (buffer.size() == 0) {
+		num_waiting_consumers++;
+		lock.wait(*data_available);
+		num_waiting_consumers--;
+	}
+
+	std::vector<ClientSocket> items;
+	items.reserve(std::min(max_items, buffer.size()));
+	while (items.size() < max_items && buffer.size() > 0) {
+		items.push_back(buffer.front());
+		buffer.pop();
+	}
+
+	// the producer may be waiting to push a whole batch, so let it know
+	space_available->notify_one();
+	return items;
+}
+
 /**
  * Adds a new item to the back of the buffer.
  *
  * @param new_item The item to put in the buffer.
  */
 void BoundedBuffer::putItem(ClientSocket new_item) {
-	std::unique_lock<std::mutex> lock(*shared_mutex);
+	TimedLock lock(*shared_mutex);
 	
 	while (buffer.size() == capacity) {
-		space_available->wait(lock);
+		lock.wait(*space_available);
 	}
 	
 	buffer.push(new_item);
 
 	data_available->notify_one();
 }
+
+/**
+ * Adds all of the given items to the back of the buffer, in order. If there
+ * isn't room for all of them, pushes as many as fit and waits for space for
+ * the rest.
+ *
+ * Each round of pushing wakes only as many waiting consumers as it takes to
+ * empty it (items_per_consumer apiece), and only once the lock is released,
+ * so that they don't wake up just to block on the mutex or find nothing left.
+ *
+ * @param new_items The items to put in the buffer.
+ */
+void BoundedBuffer::putItems(const std::vector<ClientSocket>& new_items) {
+	std::size_t next = 0;
+	while (next < new_items.size()) {
+		std::size_t num_to_wake;
+		{
+			TimedLock lock(*shared_mutex);
+			while (buffer.size() == capacity) {
+				lock.wait(*space_available);
+			}
+
+			std::size_t num_pushed = 0;
+			while (next < new_items.size() && buffer.size() < capacity) {
+				buffer.push(new_items[next++]);
+				num_pushed++;
+			}
+
+			num_to_wake = std::min((num_pushed + items_per_consumer - 1) / items_per_consumer,
+					num_waiting_consumers);
+		}
+
+		for (std::size_t i = 0; i < num_to_wake; i++) {
+			data_available->notify_one();
+		}
+	}
+}
@@ -1,4 +1,5 @@
 #include <queue>
+#include <vector>
 #include <mutex>
 #include <condition_variable>
 #include "ClientSocket.hpp"
@@ -13,17 +14,24 @@
 class BoundedBuffer {
   // begin section containing publicly accessible parts of the class
   public:
-	  // public constructor
-	  BoundedBuffer(int max_size);
+	  // public constructor; items_per_consumer is how many items a consumer
+	  // usually takes at once (see getItems)
+	  BoundedBuffer(int max_size, std::size_t items_per_consumer = 1);
 	  
 	  // public member functions (a.k.a. methods)
 	  ClientSocket getItem();
 	  void putItem(ClientSocket new_item);
 
+	  // batched versions that take the lock once for many items
+	  std::vector<ClientSocket> getItems(std::size_t max_items);
+	  void putItems(const std::vector<ClientSocket>& new_items);
+
   // begin section containing private (i.e. hidden) parts of the class
   private:
 	  // private member variables (i.e. fields)
 	  std::size_t capacity;
+	  std::size_t items_per_consumer;
+	  std::size_t num_waiting_consumers = 0;
 	  std::queue<ClientSocket> buffer;
 	  std::mutex *shared_mutex;
 	  std::condition_variable *data_available;
@@ -12,6 +12,7 @@
 
 // C++ standard libraries
 #include <span>
+#include <atomic>
 #include <vector>
 #include <system_error>
 
@@ -20,7 +21,20 @@ using std::span;
 
 #include "ClientSocket.hpp"
 
-void ClientSocket::close() { ::close(this->socket_fd); }
+// connections made into a ClientSocket and not closed yet
+static std::atomic<long> num_open{0};
+
+ClientSocket::ClientSocket(int socket_fd, uint32_t peer_address) :
+		socket_fd(socket_fd), peer_address(peer_address) {
+	num_open.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ClientSocket::close() {
+	::close(this->socket_fd);
+	num_open.fetch_sub(1, std::memory_order_relaxed);
+}
+
+long ClientSocket::numOpen() { return num_open.load(std::memory_order_relaxed); }
 
 void ClientSocket::sendData(span<const char> data) {
 	size_t total_bytes_sent = 0; // start at the beginning of the data span
@@ -59,3 +73,13 @@ vector<char> ClientSocket::receiveData(size_t max_size) {
 
 	return data;
 }
+
+size_t ClientSocket::receiveData(span<char> buffer) {
+	ssize_t num_bytes_received = recv(this->socket_fd, buffer.data(), buffer.size(), 0);
+	if (num_bytes_received == -1) {
+		std::error_code ec(errno, std::generic_category());
+		throw std::system_error(ec, "recv failed");
+	}
+
+	return num_bytes_received;
+}
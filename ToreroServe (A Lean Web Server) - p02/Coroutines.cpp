@@ -0,0 +1,44 @@
+/**
+ * File: Coroutines.cpp
+ *
+ * Implementation of the FramePool class.
+ * See the associated header file (Coroutines.hpp) for the declaration of
+ * this class.
+ */
+
+#include <new>
+
+#include "Coroutines.hpp"
+
+thread_local FramePool::FreeFrame* FramePool::free_lists[FramePool::NUM_SIZE_CLASSES];
+
+void* FramePool::allocate(std::size_t size) {
+	std::size_t size_class = (size + SIZE_CLASS - 1) / SIZE_CLASS;
+
+	// unusually large frames aren't worth pooling
+	if (size_class >= NUM_SIZE_CLASSES) {
+		return ::operator new(size);
+	}
+
+	FreeFrame *frame = free_lists[size_class];
+	if (frame != nullptr) {
+		free_lists[size_class] = frame->next;
+		return frame;
+	}
+
+	// round up so the frame can be reused by any coroutine of this class
+	return ::operator new(size_class * SIZE_CLASS);
+}
+
+void FramePool::deallocate(void* frame, std::size_t size) {
+	std::size_t size_class = (size + SIZE_CLASS - 1) / SIZE_CLASS;
+
+	if (size_class >= NUM_SIZE_CLASSES) {
+		::operator delete(frame);
+		return;
+	}
+
+	FreeFrame *free_frame = static_cast<FreeFrame*>(frame);
+	free_frame->next = free_lists[size_class];
+	free_lists[size_class] = free_frame;
+}
@@ -0,0 +1,130 @@
+#ifndef COROUTINES_HPP
+#define COROUTINES_HPP
+
+/**
+ * File: Coroutines.hpp
+ *
+ * Coroutine types used by the coroutine engine: Task<T> for operations that
+ * are awaited (e.g. receiving from a socket) and DetachedTask for top-level
+ * coroutines that nobody waits for (e.g. handling one client).
+ *
+ * Coroutine frames are allocated from FramePool rather than the heap.
+ */
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+#include <vector>
+#include <cstddef>
+
+/**
+ * Per-thread pool of coroutine frames. Frames are grouped into size classes
+ * and freed frames are kept on a free list for the next coroutine of the same
+ * class, so once a thread has warmed up, starting a coroutine costs no heap
+ * allocation. A frame must be freed by the thread that allocated it, which
+ * always holds here since each scheduler runs its coroutines on one thread.
+ */
+class FramePool {
+	public:
+		static void* allocate(std::size_t size);
+		static void deallocate(void* frame, std::size_t size);
+
+	private:
+		static const std::size_t SIZE_CLASS = 256;
+		static const std::size_t NUM_SIZE_CLASSES = 64; // frames up to 16 KiB
+
+		struct FreeFrame {
+			FreeFrame *next;
+		};
+
+		static thread_local FreeFrame* free_lists[NUM_SIZE_CLASSES];
+};
+
+/**
+ * Base class for promise types, making the frames of their coroutines come
+ * from FramePool.
+ */
+struct PooledFrame {
+	static void* operator new(std::size_t size) {
+		return FramePool::allocate(size);
+	}
+
+	static void operator delete(void* frame, std::size_t size) {
+		FramePool::deallocate(frame, size);
+	}
+};
+
+/**
+ * A coroutine that produces a value of type T. It doesn't start running
+ * until it is awaited, and resumes whoever awaited it when it finishes.
+ */
+template<typename T>
+class Task {
+	public:
+		struct promise_type : PooledFrame {
+			T value{};
+			std::exception_ptr error;
+			std::coroutine_handle<> continuation;
+
+			Task get_return_object() {
+				return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+
+			std::suspend_always initial_suspend() noexcept { return {}; }
+
+			// hands control straight back to the awaiting coroutine
+			struct FinalAwaiter {
+				bool await_ready() noexcept { return false; }
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+					return h.promise().continuation;
+				}
+				void await_resume() noexcept {}
+			};
+			FinalAwaiter final_suspend() noexcept { return {}; }
+
+			void return_value(T new_value) { value = std::move(new_value); }
+			void unhandled_exception() { error = std::current_exception(); }
+		};
+
+		Task(Task&& other) : handle(std::exchange(other.handle, nullptr)) {}
+		Task(const Task&) = delete;
+		void operator=(const Task&) = delete;
+
+		~Task() {
+			if (handle) handle.destroy();
+		}
+
+		bool await_ready() { return false; }
+
+		std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) {
+			handle.promise().continuation = awaiting;
+			return handle;
+		}
+
+		T await_resume() {
+			if (handle.promise().error) {
+				std::rethrow_exception(handle.promise().error);
+			}
+			return std::move(handle.promise().value);
+		}
+
+	private:
+		explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+		std::coroutine_handle<promise_type> handle;
+};
+
+/**
+ * A coroutine that starts running right away and cleans up after itself when
+ * it finishes. Exceptions must be handled inside the coroutine.
+ */
+struct DetachedTask {
+	struct promise_type : PooledFrame {
+		DetachedTask get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+#endif
@@ -0,0 +1,158 @@
+/**
+ * File: CpuAffinity.cpp
+ *
+ * Implementation of the CpuAffinity class.
+ * See the associated header file (CpuAffinity.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <sched.h>
+
+// C standard library
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <set>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <filesystem>
+
+#include "CpuAffinity.hpp"
+
+namespace fs = std::filesystem;
+
+static std::vector<int> worker_cpus;
+static int acceptor_cpu = -1;
+static std::atomic<unsigned> next_worker{0};
+
+/**
+ * Keeps the calling thread to the given CPUs (complaining if the kernel
+ * won't, but carrying on unpinned).
+ */
+static void pinTo(const std::set<int>& cpus) {
+	cpu_set_t mask;
+	CPU_ZERO(&mask);
+	for (int cpu : cpus) {
+		CPU_SET(cpu, &mask);
+	}
+	if (sched_setaffinity(0, sizeof(mask), &mask) < 0) {
+		perror("Setting CPU affinity failed");
+	}
+}
+
+/**
+ * Parses a single CPU number, which has to be all of the text.
+ *
+ * @return false if it isn't one.
+ */
+static bool parseCpu(const std::string& text, int& cpu) {
+	if (text.empty() || text.size() > 5 || text.find_first_not_of("0123456789") != std::string::npos) {
+		return false;
+	}
+	cpu = std::stoi(text);
+	return cpu < CPU_SETSIZE;
+}
+
+std::vector<int> CpuAffinity::parseList(const std::string& list) {
+	std::vector<int> cpus;
+	size_t start = 0;
+	while (start <= list.size()) {
+		size_t comma = std::min(list.find(',', start), list.size());
+		std::string range = list.substr(start, comma - start);
+
+		// either a single CPU or a range of them
+		size_t dash = range.find('-');
+		int first, last;
+		if (!parseCpu(range.substr(0, dash), first)) return {};
+		if (dash == std::string::npos) {
+			last = first;
+		}
+		else if (!parseCpu(range.substr(dash + 1), last) || last < first) {
+			return {};
+		}
+
+		for (int cpu = first; cpu <= last; cpu++) {
+			cpus.push_back(cpu);
+		}
+		start = comma + 1;
+	}
+	return cpus;
+}
+
+void CpuAffinity::configure(const std::vector<int>& cpus, int acceptor) {
+	worker_cpus = cpus;
+	acceptor_cpu = acceptor;
+	if (worker_cpus.empty()) return;
+
+	std::set<int> all(worker_cpus.begin(), worker_cpus.end());
+	if (acceptor_cpu >= 0) all.insert(acceptor_cpu);
+
+	// only CPUs we were started with (e.g. not those taken away by taskset)
+	cpu_set_t allowed;
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+	for (int cpu : all) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			std::cerr << "ERROR: CPU " << cpu << " is not available\n";
+			exit(1);
+		}
+	}
+
+	std::set<int> nodes;
+	for (int cpu : worker_cpus) {
+		nodes.insert(nodeOf(cpu));
+	}
+	if (acceptor_cpu >= 0 && !nodes.contains(nodeOf(acceptor_cpu))) {
+		std::cout << "The acceptor's CPU is on another NUMA node than the workers'" << std::endl;
+	}
+	pinTo(all);
+
+	std::cout << "Workers take turns on " << worker_cpus.size() << " CPU"
+		<< (worker_cpus.size() > 1 ? "s" : "") << ", on NUMA node" << (nodes.size() > 1 ? "s" : "");
+	for (int node : nodes) {
+		std::cout << " " << node;
+	}
+	std::cout << std::endl;
+}
+
+int CpuAffinity::workerCpu(unsigned worker) {
+	return worker_cpus.empty() ? -1 : worker_cpus[worker % worker_cpus.size()];
+}
+
+void CpuAffinity::pinWorkerProcess(unsigned worker) {
+	if (worker_cpus.empty()) return;
+
+	// from here on, this process's workers (and acceptor) all take the same CPU
+	int cpu = workerCpu(worker);
+	worker_cpus = {cpu};
+	acceptor_cpu = -1;
+	pinTo({cpu});
+}
+
+void CpuAffinity::pinWorker() {
+	if (worker_cpus.empty()) return;
+	pinTo({worker_cpus[next_worker++ % worker_cpus.size()]});
+}
+
+void CpuAffinity::pinAcceptor() {
+	if (worker_cpus.empty() || acceptor_cpu < 0) return;
+	pinTo({acceptor_cpu});
+}
+
+int CpuAffinity::nodeOf(int cpu) {
+	// the CPU's sysfs directory has a nodeN entry for its node
+	std::error_code error;
+	fs::path cpu_dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+	for (const fs::directory_entry& entry : fs::directory_iterator(cpu_dir, error)) {
+		std::string name = entry.path().filename();
+		if (name.starts_with("node") && name.size() > 4
+				&& name.find_first_not_of("0123456789", 4) == std::string::npos) {
+			return std::stoi(name.substr(4));
+		}
+	}
+	return 0;
+}
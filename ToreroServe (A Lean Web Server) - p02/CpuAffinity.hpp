@@ -0,0 +1,78 @@
+#ifndef CPUAFFINITY_HPP
+#define CPUAFFINITY_HPP
+
+/**
+ * File: CpuAffinity.hpp
+ *
+ * Header file for the CpuAffinity class.
+ */
+
+#include <string>
+#include <vector>
+
+/**
+ * Where the server's threads run (--worker-cpus, --acceptor-cpu).
+ *
+ * Once configured, the whole server is kept to the worker CPUs (and the
+ * acceptor's): every thread started afterwards inherits that, the writer and
+ * reader threads included. Each worker then pins itself to one of the
+ * worker CPUs, taking them in turn, and the acceptor to its own. In prefork
+ * mode, a worker process and all of its threads go on one CPU.
+ *
+ * Memory follows: the kernel places a page on the node of the CPU that
+ * first touches it, so a worker pinned before it allocates gets its read
+ * buffer, its coroutine frames and (per process) its file cache entries on
+ * its own node, and a queue model whose acceptor and workers are on one node
+ * keeps the BoundedBuffer's cache lines there too.
+ *
+ * With nothing configured, nothing is pinned.
+ */
+class CpuAffinity {
+	public:
+		/**
+		 * @param list A CPU list like "0-3,8,10-11".
+		 * @return The CPUs, in the order given, or nothing if the list is
+		 * malformed.
+		 */
+		static std::vector<int> parseList(const std::string& list);
+
+		/**
+		 * Sets the CPUs and keeps the calling thread (so the rest of the
+		 * server) to them. Must be called before any other thread starts.
+		 *
+		 * @param worker_cpus The CPUs workers take in turn (none: no pinning).
+		 * @param acceptor_cpu The acceptor's CPU, or -1 for any worker CPU.
+		 */
+		static void configure(const std::vector<int>& worker_cpus, int acceptor_cpu);
+
+		/**
+		 * @param worker A prefork worker's number.
+		 * @return The CPU that worker process goes on, or -1 if not pinned.
+		 */
+		static int workerCpu(unsigned worker);
+
+		/**
+		 * Pins a prefork worker process (which must have a single thread so
+		 * far) to its CPU, along with every thread it starts.
+		 *
+		 * @param worker The worker's number.
+		 */
+		static void pinWorkerProcess(unsigned worker);
+
+		/**
+		 * Pins the calling worker thread to the next worker CPU.
+		 */
+		static void pinWorker();
+
+		/**
+		 * Pins the calling thread to the acceptor's CPU, if it has one.
+		 */
+		static void pinAcceptor();
+
+		/**
+		 * @param cpu A CPU.
+		 * @return The NUMA node it belongs to (0 if the system doesn't say).
+		 */
+		static int nodeOf(int cpu);
+};
+#endif
@@ -0,0 +1,215 @@
+/**
+ * File: DirectoryListing.cpp
+ *
+ * Implementation of the DirectoryListing class.
+ * See the associated header file (DirectoryListing.hpp) for the declaration
+ * of this class.
+ */
+
+// operating system specific libraries
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// C standard library
+#include <cstring>
+
+// C++ standard library
+#include <algorithm>
+#include <utility>
+
+#include "DirectoryListing.hpp"
+
+// entries emitted per piece when sending out a sorted page
+static const size_t SORTED_ENTRIES_PER_PIECE = 512;
+
+DirectoryListing::DirectoryListing(int dir_fd, std::string resource, Options options) :
+		dir_fd(dir_fd), resource(std::move(resource)), options(options) {
+	// keep the window of names we remember while sorting bounded
+	if (options.sorted) {
+		size_t max_limit = options.offset < MAX_SORTED_ENTRIES ?
+			MAX_SORTED_ENTRIES - options.offset : 0;
+		this->options.limit = std::min(options.limit, max_limit);
+	}
+}
+
+DirectoryListing::~DirectoryListing() {
+	close(dir_fd);
+}
+
+bool DirectoryListing::next(std::string& out) {
+	while (true) {
+		switch (state) {
+			case State::Header:
+				out += "<html>\n<body>\n";
+				out += "<h1>Contents of " + resource + ":</h1>\n";
+				out += "<ul id=\"fileList\">\n";
+				state = State::Entries;
+				return true;
+
+			case State::Entries:
+				if (options.sorted ? nextSorted(out) : nextUnsorted(out)) {
+					return true;
+				}
+				state = State::Footer;
+				break;
+
+			case State::Footer:
+				appendFooter(out);
+				state = State::Done;
+				return true;
+
+			case State::Done:
+				return false;
+		}
+	}
+}
+
+/**
+ * Reads the next buffer's worth of entries from the directory, skipping "."
+ * and "..".
+ *
+ * @param batch Vector that the entries are appended to.
+ * @return false once the end of the directory has been reached.
+ */
+bool DirectoryListing::readBatch(std::vector<Entry>& batch) {
+	ssize_t num_bytes = getdents64(dir_fd, dirent_buffer, sizeof(dirent_buffer));
+	if (num_bytes <= 0) {
+		return false;
+	}
+
+	for (ssize_t pos = 0; pos < num_bytes; ) {
+		struct dirent64 *d = reinterpret_cast<struct dirent64*>(dirent_buffer + pos);
+		pos += d->d_reclen;
+
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+			continue;
+		}
+		batch.push_back(Entry{d->d_name, entryIsDirectory(d->d_name, d->d_type)});
+	}
+	return true;
+}
+
+/**
+ * Tells whether an entry is a directory, following symbolic links. The type
+ * reported by getdents64 is used when possible so that most entries don't
+ * need a stat.
+ */
+bool DirectoryListing::entryIsDirectory(const char* name, unsigned char d_type) {
+	if (d_type == DT_DIR) return true;
+	if (d_type != DT_LNK && d_type != DT_UNKNOWN) return false;
+
+	struct stat info;
+	return fstatat(dir_fd, name, &info, 0) == 0 && S_ISDIR(info.st_mode);
+}
+
+/**
+ * Emits the entries of the next getdents64 batch, in directory order.
+ *
+ * @return false once all entries of the page have been emitted.
+ */
+bool DirectoryListing::nextUnsorted(std::string& out) {
+	std::vector<Entry> batch;
+
+	if (num_emitted == options.limit) {
+		// the page is full, but find out whether there is a next one
+		while (!has_more && readBatch(batch)) {
+			has_more = !batch.empty();
+		}
+		return false;
+	}
+
+	if (!readBatch(batch)) {
+		return false;
+	}
+
+	for (const Entry& entry : batch) {
+		if (num_seen++ < options.offset) continue;
+
+		if (num_emitted == options.limit) {
+			has_more = true;
+			break;
+		}
+		appendEntry(out, entry);
+		num_emitted++;
+	}
+	return true;
+}
+
+/**
+ * On the first call, reads the whole directory while keeping only the
+ * entries that can end up on the requested page. Then emits that page in
+ * sorted order, a slice at a time.
+ *
+ * @return false once all entries of the page have been emitted.
+ */
+bool DirectoryListing::nextSorted(std::string& out) {
+	auto before = [this](const Entry& a, const Entry& b) {
+		return options.descending ? a.name > b.name : a.name < b.name;
+	};
+
+	if (!sorted_loaded) {
+		sorted_loaded = true;
+		// nothing past MAX_SORTED_ENTRIES can be sorted, so don't even look
+		size_t window = options.limit == 0 ? 0 : options.offset + options.limit;
+
+		// heap whose top is the entry that would be dropped first
+		std::vector<Entry> batch;
+		while (window > 0 && readBatch(batch)) {
+			for (Entry& entry : batch) {
+				num_seen++;
+				if (sorted_entries.size() < window) {
+					sorted_entries.push_back(std::move(entry));
+					std::push_heap(sorted_entries.begin(), sorted_entries.end(), before);
+				}
+				else if (before(entry, sorted_entries.front())) {
+					std::pop_heap(sorted_entries.begin(), sorted_entries.end(), before);
+					sorted_entries.back() = std::move(entry);
+					std::push_heap(sorted_entries.begin(), sorted_entries.end(), before);
+				}
+			}
+			batch.clear();
+		}
+
+		std::sort_heap(sorted_entries.begin(), sorted_entries.end(), before);
+		has_more = window > 0 && num_seen > window;
+		sorted_next = std::min(options.offset, sorted_entries.size());
+	}
+
+	if (sorted_next == sorted_entries.size()) {
+		return false;
+	}
+
+	size_t end = std::min(sorted_next + SORTED_ENTRIES_PER_PIECE, sorted_entries.size());
+	for (; sorted_next < end; sorted_next++) {
+		appendEntry(out, sorted_entries[sorted_next]);
+		num_emitted++;
+	}
+	return true;
+}
+
+void DirectoryListing::appendEntry(std::string& out, const Entry& entry) {
+	if (entry.is_directory) {
+		out += "<li><a href=\"" + entry.name + "/\">" + entry.name + "/</a></li>\n";
+	} else {
+		out += "<li><a href=\"" + entry.name + "\">" + entry.name + "</a></li>\n";
+	}
+}
+
+void DirectoryListing::appendFooter(std::string& out) {
+	out += "</ul>\n";
+
+	// link to the following page, keeping the same sorting
+	if (has_more) {
+		out += "<a href=\"?offset=" + std::to_string(options.offset + num_emitted)
+			+ "&limit=" + std::to_string(options.limit);
+		if (options.sorted) {
+			out += options.descending ? "&sort=name&order=desc" : "&sort=name";
+		}
+		out += "\">Next page</a>\n";
+	}
+
+	out += "</body>\n";
+	out += "</html>\n";
+}
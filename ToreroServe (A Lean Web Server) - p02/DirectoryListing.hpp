@@ -0,0 +1,86 @@
+#ifndef DIRECTORYLISTING_HPP
+#define DIRECTORYLISTING_HPP
+
+/**
+ * File: DirectoryListing.hpp
+ *
+ * Header file for the DirectoryListing class.
+ */
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#include "BodySource.hpp"
+
+/**
+ * Body source that generates the HTML listing of a directory while it is
+ * being sent. Entries are read straight from the kernel with getdents64, one
+ * buffer's worth at a time, so the memory used stays the same no matter how
+ * many entries the directory has.
+ *
+ * A listing can optionally be limited to a page of entries (offset/limit)
+ * and sorted by name. Sorting has to see every entry before it can emit the
+ * first one, so it only keeps the offset + limit smallest names around, which
+ * is capped at MAX_SORTED_ENTRIES.
+ */
+class DirectoryListing : public BodySource {
+	public:
+		static const size_t MAX_SORTED_ENTRIES = 10000;
+
+		struct Options {
+			bool sorted = false;
+			bool descending = false;
+			size_t offset = 0;
+			size_t limit = SIZE_MAX;
+		};
+
+		/**
+		 * Creates a listing of the given open directory. The listing takes
+		 * ownership of dir_fd and closes it when destroyed.
+		 *
+		 * @param dir_fd File descriptor of the directory, opened with O_DIRECTORY.
+		 * @param resource The path the client requested (used in the title).
+		 * @param options Sorting and pagination settings.
+		 */
+		DirectoryListing(int dir_fd, std::string resource, Options options);
+		~DirectoryListing();
+
+		DirectoryListing(const DirectoryListing&) = delete;
+		void operator=(const DirectoryListing&) = delete;
+
+		bool next(std::string& out) override;
+
+	private:
+		struct Entry {
+			std::string name;
+			bool is_directory;
+		};
+
+		enum class State { Header, Entries, Footer, Done };
+
+		int dir_fd;
+		std::string resource;
+		Options options;
+		State state = State::Header;
+
+		size_t num_seen = 0;    // entries read so far (including skipped ones)
+		size_t num_emitted = 0; // entries written to the listing so far
+		bool has_more = false;  // whether there are entries past this page
+
+		// the page being sent when sorting (only filled in on the first call)
+		std::vector<Entry> sorted_entries;
+		size_t sorted_next = 0;
+		bool sorted_loaded = false;
+
+		// getdents64 reads into here; aligned for struct dirent64
+		alignas(8) char dirent_buffer[32768];
+
+		bool readBatch(std::vector<Entry>& batch);
+		bool nextUnsorted(std::string& out);
+		bool nextSorted(std::string& out);
+		bool entryIsDirectory(const char* name, unsigned char d_type);
+		void appendEntry(std::string& out, const Entry& entry);
+		void appendFooter(std::string& out);
+};
+#endif
@@ -0,0 +1,25 @@
+/**
+ * File: EmbeddedAssets.cpp
+ *
+ * Implementation of the EmbeddedAssets class (except for all(), which is in
+ * the generated EmbeddedAssets.gen.cpp).
+ * See the associated header file (EmbeddedAssets.hpp) for the declaration of
+ * this class.
+ */
+
+// C++ standard library
+#include <algorithm>
+
+#include "EmbeddedAssets.hpp"
+
+const EmbeddedAsset* EmbeddedAssets::find(std::string_view resource) {
+	std::span<const EmbeddedAsset> assets = all();
+	auto found = std::lower_bound(assets.begin(), assets.end(), resource,
+			[](const EmbeddedAsset& asset, std::string_view resource) {
+				return asset.resource < resource;
+			});
+	if (found == assets.end() || found->resource != resource) {
+		return nullptr;
+	}
+	return &*found;
+}
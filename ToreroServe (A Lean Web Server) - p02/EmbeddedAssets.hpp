@@ -0,0 +1,56 @@
+#ifndef EMBEDDEDASSETS_HPP
+#define EMBEDDEDASSETS_HPP
+
+/**
+ * File: EmbeddedAssets.hpp
+ *
+ * Header file for the EmbeddedAssets class.
+ */
+
+#include <span>
+#include <string_view>
+
+/**
+ * A file compiled into the binary: its response, header and all, as built
+ * by the embed-assets tool.
+ */
+struct EmbeddedAsset {
+	std::string_view resource; // e.g. "/index.html"
+	std::string_view header;   // "200 OK" header, validators included
+	std::string_view body;     // the file's contents
+};
+
+/**
+ * The served tree, compiled into the server (the torero-serve-embedded
+ * target, "make embedded"), for machines that should run a single
+ * self-contained binary.
+ *
+ * The embed-assets tool turns WWW into a generated source file
+ * (EmbeddedAssets.gen.cpp) with a constexpr array per file, holding the
+ * file's header and contents back to back, and an index of all of them,
+ * sorted by resource (which a static_assert checks at compile time). So
+ * there is nothing to set up at startup, and answering a request takes a
+ * binary search: no system call, no copy of the body. The arrays end up in
+ * the binary's read-only data, whose pages every process running the binary
+ * shares through the page cache.
+ *
+ * As in the index (see FileIndex), a directory's index.html is also the
+ * directory's own response, with and without the trailing slash. Resources
+ * that aren't embedded (e.g. directories without an index.html) are still
+ * served from the disk, if the root directory is there.
+ */
+class EmbeddedAssets {
+	public:
+		/**
+		 * @param resource The requested resource (e.g. "/misc/").
+		 * @return The asset, or nullptr if the resource isn't embedded.
+		 */
+		static const EmbeddedAsset* find(std::string_view resource);
+
+		/**
+		 * @return Every asset, sorted by resource (defined in the generated
+		 * source).
+		 */
+		static std::span<const EmbeddedAsset> all();
+};
+#endif
@@ -0,0 +1,161 @@
+/**
+ * File: ErrorResponses.cpp
+ *
+ * Implementation of the ErrorResponses class.
+ * See the associated header file (ErrorResponses.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <sys/mman.h>
+
+// C standard library
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// C++ standard library
+#include <mutex>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <filesystem>
+
+#include "ErrorResponses.hpp"
+
+using std::string;
+using std::string_view;
+
+namespace fs = std::filesystem;
+
+struct Status {
+	int code;
+	const char *reason;
+	const char *extra_headers;
+};
+
+static const Status STATUSES[] = {
+	{400, "BAD REQUEST", ""},
+	{403, "FORBIDDEN", ""},
+	{404, "NOT FOUND", ""},
+	{405, "METHOD NOT ALLOWED", "Allow: GET\r\n"},
+	{408, "REQUEST TIMEOUT", ""},
+	{429, "TOO MANY REQUESTS", "Retry-After: 1\r\n"},
+	{431, "REQUEST HEADER FIELDS TOO LARGE", ""},
+	{503, "SERVICE UNAVAILABLE", "Retry-After: 1\r\n"},
+};
+
+static const char NOT_FOUND_PAGE[] =
+	"<html>\n"
+	"<head>\n"
+	"<title>Ruh-roh! Page not found!</title>\n"
+	"</head>\n"
+	"<body>\n"
+	"404 Page Not Found! :'( :'( :'(\n"
+	"</body>\n"
+	"</html>\n";
+
+static const int FIRST_STATUS = 400;
+static const int LAST_STATUS = 503;
+
+struct Entry {
+	string_view header;
+	string_view body;
+};
+
+// by status, from FIRST_STATUS; empty for codes we don't have
+static Entry entries[LAST_STATUS - FIRST_STATUS + 1];
+
+// the read-only block they all live in
+static char *block = nullptr;
+static size_t block_size = 0;
+
+static std::once_flag built_in;
+
+/**
+ * @return The body of a template, or the built-in one if the directory has
+ * no template for the status.
+ */
+static string readBody(const string& template_dir, int code) {
+	string body = code == 404 ? NOT_FOUND_PAGE : "";
+	if (template_dir.empty()) return body;
+
+	fs::path path = fs::path(template_dir) / (std::to_string(code) + ".html");
+	if (!fs::exists(path)) return body;
+
+	std::ifstream file(path, std::ios::binary);
+	body.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	if (!file.good() && !file.eof()) {
+		std::cerr << "ERROR: reading " << path.string() << " failed\n";
+		exit(1);
+	}
+	return body;
+}
+
+void ErrorResponses::load(const string& template_dir) {
+	if (!template_dir.empty() && !fs::is_directory(template_dir)) {
+		std::cerr << "ERROR: " << template_dir << " is not a directory\n";
+		exit(1);
+	}
+
+	// serialize them all first, to know how big the block has to be
+	string serialized;
+	std::vector<size_t> header_sizes;
+	std::vector<size_t> body_sizes;
+	for (const Status& status : STATUSES) {
+		string body = readBody(template_dir, status.code);
+		string header = "HTTP/1.0 " + std::to_string(status.code) + " " + status.reason + "\r\n"
+			+ status.extra_headers
+			+ (body.empty() ? "" : "Content-Type: text/html\r\n")
+			+ "Content-Length: " + std::to_string(body.size()) + "\r\n"
+			+ "\r\n";
+		header_sizes.push_back(header.size());
+		body_sizes.push_back(body.size());
+		serialized += header;
+		serialized += body;
+	}
+
+	// an earlier load's block can go (nothing has been sent from it yet)
+	if (block != nullptr) {
+		munmap(block, block_size);
+	}
+	block_size = serialized.size();
+	void *memory = mmap(nullptr, block_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) {
+		perror("Mapping the error responses failed");
+		exit(1);
+	}
+	block = static_cast<char*>(memory);
+	memcpy(block, serialized.data(), block_size);
+	if (mprotect(block, block_size, PROT_READ) < 0) {
+		perror("Protecting the error responses failed");
+		exit(1);
+	}
+
+	size_t offset = 0;
+	for (size_t i = 0; i < std::size(STATUSES); i++) {
+		Entry& entry = entries[STATUSES[i].code - FIRST_STATUS];
+		entry.header = string_view(block + offset, header_sizes[i]);
+		offset += header_sizes[i];
+		entry.body = string_view(block + offset, body_sizes[i]);
+		offset += body_sizes[i];
+	}
+}
+
+HttpResponse ErrorResponses::respond(int status) {
+	std::call_once(built_in, []() {
+		if (block == nullptr) load("");
+	});
+
+	if (status < FIRST_STATUS || status > LAST_STATUS || entries[status - FIRST_STATUS].header.empty()) {
+		status = 400;
+	}
+	const Entry& entry = entries[status - FIRST_STATUS];
+
+	HttpResponse response;
+	response.static_header = entry.header;
+	response.static_body = entry.body;
+	return response;
+}
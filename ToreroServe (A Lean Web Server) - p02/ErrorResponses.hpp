@@ -0,0 +1,47 @@
+#ifndef ERRORRESPONSES_HPP
+#define ERRORRESPONSES_HPP
+
+/**
+ * File: ErrorResponses.hpp
+ *
+ * Header file for the ErrorResponses class.
+ */
+
+#include <string>
+#include <string_view>
+
+#include "HttpResponse.hpp"
+
+/**
+ * The server's error responses (400, 403, 404, 405, 408, 429, 431 and 503),
+ * each serialized once at startup, header and body back to back, into a
+ * single block of memory that is then made read-only (and, in prefork mode,
+ * shared by all the worker processes).
+ *
+ * Answering with one is then a lookup: the response's header and body both
+ * point into the block, so nothing is built, allocated or copied for it, and
+ * the writer sends both in a single call as usual.
+ *
+ * The bodies are built in (an HTML page for 404, nothing for the others),
+ * unless a template directory has one: DIR/404.html replaces the 404 page,
+ * and DIR/403.html, say, gives the 403 one.
+ */
+class ErrorResponses {
+	public:
+		/**
+		 * Builds the responses. Must be called before any is sent (otherwise
+		 * the built-in ones are built on first use).
+		 *
+		 * @param template_dir Where to look for STATUS.html bodies, or empty
+		 * for the built-in ones only.
+		 */
+		static void load(const std::string& template_dir);
+
+		/**
+		 * @param status An HTTP status code.
+		 * @return The response for that status (for one not in the table,
+		 * the 400 one).
+		 */
+		static HttpResponse respond(int status);
+};
+#endif
@@ -0,0 +1,484 @@
+/**
+ * File: FileCache.cpp
+ *
+ * Implementation of the FileCache class.
+ * See the associated header file (FileCache.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <sched.h>
+#include <unistd.h>
+#include <sys/sysinfo.h>
+
+// C++ standard library
+#include <bit>
+#include <limits>
+#include <algorithm>
+
+#include "FileCache.hpp"
+#include "CpuAffinity.hpp"
+
+using std::string;
+using std::shared_ptr;
+
+// the sketch gets a counter per this many bytes of capacity (files are
+// usually smaller, but most requested paths aren't cached at any one time)
+static const size_t BYTES_PER_COUNTER = 4096;
+
+// with the shard count left to us, every shard can hold a few of the
+// largest files, and there are no more shards than there'd be cores
+static const size_t MIN_SHARD_CAPACITY = 4 * 1024 * 1024;
+static const size_t MAX_SHARDS = 64;
+
+// threads take the hit counters in turn
+static std::atomic<size_t> next_hit_counter{0};
+
+/*
+ * Epoch-based reclamation of replaced tables. A reader announces in a slot
+ * of its own the epoch it started reading in (0 while it isn't reading), and
+ * a writer replacing a table moves on to the next epoch. A table replaced in
+ * epoch E can go once no slot shows E or earlier: anyone who started later
+ * can only have found its replacement.
+ */
+struct alignas(64) ReaderSlot {
+	std::atomic<uint64_t> epoch{0};
+};
+
+static std::atomic<uint64_t> global_epoch{1};
+static std::mutex slots_mutex;
+static std::vector<ReaderSlot*> slots;
+
+/**
+ * A thread's slot, registered for as long as the thread lives.
+ */
+struct SlotRegistration {
+	ReaderSlot *slot = new ReaderSlot;
+
+	SlotRegistration() {
+		std::lock_guard<std::mutex> lock(slots_mutex);
+		slots.push_back(slot);
+	}
+
+	~SlotRegistration() {
+		std::lock_guard<std::mutex> lock(slots_mutex);
+		slots.erase(std::find(slots.begin(), slots.end(), slot));
+		delete slot;
+	}
+};
+
+/**
+ * Marks the calling thread as reading tables while it is in scope.
+ */
+class ReadGuard {
+	public:
+		ReadGuard() : slot(readerSlot()) {
+			slot.epoch.store(global_epoch.load());
+		}
+
+		~ReadGuard() {
+			slot.epoch.store(0, std::memory_order_release);
+		}
+
+	private:
+		ReaderSlot& slot;
+
+		static ReaderSlot& readerSlot() {
+			thread_local SlotRegistration registration;
+			return *registration.slot;
+		}
+};
+
+/**
+ * @return The epoch of the longest running reader (or the largest epoch
+ * there is if nobody is reading).
+ */
+static uint64_t oldestReader() {
+	std::lock_guard<std::mutex> lock(slots_mutex);
+	uint64_t oldest = std::numeric_limits<uint64_t>::max();
+	for (ReaderSlot *slot : slots) {
+		uint64_t epoch = slot->epoch.load();
+		if (epoch != 0) oldest = std::min(oldest, epoch);
+	}
+	return oldest;
+}
+
+static bool isSameFile(dev_t device, ino_t inode, off_t size, const struct timespec& modified,
+		const struct stat& info) {
+	return info.st_dev == device && info.st_ino == inode && info.st_size == size
+		&& info.st_mtim.tv_sec == modified.tv_sec && info.st_mtim.tv_nsec == modified.tv_nsec;
+}
+
+FileCache::Entry::~Entry() {
+	for (size_t node = 0; replicas != nullptr && node < num_nodes; node++) {
+		delete replicas[node].load();
+	}
+}
+
+FileCache::Shard::Shard(size_t capacity, size_t sketch_width) :
+	table(new Table),
+	capacity(capacity),
+	sketch(sketch_width, NUM_TOP_PATHS) {}
+
+FileCache::AccessBuffer::~AccessBuffer() {
+	if (cache != nullptr && count > 0) {
+		cache->drain(*this);
+	}
+}
+
+FileCache::FileCache(size_t capacity, bool replicate, size_t num_shards) : capacity(capacity) {
+	if (num_shards == 0) {
+		num_shards = std::clamp<size_t>(capacity / MIN_SHARD_CAPACITY, 1, MAX_SHARDS);
+	}
+	num_shards = std::bit_floor(num_shards);
+	shard_mask = num_shards - 1;
+
+	size_t shard_capacity = capacity / num_shards;
+	size_t sketch_width = std::clamp<size_t>(shard_capacity / BYTES_PER_COUNTER, 1024, 1 << 20);
+	for (size_t i = 0; i < num_shards; i++) {
+		shards.push_back(std::make_unique<Shard>(shard_capacity, sketch_width));
+	}
+
+	if (replicate) {
+		for (int cpu = 0; cpu < get_nprocs_conf(); cpu++) {
+			cpu_nodes.push_back(CpuAffinity::nodeOf(cpu));
+			num_nodes = std::max<size_t>(num_nodes, cpu_nodes.back() + 1);
+		}
+		// nothing to replicate on a single node
+		if (num_nodes == 1) cpu_nodes.clear();
+	}
+}
+
+FileCache::~FileCache() {
+	for (auto& shard : shards) {
+		delete shard->table.load();
+		for (auto& [epoch, table] : shard->retired) {
+			delete table;
+		}
+	}
+}
+
+shared_ptr<const string> FileCache::get(const string& path, int file_fd, const struct stat& info) {
+	size_t index = shardOf(path);
+	Shard& shard = *shards[index];
+
+	// a hit takes no lock (see the header)
+	shared_ptr<const string> contents;
+	{
+		ReadGuard guard;
+		const Table& table = *shard.table.load();
+		auto found = table.find(path);
+		if (found != table.end()) {
+			const Entry& entry = *found->second;
+			if (isSameFile(entry.device, entry.inode, entry.size, entry.modified, info)) {
+				if (!entry.referenced.load(std::memory_order_relaxed)) {
+					entry.referenced.store(true, std::memory_order_relaxed);
+				}
+				contents = localContents(entry);
+			}
+		}
+	}
+	if (contents != nullptr) {
+		thread_local size_t counter = next_hit_counter++ % NUM_HIT_COUNTERS;
+		hit_counters[counter].count.fetch_add(1, std::memory_order_relaxed);
+		recordLater(index, path);
+		return contents;
+	}
+
+	std::unique_lock<std::mutex> lock(shard.mutex);
+	shard.sketch.record(path);
+	shard.num_misses++;
+
+	const Table *table = shard.table.load();
+	auto found = table->find(path);
+	if (found != table->end()) {
+		const Entry& entry = *found->second;
+		if (isSameFile(entry.device, entry.inode, entry.size, entry.modified, info)) {
+			return entry.contents; // another thread just cached it
+		}
+		Table *changed = new Table(*table);
+		remove(shard, *changed, path);
+		publish(shard, changed);
+	}
+
+	size_t size = info.st_size;
+	if (size == 0 || info.st_size > MAX_FILE_SIZE || size > shard.capacity) {
+		return nullptr;
+	}
+	if (!shouldAdmit(shard, path, size)) {
+		shard.num_rejected++;
+		return nullptr;
+	}
+
+	// read without holding up the rest of the shard
+	lock.unlock();
+	auto read = std::make_shared<string>(size, '\0');
+	size_t num_read = 0;
+	while (num_read < size) {
+		ssize_t n = pread(file_fd, read->data() + num_read, size - num_read, num_read);
+		if (n <= 0) return nullptr; // the file shrank (or worse)
+		num_read += n;
+	}
+	lock.lock();
+
+	// another thread may have cached it meanwhile
+	table = shard.table.load();
+	if (table->count(path) == 0) {
+		auto entry = std::make_shared<Entry>();
+		entry->path = path;
+		entry->device = info.st_dev;
+		entry->inode = info.st_ino;
+		entry->size = info.st_size;
+		entry->modified = info.st_mtim;
+		entry->contents = read;
+		entry->node = 0;
+		if (!cpu_nodes.empty()) {
+			// we just touched the pages, so that's where they are
+			entry->node = currentNode();
+			entry->num_nodes = num_nodes;
+			entry->replicas = std::make_unique<std::atomic<shared_ptr<const string>*>[]>(num_nodes);
+		}
+
+		Table *changed = new Table(*table);
+		insert(shard, *changed, std::move(entry));
+		publish(shard, changed);
+	}
+	return read;
+}
+
+void FileCache::recordAccess(const string& path) {
+	recordLater(shardOf(path), path);
+}
+
+size_t FileCache::shardOf(const string& path) const {
+	// the sketches use the low bits of the same hash, so shards take (mixed)
+	// high ones
+	uint64_t hash = std::hash<string>()(path);
+	return ((hash * 0x9e3779b97f4a7c15) >> 40) & shard_mask;
+}
+
+void FileCache::recordLater(size_t shard, const string& path) {
+	// there's a single cache in the server; a thread moving on to another one
+	// (as the benchmark's do) just drops what it had
+	thread_local AccessBuffer buffer;
+	if (buffer.cache != this) {
+		buffer.cache = this;
+		buffer.count = 0;
+	}
+
+	AccessBuffer::Access& access = buffer.accesses[buffer.count++];
+	access.shard = shard;
+	access.path.assign(path);
+	if (buffer.count == AccessBuffer::SIZE) {
+		drain(buffer);
+	}
+}
+
+/**
+ * Records a thread's buffered requests in their shards, taking each shard's
+ * lock once, and only if it's free: the sketch is an estimate anyway, and a
+ * hit shouldn't wait for a miss.
+ */
+void FileCache::drain(AccessBuffer& buffer) {
+	auto *accesses = buffer.accesses;
+	std::sort(accesses, accesses + buffer.count, [](const auto& a, const auto& b) {
+		return a.shard < b.shard;
+	});
+
+	size_t start = 0;
+	while (start < buffer.count) {
+		Shard& shard = *shards[accesses[start].shard];
+		size_t end = start;
+		while (end < buffer.count && accesses[end].shard == accesses[start].shard) {
+			end++;
+		}
+
+		std::unique_lock<std::mutex> lock(shard.mutex, std::try_to_lock);
+		if (lock.owns_lock()) {
+			const Table& table = *shard.table.load();
+			for (size_t i = start; i < end; i++) {
+				shard.sketch.record(accesses[i].path);
+
+				// hot entries are the ones worth copying to other nodes
+				if (!cpu_nodes.empty() && shard.sketch.estimate(accesses[i].path) >= HOT_ESTIMATE) {
+					auto found = table.find(accesses[i].path);
+					if (found != table.end()) {
+						found->second->hot.store(true, std::memory_order_relaxed);
+					}
+				}
+			}
+		}
+		start = end;
+	}
+	buffer.count = 0;
+}
+
+int FileCache::currentNode() const {
+	int cpu = sched_getcpu();
+	return cpu >= 0 && (size_t) cpu < cpu_nodes.size() ? cpu_nodes[cpu] : 0;
+}
+
+/**
+ * @return The entry's contents, from the calling thread's NUMA node if it is
+ * hot and replicas are on (copying them there first if nobody has yet).
+ */
+shared_ptr<const string> FileCache::localContents(const Entry& entry) {
+	if (entry.replicas == nullptr || !entry.hot.load(std::memory_order_relaxed)) {
+		return entry.contents;
+	}
+	int node = currentNode();
+	if (node == entry.node) {
+		return entry.contents;
+	}
+
+	auto& slot = entry.replicas[node];
+	shared_ptr<const string> *replica = slot.load(std::memory_order_acquire);
+	if (replica == nullptr) {
+		auto *copy = new shared_ptr<const string>(std::make_shared<const string>(*entry.contents));
+		if (slot.compare_exchange_strong(replica, copy)) {
+			replica = copy;
+			num_replicas++;
+		}
+		else {
+			delete copy; // someone else on this node was quicker
+		}
+	}
+	return *replica;
+}
+
+/**
+ * Decides whether a file may have a place in its shard: always while there
+ * is room, otherwise only if it is more popular than each of the files the
+ * clock hand would take to make room for it. Ties go to the files already
+ * cached.
+ */
+bool FileCache::shouldAdmit(Shard& shard, const string& path, size_t size) const {
+	if (shard.used + size <= shard.capacity) {
+		return true;
+	}
+
+	unsigned frequency = shard.sketch.estimate(path);
+	size_t freed = 0;
+	size_t n = shard.clock.size();
+	for (size_t i = 0; i < 2 * n && shard.used - freed + size > shard.capacity; i++) {
+		const Entry& victim = *shard.clock[(shard.hand + i) % n];
+
+		// the first time round, the hand spares referenced entries; the second
+		// time round, it takes them too
+		bool spared = victim.referenced.load(std::memory_order_relaxed);
+		if (spared == (i < n)) continue;
+
+		if (shard.sketch.estimate(victim.path) >= frequency) {
+			return false;
+		}
+		freed += victim.size;
+	}
+	return true;
+}
+
+/**
+ * Makes a changed copy of a shard's table the one readers see, and frees
+ * the tables replaced earlier that nobody can be reading any more.
+ */
+void FileCache::publish(Shard& shard, Table *table) {
+	const Table *old = shard.table.exchange(table);
+	shard.retired.emplace_back(global_epoch.fetch_add(1), old);
+
+	uint64_t oldest = oldestReader();
+	std::erase_if(shard.retired, [oldest](const auto& retired) {
+		if (retired.first >= oldest) return false;
+		delete retired.second;
+		return true;
+	});
+}
+
+/**
+ * Adds an entry, evicting until it fits: the clock hand goes round, sparing
+ * (once) the entries that were hit since it last passed them.
+ */
+void FileCache::insert(Shard& shard, Table& table, std::shared_ptr<const Entry> entry) {
+	while (!shard.clock.empty() && shard.used + entry->size > shard.capacity) {
+		if (shard.hand >= shard.clock.size()) shard.hand = 0;
+		const Entry& candidate = *shard.clock[shard.hand];
+		if (candidate.referenced.exchange(false)) {
+			shard.hand++;
+			continue;
+		}
+		remove(shard, table, string(candidate.path));
+		shard.num_evicted++;
+	}
+
+	// just behind the hand, so it has a full round to be hit
+	if (shard.hand > shard.clock.size()) shard.hand = 0;
+	shard.used += entry->size;
+	table[entry->path] = entry;
+	shard.clock.insert(shard.clock.begin() + shard.hand, std::move(entry));
+	shard.hand++;
+}
+
+void FileCache::remove(Shard& shard, Table& table, const string& path) {
+	auto found = table.find(path);
+	shard.used -= found->second->size;
+
+	auto position = std::find(shard.clock.begin(), shard.clock.end(), found->second);
+	if ((size_t) (position - shard.clock.begin()) < shard.hand) {
+		shard.hand--;
+	}
+	shard.clock.erase(position);
+	table.erase(found);
+}
+
+FileCache::Statistics FileCache::statistics() const {
+	Statistics statistics = {0, 0, capacity, 0, 0, 0, 0, shards.size(), num_replicas.load()};
+	for (const HitCounter& counter : hit_counters) {
+		statistics.num_hits += counter.count.load(std::memory_order_relaxed);
+	}
+	for (auto& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		statistics.num_files += shard->clock.size();
+		statistics.used += shard->used;
+		statistics.num_misses += shard->num_misses;
+		statistics.num_rejected += shard->num_rejected;
+		statistics.num_evicted += shard->num_evicted;
+	}
+	return statistics;
+}
+
+void FileCache::printReport(std::ostream& out) const {
+	Statistics totals = statistics();
+
+	// each shard knows its own most requested paths
+	struct TopPath {
+		unsigned estimate;
+		string path;
+		bool cached;
+	};
+	std::vector<TopPath> top_paths;
+	for (auto& shard : shards) {
+		std::lock_guard<std::mutex> lock(shard->mutex);
+		const Table& table = *shard->table.load();
+		for (auto& [path, estimate] : shard->sketch.topKeys()) {
+			top_paths.push_back({estimate, path, table.count(path) > 0});
+		}
+	}
+	std::stable_sort(top_paths.begin(), top_paths.end(), [](const TopPath& a, const TopPath& b) {
+		return a.estimate > b.estimate;
+	});
+	if (top_paths.size() > NUM_TOP_PATHS) {
+		top_paths.resize(NUM_TOP_PATHS);
+	}
+
+	out << "File cache (pid " << getpid() << ", " << totals.num_shards << " shards): "
+		<< totals.num_files << " files, " << totals.used << " of " << totals.capacity << " bytes; "
+		<< totals.num_hits << " hits, " << totals.num_misses << " misses, "
+		<< totals.num_rejected << " not admitted, " << totals.num_evicted << " evicted";
+	if (!cpu_nodes.empty()) {
+		out << ", " << totals.num_replicas << " NUMA replicas";
+	}
+	out << "\n";
+	out << "Most requested lately (estimated requests, path):\n";
+	for (const TopPath& top : top_paths) {
+		out << "  " << top.estimate << "\t" << top.path << (top.cached ? "" : " (not cached)") << "\n";
+	}
+	out.flush();
+}
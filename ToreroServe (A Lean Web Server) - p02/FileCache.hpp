@@ -0,0 +1,211 @@
+#ifndef FILECACHE_HPP
+#define FILECACHE_HPP
+
+/**
+ * File: FileCache.hpp
+ *
+ * Header file for the FileCache class.
+ */
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstddef>
+#include <unordered_map>
+#include <sys/stat.h>
+
+#include "FrequencySketch.hpp"
+
+/**
+ * In-memory cache of file contents, filled while serving (unlike the hot
+ * files of the FileIndex, which are picked once at startup).
+ *
+ * Eviction is CLOCK (an approximation of LRU), but admission is TinyLFU:
+ * every lookup is recorded in a FrequencySketch, and once the cache is full
+ * a file only gets in if it has been requested more often lately than every
+ * file it would push out. A crawler going once over lots of rarely
+ * requested files thus leaves the cached ones alone, where plain LRU would
+ * flush them all.
+ *
+ * Cached contents are checked against a fresh fstat of the file on every
+ * hit, so a changed file is read again rather than served stale.
+ *
+ * The cache is built for many workers hitting it at once:
+ *  - it is split into shards by path hash, each with its own capacity,
+ *    sketch, lock and counters, so misses on different shards don't meet;
+ *  - a hit takes no lock at all: each shard's entries are an immutable
+ *    table that changes are made to a copy of, which then replaces it
+ *    (read-copy-update), and a replaced table is only freed once no reader
+ *    can be looking at it any more (readers announce the epoch they read
+ *    in, in a slot of their own);
+ *  - a hit writes nothing shared but the contents' reference count: its
+ *    CLOCK bit is set only if it isn't already, it is counted in one of
+ *    several counters (threads take turns picking one, each on a cache line
+ *    of its own), and its sketch record goes to a buffer of the calling
+ *    thread's, which is drained into the shards a batch at a time, skipping
+ *    a shard whose lock is taken rather than waiting for it;
+ *  - optionally, hot entries get a copy on every NUMA node they're read
+ *    from (made by the first reader there, so on its node), and readers
+ *    take their own node's copy, so a hot file's reference count and pages
+ *    don't bounce between sockets either.
+ */
+class FileCache {
+	public:
+		/**
+		 * @param capacity Most bytes of file contents kept in memory (not
+		 * counting NUMA replicas).
+		 * @param replicate Whether hot entries get a copy per NUMA node.
+		 * @param num_shards How many shards (rounded down to a power of two), or
+		 * 0 for as many as the capacity comfortably allows.
+		 */
+		FileCache(size_t capacity, bool replicate = false, size_t num_shards = 0);
+		~FileCache();
+
+		FileCache(const FileCache&) = delete;
+		void operator=(const FileCache&) = delete;
+
+		/**
+		 * Records a request for a file and returns its contents if they are
+		 * cached, or if the file just earned its place (in which case it is
+		 * read here, from file_fd).
+		 *
+		 * @param path Path of the file.
+		 * @param file_fd The file, opened for reading.
+		 * @param info An fstat of file_fd.
+		 * @return The contents, or nullptr if the file should be sent from
+		 * file_fd instead.
+		 */
+		std::shared_ptr<const std::string> get(const std::string& path, int file_fd,
+				const struct stat& info);
+
+		/**
+		 * Records a request for a file that is served from somewhere else
+		 * (so that it still shows up in the report).
+		 */
+		void recordAccess(const std::string& path);
+
+		/**
+		 * Prints the cache's counters and the most requested paths.
+		 */
+		void printReport(std::ostream& out) const;
+
+		struct Statistics {
+			size_t num_files;
+			size_t used;
+			size_t capacity;
+			size_t num_hits;
+			size_t num_misses;
+			size_t num_rejected;
+			size_t num_evicted;
+			size_t num_shards;
+			size_t num_replicas; // NUMA copies made
+		};
+
+		/**
+		 * @return The cache's counters.
+		 */
+		Statistics statistics() const;
+
+	private:
+		// files bigger than this are never cached
+		static const off_t MAX_FILE_SIZE = 1024 * 1024;
+
+		// how many paths the report lists
+		static const size_t NUM_TOP_PATHS = 10;
+
+		// entries whose estimated requests reach this are hot (and get NUMA
+		// replicas, when those are on)
+		static const unsigned HOT_ESTIMATE = 8;
+
+		// how many counters hits are spread over
+		static const size_t NUM_HIT_COUNTERS = 64;
+
+		struct Entry {
+			std::string path;
+			dev_t device;
+			ino_t inode;
+			off_t size;
+			struct timespec modified;
+			std::shared_ptr<const std::string> contents;
+			int node; // where contents live
+
+			// set by hits, cleared by the clock hand
+			mutable std::atomic<bool> referenced{false};
+			mutable std::atomic<bool> hot{false};
+
+			// copies of contents, by NUMA node (nullptr if replicas are off)
+			std::unique_ptr<std::atomic<std::shared_ptr<const std::string>*>[]> replicas;
+			size_t num_nodes = 0;
+
+			~Entry();
+		};
+
+		// a shard's entries, never changed once published
+		using Table = std::unordered_map<std::string, std::shared_ptr<const Entry>>;
+
+		struct alignas(64) Shard {
+			std::atomic<const Table*> table;
+
+			// everything below is the writers' (and drains'), under the mutex
+			std::mutex mutex;
+			size_t capacity;
+			size_t used = 0;
+			FrequencySketch sketch;
+			std::vector<std::shared_ptr<const Entry>> clock;
+			size_t hand = 0;
+			std::vector<std::pair<uint64_t, const Table*>> retired; // by epoch
+
+			size_t num_misses = 0;
+			size_t num_rejected = 0;
+			size_t num_evicted = 0;
+
+			Shard(size_t capacity, size_t sketch_width);
+		};
+
+		std::vector<std::unique_ptr<Shard>> shards;
+		size_t shard_mask;
+		size_t capacity;
+
+		// NUMA node of each CPU, when replicating
+		std::vector<int> cpu_nodes;
+		size_t num_nodes = 1;
+		std::atomic<size_t> num_replicas{0};
+
+		struct alignas(64) HitCounter {
+			std::atomic<size_t> count{0};
+		};
+		HitCounter hit_counters[NUM_HIT_COUNTERS];
+
+		/**
+		 * Requests seen by one thread that are still to be recorded in their
+		 * shards' sketches. A full buffer is drained by whoever fills it (so
+		 * the sketches may be up to SIZE requests per thread behind).
+		 */
+		struct AccessBuffer {
+			static const size_t SIZE = 32;
+
+			FileCache *cache = nullptr;
+			size_t count = 0;
+			struct Access {
+				size_t shard;
+				std::string path; // keeps its capacity, so filling doesn't allocate
+			} accesses[SIZE];
+
+			~AccessBuffer();
+		};
+
+		size_t shardOf(const std::string& path) const;
+		void recordLater(size_t shard, const std::string& path);
+		void drain(AccessBuffer& buffer);
+		int currentNode() const;
+		std::shared_ptr<const std::string> localContents(const Entry& entry);
+
+		bool shouldAdmit(Shard& shard, const std::string& path, size_t size) const;
+		void publish(Shard& shard, Table* table);
+		void insert(Shard& shard, Table& table, std::shared_ptr<const Entry> entry);
+		void remove(Shard& shard, Table& table, const std::string& path);
+};
+#endif
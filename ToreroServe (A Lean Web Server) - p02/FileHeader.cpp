@@ -0,0 +1,84 @@
+/**
+ * File: FileHeader.cpp
+ *
+ * Implementation of the functions that build the headers files are served
+ * with. See the associated header file (FileHeader.hpp) for their
+ * declarations.
+ */
+
+// operating system specific libraries
+#include <sys/stat.h>
+
+// C standard library
+#include <ctime>
+#include <cstdio>
+
+// C++ standard libraries
+#include <string>
+#include <filesystem>
+
+#include "FileHeader.hpp"
+
+namespace fs = std::filesystem;
+
+using std::string;
+
+/** 
+ * Returns the content type for a given file path.
+ * Basically, this function looks at the file extension and
+ * returns the appropriate MIME type.
+ * For Dr. Sat, the fs::path is useful because it has a function
+ * to easily get the file extension ... I'm taking path as a param and 
+ * returning a string because that's what the rest of the code uses.
+ * 
+ * @param path The file path.
+ * @return The MIME type as a string.
+ */
+std::string getPathExtension(const string& path) {
+	auto ext = fs::path(path).extension().string();
+	if (ext == ".html" || ext == ".htm") return "text/html";
+	if (ext == ".css") return "text/css";
+	if (ext == ".js") return "application/javascript";
+	if (ext == ".png") return "image/png";
+	if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
+	if (ext == ".gif") return "image/gif";
+	if (ext == ".pdf") return "application/pdf";
+	if (ext == ".json") return "application/json";
+	if (ext == ".txt") return "text/plain";
+	return "application/octet-stream"; 
+}
+
+/**
+ * Builds a 200 OK header for a body of the given content type and length.
+ * Within an OK header typically the content length is also sent, so that is
+ * included as a parameter.
+ * 
+ * @param content_type The MIME type of the body.
+ * @param content_length The size of the body in bytes.
+ * @return The serialized header, including the blank line that ends it.
+ */
+string buildOKHeader(const string& content_type, size_t content_length) {
+	return
+		"HTTP/1.0 200 OK\r\n"
+		"Content-Type: " + content_type + "\r\n"
+		"Content-Length: " + std::to_string(content_length) + "\r\n"
+		"\r\n";
+}
+
+string buildFileHeader(const string& path, const struct stat& info) {
+	// validators: the ETag changes whenever the file is replaced or modified
+	char etag[64];
+	snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"", (unsigned long) info.st_ino,
+			(unsigned long) info.st_size,
+			(unsigned long) (info.st_mtim.tv_sec * 1000000000L + info.st_mtim.tv_nsec));
+
+	char last_modified[64];
+	struct tm utc;
+	gmtime_r(&info.st_mtim.tv_sec, &utc);
+	strftime(last_modified, sizeof(last_modified), "%a, %d %b %Y %H:%M:%S GMT", &utc);
+
+	string header = buildOKHeader(getPathExtension(path), info.st_size);
+	header.insert(header.size() - 2,
+			string("ETag: ") + etag + "\r\nLast-Modified: " + last_modified + "\r\n");
+	return header;
+}
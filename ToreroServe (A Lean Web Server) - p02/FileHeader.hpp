@@ -0,0 +1,28 @@
+#ifndef FILEHEADER_HPP
+#define FILEHEADER_HPP
+
+/**
+ * File: FileHeader.hpp
+ *
+ * Functions that build the headers files are served with. They are kept
+ * apart from the rest of torero-serve.cpp so that the embed-assets tool can
+ * build exactly the headers the server would.
+ */
+
+#include <string>
+#include <cstddef>
+#include <sys/stat.h>
+
+std::string getPathExtension(const std::string& path);
+std::string buildOKHeader(const std::string& content_type, size_t content_length);
+
+/**
+ * Builds the 200 header for a file, validators (ETag and Last-Modified)
+ * included.
+ *
+ * @param path Path of the file, for its content type.
+ * @param info A stat of the file.
+ * @return The serialized header, including the blank line that ends it.
+ */
+std::string buildFileHeader(const std::string& path, const struct stat& info);
+#endif
@@ -0,0 +1,437 @@
+/**
+ * File: FileIndex.cpp
+ *
+ * Implementation of the FileIndex class.
+ * See the associated header file (FileIndex.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// C standard library
+#include <cstdint>
+#include <cstring>
+
+// C++ standard library
+#include <thread>
+#include <algorithm>
+#include <utility>
+
+#include "FileIndex.hpp"
+#include "FileHeader.hpp"
+
+using std::string;
+using std::vector;
+using std::shared_ptr;
+
+using Clock = std::chrono::steady_clock;
+
+bool FileIndex::Entry::isCurrent(const struct stat& info) const {
+	return info.st_dev == device && info.st_ino == inode && info.st_size == size
+		&& info.st_mtim.tv_sec == modified.tv_sec && info.st_mtim.tv_nsec == modified.tv_nsec;
+}
+
+FileIndex::~FileIndex() {
+	if (hot_mapping != nullptr) {
+		munmap(const_cast<char*>(hot_mapping), hot_mapping_size);
+	}
+	if (hot_fd >= 0) {
+		close(hot_fd);
+	}
+}
+
+bool FileIndex::build(int num_threads, Clock::time_point deadline,
+		const vector<string>& hot_resources) {
+	// the memfd starts out as big as it may get; tmpfs only allocates the
+	// pages that actually get written
+	if (!hot_resources.empty()) {
+		hot_fd = memfd_create("torero-hot-files", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (hot_fd >= 0 && ftruncate(hot_fd, MAX_HOT_BYTES) == 0) {
+			hot.insert(hot_resources.begin(), hot_resources.end());
+		}
+	}
+	this->deadline = deadline;
+	directories_left.push_back("");
+
+	vector<std::thread> walkers;
+	for (int i = 0; i < num_threads; i++) {
+		walkers.push_back(std::thread(&FileIndex::walk, this));
+	}
+	for (std::thread& walker : walkers) {
+		walker.join();
+	}
+
+	bool finished = directories_left.empty() && Clock::now() < deadline;
+	mapHotFiles();
+	return finished;
+}
+
+const FileIndex::Entry* FileIndex::find(const string& resource) const {
+	auto found = entries.find(resource);
+	return found == entries.end() ? nullptr : found->second.get();
+}
+
+std::string_view FileIndex::contentsOf(const Entry& entry) const {
+	if (!entry.is_hot) return std::string_view();
+	return std::string_view(hot_mapping + entry.hot_offset, entry.size);
+}
+
+/**
+ * Trims the memfd down to what the hot files use, seals it so that nobody can
+ * change it any more and maps it read-only. Hot entries stay hot only if all
+ * of that works.
+ */
+void FileIndex::mapHotFiles() {
+	if (hot_fd < 0) return;
+
+	size_t used = std::min(hot_reserved.load(), MAX_HOT_BYTES);
+	bool mapped = false;
+	if (num_hot_files > 0 && ftruncate(hot_fd, used) == 0
+			&& fcntl(hot_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) == 0) {
+		void *mapping = mmap(nullptr, used, PROT_READ, MAP_SHARED, hot_fd, 0);
+		if (mapping != MAP_FAILED) {
+			hot_mapping = static_cast<const char*>(mapping);
+			hot_mapping_size = used;
+			mapped = true;
+		}
+	}
+
+	if (!mapped) {
+		// cool everything down again (nothing is using the index yet)
+		for (auto& [resource, entry] : entries) {
+			const_cast<Entry&>(*entry).is_hot = false;
+		}
+		num_hot_files = 0;
+		hot_bytes = 0;
+	}
+
+	// the mapping keeps the memory around; the descriptor is only kept for
+	// handing the hot files over in an upgrade
+	if (!mapped) {
+		close(hot_fd);
+		hot_fd = -1;
+	}
+}
+
+// first bytes of a snapshot, which change whenever its layout does
+static const char SNAPSHOT_MAGIC[] = "torero-index-1\n";
+
+/**
+ * Appends a number to a snapshot (in the machine's own byte order, since
+ * snapshots never leave it).
+ */
+static void appendNumber(string& out, uint64_t value) {
+	out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendString(string& out, const string& value) {
+	appendNumber(out, value.size());
+	out += value;
+}
+
+/**
+ * Reads the parts of a snapshot back, in the order they were appended. Once
+ * something doesn't add up, every read fails.
+ */
+struct SnapshotReader {
+	std::string_view data;
+	bool ok = true;
+
+	uint64_t number() {
+		uint64_t value = 0;
+		if (data.size() < sizeof(value)) {
+			ok = false;
+			return 0;
+		}
+		memcpy(&value, data.data(), sizeof(value));
+		data.remove_prefix(sizeof(value));
+		return value;
+	}
+
+	string text() {
+		uint64_t size = number();
+		if (size > data.size()) {
+			ok = false;
+			return string();
+		}
+		string value(data.substr(0, size));
+		data.remove_prefix(size);
+		return value;
+	}
+};
+
+bool FileIndex::saveSnapshot(int fd) const {
+	// entries are shared by a directory and its index.html, so they're
+	// written once each and the resources refer to them by number
+	std::unordered_map<const Entry*, uint64_t> numbers;
+	vector<const Entry*> unique_entries;
+	for (auto& [resource, entry] : entries) {
+		if (numbers.emplace(entry.get(), unique_entries.size()).second) {
+			unique_entries.push_back(entry.get());
+		}
+	}
+
+	string out = SNAPSHOT_MAGIC;
+	appendNumber(out, unique_entries.size());
+	for (const Entry* entry : unique_entries) {
+		appendString(out, entry->path);
+		appendNumber(out, entry->device);
+		appendNumber(out, entry->inode);
+		appendNumber(out, entry->size);
+		appendNumber(out, entry->modified.tv_sec);
+		appendNumber(out, entry->modified.tv_nsec);
+		appendString(out, entry->header);
+		appendNumber(out, entry->is_hot);
+		appendNumber(out, entry->hot_offset);
+	}
+	appendNumber(out, entries.size());
+	for (auto& [resource, entry] : entries) {
+		appendString(out, resource);
+		appendNumber(out, numbers[entry.get()]);
+	}
+	appendNumber(out, num_files);
+
+	size_t num_written = 0;
+	while (num_written < out.size()) {
+		ssize_t n = write(fd, out.data() + num_written, out.size() - num_written);
+		if (n <= 0) return false;
+		num_written += n;
+	}
+	return true;
+}
+
+bool FileIndex::loadSnapshot(int fd, int hot_fd) {
+	struct stat info;
+	string data;
+	if (fstat(fd, &info) == 0) {
+		data.resize(info.st_size);
+		size_t num_read = 0;
+		while (num_read < data.size()) {
+			ssize_t n = pread(fd, data.data() + num_read, data.size() - num_read, num_read);
+			if (n <= 0) break;
+			num_read += n;
+		}
+		data.resize(num_read);
+	}
+
+	SnapshotReader reader{data};
+	size_t magic_size = sizeof(SNAPSHOT_MAGIC) - 1;
+	if (reader.data.substr(0, magic_size) != std::string_view(SNAPSHOT_MAGIC, magic_size)) {
+		if (hot_fd >= 0) close(hot_fd);
+		return false;
+	}
+	reader.data.remove_prefix(magic_size);
+
+	// the hot files stay where the old process put them
+	struct stat hot_info;
+	if (hot_fd >= 0 && fstat(hot_fd, &hot_info) == 0 && hot_info.st_size > 0) {
+		void *mapping = mmap(nullptr, hot_info.st_size, PROT_READ, MAP_SHARED, hot_fd, 0);
+		if (mapping != MAP_FAILED) {
+			this->hot_fd = hot_fd;
+			hot_mapping = static_cast<const char*>(mapping);
+			hot_mapping_size = hot_info.st_size;
+		}
+	}
+	if (hot_mapping == nullptr && hot_fd >= 0) {
+		close(hot_fd);
+	}
+
+	// (a count bigger than the snapshot can only be garbage)
+	size_t num_entries = reader.number();
+	if (num_entries > reader.data.size()) reader.ok = false;
+
+	vector<shared_ptr<const Entry>> unique_entries(reader.ok ? num_entries : 0);
+	for (size_t i = 0; i < unique_entries.size() && reader.ok; i++) {
+		auto entry = std::make_shared<Entry>();
+		entry->path = reader.text();
+		entry->device = reader.number();
+		entry->inode = reader.number();
+		entry->size = reader.number();
+		entry->modified.tv_sec = reader.number();
+		entry->modified.tv_nsec = reader.number();
+		entry->header = reader.text();
+		entry->is_hot = reader.number() != 0;
+		entry->hot_offset = reader.number();
+
+		// only if it's (still) inside the mapping
+		entry->is_hot = entry->is_hot && entry->hot_offset <= hot_mapping_size
+			&& (size_t) entry->size <= hot_mapping_size - entry->hot_offset;
+		if (entry->is_hot) {
+			num_hot_files++;
+			hot_bytes += entry->size;
+		}
+		unique_entries[i] = std::move(entry);
+	}
+
+	size_t num_resources = reader.number();
+	for (size_t i = 0; i < num_resources && reader.ok; i++) {
+		string resource = reader.text();
+		uint64_t number = reader.number();
+		if (number >= unique_entries.size()) reader.ok = false;
+		if (reader.ok) entries.emplace(std::move(resource), unique_entries[number]);
+	}
+	num_files = reader.number();
+
+	if (!reader.ok) {
+		entries.clear();
+		num_files = 0;
+		num_hot_files = 0;
+		hot_bytes = 0;
+	}
+	return reader.ok;
+}
+
+/**
+ * Copies a file into the hot file memfd, at the given offset.
+ *
+ * @return false if the file couldn't be read in full (e.g. it shrank).
+ */
+bool FileIndex::copyHotFile(int file_fd, size_t size, size_t offset) {
+	char buffer[65536];
+	size_t num_copied = 0;
+	while (num_copied < size) {
+		ssize_t n = pread(file_fd, buffer, std::min(sizeof(buffer), size - num_copied), num_copied);
+		if (n <= 0 || pwrite(hot_fd, buffer, n, offset + num_copied) != n) {
+			return false;
+		}
+		num_copied += n;
+	}
+	return true;
+}
+
+/**
+ * Run by each thread of the walk: takes directories off the shared list
+ * until there are none left and nobody is still reading one (that might add
+ * more), or until the deadline.
+ */
+void FileIndex::walk() {
+	vector<std::pair<string, shared_ptr<const Entry>>> found;
+	vector<string> subdirectories;
+
+	std::unique_lock<std::mutex> lock(walk_mutex);
+	while (Clock::now() < deadline) {
+		bool has_work = walk_changed.wait_until(lock, deadline, [this]() {
+			return !directories_left.empty() || num_walking == 0;
+		});
+		if (!has_work || directories_left.empty()) break;
+
+		string directory = std::move(directories_left.back());
+		directories_left.pop_back();
+		num_walking++;
+
+		lock.unlock();
+		indexDirectory(directory, found, subdirectories);
+		lock.lock();
+
+		for (auto& [resource, entry] : found) {
+			entries.emplace(std::move(resource), std::move(entry));
+		}
+		found.clear();
+		for (string& subdirectory : subdirectories) {
+			directories_left.push_back(std::move(subdirectory));
+		}
+		subdirectories.clear();
+
+		num_walking--;
+		walk_changed.notify_all();
+	}
+}
+
+/**
+ * Indexes the files of one directory.
+ *
+ * @param directory The directory, relative to the root ("" for the root).
+ * @param found Vector the new (resource, entry) pairs are added to.
+ * @param subdirectories Vector the directory's subdirectories are added to.
+ */
+void FileIndex::indexDirectory(const string& directory,
+		vector<std::pair<string, shared_ptr<const Entry>>>& found,
+		vector<string>& subdirectories) {
+	int dir_fd = open((root + directory).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd < 0) return;
+
+	DIR *dir = fdopendir(dir_fd);
+	if (dir == nullptr) {
+		close(dir_fd);
+		return;
+	}
+
+	struct dirent *d;
+	while ((d = readdir(dir)) != nullptr && Clock::now() < deadline) {
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) {
+			continue;
+		}
+
+		// follow symbolic links, like the request path does
+		struct stat info;
+		if (fstatat(dir_fd, d->d_name, &info, 0) < 0) continue;
+
+		string resource = directory + "/" + d->d_name;
+		if (S_ISDIR(info.st_mode)) {
+			subdirectories.push_back(std::move(resource));
+			continue;
+		}
+		if (!S_ISREG(info.st_mode)) continue;
+
+		// a directory's index.html is also what the directory itself serves
+		bool is_index = strcmp(d->d_name, "index.html") == 0;
+		string dir_resource = directory.empty() ? "/" : directory;
+		bool is_hot = hot.count(resource) > 0 || (is_index
+				&& (hot.count(dir_resource) > 0 || hot.count(directory + "/") > 0));
+
+		shared_ptr<const Entry> entry = indexFile(dir_fd, d->d_name, resource, info, is_hot);
+		found.push_back({std::move(resource), entry});
+		if (is_index) {
+			found.push_back({directory + "/", entry});
+			if (!directory.empty()) found.push_back({directory, entry});
+		}
+	}
+
+	closedir(dir);
+}
+
+/**
+ * Makes the entry for one regular file, and reads it into memory (if hot) or
+ * into the page cache.
+ */
+shared_ptr<const FileIndex::Entry> FileIndex::indexFile(int dir_fd, const char* name,
+		const string& resource, const struct stat& info, bool is_hot) {
+	auto entry = std::make_shared<Entry>();
+	entry->path = root + resource;
+	entry->device = info.st_dev;
+	entry->inode = info.st_ino;
+	entry->size = info.st_size;
+	entry->modified = info.st_mtim;
+	entry->header = buildFileHeader(entry->path, info);
+	num_files++;
+
+	int file_fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+	if (file_fd < 0) return entry;
+
+	// space in the memfd is handed out first come, first served; once it
+	// runs out, the remaining hot files are just read ahead like the rest
+	size_t size = info.st_size;
+	size_t offset = 0;
+	bool fits = is_hot && info.st_size > 0 && info.st_size <= MAX_HOT_FILE_SIZE
+		&& (offset = hot_reserved.fetch_add(size)) + size <= MAX_HOT_BYTES;
+
+	// a file that changed under us is just left out of memory
+	if (fits && copyHotFile(file_fd, size, offset)) {
+		entry->is_hot = true;
+		entry->hot_offset = offset;
+		num_hot_files++;
+		hot_bytes += size;
+	}
+	else if (readahead_bytes.fetch_add(size) + size <= MAX_READAHEAD_BYTES) {
+		// only start the reads; they go on in the background
+		posix_fadvise(file_fd, 0, 0, POSIX_FADV_WILLNEED);
+	}
+
+	close(file_fd);
+	return entry;
+}
@@ -0,0 +1,176 @@
+#ifndef FILEINDEX_HPP
+#define FILEINDEX_HPP
+
+/**
+ * File: FileIndex.hpp
+ *
+ * Header file for the FileIndex class.
+ */
+
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+
+/**
+ * Index of the served tree, built once at startup so that the first request
+ * for each file doesn't have to pay for the lookups (and disk reads) that
+ * every later one gets from the kernel's caches anyway.
+ *
+ * Building the index walks the tree with a few threads, one directory at a
+ * time each. For every regular file it records the metadata, a ready-made
+ * 200 header (with ETag and Last-Modified validators), and then either reads
+ * the file into memory, if it is one of the hot ones, or asks the kernel to
+ * start reading it into the page cache in the background.
+ *
+ * Hot files are copied into a memfd that is sealed and mapped read-only once
+ * the walk is over. Processes forked after that share the very same pages,
+ * so N worker processes don't mean N copies of the hot files.
+ *
+ * The index is a snapshot: whoever uses an entry should check it against a
+ * fresh stat (see isCurrent) and fall back to the normal path if the file
+ * has changed since. That also makes it fine to hand it over to the process
+ * that replaces this one in an upgrade (see saveSnapshot), which then starts
+ * out with everything warm instead of walking the tree again.
+ */
+class FileIndex {
+	public:
+		struct Entry {
+			std::string path; // path of the file, including the root
+			dev_t device;
+			ino_t inode;
+			off_t size;
+			struct timespec modified;
+
+			// "200 OK" header for the file, validators included
+			std::string header;
+
+			// where the file's contents are in the hot file mapping (hot files
+			// only, see FileIndex::contentsOf)
+			bool is_hot = false;
+			size_t hot_offset = 0;
+
+			/**
+			 * @return Whether the given stat of path still describes the file
+			 * this entry was made from.
+			 */
+			bool isCurrent(const struct stat& info) const;
+		};
+
+		/**
+		 * @param root The directory being served.
+		 */
+		FileIndex(std::string root) : root(std::move(root)) {};
+		~FileIndex();
+
+		FileIndex(const FileIndex&) = delete;
+		void operator=(const FileIndex&) = delete;
+
+		/**
+		 * Walks the tree and fills in the index. Stops early (leaving the
+		 * index partial) if the deadline passes.
+		 *
+		 * @param num_threads How many threads walk the tree.
+		 * @param deadline When to give up.
+		 * @param hot_resources Resources (e.g. "/index.html") to load into
+		 * memory.
+		 * @return false if the deadline passed before the walk was done.
+		 */
+		bool build(int num_threads, std::chrono::steady_clock::time_point deadline,
+				const std::vector<std::string>& hot_resources);
+
+		/**
+		 * Looks up a resource. Directories with an index.html map to the
+		 * entry of that file. Must not be called while the index is being built.
+		 *
+		 * @param resource The requested resource (e.g. "/misc/").
+		 * @return The entry, or nullptr if the resource isn't indexed.
+		 */
+		const Entry* find(const std::string& resource) const;
+
+		/**
+		 * Writes the index out, for another process to load with
+		 * loadSnapshot. The hot files themselves aren't part of it; they are
+		 * handed over as the memfd they're in (see hotFd).
+		 *
+		 * @param fd Where to write the snapshot (e.g. a memfd).
+		 * @return false if writing it failed.
+		 */
+		bool saveSnapshot(int fd) const;
+
+		/**
+		 * Fills in an empty index from a snapshot, instead of building it.
+		 *
+		 * @param fd The snapshot, as written by saveSnapshot.
+		 * @param hot_fd The memfd with the hot files, which the index now
+		 * owns, or -1 (the hot entries are then served like the rest).
+		 * @return false if the snapshot couldn't be read, which leaves the
+		 * index empty.
+		 */
+		bool loadSnapshot(int fd, int hot_fd);
+
+		/**
+		 * @return The sealed memfd the hot files are mapped from, or -1 if
+		 * there are none.
+		 */
+		int hotFd() const { return hot_fd; }
+
+		/**
+		 * @return The contents of a hot file, straight from the shared
+		 * mapping (empty for files that aren't hot).
+		 */
+		std::string_view contentsOf(const Entry& entry) const;
+
+		size_t numFiles() const { return num_files; }
+		size_t numHotFiles() const { return num_hot_files; }
+		size_t hotBytes() const { return hot_bytes; }
+
+	private:
+		// files bigger than this are never kept in memory
+		static const off_t MAX_HOT_FILE_SIZE = 1024 * 1024;
+
+		// most memory used by hot files, and most file data read ahead
+		static const size_t MAX_HOT_BYTES = 64 * 1024 * 1024;
+		static const size_t MAX_READAHEAD_BYTES = 512 * 1024 * 1024;
+
+		std::string root;
+
+		// memfd the hot files are copied into during the walk, and where it
+		// is mapped afterwards
+		int hot_fd = -1;
+		const char *hot_mapping = nullptr;
+		size_t hot_mapping_size = 0;
+		std::atomic<size_t> hot_reserved{0};
+		std::unordered_map<std::string, std::shared_ptr<const Entry>> entries;
+		std::unordered_set<std::string> hot;
+
+		// state of the walk, shared by its threads
+		std::mutex walk_mutex;
+		std::condition_variable walk_changed;
+		std::vector<std::string> directories_left; // relative to root
+		int num_walking = 0;
+		std::chrono::steady_clock::time_point deadline;
+
+		std::atomic<size_t> num_files{0};
+		std::atomic<size_t> num_hot_files{0};
+		std::atomic<size_t> hot_bytes{0};
+		std::atomic<size_t> readahead_bytes{0};
+
+		void walk();
+		void indexDirectory(const std::string& directory,
+				std::vector<std::pair<std::string, std::shared_ptr<const Entry>>>& found,
+				std::vector<std::string>& subdirectories);
+		std::shared_ptr<const Entry> indexFile(int dir_fd, const char* name,
+				const std::string& resource, const struct stat& info, bool is_hot);
+		bool copyHotFile(int file_fd, size_t size, size_t offset);
+		void mapHotFiles();
+};
+#endif
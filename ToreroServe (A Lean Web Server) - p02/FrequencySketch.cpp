@@ -0,0 +1,134 @@
+/**
+ * File: FrequencySketch.cpp
+ *
+ * Implementation of the FrequencySketch class.
+ * See the associated header file (FrequencySketch.hpp) for the declaration
+ * of this class.
+ */
+
+// C++ standard library
+#include <algorithm>
+#include <functional>
+
+#include "FrequencySketch.hpp"
+
+using std::string;
+using std::string_view;
+
+// odd constants that spread a hash differently for each row
+static const uint64_t ROW_SEEDS[] = {
+	0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL, 0x165667b19e3779f9ULL, 0xd6e8feb86659fd93ULL
+};
+
+FrequencySketch::FrequencySketch(size_t width, size_t num_top_keys) : num_top_keys(num_top_keys) {
+	size_t rounded = 64;
+	while (rounded < width) rounded *= 2;
+
+	width_mask = rounded - 1;
+	counters.assign(DEPTH * rounded, 0);
+	doorkeeper.assign(rounded / 64, 0);
+	sample_size = SAMPLE_FACTOR * rounded;
+}
+
+size_t FrequencySketch::counterIndex(uint64_t hash, int row) const {
+	uint64_t mixed = (hash ^ (hash >> 29)) * ROW_SEEDS[row];
+	return row * (width_mask + 1) + ((mixed >> 32) & width_mask);
+}
+
+bool FrequencySketch::inDoorkeeper(uint64_t hash) const {
+	// two bits per key, from the two halves of the hash
+	size_t first = hash & width_mask;
+	size_t second = (hash >> 32) & width_mask;
+	return (doorkeeper[first / 64] >> (first % 64) & 1) && (doorkeeper[second / 64] >> (second % 64) & 1);
+}
+
+void FrequencySketch::record(string_view key) {
+	uint64_t hash = std::hash<string_view>()(key);
+
+	if (!inDoorkeeper(hash)) {
+		size_t first = hash & width_mask;
+		size_t second = (hash >> 32) & width_mask;
+		doorkeeper[first / 64] |= uint64_t(1) << (first % 64);
+		doorkeeper[second / 64] |= uint64_t(1) << (second % 64);
+	}
+	else {
+		// only the smallest counters go up (conservative update), which
+		// keeps collisions from inflating the others
+		unsigned smallest = smallestCounter(hash);
+		for (int row = 0; row < DEPTH; row++) {
+			uint8_t& counter = counters[counterIndex(hash, row)];
+			if (counter == smallest && counter < 255) counter++;
+		}
+	}
+
+	updateTopKeys(hash, key, estimate(hash));
+
+	if (++num_records >= sample_size) {
+		age();
+	}
+}
+
+unsigned FrequencySketch::estimate(string_view key) const {
+	return estimate(std::hash<string_view>()(key));
+}
+
+unsigned FrequencySketch::estimate(uint64_t hash) const {
+	return smallestCounter(hash) + (inDoorkeeper(hash) ? 1 : 0);
+}
+
+unsigned FrequencySketch::smallestCounter(uint64_t hash) const {
+	unsigned smallest = 255;
+	for (int row = 0; row < DEPTH; row++) {
+		smallest = std::min<unsigned>(smallest, counters[counterIndex(hash, row)]);
+	}
+	return smallest;
+}
+
+/**
+ * Keeps the key among the top ones if its estimate beats the lowest of them.
+ */
+void FrequencySketch::updateTopKeys(uint64_t hash, string_view key, unsigned estimate) {
+	if (num_top_keys == 0) return;
+
+	size_t lowest = 0;
+	for (size_t i = 0; i < top_keys.size(); i++) {
+		if (top_keys[i].hash == hash && top_keys[i].key == key) {
+			top_keys[i].estimate = estimate;
+			return;
+		}
+		if (top_keys[i].estimate < top_keys[lowest].estimate) lowest = i;
+	}
+
+	if (top_keys.size() < num_top_keys) {
+		top_keys.push_back({hash, string(key), estimate});
+	}
+	else if (estimate > top_keys[lowest].estimate) {
+		top_keys[lowest] = {hash, string(key), estimate};
+	}
+}
+
+std::vector<std::pair<string, unsigned>> FrequencySketch::topKeys() const {
+	std::vector<std::pair<string, unsigned>> keys;
+	for (const TopKey& top : top_keys) {
+		keys.push_back({top.key, top.estimate});
+	}
+	std::sort(keys.begin(), keys.end(),
+			[](const auto& a, const auto& b) { return a.second > b.second; });
+	return keys;
+}
+
+/**
+ * Halves every count, forgetting about the keys seen only once.
+ */
+void FrequencySketch::age() {
+	for (uint8_t& counter : counters) {
+		counter /= 2;
+	}
+	std::fill(doorkeeper.begin(), doorkeeper.end(), 0);
+
+	// the doorkeeper's share of each estimate is gone too
+	for (TopKey& top : top_keys) {
+		top.estimate = top.estimate / 2;
+	}
+	num_records = 0;
+}
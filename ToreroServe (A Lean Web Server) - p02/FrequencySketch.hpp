@@ -0,0 +1,85 @@
+#ifndef FREQUENCYSKETCH_HPP
+#define FREQUENCYSKETCH_HPP
+
+/**
+ * File: FrequencySketch.hpp
+ *
+ * Header file for the FrequencySketch class.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Approximate count of how often each key (a file path) was seen lately, in
+ * a fixed amount of memory: a count-min sketch, as used by TinyLFU.
+ *
+ * Each key maps to one counter in each of DEPTH rows. Recording the key
+ * increments them, and its estimate is the smallest of them. Collisions can
+ * only make an estimate too high, never too low.
+ *
+ * Two additions keep the counts meaningful:
+ *  - a doorkeeper (a Bloom filter) absorbs the first occurrence of each key,
+ *    so that the many keys seen just once never reach the counters;
+ *  - aging: after SAMPLE_FACTOR times as many records as there are counters
+ *    per row, every counter is halved and the doorkeeper is cleared, so
+ *    that what was popular a while ago fades out.
+ *
+ * The sketch also keeps the few keys with the highest estimates, for
+ * reporting. Not thread safe; FileCache calls it under its shards' locks.
+ */
+class FrequencySketch {
+	public:
+		/**
+		 * @param width Counters per row (rounded up to a power of two).
+		 * @param num_top_keys How many of the most frequent keys to track.
+		 */
+		FrequencySketch(size_t width, size_t num_top_keys);
+
+		/**
+		 * Records one occurrence of a key.
+		 */
+		void record(std::string_view key);
+
+		/**
+		 * @return The estimated number of recent occurrences of the key
+		 * (at most 256).
+		 */
+		unsigned estimate(std::string_view key) const;
+
+		/**
+		 * @return The most frequent keys seen lately with their estimates,
+		 * most frequent first.
+		 */
+		std::vector<std::pair<std::string, unsigned>> topKeys() const;
+
+	private:
+		static const int DEPTH = 4;
+		static const size_t SAMPLE_FACTOR = 10;
+
+		struct TopKey {
+			uint64_t hash;
+			std::string key;
+			unsigned estimate;
+		};
+
+		size_t width_mask;
+		std::vector<uint8_t> counters; // DEPTH rows of width each
+		std::vector<uint64_t> doorkeeper; // bits
+		size_t num_records = 0;
+		size_t sample_size;
+
+		std::vector<TopKey> top_keys;
+		size_t num_top_keys;
+
+		size_t counterIndex(uint64_t hash, int row) const;
+		bool inDoorkeeper(uint64_t hash) const;
+		unsigned estimate(uint64_t hash) const;
+		unsigned smallestCounter(uint64_t hash) const;
+		void updateTopKeys(uint64_t hash, std::string_view key, unsigned estimate);
+		void age();
+};
+#endif
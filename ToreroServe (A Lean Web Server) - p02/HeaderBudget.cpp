@@ -0,0 +1,48 @@
+/**
+ * File: HeaderBudget.cpp
+ *
+ * Implementation of the HeaderBudget class.
+ * See the associated header file (HeaderBudget.hpp) for the declaration of
+ * this class.
+ */
+
+// C++ standard library
+#include <atomic>
+
+#include "HeaderBudget.hpp"
+
+// what an HTTP/2 client with prior knowledge starts with, instead of a header
+static const std::string_view HTTP2_PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+static HeaderBudget::Limits current_limits;
+static std::atomic<size_t> memory_in_use{0};
+
+void HeaderBudget::setLimits(const Limits& limits) { current_limits = limits; }
+
+const HeaderBudget::Limits& HeaderBudget::limits() { return current_limits; }
+
+bool HeaderBudget::isComplete(std::string_view data, size_t checked) {
+	// the preface has a blank line of its own, before its end
+	if (data.starts_with(HTTP2_PREFACE.substr(0, 4))) {
+		return data.size() >= HTTP2_PREFACE.size();
+	}
+
+	// the blank line may straddle what was checked and what's new
+	size_t from = checked < 3 ? 0 : checked - 3;
+	return data.find("\r\n\r\n", from) != std::string_view::npos;
+}
+
+bool HeaderBudget::reserve(size_t bytes) {
+	size_t in_use = memory_in_use.load(std::memory_order_relaxed);
+	do {
+		if (in_use + bytes > current_limits.memory) return false;
+	} while (!memory_in_use.compare_exchange_weak(in_use, in_use + bytes,
+				std::memory_order_relaxed));
+	return true;
+}
+
+void HeaderBudget::release(size_t bytes) {
+	memory_in_use.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t HeaderBudget::inUse() { return memory_in_use.load(std::memory_order_relaxed); }
@@ -0,0 +1,106 @@
+#ifndef HEADERBUDGET_HPP
+#define HEADERBUDGET_HPP
+
+/**
+ * File: HeaderBudget.hpp
+ *
+ * Header file for the HeaderBudget class.
+ */
+
+#include <cstddef>
+#include <string_view>
+
+/**
+ * What a client may cost us before its request header is in: a request is
+ * received piece by piece until the blank line that ends its header, which
+ * has to arrive within a time limit and stay under a size limit. On top of
+ * that, the memory held by all the headers that are still on their way is
+ * capped, so a crowd of clients trickling in requests (slowloris) can't
+ * make the server grow without bound either.
+ *
+ * Every engine keeps to the same limits; how each one waits without tying
+ * up a thread is its own business (see RequestReader for the threads
+ * engine).
+ */
+class HeaderBudget {
+	public:
+		struct Limits {
+			size_t max_bytes = 32768;            // per header
+			double timeout_seconds = 10;         // from the first read to the blank line
+			size_t memory = 64 * 1024 * 1024;    // all partial headers together
+		};
+
+		/**
+		 * Sets the limits. Must be called before any request is received.
+		 */
+		static void setLimits(const Limits& limits);
+
+		/**
+		 * @return The limits in force.
+		 */
+		static const Limits& limits();
+
+		/**
+		 * @param data What has been received of a request so far.
+		 * @param checked How much of it was already found incomplete, so a
+		 * header arriving a byte at a time isn't searched over and over.
+		 * @return Whether the header is all there (for an HTTP/2 connection:
+		 * its whole preface).
+		 */
+		static bool isComplete(std::string_view data, size_t checked = 0);
+
+		/**
+		 * Takes memory for a partial header out of the shared budget.
+		 *
+		 * @param bytes How much.
+		 * @return false (taking nothing) if the budget doesn't have that much
+		 * left.
+		 */
+		static bool reserve(size_t bytes);
+
+		/**
+		 * Gives memory taken with reserve back.
+		 *
+		 * @param bytes How much.
+		 */
+		static void release(size_t bytes);
+
+		/**
+		 * @return How much of the shared budget is taken right now.
+		 */
+		static size_t inUse();
+
+		/**
+		 * Memory some partial header holds, given back to the budget when the
+		 * reservation goes away (or is cleared).
+		 */
+		class Reservation {
+			public:
+				Reservation() = default;
+				~Reservation() { clear(); }
+
+				Reservation(const Reservation&) = delete;
+				void operator=(const Reservation&) = delete;
+
+				/**
+				 * @param more How much more to take.
+				 * @return false (taking nothing) if the budget is out.
+				 */
+				bool grow(size_t more) {
+					if (!reserve(more)) return false;
+					bytes += more;
+					return true;
+				}
+
+				void clear() {
+					release(bytes);
+					bytes = 0;
+				}
+
+				size_t size() const { return bytes; }
+
+			private:
+				size_t bytes = 0;
+		};
+};
+#endif
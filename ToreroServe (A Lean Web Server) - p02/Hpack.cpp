@@ -0,0 +1,416 @@
+/**
+ * File: Hpack.cpp
+ *
+ * Implementation of HPACK: the table, the decoder and the encoder.
+ * See the associated header file (Hpack.hpp) for their declarations.
+ */
+
+// C++ standard library
+#include <algorithm>
+#include <utility>
+
+#include "Hpack.hpp"
+
+using std::string;
+using std::string_view;
+
+// every dynamic table entry costs this much on top of its name and value
+static const size_t ENTRY_OVERHEAD = 32;
+
+// RFC 7541, Appendix A
+static const HpackHeader STATIC_TABLE[HpackTable::STATIC_TABLE_SIZE] = {
+	{":authority", ""}, {":method", "GET"}, {":method", "POST"}, {":path", "/"},
+	{":path", "/index.html"}, {":scheme", "http"}, {":scheme", "https"},
+	{":status", "200"}, {":status", "204"}, {":status", "206"}, {":status", "304"},
+	{":status", "400"}, {":status", "404"}, {":status", "500"}, {"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"}, {"accept-language", ""}, {"accept-ranges", ""},
+	{"accept", ""}, {"access-control-allow-origin", ""}, {"age", ""}, {"allow", ""},
+	{"authorization", ""}, {"cache-control", ""}, {"content-disposition", ""},
+	{"content-encoding", ""}, {"content-language", ""}, {"content-length", ""},
+	{"content-location", ""}, {"content-range", ""}, {"content-type", ""}, {"cookie", ""},
+	{"date", ""}, {"etag", ""}, {"expect", ""}, {"expires", ""}, {"from", ""}, {"host", ""},
+	{"if-match", ""}, {"if-modified-since", ""}, {"if-none-match", ""}, {"if-range", ""},
+	{"if-unmodified-since", ""}, {"last-modified", ""}, {"link", ""}, {"location", ""},
+	{"max-forwards", ""}, {"proxy-authenticate", ""}, {"proxy-authorization", ""},
+	{"range", ""}, {"referer", ""}, {"refresh", ""}, {"retry-after", ""}, {"server", ""},
+	{"set-cookie", ""}, {"strict-transport-security", ""}, {"transfer-encoding", ""},
+	{"user-agent", ""}, {"vary", ""}, {"via", ""}, {"www-authenticate", ""},
+};
+
+// RFC 7541, Appendix B: code (right-aligned) and length in bits of each byte
+struct HuffmanCode {
+	uint32_t code;
+	uint8_t length;
+};
+
+static const HuffmanCode HUFFMAN_CODES[256] = {
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28},
+	{0xfffffe4, 28}, {0xfffffe5, 28}, {0xfffffe6, 28}, {0xfffffe7, 28},
+	{0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28},
+	{0xfffffed, 28}, {0xfffffee, 28}, {0xfffffef, 28}, {0xffffff0, 28},
+	{0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28},
+	{0xffffff8, 28}, {0xffffff9, 28}, {0xffffffa, 28}, {0xffffffb, 28},
+	{0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11},
+	{0x3fa, 10}, {0x3fb, 10}, {0xf9, 8}, {0x7fb, 11},
+	{0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6},
+	{0x1a, 6}, {0x1b, 6}, {0x1c, 6}, {0x1d, 6},
+	{0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10},
+	{0x1ffa, 13}, {0x21, 6}, {0x5d, 7}, {0x5e, 7},
+	{0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7},
+	{0x67, 7}, {0x68, 7}, {0x69, 7}, {0x6a, 7},
+	{0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7},
+	{0xfc, 8}, {0x73, 7}, {0xfd, 8}, {0x1ffb, 13},
+	{0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5},
+	{0x24, 6}, {0x5, 5}, {0x25, 6}, {0x26, 6},
+	{0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5},
+	{0x2b, 6}, {0x76, 7}, {0x2c, 6}, {0x8, 5},
+	{0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15},
+	{0x7fc, 11}, {0x3ffd, 14}, {0x1ffd, 13}, {0xffffffc, 28},
+	{0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23},
+	{0x3fffd6, 22}, {0x7fffda, 23}, {0x7fffdb, 23}, {0x7fffdc, 23},
+	{0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23},
+	{0xffffee, 24}, {0x7fffe1, 23}, {0x7fffe2, 23}, {0x7fffe3, 23},
+	{0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24},
+	{0x3fffda, 22}, {0x1fffdd, 21}, {0xfffe9, 20}, {0x3fffdb, 22},
+	{0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24},
+	{0x1fffdf, 21}, {0x3fffdf, 22}, {0x7fffeb, 23}, {0x7fffec, 23},
+	{0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23},
+	{0xfffea, 20}, {0x3fffe2, 22}, {0x3fffe3, 22}, {0x3fffe4, 22},
+	{0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19},
+	{0x3fffe7, 22}, {0x7ffff2, 23}, {0x3fffe8, 22}, {0x1ffffec, 25},
+	{0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25},
+	{0x7fff2, 19}, {0x1fffe3, 21}, {0x3ffffe6, 26}, {0x7ffffe0, 27},
+	{0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26},
+	{0xffffffd, 28}, {0x7ffffe3, 27}, {0x7ffffe4, 27}, {0x7ffffe5, 27},
+	{0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23},
+	{0x3fffea, 22}, {0x3fffeb, 22}, {0x1ffffee, 25}, {0x1ffffef, 25},
+	{0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26},
+	{0x7ffffe7, 27}, {0x7ffffe8, 27}, {0x7ffffe9, 27}, {0x7ffffea, 27},
+	{0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26},
+};
+
+const HpackHeader* HpackTable::get(uint64_t index) const {
+	if (index == 0) {
+		return nullptr;
+	}
+	if (index <= STATIC_TABLE_SIZE) {
+		return &STATIC_TABLE[index - 1];
+	}
+	if (index - STATIC_TABLE_SIZE <= entries.size()) {
+		return &entries[index - STATIC_TABLE_SIZE - 1];
+	}
+	return nullptr;
+}
+
+void HpackTable::add(string name, string value) {
+	size_t entry_size = name.size() + value.size() + ENTRY_OVERHEAD;
+	if (entry_size > max_size) {
+		evictDownTo(0);
+		return;
+	}
+
+	evictDownTo(max_size - entry_size);
+	entries.push_front(HpackHeader{std::move(name), std::move(value)});
+	size += entry_size;
+}
+
+void HpackTable::setMaxSize(size_t new_max_size) {
+	max_size = new_max_size;
+	evictDownTo(max_size);
+}
+
+void HpackTable::evictDownTo(size_t target_size) {
+	while (size > target_size) {
+		const HpackHeader& oldest = entries.back();
+		size -= oldest.name.size() + oldest.value.size() + ENTRY_OVERHEAD;
+		entries.pop_back();
+	}
+}
+
+uint64_t HpackTable::find(const string& name, const string& value, bool& value_matched) const {
+	uint64_t name_index = 0;
+	value_matched = false;
+
+	for (size_t i = 0; i < STATIC_TABLE_SIZE; i++) {
+		if (STATIC_TABLE[i].name != name) continue;
+		if (STATIC_TABLE[i].value == value) {
+			value_matched = true;
+			return i + 1;
+		}
+		if (name_index == 0) name_index = i + 1;
+	}
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		if (entries[i].name != name) continue;
+		if (entries[i].value == value) {
+			value_matched = true;
+			return STATIC_TABLE_SIZE + i + 1;
+		}
+		if (name_index == 0) name_index = STATIC_TABLE_SIZE + i + 1;
+	}
+
+	return name_index;
+}
+
+void hpackEncodeInteger(string& out, uint8_t flags, int prefix_bits, uint64_t value) {
+	uint64_t max_prefix = (1u << prefix_bits) - 1;
+	if (value < max_prefix) {
+		out += char(flags | value);
+		return;
+	}
+
+	out += char(flags | max_prefix);
+	value -= max_prefix;
+	while (value >= 128) {
+		out += char(0x80 | (value & 0x7f));
+		value >>= 7;
+	}
+	out += char(value);
+}
+
+/**
+ * Reads an HPACK integer with the given prefix size off the front of in.
+ *
+ * @return false if the integer is truncated or absurdly large.
+ */
+static bool decodeInteger(string_view& in, int prefix_bits, uint64_t& value) {
+	if (in.empty()) return false;
+
+	uint64_t max_prefix = (1u << prefix_bits) - 1;
+	value = uint8_t(in[0]) & max_prefix;
+	in.remove_prefix(1);
+	if (value < max_prefix) {
+		return true;
+	}
+
+	for (int shift = 0; shift <= 28; shift += 7) {
+		if (in.empty()) return false;
+		uint8_t byte = in[0];
+		in.remove_prefix(1);
+		value += uint64_t(byte & 0x7f) << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * Reads a string literal (plain or Huffman-coded) off the front of in.
+ */
+static bool decodeString(string_view& in, string& out) {
+	if (in.empty()) return false;
+	bool huffman = in[0] & 0x80;
+
+	uint64_t length;
+	if (!decodeInteger(in, 7, length) || length > in.size()) {
+		return false;
+	}
+
+	string_view data = in.substr(0, length);
+	in.remove_prefix(length);
+
+	out.clear();
+	if (huffman) {
+		return hpackHuffmanDecode(data, out);
+	}
+	out.assign(data);
+	return true;
+}
+
+/**
+ * Binary tree of the Huffman code, built on first use. Leaves have no
+ * children and hold a symbol.
+ */
+struct HuffmanNode {
+	int16_t children[2] = {-1, -1};
+	int16_t symbol = -1;
+};
+
+static const std::vector<HuffmanNode>& huffmanTree() {
+	static const std::vector<HuffmanNode> tree = [] {
+		std::vector<HuffmanNode> nodes(1);
+		for (int symbol = 0; symbol < 256; symbol++) {
+			const HuffmanCode& code = HUFFMAN_CODES[symbol];
+			int node = 0;
+			for (int bit = code.length - 1; bit >= 0; bit--) {
+				int branch = (code.code >> bit) & 1;
+				if (nodes[node].children[branch] == -1) {
+					nodes[node].children[branch] = nodes.size();
+					nodes.push_back(HuffmanNode());
+				}
+				node = nodes[node].children[branch];
+			}
+			nodes[node].symbol = symbol;
+		}
+		return nodes;
+	}();
+	return tree;
+}
+
+bool hpackHuffmanDecode(string_view in, string& out) {
+	const std::vector<HuffmanNode>& tree = huffmanTree();
+
+	int node = 0;
+	int bits_since_symbol = 0;
+	bool all_ones = true;
+
+	for (unsigned char byte : in) {
+		for (int bit = 7; bit >= 0; bit--) {
+			int branch = (byte >> bit) & 1;
+			node = tree[node].children[branch];
+			if (node == -1) {
+				return false; // only EOS (which may not appear) gets here
+			}
+
+			bits_since_symbol++;
+			all_ones = all_ones && branch == 1;
+
+			if (tree[node].symbol != -1) {
+				out += char(tree[node].symbol);
+				node = 0;
+				bits_since_symbol = 0;
+				all_ones = true;
+			}
+		}
+	}
+
+	// the padding has to be a (strict) prefix of EOS, i.e. under 8 one bits
+	return bits_since_symbol < 8 && all_ones;
+}
+
+HpackDecoder::HpackDecoder(size_t max_table_size, size_t max_header_list_size) :
+		table(max_table_size), max_table_size(max_table_size),
+		max_header_list_size(max_header_list_size) {}
+
+bool HpackDecoder::decode(string_view block, std::vector<HpackHeader>& headers) {
+	size_t list_size = 0;
+	bool at_start = true;
+
+	while (!block.empty()) {
+		uint8_t first = block[0];
+		HpackHeader header;
+
+		if (first & 0x80) {
+			// indexed header field
+			uint64_t index;
+			if (!decodeInteger(block, 7, index)) return false;
+
+			const HpackHeader *entry = table.get(index);
+			if (entry == nullptr) return false;
+			header = *entry;
+		}
+		else if ((first & 0xe0) == 0x20) {
+			// dynamic table size update, only allowed before any header
+			uint64_t new_size;
+			if (!decodeInteger(block, 5, new_size)) return false;
+			if (!at_start || new_size > max_table_size) return false;
+			table.setMaxSize(new_size);
+			continue;
+		}
+		else {
+			// literal, with incremental indexing (01), without indexing (0000)
+			// or never indexed (0001)
+			bool add_to_table = (first & 0xc0) == 0x40;
+			int prefix_bits = add_to_table ? 6 : 4;
+
+			uint64_t name_index;
+			if (!decodeInteger(block, prefix_bits, name_index)) return false;
+
+			if (name_index == 0) {
+				if (!decodeString(block, header.name)) return false;
+			}
+			else {
+				const HpackHeader *entry = table.get(name_index);
+				if (entry == nullptr) return false;
+				header.name = entry->name;
+			}
+			if (!decodeString(block, header.value)) return false;
+
+			if (add_to_table) {
+				table.add(header.name, header.value);
+			}
+		}
+
+		at_start = false;
+		list_size += header.name.size() + header.value.size() + ENTRY_OVERHEAD;
+		if (list_size > max_header_list_size) {
+			return false;
+		}
+		headers.push_back(std::move(header));
+	}
+	return true;
+}
+
+HpackEncoder::HpackEncoder(size_t max_table_size) :
+		table(max_table_size), max_table_size(max_table_size) {}
+
+void HpackEncoder::setPeerTableSize(size_t size) {
+	size_t new_size = std::min(size, max_table_size);
+	if (new_size != table.getMaxSize()) {
+		table.setMaxSize(new_size);
+		size_update_pending = true;
+	}
+}
+
+void HpackEncoder::encode(string& out, const std::vector<HpackHeader>& headers,
+		const std::vector<string_view>& no_index) {
+	if (size_update_pending) {
+		hpackEncodeInteger(out, 0x20, 5, table.getMaxSize());
+		size_update_pending = false;
+	}
+
+	for (const HpackHeader& header : headers) {
+		bool value_matched;
+		uint64_t index = table.find(header.name, header.value, value_matched);
+
+		if (value_matched) {
+			hpackEncodeInteger(out, 0x80, 7, index);
+			continue;
+		}
+
+		bool add_to_table = true;
+		for (string_view name : no_index) {
+			if (header.name == name) add_to_table = false;
+		}
+
+		// literal (not Huffman-coded: not worth the CPU for our few headers)
+		if (add_to_table) {
+			hpackEncodeInteger(out, 0x40, 6, index);
+		}
+		else {
+			hpackEncodeInteger(out, 0x00, 4, index);
+		}
+		if (index == 0) {
+			hpackEncodeInteger(out, 0x00, 7, header.name.size());
+			out += header.name;
+		}
+		hpackEncodeInteger(out, 0x00, 7, header.value.size());
+		out += header.value;
+
+		if (add_to_table) {
+			table.add(header.name, header.value);
+		}
+	}
+}
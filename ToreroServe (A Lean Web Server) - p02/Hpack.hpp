@@ -0,0 +1,133 @@
+#ifndef HPACK_HPP
+#define HPACK_HPP
+
+/**
+ * File: Hpack.hpp
+ *
+ * HPACK (RFC 7541), the header compression used by HTTP/2: the shared
+ * static + dynamic table, a decoder for the requests' header blocks and an
+ * encoder for the responses' ones.
+ */
+
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+struct HpackHeader {
+	std::string name;
+	std::string value;
+};
+
+/**
+ * The static table followed by a dynamic table whose total size (as defined
+ * by HPACK: name + value + 32 per entry) is kept under a maximum by evicting
+ * the oldest entries.
+ */
+class HpackTable {
+	public:
+		static const size_t STATIC_TABLE_SIZE = 61;
+
+		HpackTable(size_t max_size) : max_size(max_size) {}
+
+		/**
+		 * @param index The 1-based HPACK index (static entries first).
+		 * @return The entry, or nullptr if there is no such index.
+		 */
+		const HpackHeader* get(uint64_t index) const;
+
+		/**
+		 * Inserts an entry at the front of the dynamic table. An entry bigger
+		 * than the whole table just empties it.
+		 */
+		void add(std::string name, std::string value);
+
+		void setMaxSize(size_t new_max_size);
+		size_t getMaxSize() const { return max_size; }
+
+		/**
+		 * Looks for an entry with the given name and value, or else just the
+		 * given name.
+		 *
+		 * @param value_matched Set to whether the value matched too.
+		 * @return The index of the entry, or 0 if the name isn't there.
+		 */
+		uint64_t find(const std::string& name, const std::string& value, bool& value_matched) const;
+
+	private:
+		std::deque<HpackHeader> entries; // newest first
+		size_t size = 0;
+		size_t max_size;
+
+		void evictDownTo(size_t target_size);
+};
+
+class HpackDecoder {
+	public:
+		/**
+		 * @param max_table_size The table size we allow the peer to use (our
+		 * SETTINGS_HEADER_TABLE_SIZE).
+		 * @param max_header_list_size Most decoded bytes a header block may
+		 * produce (counted like the table size).
+		 */
+		HpackDecoder(size_t max_table_size, size_t max_header_list_size);
+
+		/**
+		 * Decodes a complete header block.
+		 *
+		 * @param block The block (all fragments joined together).
+		 * @param headers Vector that the decoded headers are appended to.
+		 * @return false on a compression error, after which the decoder is
+		 * out of sync with the peer and the connection has to be closed.
+		 */
+		bool decode(std::string_view block, std::vector<HpackHeader>& headers);
+
+	private:
+		HpackTable table;
+		size_t max_table_size;
+		size_t max_header_list_size;
+};
+
+class HpackEncoder {
+	public:
+		HpackEncoder(size_t max_table_size);
+
+		/**
+		 * Applies the peer's SETTINGS_HEADER_TABLE_SIZE. We never use more
+		 * than the size we started with, but have to shrink if asked to.
+		 */
+		void setPeerTableSize(size_t size);
+
+		/**
+		 * Encodes a header block. Headers are added to the dynamic table
+		 * unless index is false for them, so that e.g. a repeated
+		 * Content-Type costs a single byte.
+		 *
+		 * @param out String that the block is appended to.
+		 * @param headers The headers to encode.
+		 * @param no_index Names of headers whose values rarely repeat.
+		 */
+		void encode(std::string& out, const std::vector<HpackHeader>& headers,
+				const std::vector<std::string_view>& no_index);
+
+	private:
+		HpackTable table;
+		size_t max_table_size;
+		bool size_update_pending = false;
+};
+
+/**
+ * Appends an HPACK integer whose first byte has prefix_bits bits available,
+ * the other bits of that byte being given by flags.
+ */
+void hpackEncodeInteger(std::string& out, uint8_t flags, int prefix_bits, uint64_t value);
+
+/**
+ * Decodes a Huffman-coded string literal.
+ *
+ * @return false if the input isn't valid Huffman code (including bad padding).
+ */
+bool hpackHuffmanDecode(std::string_view in, std::string& out);
+#endif
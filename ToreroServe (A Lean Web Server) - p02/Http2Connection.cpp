@@ -0,0 +1,690 @@
+/**
+ * File: Http2Connection.cpp
+ *
+ * Implementation of the Http2Connection class.
+ * See the associated header file (Http2Connection.hpp) for the declaration
+ * of this class.
+ */
+
+// operating system specific libraries
+#include <unistd.h>
+
+// C++ standard library
+#include <algorithm>
+#include <cctype>
+#include <utility>
+
+#include "Http2Connection.hpp"
+#include "torero-serve.hpp"
+#include "LargeFile.hpp"
+
+using std::string;
+using std::string_view;
+using std::vector;
+
+// frame types
+enum FrameType : uint8_t {
+	DATA = 0x0,
+	HEADERS = 0x1,
+	PRIORITY = 0x2,
+	RST_STREAM = 0x3,
+	SETTINGS = 0x4,
+	PUSH_PROMISE = 0x5,
+	PING = 0x6,
+	GOAWAY = 0x7,
+	WINDOW_UPDATE = 0x8,
+	CONTINUATION = 0x9,
+};
+
+// frame flags
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+// settings
+static const uint16_t SETTINGS_HEADER_TABLE_SIZE = 0x1;
+static const uint16_t SETTINGS_ENABLE_PUSH = 0x2;
+static const uint16_t SETTINGS_MAX_CONCURRENT_STREAMS = 0x3;
+static const uint16_t SETTINGS_INITIAL_WINDOW_SIZE = 0x4;
+static const uint16_t SETTINGS_MAX_FRAME_SIZE = 0x5;
+static const uint16_t SETTINGS_MAX_HEADER_LIST_SIZE = 0x6;
+
+// error codes
+static const uint32_t NO_ERROR = 0x0;
+static const uint32_t PROTOCOL_ERROR = 0x1;
+static const uint32_t INTERNAL_ERROR = 0x2;
+static const uint32_t FLOW_CONTROL_ERROR = 0x3;
+static const uint32_t FRAME_SIZE_ERROR = 0x6;
+static const uint32_t REFUSED_STREAM = 0x7;
+static const uint32_t COMPRESSION_ERROR = 0x9;
+static const uint32_t ENHANCE_YOUR_CALM = 0xb;
+
+static const int64_t MAX_WINDOW_SIZE = 0x7fffffff;
+
+static const size_t FRAME_HEADER_SIZE = 9;
+
+static uint32_t readUint32(const char* p) {
+	const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+	return uint32_t(u[0]) << 24 | uint32_t(u[1]) << 16 | uint32_t(u[2]) << 8 | u[3];
+}
+
+static void appendUint32(string& out, uint32_t value) {
+	out += char(value >> 24);
+	out += char(value >> 16);
+	out += char(value >> 8);
+	out += char(value);
+}
+
+static void writeFrameHeader(char* p, size_t length, uint8_t type, uint8_t flags, uint32_t stream_id) {
+	p[0] = char(length >> 16);
+	p[1] = char(length >> 8);
+	p[2] = char(length);
+	p[3] = char(type);
+	p[4] = char(flags);
+	p[5] = char(stream_id >> 24);
+	p[6] = char(stream_id >> 16);
+	p[7] = char(stream_id >> 8);
+	p[8] = char(stream_id);
+}
+
+/**
+ * Turns the serialized HTTP/1 header of a response into HTTP/2 headers: the
+ * status code becomes :status, names are lowercased, and headers that are
+ * specific to HTTP/1 connections are left out.
+ *
+ * @param chunked Set to whether the body is in the chunked format (which the
+ * left out Transfer-Encoding said).
+ */
+static vector<HpackHeader> convertHeader(string_view header, bool& chunked) {
+	vector<HpackHeader> headers;
+
+	size_t line_end = header.find("\r\n");
+	size_t status_start = header.find(' ');
+	headers.push_back(HpackHeader{":status", string(header.substr(status_start + 1, 3))});
+
+	while (line_end != string::npos) {
+		size_t line_start = line_end + 2;
+		line_end = header.find("\r\n", line_start);
+		if (line_end == string::npos || line_end == line_start) break;
+
+		size_t colon = header.find(':', line_start);
+		if (colon == string::npos || colon > line_end) continue;
+
+		string name(header.substr(line_start, colon - line_start));
+		std::transform(name.begin(), name.end(), name.begin(),
+				[](unsigned char c) { return std::tolower(c); });
+		size_t value_start = header.find_first_not_of(' ', colon + 1);
+		string value(header.substr(value_start, line_end - value_start));
+		if (name == "transfer-encoding") {
+			chunked = value.find("chunked") != string::npos;
+			continue;
+		}
+		if (name == "connection" || name == "keep-alive") {
+			continue;
+		}
+		headers.push_back(HpackHeader{name, std::move(value)});
+	}
+	return headers;
+}
+
+Http2Connection::Http2Connection(uint32_t client_address) :
+		client_address(client_address), decoder(HEADER_TABLE_SIZE, MAX_HEADER_LIST_SIZE), encoder(HEADER_TABLE_SIZE) {
+	string settings;
+	settings += char(SETTINGS_MAX_CONCURRENT_STREAMS >> 8);
+	settings += char(SETTINGS_MAX_CONCURRENT_STREAMS);
+	appendUint32(settings, MAX_CONCURRENT_STREAMS);
+	settings += char(SETTINGS_MAX_HEADER_LIST_SIZE >> 8);
+	settings += char(SETTINGS_MAX_HEADER_LIST_SIZE);
+	appendUint32(settings, MAX_HEADER_LIST_SIZE);
+	appendFrame(control, SETTINGS, 0, 0, settings);
+}
+
+Http2Connection::~Http2Connection() {
+	for (auto& [stream_id, stream] : streams) {
+		if (stream.response.file_fd != -1) {
+			close(stream.response.file_fd);
+		}
+	}
+}
+
+bool Http2Connection::looksLikePreface(std::span<const char> data) {
+	size_t length = std::min(data.size(), PREFACE.size());
+	return length >= 3 && string_view(data.data(), length) == PREFACE.substr(0, length);
+}
+
+void Http2Connection::receive(std::span<const char> data) {
+	if (going_away) return;
+	input.append(data.data(), data.size());
+
+	size_t pos = 0;
+	if (!preface_received) {
+		size_t length = std::min(input.size(), PREFACE.size());
+		if (string_view(input).substr(0, length) != PREFACE.substr(0, length)) {
+			connectionError(PROTOCOL_ERROR);
+			return;
+		}
+		if (input.size() < PREFACE.size()) return;
+
+		preface_received = true;
+		pos = PREFACE.size();
+	}
+
+	while (!going_away && input.size() - pos >= FRAME_HEADER_SIZE) {
+		const char *p = input.data() + pos;
+		uint32_t length = readUint32(p) >> 8;
+		if (length > MAX_FRAME_SIZE) {
+			connectionError(FRAME_SIZE_ERROR);
+			break;
+		}
+		if (input.size() - pos < FRAME_HEADER_SIZE + length) break;
+
+		uint8_t type = p[3];
+		uint8_t flags = p[4];
+		uint32_t stream_id = readUint32(p + 5) & 0x7fffffff;
+		handleFrame(type, flags, stream_id, string_view(p + FRAME_HEADER_SIZE, length));
+
+		pos += FRAME_HEADER_SIZE + length;
+	}
+
+	input.erase(0, pos);
+}
+
+void Http2Connection::handleFrame(uint8_t type, uint8_t flags, uint32_t stream_id,
+		string_view payload) {
+	// nothing may come between the frames of a header block
+	if (header_stream_id != 0 && type != CONTINUATION) {
+		connectionError(PROTOCOL_ERROR);
+		return;
+	}
+
+	switch (type) {
+		case DATA:
+			handleData(flags, stream_id, payload);
+			break;
+
+		case HEADERS:
+		case CONTINUATION:
+			handleHeaders(type == HEADERS ? flags : flags & FLAG_END_HEADERS,
+					type == HEADERS ? stream_id : stream_id | 0x80000000, payload);
+			break;
+
+		case PRIORITY:
+			if (payload.size() != 5) connectionError(FRAME_SIZE_ERROR);
+			break; // we don't prioritize, every stream gets its turn
+
+		case RST_STREAM:
+			if (stream_id == 0) connectionError(PROTOCOL_ERROR);
+			else if (payload.size() != 4) connectionError(FRAME_SIZE_ERROR);
+			else closeStream(stream_id);
+			break;
+
+		case SETTINGS:
+			handleSettings(flags, stream_id, payload);
+			break;
+
+		case PUSH_PROMISE:
+			connectionError(PROTOCOL_ERROR); // clients can't push
+			break;
+
+		case PING:
+			if (stream_id != 0) connectionError(PROTOCOL_ERROR);
+			else if (payload.size() != 8) connectionError(FRAME_SIZE_ERROR);
+			else if (!(flags & FLAG_ACK)) appendFrame(control, PING, FLAG_ACK, 0, payload);
+			break;
+
+		case GOAWAY:
+			peer_going_away = true;
+			break;
+
+		case WINDOW_UPDATE:
+			handleWindowUpdate(stream_id, payload);
+			break;
+
+		default:
+			break; // unknown frame types are ignored
+	}
+}
+
+/**
+ * Handles a HEADERS frame, or a CONTINUATION frame (whose stream ID is then
+ * tagged with the high bit, which a real stream ID never has).
+ */
+void Http2Connection::handleHeaders(uint8_t flags, uint32_t stream_id, string_view payload) {
+	bool continuation = stream_id & 0x80000000;
+	stream_id &= 0x7fffffff;
+
+	if (continuation) {
+		if (header_stream_id == 0 || stream_id != header_stream_id) {
+			connectionError(PROTOCOL_ERROR);
+			return;
+		}
+	}
+	else {
+		if (stream_id == 0) {
+			connectionError(PROTOCOL_ERROR);
+			return;
+		}
+
+		if (flags & FLAG_PADDED) {
+			if (payload.empty() || uint8_t(payload[0]) >= payload.size()) {
+				connectionError(PROTOCOL_ERROR);
+				return;
+			}
+			size_t pad_length = uint8_t(payload[0]);
+			payload = payload.substr(1, payload.size() - 1 - pad_length);
+		}
+		if (flags & FLAG_PRIORITY) {
+			if (payload.size() < 5) {
+				connectionError(PROTOCOL_ERROR);
+				return;
+			}
+			payload.remove_prefix(5);
+		}
+
+		header_stream_id = stream_id;
+		header_end_stream = flags & FLAG_END_STREAM;
+		header_block.clear();
+	}
+
+	if (header_block.size() + payload.size() > MAX_HEADER_BLOCK_SIZE) {
+		connectionError(ENHANCE_YOUR_CALM);
+		return;
+	}
+	header_block.append(payload);
+
+	if (!(flags & FLAG_END_HEADERS)) {
+		return;
+	}
+	header_stream_id = 0;
+
+	// the block has to be decoded even if we ignore it, to keep the tables in sync
+	vector<HpackHeader> headers;
+	if (!decoder.decode(header_block, headers)) {
+		connectionError(COMPRESSION_ERROR);
+		return;
+	}
+
+	if (stream_id <= last_stream_id) {
+		return; // trailers of a request we already answered
+	}
+	if (stream_id % 2 == 0) {
+		connectionError(PROTOCOL_ERROR); // client streams are odd
+		return;
+	}
+	last_stream_id = stream_id;
+
+	if (streams.size() >= MAX_CONCURRENT_STREAMS) {
+		resetStream(stream_id, REFUSED_STREAM);
+		return;
+	}
+	handleRequest(stream_id, headers);
+}
+
+void Http2Connection::handleData(uint8_t flags, uint32_t stream_id, string_view payload) {
+	if (stream_id == 0) {
+		connectionError(PROTOCOL_ERROR);
+		return;
+	}
+
+	// request bodies are ignored, but they still count against our windows,
+	// so give the space right back
+	if (!payload.empty()) {
+		string increment;
+		appendUint32(increment, payload.size());
+		appendFrame(control, WINDOW_UPDATE, 0, 0, increment);
+		if (!(flags & FLAG_END_STREAM) && streams.count(stream_id) > 0) {
+			appendFrame(control, WINDOW_UPDATE, 0, stream_id, increment);
+		}
+	}
+}
+
+void Http2Connection::handleSettings(uint8_t flags, uint32_t stream_id, string_view payload) {
+	if (stream_id != 0) {
+		connectionError(PROTOCOL_ERROR);
+		return;
+	}
+	if (flags & FLAG_ACK) {
+		if (!payload.empty()) connectionError(FRAME_SIZE_ERROR);
+		return;
+	}
+	if (payload.size() % 6 != 0) {
+		connectionError(FRAME_SIZE_ERROR);
+		return;
+	}
+
+	for (size_t pos = 0; pos < payload.size(); pos += 6) {
+		uint16_t id = uint16_t(uint8_t(payload[pos])) << 8 | uint8_t(payload[pos + 1]);
+		uint32_t value = readUint32(payload.data() + pos + 2);
+
+		switch (id) {
+			case SETTINGS_HEADER_TABLE_SIZE:
+				encoder.setPeerTableSize(value);
+				break;
+
+			case SETTINGS_ENABLE_PUSH:
+				if (value > 1) {
+					connectionError(PROTOCOL_ERROR);
+					return;
+				}
+				break;
+
+			case SETTINGS_INITIAL_WINDOW_SIZE: {
+				if (value > MAX_WINDOW_SIZE) {
+					connectionError(FLOW_CONTROL_ERROR);
+					return;
+				}
+
+				// applies to the windows of all open streams, retroactively
+				int64_t delta = int64_t(value) - peer_initial_window;
+				peer_initial_window = value;
+				for (auto& [id, stream] : streams) {
+					stream.send_window += delta;
+					if (stream.send_window > MAX_WINDOW_SIZE) {
+						connectionError(FLOW_CONTROL_ERROR);
+						return;
+					}
+					queueStream(id, stream);
+				}
+				break;
+			}
+
+			case SETTINGS_MAX_FRAME_SIZE:
+				if (value < 16384 || value > 16777215) {
+					connectionError(PROTOCOL_ERROR);
+					return;
+				}
+				peer_max_frame_size = value;
+				break;
+
+			default:
+				break; // nothing else affects what we send
+		}
+	}
+
+	appendFrame(control, SETTINGS, FLAG_ACK, 0, "");
+}
+
+void Http2Connection::handleWindowUpdate(uint32_t stream_id, string_view payload) {
+	if (payload.size() != 4) {
+		connectionError(FRAME_SIZE_ERROR);
+		return;
+	}
+
+	int64_t increment = readUint32(payload.data()) & 0x7fffffff;
+	if (stream_id == 0) {
+		connection_window += increment;
+		if (increment == 0 || connection_window > MAX_WINDOW_SIZE) {
+			connectionError(increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+		}
+		return;
+	}
+
+	auto it = streams.find(stream_id);
+	if (it == streams.end()) {
+		return; // the stream is already done
+	}
+
+	Stream& stream = it->second;
+	stream.send_window += increment;
+	if (increment == 0 || stream.send_window > MAX_WINDOW_SIZE) {
+		resetStream(stream_id, increment == 0 ? PROTOCOL_ERROR : FLOW_CONTROL_ERROR);
+		return;
+	}
+	queueStream(stream_id, stream);
+}
+
+/**
+ * Answers a request whose headers are complete.
+ */
+void Http2Connection::handleRequest(uint32_t stream_id, const vector<HpackHeader>& headers) {
+	// every stream is a request of its own as far as the rate limit goes
+	if (!std::exchange(first_request, false) && !admitRequest(client_address)) {
+		sendResponse(stream_id, respondWith429());
+		return;
+	}
+
+	string method;
+	string path;
+	for (const HpackHeader& header : headers) {
+		if (header.name == ":method") method = header.value;
+		else if (header.name == ":path") path = header.value;
+	}
+
+	// an empty resource makes buildResponse answer with the rejection, as
+	// with HTTP/1
+	HttpRequest request;
+	if (!method.empty() && method != "GET") {
+		request.rejection = 405;
+	}
+	else if (!path.empty() && path[0] == '/') {
+		setTarget(request, path);
+	}
+
+	sendResponse(stream_id, buildResponse(request));
+}
+
+void Http2Connection::sendResponse(uint32_t stream_id, HttpResponse response) {
+	Stream& stream = streams[stream_id];
+	stream.response = std::move(response);
+	stream.send_window = peer_initial_window;
+
+	bool chunked = false;
+	vector<HpackHeader> headers = convertHeader(stream.response.headerData(), chunked);
+
+	// HTTP/2 has its own framing, so a chunked body (e.g. a proxied one) is
+	// sent as just the contents of its chunks
+	if (chunked) {
+		HttpResponse& r = stream.response;
+		auto unchunked = std::make_unique<UnchunkedBody>(std::move(r.stream));
+		auto start = std::make_shared<string>();
+		unchunked->decode(r.bodyData(), *start);
+		r.body = std::move(start);
+		r.stream = std::move(unchunked);
+	}
+
+	bool has_body = hasMoreData(stream);
+	sendHeaders(stream_id, headers, !has_body);
+
+	if (has_body) {
+		queueStream(stream_id, stream);
+	}
+	else {
+		closeStream(stream_id);
+	}
+}
+
+void Http2Connection::sendHeaders(uint32_t stream_id, const vector<HpackHeader>& headers,
+		bool end_stream) {
+	static const vector<string_view> no_index = {"content-length"};
+
+	string block;
+	encoder.encode(block, headers, no_index);
+
+	// split into HEADERS + CONTINUATION frames if it doesn't fit in one
+	string_view rest = block;
+	bool first = true;
+	do {
+		string_view fragment = rest.substr(0, peer_max_frame_size);
+		rest.remove_prefix(fragment.size());
+
+		uint8_t flags = rest.empty() ? FLAG_END_HEADERS : 0;
+		if (first && end_stream) flags |= FLAG_END_STREAM;
+
+		appendFrame(control, first ? HEADERS : CONTINUATION, flags, stream_id, fragment);
+		first = false;
+	} while (!rest.empty());
+}
+
+/**
+ * Tells whether the stream has more body to send, pulling the next piece out
+ * of a streamed body if needed (so that the last DATA frame can carry
+ * END_STREAM).
+ */
+bool Http2Connection::hasMoreData(Stream& stream) {
+	HttpResponse& r = stream.response;
+	if (stream.body_sent < r.bodyData().size()) return true;
+	if (stream.piece_sent < stream.piece.size()) return true;
+
+	while (r.stream) {
+		stream.piece.clear();
+		stream.piece_sent = 0;
+		if (!r.stream->next(stream.piece)) {
+			r.stream.reset();
+		}
+		else if (!stream.piece.empty()) {
+			return true;
+		}
+	}
+
+	return r.file_length > 0;
+}
+
+/**
+ * Appends one DATA frame for the stream, as big as its turn and the flow
+ * control windows allow.
+ *
+ * @return Whether the stream has more to send afterwards.
+ */
+bool Http2Connection::sendData(uint32_t stream_id, Stream& stream, string& out) {
+	HttpResponse& r = stream.response;
+
+	// a SETTINGS_INITIAL_WINDOW_SIZE decrease can leave a window negative
+	size_t limit = std::max<int64_t>(0, std::min<int64_t>({int64_t(DATA_QUANTUM),
+			int64_t(peer_max_frame_size), stream.send_window, connection_window}));
+
+	size_t frame_start = out.size();
+	out.append(FRAME_HEADER_SIZE, '\0');
+
+	size_t length = 0;
+	while (length < limit && hasMoreData(stream)) {
+		size_t room = limit - length;
+
+		std::string_view body = r.bodyData();
+		if (stream.body_sent < body.size()) {
+			size_t n = std::min(room, body.size() - stream.body_sent);
+			out.append(body.data() + stream.body_sent, n);
+			stream.body_sent += n;
+			length += n;
+		}
+		else if (stream.piece_sent < stream.piece.size()) {
+			size_t n = std::min(room, stream.piece.size() - stream.piece_sent);
+			out.append(stream.piece, stream.piece_sent, n);
+			stream.piece_sent += n;
+			length += n;
+		}
+		else {
+			size_t n = std::min(room, r.file_length);
+			size_t old_size = out.size();
+			out.resize(old_size + n);
+			ssize_t num_read = pread(r.file_fd, &out[old_size], n, r.file_offset);
+			if (num_read <= 0) {
+				// the file shrank under us; all we can do is give up on the stream
+				out.resize(frame_start);
+				resetStream(stream_id, INTERNAL_ERROR);
+				return false;
+			}
+			out.resize(old_size + num_read);
+			if (r.drop_behind) dropPassedPages(r.file_fd, r.file_offset, r.file_offset + num_read);
+			r.file_offset += num_read;
+			r.file_length -= num_read;
+			length += num_read;
+		}
+	}
+
+	bool more = hasMoreData(stream);
+	writeFrameHeader(&out[frame_start], length, DATA, more ? 0 : FLAG_END_STREAM, stream_id);
+
+	stream.send_window -= length;
+	connection_window -= length;
+	return more;
+}
+
+void Http2Connection::produce(string& out, size_t max_bytes) {
+	out += control;
+	control.clear();
+
+	while (out.size() < max_bytes && connection_window > 0 && !ready.empty()) {
+		uint32_t stream_id = ready.front();
+		ready.pop_front();
+
+		auto it = streams.find(stream_id);
+		if (it == streams.end()) continue; // reset by the client
+
+		Stream& stream = it->second;
+		stream.queued = false;
+
+		// its window shrank while it waited (SETTINGS_INITIAL_WINDOW_SIZE): it
+		// sits out until a WINDOW_UPDATE queues it again
+		if (stream.send_window <= 0) continue;
+
+		if (sendData(stream_id, stream, out)) {
+			queueStream(stream_id, stream);
+		}
+		else {
+			closeStream(stream_id);
+		}
+	}
+}
+
+void Http2Connection::goAway() {
+	connectionError(NO_ERROR);
+}
+
+bool Http2Connection::wantsWrite() const {
+	return !control.empty() || (connection_window > 0 && !ready.empty());
+}
+
+bool Http2Connection::finished() const {
+	if (!control.empty()) return false;
+	return going_away || (peer_going_away && streams.empty());
+}
+
+/**
+ * Puts the stream at the back of the ready queue, unless it is already in
+ * it or has to wait for a WINDOW_UPDATE.
+ */
+void Http2Connection::queueStream(uint32_t stream_id, Stream& stream) {
+	if (!stream.queued && stream.send_window > 0) {
+		ready.push_back(stream_id);
+		stream.queued = true;
+	}
+}
+
+void Http2Connection::closeStream(uint32_t stream_id) {
+	auto it = streams.find(stream_id);
+	if (it == streams.end()) return;
+
+	if (it->second.response.file_fd != -1) {
+		close(it->second.response.file_fd);
+	}
+	streams.erase(it);
+}
+
+void Http2Connection::appendFrame(string& out, uint8_t type, uint8_t flags, uint32_t stream_id,
+		string_view payload) {
+	size_t frame_start = out.size();
+	out.resize(frame_start + FRAME_HEADER_SIZE);
+	writeFrameHeader(&out[frame_start], payload.size(), type, flags, stream_id);
+	out.append(payload);
+}
+
+void Http2Connection::resetStream(uint32_t stream_id, uint32_t error_code) {
+	string payload;
+	appendUint32(payload, error_code);
+	appendFrame(control, RST_STREAM, 0, stream_id, payload);
+	closeStream(stream_id);
+}
+
+void Http2Connection::connectionError(uint32_t error_code) {
+	if (going_away) return;
+
+	string payload;
+	appendUint32(payload, last_stream_id);
+	appendUint32(payload, error_code);
+	appendFrame(control, GOAWAY, 0, 0, payload);
+
+	going_away = true;
+	ready.clear();
+}
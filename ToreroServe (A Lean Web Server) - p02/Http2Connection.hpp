@@ -0,0 +1,158 @@
+#ifndef HTTP2CONNECTION_HPP
+#define HTTP2CONNECTION_HPP
+
+/**
+ * File: Http2Connection.hpp
+ *
+ * Header file for the Http2Connection class.
+ */
+
+#include <deque>
+#include <map>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+
+#include "Hpack.hpp"
+#include "HttpResponse.hpp"
+
+/**
+ * The server side of one HTTP/2 connection (RFC 9113), without any I/O of
+ * its own: whoever drives it feeds it the bytes received from the client
+ * and sends out the bytes it produces. That way the same code runs over a
+ * plain socket, over TLS, on a worker thread or in a coroutine.
+ *
+ * Every request is answered with the same buildResponse as HTTP/1, as soon
+ * as its headers are complete. The response header is sent right away and
+ * the bodies of all open streams are then interleaved a frame (at most
+ * DATA_QUANTUM bytes) at a time, round-robin, as far as the flow control
+ * windows allow. A big file therefore never holds up the small ones
+ * requested after it on the same connection.
+ */
+class Http2Connection {
+	public:
+		static constexpr std::string_view PREFACE = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+
+		/**
+		 * @param client_address The client's IPv4 address, which every
+		 * request after the first is checked against the rate limit with (the
+		 * first was admitted along with the connection).
+		 */
+		Http2Connection(uint32_t client_address);
+		~Http2Connection();
+
+		Http2Connection(const Http2Connection&) = delete;
+		void operator=(const Http2Connection&) = delete;
+
+		/**
+		 * Tells whether the given first bytes of a connection are (the start
+		 * of) the HTTP/2 connection preface.
+		 */
+		static bool looksLikePreface(std::span<const char> data);
+
+		/**
+		 * Processes bytes received from the client, which starts with the
+		 * connection preface. Incomplete frames are kept until the rest
+		 * arrives.
+		 */
+		void receive(std::span<const char> data);
+
+		/**
+		 * Appends the frames that are ready to go out to out: pending control
+		 * frames and response headers first, then DATA frames until about
+		 * max_bytes have been produced or the flow control windows are used up.
+		 */
+		void produce(std::string& out, size_t max_bytes);
+
+		/**
+		 * Starts closing the connection gracefully (GOAWAY without an error),
+		 * e.g. when it has been idle for too long.
+		 */
+		void goAway();
+
+		/**
+		 * @return Whether produce would produce anything right now.
+		 */
+		bool wantsWrite() const;
+
+		/**
+		 * @return Whether the connection is done (after a GOAWAY) and
+		 * everything it had to send has been produced.
+		 */
+		bool finished() const;
+
+	private:
+		// limits we announce in our SETTINGS
+		static const uint32_t MAX_CONCURRENT_STREAMS = 100;
+		static const uint32_t MAX_HEADER_LIST_SIZE = 16384;
+		static const uint32_t HEADER_TABLE_SIZE = 4096;
+
+		// frames we accept are at most the default SETTINGS_MAX_FRAME_SIZE
+		static const uint32_t MAX_FRAME_SIZE = 16384;
+
+		// most bytes a header block may take, CONTINUATION frames included
+		static const size_t MAX_HEADER_BLOCK_SIZE = 65536;
+
+		// most bytes of DATA a stream sends before the next stream's turn
+		static const size_t DATA_QUANTUM = 16384;
+
+		struct Stream {
+			HttpResponse response;
+			int64_t send_window;
+			bool queued = false; // whether it is in the ready queue
+
+			size_t body_sent = 0;
+			std::string piece;   // latest piece produced by response.stream
+			size_t piece_sent = 0;
+		};
+
+		uint32_t client_address;
+		bool first_request = true;
+
+		std::string input;
+		bool preface_received = false;
+
+		// frames to send before any more DATA
+		std::string control;
+
+		std::map<uint32_t, Stream> streams;
+		std::deque<uint32_t> ready; // streams that can send DATA, in turn order
+		uint32_t last_stream_id = 0;
+
+		// header block being put together from HEADERS + CONTINUATION frames
+		uint32_t header_stream_id = 0;
+		bool header_end_stream = false;
+		std::string header_block;
+
+		int64_t connection_window = 65535;
+		int64_t peer_initial_window = 65535;
+		uint32_t peer_max_frame_size = 16384;
+
+		HpackDecoder decoder;
+		HpackEncoder encoder;
+
+		bool going_away = false;      // we sent (or are sending) GOAWAY
+		bool peer_going_away = false; // the client sent GOAWAY
+
+		void handleFrame(uint8_t type, uint8_t flags, uint32_t stream_id, std::string_view payload);
+		void handleHeaders(uint8_t flags, uint32_t stream_id, std::string_view payload);
+		void handleData(uint8_t flags, uint32_t stream_id, std::string_view payload);
+		void handleSettings(uint8_t flags, uint32_t stream_id, std::string_view payload);
+		void handleWindowUpdate(uint32_t stream_id, std::string_view payload);
+		void handleRequest(uint32_t stream_id, const std::vector<HpackHeader>& headers);
+
+		void sendResponse(uint32_t stream_id, HttpResponse response);
+		void sendHeaders(uint32_t stream_id, const std::vector<HpackHeader>& headers, bool end_stream);
+		bool sendData(uint32_t stream_id, Stream& stream, std::string& out);
+		bool hasMoreData(Stream& stream);
+		void queueStream(uint32_t stream_id, Stream& stream);
+		void closeStream(uint32_t stream_id);
+
+		void appendFrame(std::string& out, uint8_t type, uint8_t flags, uint32_t stream_id,
+				std::string_view payload);
+		void resetStream(uint32_t stream_id, uint32_t error_code);
+		void connectionError(uint32_t error_code);
+};
+#endif
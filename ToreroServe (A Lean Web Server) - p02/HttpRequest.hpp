@@ -0,0 +1,27 @@
+#ifndef HTTPREQUEST_HPP
+#define HTTPREQUEST_HPP
+
+/**
+ * File: HttpRequest.hpp
+ *
+ * The parts of an HTTP request line that the server cares about.
+ */
+
+#include <string>
+
+struct HttpRequest {
+	// path part of the requested resource (e.g. "/misc/"); empty if the
+	// request can't be served
+	std::string resource;
+
+	// what a request without a resource gets: 400 (malformed), 403 (a path
+	// climbing out of WWW) or 405 (a method other than GET)
+	int rejection = 400;
+
+	// everything after the '?' in the requested resource, if there was one
+	std::string query;
+
+	// the X in "HTTP/1.X"
+	int minor_version = 0;
+};
+#endif
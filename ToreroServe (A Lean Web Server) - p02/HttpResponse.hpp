@@ -0,0 +1,83 @@
+#ifndef HTTPRESPONSE_HPP
+#define HTTPRESPONSE_HPP
+
+/**
+ * File: HttpResponse.hpp
+ *
+ * Descriptor for a fully resolved HTTP response that is ready to be written
+ * to a client.
+ */
+
+#include <string>
+#include <string_view>
+#include <memory>
+#include <cstdlib>
+#include <sys/types.h>
+
+#include "BodySource.hpp"
+#include "RateLimiter.hpp"
+
+/**
+ * A response is made of a serialized header followed by an optional body. The
+ * body is an in-memory buffer (generated HTML or cached file data), a region
+ * of an open file, or a stream that produces the body while it is being sent.
+ * A streamed body may follow an in-memory one (e.g. the part that was
+ * already generated while deciding whether to stream).
+ *
+ * Workers only build these descriptors; the ResponseWriter is responsible for
+ * actually streaming them out and for closing file_fd when it is done.
+ */
+struct HttpResponse {
+	std::string header;
+
+	// header that outlives every response (e.g. a prebuilt error response's,
+	// see ErrorResponses), used when there is no header above
+	std::string_view static_header;
+
+	// in-memory body (may be shared with a cache, hence the shared_ptr)
+	std::shared_ptr<const std::string> body;
+
+	// in-memory body that outlives every response (e.g. a mapping shared
+	// by all processes), used when there is no body above
+	std::string_view static_body;
+
+	// file body, only used when file_fd is not -1
+	int file_fd = -1;
+	off_t file_offset = 0;
+	size_t file_length = 0;
+
+	// a large file: drop its pages from the page cache once they have been
+	// sent (see LargeFile.hpp)
+	bool drop_behind = false;
+
+	// streamed body, sent after the in-memory body (if any)
+	std::unique_ptr<BodySource> stream;
+
+	// the client's connection slot with the rate limiter (if it has one),
+	// given back once the response is done with
+	RateLimiter::Slot client_slot;
+
+	/**
+	 * @return The in-memory body, whichever of the two kinds it is.
+	 */
+	std::string_view bodyData() const {
+		return body ? std::string_view(*body) : static_body;
+	}
+
+	/**
+	 * @return The header, whichever of the two kinds it is.
+	 */
+	std::string_view headerData() const {
+		return header.empty() ? static_header : std::string_view(header);
+	}
+
+	/**
+	 * @return The status code, or 0 if there is no header ("HTTP/1.0 200 OK":
+	 * the code always starts at the same spot).
+	 */
+	int status() const {
+		std::string_view data = headerData();
+		return data.size() > 12 ? atoi(data.data() + 9) : 0;
+	}
+};
+#endif
@@ -0,0 +1,214 @@
+/**
+ * File: IoUring.cpp
+ *
+ * Implementation of the IoUring class.
+ * See the associated header file (IoUring.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "IoUring.hpp"
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+	return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+	return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void* arg, unsigned nr_args) {
+	return syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+IoUring::IoUring(unsigned entries) : sqe_tail(0) {
+	struct io_uring_params params;
+	memset(&params, 0, sizeof(params));
+
+	// only this thread submits, which lets the kernel skip some locking
+	params.flags = IORING_SETUP_SINGLE_ISSUER;
+	ring_fd = io_uring_setup(entries, &params);
+	if (ring_fd < 0 && errno == EINVAL) {
+		// older kernel: try again without the optional flag
+		memset(&params, 0, sizeof(params));
+		ring_fd = io_uring_setup(entries, &params);
+	}
+	if (ring_fd < 0) {
+		perror("Creating io_uring failed");
+		exit(1);
+	}
+
+	sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+	sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// with IORING_FEAT_SINGLE_MMAP both rings live in the same mapping
+	bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+	if (single_mmap) {
+		if (cq_ring_size > sq_ring_size) sq_ring_size = cq_ring_size;
+		cq_ring_size = sq_ring_size;
+	}
+
+	sq_ring_ptr = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+	cq_ring_ptr = single_mmap ? sq_ring_ptr : mmap(nullptr, cq_ring_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+	sqes = static_cast<struct io_uring_sqe*>(mmap(nullptr, sqes_size,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+	if (sq_ring_ptr == MAP_FAILED || cq_ring_ptr == MAP_FAILED || sqes == MAP_FAILED) {
+		perror("Mapping io_uring failed");
+		exit(1);
+	}
+
+	char *sq = static_cast<char*>(sq_ring_ptr);
+	sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+	sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+	sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+	sq_entries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+	sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+	char *cq = static_cast<char*>(cq_ring_ptr);
+	cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+	cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+	cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+	cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+	sqe_tail = *sq_tail;
+}
+
+IoUring::~IoUring() {
+	munmap(sqes, sqes_size);
+	if (cq_ring_ptr != sq_ring_ptr) munmap(cq_ring_ptr, cq_ring_size);
+	munmap(sq_ring_ptr, sq_ring_size);
+	close(ring_fd);
+}
+
+void IoUring::reserve(unsigned count) {
+	unsigned head;
+	while (sqe_tail - (head = __atomic_load_n(sq_head, __ATOMIC_ACQUIRE)) + count > sq_entries) {
+		submit();
+
+		// the kernel may take nothing for the moment (EBUSY, EAGAIN), and
+		// until it does the queued SQEs' places can't be handed out again
+		if (__atomic_load_n(sq_head, __ATOMIC_ACQUIRE) == head) {
+			sched_yield();
+		}
+	}
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+	reserve(1);
+
+	unsigned index = sqe_tail & sq_mask;
+	struct io_uring_sqe *sqe = &sqes[index];
+	memset(sqe, 0, sizeof(*sqe));
+
+	sq_array[index] = index;
+	sqe_tail++;
+	return sqe;
+}
+
+int IoUring::submitAndWait(unsigned min_complete) {
+	unsigned to_submit = sqe_tail - *sq_tail;
+
+	// publish the new SQEs before telling the kernel about them
+	__atomic_store_n(sq_tail, sqe_tail, __ATOMIC_RELEASE);
+
+	if (to_submit == 0 && min_complete == 0) {
+		return 0;
+	}
+
+	unsigned flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0;
+	int ret;
+	do {
+		ret = io_uring_enter(ring_fd, to_submit, min_complete, flags);
+	} while (ret < 0 && errno == EINTR);
+
+	if (ret < 0 && errno != EBUSY && errno != EAGAIN) {
+		perror("io_uring_enter failed");
+		exit(1);
+	}
+	return ret;
+}
+
+struct io_uring_cqe* IoUring::peekCqe() {
+	unsigned head = *cq_head;
+	if (head == __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+		return nullptr;
+	}
+	return &cqes[head & cq_mask];
+}
+
+void IoUring::advanceCq(unsigned count) {
+	__atomic_store_n(cq_head, *cq_head + count, __ATOMIC_RELEASE);
+}
+
+void IoUring::registerOrExit(unsigned opcode, void* arg, unsigned nr_args, const char* what) {
+	if (io_uring_register(ring_fd, opcode, arg, nr_args) < 0) {
+		perror(what);
+		exit(1);
+	}
+}
+
+bool IoUring::registerBuffers(const struct iovec* buffers, unsigned count) {
+	return io_uring_register(ring_fd, IORING_REGISTER_BUFFERS,
+			const_cast<struct iovec*>(buffers), count) == 0;
+}
+
+void IoUring::registerSparseFiles(unsigned count) {
+	struct io_uring_rsrc_register reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.nr = count;
+	reg.flags = IORING_RSRC_REGISTER_SPARSE;
+
+	registerOrExit(IORING_REGISTER_FILES2, &reg, sizeof(reg),
+			"Registering io_uring files failed");
+}
+
+struct io_uring_buf_ring* IoUring::setupBufferRing(uint16_t group, unsigned entries) {
+	size_t ring_size = entries * sizeof(struct io_uring_buf);
+	void *ring = mmap(nullptr, ring_size, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (ring == MAP_FAILED) {
+		perror("Allocating io_uring buffer ring failed");
+		exit(1);
+	}
+
+	struct io_uring_buf_reg reg;
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+	reg.ring_entries = entries;
+	reg.bgid = group;
+
+	registerOrExit(IORING_REGISTER_PBUF_RING, &reg, 1,
+			"Registering io_uring buffer ring failed");
+
+	return static_cast<struct io_uring_buf_ring*>(ring);
+}
+
+void IoUring::provideBuffer(struct io_uring_buf_ring* ring, unsigned entries,
+		void* addr, unsigned length, uint16_t buffer_id) {
+	unsigned short tail = ring->tail;
+
+	// not ring->bufs: in C++ the header's flex array macro adds an empty
+	// struct in front of it, which shifts every entry by 8 bytes
+	struct io_uring_buf *bufs = reinterpret_cast<struct io_uring_buf*>(ring);
+	struct io_uring_buf *buf = &bufs[tail & (entries - 1)];
+
+	buf->addr = reinterpret_cast<uint64_t>(addr);
+	buf->len = length;
+	buf->bid = buffer_id;
+
+	__atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+}
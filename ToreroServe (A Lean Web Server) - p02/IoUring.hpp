@@ -0,0 +1,128 @@
+#ifndef IOURING_HPP
+#define IOURING_HPP
+
+/**
+ * File: IoUring.hpp
+ *
+ * Header file for the IoUring class.
+ */
+
+#include <cstdint>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/**
+ * Thin wrapper around a single io_uring instance, talking to the kernel
+ * directly through the io_uring system calls (so no liburing needed).
+ *
+ * The ring is meant to be used from a single thread: SQEs are handed out
+ * with getSqe, sent to the kernel with submit, and completions are read back
+ * with peekCqe/advanceCq.
+ */
+class IoUring {
+	public:
+		/**
+		 * Creates a ring with room for the given number of submissions.
+		 * Exits the program if io_uring isn't available.
+		 */
+		IoUring(unsigned entries);
+		~IoUring();
+
+		IoUring(const IoUring&) = delete;
+		void operator=(const IoUring&) = delete;
+
+		/**
+		 * Returns a cleared SQE to fill in. If the submission queue is full,
+		 * whatever is in it is submitted first to make room.
+		 */
+		struct io_uring_sqe* getSqe();
+
+		/**
+		 * Makes room for the given number of SQEs, submitting whatever is
+		 * queued first if there isn't enough, and waiting until the kernel
+		 * has taken it. Call this before the first SQE of a linked chain,
+		 * with the length of the chain: a chain only holds within a single
+		 * submission, so getSqe must not submit half of it.
+		 */
+		void reserve(unsigned count);
+
+		/**
+		 * Submits all queued SQEs and waits until at least min_complete
+		 * completions are available.
+		 *
+		 * @return The number of SQEs submitted.
+		 */
+		int submitAndWait(unsigned min_complete);
+		int submit() { return submitAndWait(0); }
+
+		/**
+		 * @return The oldest completion not yet consumed, or nullptr if there
+		 * is none.
+		 */
+		struct io_uring_cqe* peekCqe();
+
+		/**
+		 * Marks the given number of completions as consumed.
+		 */
+		void advanceCq(unsigned count);
+
+		/**
+		 * Registers buffers, so that fixed reads (READ_FIXED) into them skip
+		 * mapping the user pages on every operation.
+		 *
+		 * @return false if they couldn't be registered (e.g. because they
+		 * would go over RLIMIT_MEMLOCK).
+		 */
+		bool registerBuffers(const struct iovec* buffers, unsigned count);
+
+		/**
+		 * Registers an empty table of the given size for direct (fixed) file
+		 * descriptors, which operations like openat can fill in.
+		 */
+		void registerSparseFiles(unsigned count);
+
+		/**
+		 * Creates and registers a provided-buffer ring for the given buffer
+		 * group. The kernel picks a buffer from it when a recv is submitted
+		 * with IOSQE_BUFFER_SELECT, so buffers are only tied up while data is
+		 * actually waiting.
+		 *
+		 * @param group The buffer group ID.
+		 * @param entries Number of ring entries (a power of 2).
+		 * @return The ring, to be filled in with provideBuffer.
+		 */
+		struct io_uring_buf_ring* setupBufferRing(uint16_t group, unsigned entries);
+
+		/**
+		 * Hands a buffer (back) to a provided-buffer ring.
+		 */
+		static void provideBuffer(struct io_uring_buf_ring* ring, unsigned entries,
+				void* addr, unsigned length, uint16_t buffer_id);
+
+	private:
+		int ring_fd;
+
+		// submission queue
+		unsigned *sq_head;
+		unsigned *sq_tail;
+		unsigned sq_mask;
+		unsigned sq_entries;
+		unsigned *sq_array;
+		struct io_uring_sqe *sqes;
+		unsigned sqe_tail; // SQEs handed out, but not yet published to the kernel
+
+		// completion queue
+		unsigned *cq_head;
+		unsigned *cq_tail;
+		unsigned cq_mask;
+		struct io_uring_cqe *cqes;
+
+		void *sq_ring_ptr;
+		size_t sq_ring_size;
+		void *cq_ring_ptr;
+		size_t cq_ring_size;
+		size_t sqes_size;
+
+		void registerOrExit(unsigned opcode, void* arg, unsigned nr_args, const char* what);
+};
+#endif
@@ -0,0 +1,158 @@
+/**
+ * File: LargeFile.cpp
+ *
+ * Implementation of the large file helpers (see LargeFile.hpp).
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+// C++ standard library
+#include <algorithm>
+
+#include "LargeFile.hpp"
+
+// pages are dropped a step at a time, this far behind the download (about
+// what socket buffers and in-flight splices can still be holding on to)
+static const off_t DROP_STEP = 8 * 1024 * 1024;
+static const off_t DROP_LAG = 8 * 1024 * 1024;
+
+void dropPassedPages(int file_fd, off_t old_offset, off_t new_offset) {
+	off_t old_step = old_offset / DROP_STEP;
+	off_t new_step = new_offset / DROP_STEP;
+	if (new_step == old_step) return;
+
+	// everything behind is dropped again, since pages that were still
+	// being sent the last time around are skipped by the kernel (finding no
+	// pages where they are already gone is cheap)
+	off_t end = new_step * DROP_STEP - DROP_LAG;
+	if (end > 0) {
+		posix_fadvise(file_fd, 0, end, POSIX_FADV_DONTNEED);
+	}
+}
+
+DirectFileBody::Signal::Signal() : event_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {}
+
+DirectFileBody::Signal::~Signal() {
+	if (event_fd >= 0) close(event_fd);
+}
+
+DirectFileBody::DirectFileBody(int file_fd, size_t length) : file_fd(file_fd), remaining(length) {
+	signal = std::make_shared<Signal>();
+	buffers[0] = static_cast<char*>(aligned_alloc(ALIGNMENT, READ_SIZE));
+	buffers[1] = static_cast<char*>(aligned_alloc(ALIGNMENT, READ_SIZE));
+	if (remaining > 0) {
+		startRead();
+	}
+}
+
+DirectFileBody::~DirectFileBody() {
+	// the kernel (or glibc's AIO thread) may still be writing into a buffer
+	if (reading && aio_cancel(file_fd, &request) == AIO_NOTCANCELED) {
+		finishRead();
+	}
+	free(buffers[0]);
+	free(buffers[1]);
+	close(file_fd);
+}
+
+/**
+ * Called (on a thread of glibc's) once a read is done: signals the eventfd,
+ * and lets go of the read's reference to it.
+ */
+void DirectFileBody::notify(union sigval value) {
+	auto signal = static_cast<std::shared_ptr<Signal>*>(value.sival_ptr);
+	uint64_t one = 1;
+	if (write((*signal)->event_fd, &one, sizeof(one)) < 0) {
+		// only fails if the counter is about to overflow, i.e. it's signalled
+	}
+	delete signal;
+}
+
+/**
+ * Starts reading the next block into the current buffer.
+ */
+void DirectFileBody::startRead() {
+	memset(&request, 0, sizeof(request));
+	request.aio_fildes = file_fd;
+	request.aio_buf = buffers[current];
+	request.aio_nbytes = READ_SIZE;
+	request.aio_offset = read_offset;
+
+	if (signal->event_fd >= 0) {
+		request.aio_sigevent.sigev_notify = SIGEV_THREAD;
+		request.aio_sigevent.sigev_notify_function = notify;
+		request.aio_sigevent.sigev_value.sival_ptr = new std::shared_ptr<Signal>(signal);
+	}
+	reading = aio_read(&request) == 0;
+	if (!reading && signal->event_fd >= 0) {
+		delete static_cast<std::shared_ptr<Signal>*>(request.aio_sigevent.sigev_value.sival_ptr);
+	}
+}
+
+/**
+ * Waits for the pending read.
+ *
+ * @return How many bytes it read, or -1 if it failed.
+ */
+ssize_t DirectFileBody::finishRead() {
+	const struct aiocb *requests[] = {&request};
+	while (aio_error(&request) == EINPROGRESS) {
+		aio_suspend(requests, 1, nullptr);
+	}
+	reading = false;
+	return aio_return(&request);
+}
+
+int DirectFileBody::makeNonBlocking() {
+	non_blocking = signal->event_fd >= 0;
+	return signal->event_fd;
+}
+
+bool DirectFileBody::next(std::string& out) {
+	if (remaining == 0 || !reading) return false;
+
+	if (non_blocking) {
+		// reset the eventfd before looking, so a read finishing right after
+		// the look still wakes the caller up
+		uint64_t count;
+		if (read(signal->event_fd, &count, sizeof(count)) < 0) {
+			// nothing was signalled yet
+		}
+		if (aio_error(&request) == EINPROGRESS) return true;
+	}
+
+	ssize_t num_read = finishRead();
+	if (num_read <= 0) {
+		// the file shrank (or the read failed); the body just ends early
+		remaining = 0;
+		return false;
+	}
+
+	size_t n = std::min(size_t(num_read), remaining);
+	char *data = buffers[current];
+	remaining -= n;
+	read_offset += num_read;
+
+	// a short read that isn't the end of the file would leave the next
+	// offset unaligned, so it has to be the last one
+	if (remaining > 0 && num_read % ALIGNMENT != 0) {
+		remaining = 0;
+	}
+
+	// get the next block coming before sending this one
+	current = 1 - current;
+	if (remaining > 0) {
+		startRead();
+	}
+
+	out.append(data, n);
+	return true;
+}
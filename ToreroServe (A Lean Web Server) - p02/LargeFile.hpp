@@ -0,0 +1,94 @@
+#ifndef LARGEFILE_HPP
+#define LARGEFILE_HPP
+
+/**
+ * File: LargeFile.hpp
+ *
+ * Helpers for sending files that are too big to be worth keeping in the page
+ * cache: read once, start to end, by a single download, they would only push
+ * the small, popular files out of it.
+ *
+ * There are two ways to send them:
+ *  - sendfile as usual, with the file marked POSIX_FADV_SEQUENTIAL (so the
+ *    kernel reads ahead further) and the pages the download is done with
+ *    dropped as it goes (see dropPassedPages);
+ *  - O_DIRECT reads that bypass the page cache altogether, into two aligned
+ *    buffers so that the next block is being read while the current one is
+ *    being sent (see DirectFileBody).
+ */
+
+#include <aio.h>
+#include <sys/types.h>
+#include <memory>
+#include <string>
+#include <cstddef>
+
+#include "BodySource.hpp"
+
+/**
+ * Drops the pages of a file that a download has moved past, once it crosses
+ * into a new step of the file. Pages just behind the cursor are left alone,
+ * since they may still be in the socket's buffers.
+ *
+ * @param file_fd The file.
+ * @param old_offset Where the download was.
+ * @param new_offset Where it is now.
+ */
+void dropPassedPages(int file_fd, off_t old_offset, off_t new_offset);
+
+/**
+ * Body that reads a file with O_DIRECT, double-buffered: the read of the next
+ * block is started (with POSIX AIO) before the current one is handed out.
+ * Each piece is a copy, but the file never goes through the page cache.
+ *
+ * Every read signals an eventfd when it completes, so that an event loop can
+ * wait for it (see makeNonBlocking) instead of blocking on a cold disk.
+ */
+class DirectFileBody : public BodySource {
+	public:
+		/**
+		 * Takes over a file opened with O_DIRECT (and closes it when done).
+		 *
+		 * @param file_fd The file.
+		 * @param length How many bytes of it to send, from the start.
+		 */
+		DirectFileBody(int file_fd, size_t length);
+		~DirectFileBody();
+
+		DirectFileBody(const DirectFileBody&) = delete;
+		void operator=(const DirectFileBody&) = delete;
+
+		bool next(std::string& out) override;
+		int makeNonBlocking() override;
+
+	private:
+		// O_DIRECT wants offsets, lengths and buffers aligned to the
+		// device's block size; 4096 covers every usual one
+		static const size_t ALIGNMENT = 4096;
+		static const size_t READ_SIZE = 1024 * 1024;
+
+		int file_fd;
+		size_t remaining; // bytes not handed out yet
+		off_t read_offset = 0; // where the next read starts
+
+		char *buffers[2];
+		int current = 0; // buffer the pending read goes into
+		struct aiocb request;
+		bool reading = false;
+		bool non_blocking = false;
+
+		// the eventfd that completed reads are signalled on, kept open by each
+		// read's notification until it has run (which may be after we're gone)
+		struct Signal {
+			int event_fd;
+			Signal();
+			~Signal();
+		};
+		std::shared_ptr<Signal> signal;
+
+		static void notify(union sigval value);
+
+		void startRead();
+		ssize_t finishRead();
+};
+#endif
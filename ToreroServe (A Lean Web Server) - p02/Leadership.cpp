@@ -0,0 +1,28 @@
+/**
+ * File: Leadership.cpp
+ *
+ * Implementation of the Leadership class.
+ * See the associated header file (Leadership.hpp) for the declaration of
+ * this class.
+ */
+
+#include "Leadership.hpp"
+
+void Leadership::becomeLeader() {
+	std::unique_lock<std::mutex> lock(shared_mutex);
+
+	while (has_leader) {
+		leader_needed.wait(lock);
+	}
+
+	has_leader = true;
+}
+
+void Leadership::promoteFollower() {
+	{
+		std::unique_lock<std::mutex> lock(shared_mutex);
+		has_leader = false;
+	}
+
+	leader_needed.notify_one();
+}
@@ -0,0 +1,41 @@
+#ifndef LEADERSHIP_HPP
+#define LEADERSHIP_HPP
+
+/**
+ * File: Leadership.hpp
+ *
+ * Header file for the Leadership class.
+ */
+
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * Class that makes sure only one thread at a time is the leader, for the
+ * leader/follower worker model.
+ *
+ * The leader is the only worker waiting in accept. As soon as it has a
+ * connection it promotes one of the followers to be the next leader and then
+ * handles the connection itself, so the connection never has to be handed to
+ * another thread.
+ */
+class Leadership {
+  public:
+	  Leadership() : has_leader(false) {};
+
+	  /**
+	   * Waits until there is no leader, then becomes the leader.
+	   */
+	  void becomeLeader();
+
+	  /**
+	   * Gives up leadership, waking up one of the followers to take over.
+	   */
+	  void promoteFollower();
+
+  private:
+	  bool has_leader;
+	  std::mutex shared_mutex;
+	  std::condition_variable leader_needed;
+};
+#endif
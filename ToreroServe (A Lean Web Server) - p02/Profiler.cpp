@@ -0,0 +1,189 @@
+/**
+ * File: Profiler.cpp
+ *
+ * Implementation of the Profiler and TimedLock classes, and the counting
+ * operator new. Empty unless TORERO_PROFILE is defined.
+ */
+
+#ifdef TORERO_PROFILE
+
+// operating system specific libraries
+#include <signal.h>
+#include <unistd.h>
+#include <time.h>
+
+// C standard library
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <atomic>
+#include <new>
+#include <thread>
+#include <iostream>
+
+#include "Profiler.hpp"
+
+// threads beyond this many all share the last slot
+static const int MAX_THREADS = 1024;
+
+/**
+ * Counters of one thread. Only that thread updates them (which is why the
+ * updates below are a load and a store rather than a locked add); the
+ * reporter only reads them.
+ */
+struct ThreadProfile {
+	const char *role = "thread";
+	std::atomic<uint64_t> requests{0};
+	std::atomic<uint64_t> allocations{0};
+	std::atomic<uint64_t> allocated_bytes{0};
+	std::atomic<uint64_t> locks{0};
+	std::atomic<uint64_t> lock_wait_ns{0};
+	std::atomic<uint64_t> lock_hold_ns{0};
+	std::atomic<uint64_t> condition_waits{0};
+	std::atomic<uint64_t> condition_wait_ns{0};
+};
+
+// a fixed array, since operator new can't allocate to make room for a thread
+static ThreadProfile profiles[MAX_THREADS];
+static std::atomic<int> num_profiles{0};
+static thread_local ThreadProfile *current = nullptr;
+
+static ThreadProfile& currentProfile() {
+	if (current == nullptr) {
+		current = &profiles[std::min(num_profiles.fetch_add(1), MAX_THREADS - 1)];
+	}
+	return *current;
+}
+
+static void add(std::atomic<uint64_t>& counter, uint64_t amount) {
+	counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+static uint64_t nanoseconds() {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void* operator new(size_t size) {
+	ThreadProfile& profile = currentProfile();
+	add(profile.allocations, 1);
+	add(profile.allocated_bytes, size);
+
+	void *memory = malloc(size == 0 ? 1 : size);
+	if (memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+	ThreadProfile& profile = currentProfile();
+	add(profile.allocations, 1);
+	add(profile.allocated_bytes, size);
+
+	void *memory;
+	if (posix_memalign(&memory, std::max(size_t(alignment), sizeof(void*)), size == 0 ? 1 : size) != 0) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+void operator delete(void* memory, std::align_val_t) noexcept { free(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept { free(memory); }
+
+void Profiler::nameThread(const char* role) {
+	currentProfile().role = role;
+}
+
+void Profiler::countRequest() {
+	add(currentProfile().requests, 1);
+}
+
+/**
+ * Prints a line per thread that did anything, and the totals.
+ */
+static void printSummary(std::ostream& out) {
+	char line[256];
+	snprintf(line, sizeof(line), "%-16s %9s %10s %12s %10s %10s %9s %10s %10s %9s %11s\n", "thread",
+			"requests", "allocs", "alloc bytes", "allocs/req", "bytes/req", "locks", "wait us",
+			"hold us", "cv waits", "cv wait ms");
+	out << "Profile of pid " << getpid() << ":\n" << line;
+
+	auto printLine = [&](const char* name, uint64_t requests, uint64_t allocations, uint64_t bytes,
+			uint64_t locks, uint64_t wait_ns, uint64_t hold_ns, uint64_t cv_waits, uint64_t cv_wait_ns) {
+		double per_request = requests > 0 ? 1.0 / requests : 0;
+		snprintf(line, sizeof(line), "%-16s %9lu %10lu %12lu %10.1f %10.0f %9lu %10.0f %10.0f %9lu %11.1f\n",
+				name, requests, allocations, bytes, allocations * per_request, bytes * per_request,
+				locks, wait_ns / 1e3, hold_ns / 1e3, cv_waits, cv_wait_ns / 1e6);
+		out << line;
+	};
+
+	uint64_t totals[8] = {};
+	int count = std::min(num_profiles.load(), MAX_THREADS);
+	for (int i = 0; i < count; i++) {
+		ThreadProfile& p = profiles[i];
+		uint64_t values[8] = {p.requests.load(), p.allocations.load(), p.allocated_bytes.load(),
+			p.locks.load(), p.lock_wait_ns.load(), p.lock_hold_ns.load(),
+			p.condition_waits.load(), p.condition_wait_ns.load()};
+		for (int v = 0; v < 8; v++) totals[v] += values[v];
+		if (values[0] == 0 && values[1] == 0 && values[3] == 0) continue; // idle threads
+
+		char name[32];
+		snprintf(name, sizeof(name), "%s #%d", p.role, i);
+		printLine(name, values[0], values[1], values[2], values[3], values[4], values[5],
+				values[6], values[7]);
+	}
+	printLine("total", totals[0], totals[1], totals[2], totals[3], totals[4], totals[5],
+			totals[6], totals[7]);
+	out.flush();
+}
+
+void Profiler::startReporter() {
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGUSR2);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+	std::thread([signals]() {
+		nameThread("reporter");
+		int signal_number;
+		while (sigwait(&signals, &signal_number) == 0) {
+			printSummary(std::cout);
+			if (signal_number != SIGUSR2) {
+				exit(0);
+			}
+		}
+	}).detach();
+}
+
+TimedLock::TimedLock(std::mutex& mutex) : lock(mutex, std::defer_lock) {
+	uint64_t start = nanoseconds();
+	lock.lock();
+	held_since = nanoseconds();
+
+	ThreadProfile& profile = currentProfile();
+	add(profile.locks, 1);
+	add(profile.lock_wait_ns, held_since - start);
+}
+
+TimedLock::~TimedLock() {
+	held_ns += nanoseconds() - held_since;
+	add(currentProfile().lock_hold_ns, held_ns);
+}
+
+void TimedLock::wait(std::condition_variable& condition) {
+	uint64_t start = nanoseconds();
+	held_ns += start - held_since;
+	condition.wait(lock);
+	held_since = nanoseconds();
+
+	ThreadProfile& profile = currentProfile();
+	add(profile.condition_waits, 1);
+	add(profile.condition_wait_ns, held_since - start);
+}
+
+#endif
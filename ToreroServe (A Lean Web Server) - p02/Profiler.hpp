@@ -0,0 +1,91 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+/**
+ * File: Profiler.hpp
+ *
+ * Header file for the Profiler class and the TimedLock class.
+ */
+
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+/**
+ * Allocation and lock contention counters, kept per thread, for profiling
+ * builds only (make torero-serve-profile, which defines TORERO_PROFILE). In
+ * normal builds every hook below is an empty inline function.
+ *
+ * What gets counted:
+ *  - every operator new, with its size (the profiling build replaces the
+ *    global operator new);
+ *  - requests, so that allocations can be put per request;
+ *  - for the locks taken through TimedLock (BoundedBuffer's): how long
+ *    threads waited to get them, how long they held them, and how long they
+ *    spent waiting on condition variables.
+ *
+ * The summary (one line per thread, plus totals) is printed on SIGUSR2 and
+ * at shutdown (SIGINT or SIGTERM).
+ */
+class Profiler {
+	public:
+#ifdef TORERO_PROFILE
+		static constexpr bool ENABLED = true;
+
+		/**
+		 * Names the current thread's role in the summary (e.g. "worker").
+		 *
+		 * @param role A string literal.
+		 */
+		static void nameThread(const char* role);
+
+		/**
+		 * Counts a request handled by the current thread.
+		 */
+		static void countRequest();
+
+		/**
+		 * Starts the thread that prints the summary on SIGUSR2 and at
+		 * shutdown. Must run before any other thread is started, so that
+		 * they all leave those signals to it.
+		 */
+		static void startReporter();
+#else
+		static constexpr bool ENABLED = false;
+
+		static void nameThread(const char*) {}
+		static void countRequest() {}
+		static void startReporter() {}
+#endif
+};
+
+/**
+ * A lock on a mutex (a std::unique_lock underneath) that, in profiling
+ * builds, times how long it took to get and how long it was held. Waits on
+ * condition variables go through wait, so that they count as waiting rather
+ * than holding.
+ */
+class TimedLock {
+	public:
+#ifdef TORERO_PROFILE
+		TimedLock(std::mutex& mutex);
+		~TimedLock();
+
+		void wait(std::condition_variable& condition);
+#else
+		TimedLock(std::mutex& mutex) : lock(mutex) {}
+
+		void wait(std::condition_variable& condition) { condition.wait(lock); }
+#endif
+
+		TimedLock(const TimedLock&) = delete;
+		void operator=(const TimedLock&) = delete;
+
+	private:
+		std::unique_lock<std::mutex> lock;
+#ifdef TORERO_PROFILE
+		uint64_t held_since;
+		uint64_t held_ns = 0;
+#endif
+};
+#endif
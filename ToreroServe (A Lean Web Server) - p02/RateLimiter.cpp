@@ -0,0 +1,155 @@
+/**
+ * File: RateLimiter.cpp
+ *
+ * Implementation of the RateLimiter class.
+ * See the associated header file (RateLimiter.hpp) for the declaration of
+ * this class.
+ */
+
+// C++ standard library
+#include <chrono>
+#include <iterator>
+#include <algorithm>
+
+#include "RateLimiter.hpp"
+
+RateLimiter::Slot& RateLimiter::Slot::operator=(Slot&& other) noexcept {
+	if (this != &other) {
+		if (limiter) limiter->release(address);
+		limiter = std::exchange(other.limiter, nullptr);
+		address = other.address;
+	}
+	return *this;
+}
+
+RateLimiter::Slot::~Slot() {
+	if (limiter) limiter->release(address);
+}
+
+RateLimiter::Shard& RateLimiter::shardOf(uint32_t address) {
+	// neighbouring addresses differ in their last byte, so mix before picking
+	return shards[(address * 2654435761u) >> 24 & (NUM_SHARDS - 1)];
+}
+
+/**
+ * Finds the address's entry (refilled up to now) or makes one, which either
+ * way ends up at the front of the shard's LRU list. The shard must be locked.
+ *
+ * @return The entry, or nullptr if the shard is full and no entry near its
+ * tail is free to be reused (every one has connections open).
+ */
+RateLimiter::Entry* RateLimiter::lookup(Shard& shard, uint32_t address) {
+	int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+
+	Entry *entry;
+	auto found = shard.index.find(address);
+	if (found != shard.index.end()) {
+		// move it to the front of the LRU list (no allocation involved)
+		shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+		entry = &*found->second;
+
+		// refill lazily, for all the time since it was last seen
+		double elapsed = (now - entry->last_seen) / 1e9;
+		entry->tokens = std::min(limits.burst,
+				entry->tokens + elapsed * limits.requests_per_second);
+		entry->last_seen = now;
+	}
+	else {
+		expire(shard, now);
+		if (shard.lru.size() < MAX_ENTRIES_PER_SHARD) {
+			shard.lru.push_front(Entry{address, 0, limits.burst, now});
+			shard.index.emplace(address, shard.lru.begin());
+		}
+		else {
+			// full: reuse the least recently used entry's nodes rather than
+			// allocating new ones, since this is what a flood of addresses
+			// hits. Entries with connections open are never reused (their
+			// count must survive until the connections are released); they
+			// go to the front, out of the way of the next search.
+			size_t num_searched = 0;
+			while (shard.lru.back().connections > 0) {
+				if (++num_searched > MAX_REUSE_SEARCH) return nullptr;
+				shard.lru.splice(shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+			}
+			auto node = shard.index.extract(shard.lru.back().address);
+			shard.lru.splice(shard.lru.begin(), shard.lru, std::prev(shard.lru.end()));
+			shard.lru.front() = Entry{address, 0, limits.burst, now};
+			node.key() = address;
+			shard.index.insert(std::move(node));
+		}
+		entry = &shard.lru.front();
+	}
+	return entry;
+}
+
+/**
+ * Takes a token from the entry's bucket, if there is a rate limit.
+ *
+ * @return false if the bucket is empty.
+ */
+bool RateLimiter::takeToken(Entry& entry) {
+	if (limits.requests_per_second > 0) {
+		if (entry.tokens < 1) return false;
+		entry.tokens -= 1;
+	}
+	return true;
+}
+
+bool RateLimiter::admit(uint32_t address, Slot& slot) {
+	Shard& shard = shardOf(address);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	// a shard full of clients with connections open has no room to track
+	// another one, so it is turned away like one over its limits
+	Entry *entry = lookup(shard, address);
+	if (entry == nullptr) return false;
+	if (limits.max_connections > 0 && entry->connections >= limits.max_connections) {
+		return false;
+	}
+	if (!takeToken(*entry)) return false;
+
+	entry->connections++;
+	slot = Slot();
+	slot.limiter = this;
+	slot.address = address;
+	return true;
+}
+
+bool RateLimiter::admitRequest(uint32_t address) {
+	if (limits.requests_per_second <= 0) return true;
+
+	Shard& shard = shardOf(address);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+	Entry *entry = lookup(shard, address);
+	return entry != nullptr && takeToken(*entry);
+}
+
+/**
+ * Drops the entries at the tail of the shard's LRU list that have been idle
+ * for long enough (and so would have a full bucket anyway).
+ */
+void RateLimiter::expire(Shard& shard, int64_t now) {
+	while (!shard.lru.empty()) {
+		Entry& oldest = shard.lru.back();
+		if (oldest.connections > 0 || now - oldest.last_seen <= IDLE_EXPIRY_NS) break;
+
+		shard.index.erase(oldest.address);
+		shard.lru.pop_back();
+	}
+}
+
+void RateLimiter::release(uint32_t address) {
+	Shard& shard = shardOf(address);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	// the entry may have been pushed out of a full shard in the meantime
+	auto found = shard.index.find(address);
+	if (found != shard.index.end() && found->second->connections > 0) {
+		// in a full shard, an entry that is free to be reused again goes where
+		// the search for one starts
+		if (--found->second->connections == 0 && shard.lru.size() >= MAX_ENTRIES_PER_SHARD) {
+			shard.lru.splice(shard.lru.end(), shard.lru, found->second);
+		}
+	}
+}
@@ -0,0 +1,119 @@
+#ifndef RATELIMITER_HPP
+#define RATELIMITER_HPP
+
+/**
+ * File: RateLimiter.hpp
+ *
+ * Header file for the RateLimiter class.
+ */
+
+#include <list>
+#include <mutex>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+#include <unordered_map>
+
+/**
+ * Class that keeps a single client address from hogging the server, by
+ * limiting both how many requests per second it gets (a token bucket per
+ * address) and how many connections it may have open at once.
+ *
+ * The buckets live in a hash table split into shards, each with its own lock,
+ * so threads checking different addresses rarely wait on each other. Buckets
+ * are only refilled when they are looked at (from the time since the last
+ * look), and each shard keeps its buckets in least recently used order so
+ * that idle ones can be dropped from the tail once the shard fills up or they
+ * have been idle for long enough. A client with connections open is never
+ * dropped (its count would be lost), so a shard that fills up with those
+ * turns new addresses away.
+ */
+class RateLimiter {
+	public:
+		struct Limits {
+			double requests_per_second = 0; // 0 means no rate limit
+			double burst = 1;               // most requests allowed back to back
+			unsigned max_connections = 0;   // 0 means no connection limit
+		};
+
+		/**
+		 * One of a client's connection slots, which is given back when this is
+		 * destroyed (i.e. when whoever owns the connection is done with it).
+		 */
+		class Slot {
+			public:
+				Slot() = default;
+				Slot(Slot&& other) noexcept :
+					limiter(std::exchange(other.limiter, nullptr)), address(other.address) {}
+				Slot& operator=(Slot&& other) noexcept;
+				~Slot();
+
+				Slot(const Slot&) = delete;
+				void operator=(const Slot&) = delete;
+
+			private:
+				friend class RateLimiter;
+				RateLimiter *limiter = nullptr;
+				uint32_t address = 0;
+		};
+
+		RateLimiter(Limits limits) : limits(limits) {};
+
+		RateLimiter(const RateLimiter&) = delete;
+		void operator=(const RateLimiter&) = delete;
+
+		/**
+		 * Decides whether a request from the given address may go ahead, taking
+		 * a token from its bucket and a connection slot if so.
+		 *
+		 * @param address The client's IPv4 address (as in sin_addr.s_addr).
+		 * @param slot Set to the connection slot taken for the client, which it
+		 * holds for as long as its connection is open.
+		 * @return false if the client is over one of its limits (or can't be
+		 * tracked, see above).
+		 */
+		bool admit(uint32_t address, Slot& slot);
+
+		/**
+		 * Decides whether one more request from an address that already holds
+		 * a connection slot may go ahead (e.g. another stream of its HTTP/2
+		 * connection), taking a token from its bucket if so.
+		 *
+		 * @param address The client's IPv4 address (as in sin_addr.s_addr).
+		 * @return false if the client is over its request rate.
+		 */
+		bool admitRequest(uint32_t address);
+
+	private:
+		static const size_t NUM_SHARDS = 64;           // must be a power of 2
+		static const size_t MAX_ENTRIES_PER_SHARD = 4096;
+		static const int64_t IDLE_EXPIRY_NS = 60'000'000'000;
+
+		// most entries with connections open skipped over when looking for
+		// one to reuse in a full shard
+		static const size_t MAX_REUSE_SEARCH = 16;
+
+		struct Entry {
+			uint32_t address;
+			unsigned connections;
+			double tokens;
+			int64_t last_seen; // steady clock time of the last refill, in ns
+		};
+
+		// padded to a cache line so that neighbouring locks don't share one
+		struct alignas(64) Shard {
+			std::mutex mutex;
+			std::list<Entry> lru; // most recently used first
+			std::unordered_map<uint32_t, std::list<Entry>::iterator> index;
+		};
+
+		Limits limits;
+		Shard shards[NUM_SHARDS];
+
+		Shard& shardOf(uint32_t address);
+		Entry* lookup(Shard& shard, uint32_t address);
+		bool takeToken(Entry& entry);
+		void expire(Shard& shard, int64_t now);
+		void release(uint32_t address);
+};
+#endif
@@ -0,0 +1,265 @@
+/**
+ * File: RequestReader.cpp
+ *
+ * Implementation of the RequestReader class.
+ * See the associated header file (RequestReader.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <utility>
+#include <algorithm>
+
+#include "RequestReader.hpp"
+#include "Profiler.hpp"
+
+// maximum number of events handled per call to epoll_wait
+static const int MAX_EVENTS = 64;
+
+// most bytes taken off a socket per recv
+static const size_t READ_CHUNK_SIZE = 4096;
+
+// statuses a client can be turned away with (0 means it's simply gone)
+static const int GONE = 0;
+static const int TOO_SLOW = 408;
+static const int TOO_BIG = 431;
+static const int OUT_OF_MEMORY = 503;
+
+/**
+ * Constructor that starts the given number of I/O threads, each with its own
+ * epoll instance, and of workers.
+ */
+RequestReader::RequestReader(int num_threads, int num_workers, Handler on_request, Rejecter on_reject)
+		: on_request(std::move(on_request)), on_reject(std::move(on_reject)) {
+	for (int i = 0; i < num_threads; i++) {
+		auto io = std::make_unique<IOThread>();
+
+		io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		io->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (io->epoll_fd < 0 || io->wakeup_fd < 0) {
+			perror("Creating request reader failed");
+			exit(1);
+		}
+
+		// a null data pointer marks the wakeup event
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->wakeup_fd, &ev);
+
+		io->thread = std::thread(&RequestReader::runIOThread, this, std::ref(*io));
+		io_threads.push_back(std::move(io));
+	}
+
+	for (int i = 0; i < num_workers; i++) {
+		workers.emplace_back(&RequestReader::runWorker, this);
+	}
+}
+
+void RequestReader::submit(ClientSocket client, std::string_view received, Clock::time_point started) {
+	PendingRead *pending = new PendingRead(client);
+
+	// what the client costs us no matter how much it sends
+	size_t capacity = std::max(received.size(), READ_CHUNK_SIZE);
+	if (!pending->reserved.grow(sizeof(PendingRead) + capacity)) {
+		delete pending;
+		on_reject(client, OUT_OF_MEMORY);
+		return;
+	}
+	pending->received.reserve(capacity);
+	pending->received.append(received);
+	pending->deadline = started + std::chrono::duration_cast<Clock::duration>(
+			std::chrono::duration<double>(HeaderBudget::limits().timeout_seconds));
+
+	IOThread& io = *io_threads[next_thread++ % io_threads.size()];
+	{
+		std::unique_lock<std::mutex> lock(io.incoming_mutex);
+		io.incoming.push_back(pending);
+	}
+	num_waiting++;
+
+	uint64_t one = 1;
+	if (write(io.wakeup_fd, &one, sizeof(one)) < 0) {
+		perror("Waking up request reader failed");
+	}
+}
+
+/**
+ * Takes whatever the client has sent since we last looked, and sees its
+ * request through to the handler (or the rejecter) once there's a verdict.
+ *
+ * @param io The I/O thread the client belongs to.
+ * @param pending The client.
+ */
+void RequestReader::readSome(IOThread& io, PendingRead* pending) {
+	const HeaderBudget::Limits& limits = HeaderBudget::limits();
+	std::string& received = pending->received;
+
+	while (true) {
+		char chunk[READ_CHUNK_SIZE];
+		// never more than it takes to go over the limit
+		ssize_t num_received = recv(pending->client.getFd(), chunk,
+				std::min(sizeof(chunk), limits.max_bytes + 1 - received.size()), MSG_DONTWAIT);
+		if (num_received < 0) {
+			if (errno == EINTR) continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+			finish(io, pending, GONE);
+			return;
+		}
+		if (num_received == 0) {
+			finish(io, pending, GONE);
+			return;
+		}
+
+		// grow the way a string would, but only with memory from the budget
+		size_t needed = received.size() + num_received;
+		size_t capacity = pending->reserved.size() - sizeof(PendingRead);
+		if (needed > capacity) {
+			size_t new_capacity = std::max(needed, std::min(2 * capacity, limits.max_bytes + READ_CHUNK_SIZE));
+			if (!pending->reserved.grow(new_capacity - capacity)) {
+				finish(io, pending, OUT_OF_MEMORY);
+				return;
+			}
+			received.reserve(new_capacity);
+		}
+
+		size_t checked = received.size();
+		received.append(chunk, num_received);
+
+		if (HeaderBudget::isComplete(received, checked)) {
+			// the request goes to a worker (keeping its memory reserved until
+			// it is handled); the client isn't this thread's after that
+			epoll_ctl(io.epoll_fd, EPOLL_CTL_DEL, pending->client.getFd(), nullptr);
+			io.by_deadline.erase(pending->position);
+			num_waiting--;
+			{
+				std::unique_lock<std::mutex> lock(complete_mutex);
+				complete.push_back(pending);
+			}
+			complete_available.notify_one();
+			return;
+		}
+		if (received.size() > limits.max_bytes) {
+			finish(io, pending, TOO_BIG);
+			return;
+		}
+	}
+}
+
+/**
+ * Gives up on a client: turns it away with a status (or just closes it if
+ * it's gone) and releases everything it held.
+ *
+ * @param io The I/O thread the client belongs to.
+ * @param pending The client.
+ * @param status The status to turn it away with, or GONE.
+ */
+void RequestReader::finish(IOThread& io, PendingRead* pending, int status) {
+	epoll_ctl(io.epoll_fd, EPOLL_CTL_DEL, pending->client.getFd(), nullptr);
+	io.by_deadline.erase(pending->position);
+	if (status == GONE) {
+		pending->client.close();
+	}
+	else {
+		on_reject(pending->client, status);
+	}
+	num_waiting--;
+	delete pending;
+}
+
+/**
+ * Body of a worker: handles complete requests as the I/O threads queue them.
+ */
+void RequestReader::runWorker() {
+	Profiler::nameThread("reader worker");
+	while (true) {
+		PendingRead *pending;
+		{
+			std::unique_lock<std::mutex> lock(complete_mutex);
+			complete_available.wait(lock, [this]() { return !complete.empty(); });
+			pending = complete.front();
+			complete.pop_front();
+		}
+
+		on_request(pending->client, pending->received);
+		delete pending;
+	}
+}
+
+/**
+ * Body of an I/O thread: waits for its clients to send more of their
+ * requests, until they're complete or the clients run out of time.
+ *
+ * @param io The state belonging to this I/O thread.
+ */
+void RequestReader::runIOThread(IOThread& io) {
+	Profiler::nameThread("reader");
+	struct epoll_event events[MAX_EVENTS];
+
+	while (true) {
+		// sleep no longer than until the next deadline
+		int timeout_ms = -1;
+		if (!io.by_deadline.empty()) {
+			auto left = io.by_deadline.front()->deadline - Clock::now();
+			timeout_ms = std::max(0L, long(std::chrono::ceil<std::chrono::milliseconds>(left).count()));
+		}
+
+		int num_events = epoll_wait(io.epoll_fd, events, MAX_EVENTS, timeout_ms);
+		if (num_events < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait failed");
+			exit(1);
+		}
+
+		for (int i = 0; i < num_events; i++) {
+			PendingRead *pending = static_cast<PendingRead*>(events[i].data.ptr);
+
+			if (pending == nullptr) {
+				// new clients were handed to us
+				uint64_t count;
+				while (read(io.wakeup_fd, &count, sizeof(count)) > 0);
+
+				std::vector<PendingRead*> incoming;
+				{
+					std::unique_lock<std::mutex> lock(io.incoming_mutex);
+					incoming.swap(io.incoming);
+				}
+
+				// what was sent since the worker looked is reported right
+				// away, as adding a ready socket counts as an edge
+				for (PendingRead *p : incoming) {
+					p->position = io.by_deadline.insert(io.by_deadline.end(), p);
+
+					struct epoll_event ev = {};
+					ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+					ev.data.ptr = p;
+					if (epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, p->client.getFd(), &ev) < 0) {
+						finish(io, p, GONE);
+					}
+				}
+				continue;
+			}
+
+			// a client is only ever in one event of a batch (we never add
+			// it twice), so it's safe to finish it right away
+			readSome(io, pending);
+		}
+
+		// turn away everyone whose time is up
+		Clock::time_point now = Clock::now();
+		while (!io.by_deadline.empty() && io.by_deadline.front()->deadline <= now) {
+			finish(io, io.by_deadline.front(), TOO_SLOW);
+		}
+	}
+}
@@ -0,0 +1,127 @@
+#ifndef REQUESTREADER_HPP
+#define REQUESTREADER_HPP
+
+/**
+ * File: RequestReader.hpp
+ *
+ * Header file for the RequestReader class.
+ */
+
+#include <list>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <string_view>
+#include <condition_variable>
+
+#include "ClientSocket.hpp"
+#include "HeaderBudget.hpp"
+
+/**
+ * The counterpart of the ResponseWriter for the other end of a request:
+ * a small set of I/O threads that wait for the rest of requests that didn't
+ * arrive in one piece, so that a client sending its request slowly (on
+ * purpose or not) never holds on to a worker.
+ *
+ * A worker that finds only part of a request hands the client over with
+ * submit(). One of the I/O threads then collects the rest with its own epoll
+ * instance, keeping to the HeaderBudget: a client whose header gets too big
+ * or takes too long, or that would take the memory of all partial requests
+ * over budget, is turned away. Once the header is complete, the request is
+ * queued for one of the reader's own workers, which handles it like any
+ * other worker would. Handling can take a while (a proxied request waits on
+ * its backend), and done on an I/O thread it would hold up the reads and
+ * deadlines of every other client there.
+ */
+class RequestReader {
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		// handles a client whose request is complete (on one of the workers)
+		using Handler = std::function<void(ClientSocket client, std::string_view request)>;
+
+		// turns a client away with the given status: 408 (too slow), 431 (too
+		// big) or 503 (out of memory budget)
+		using Rejecter = std::function<void(ClientSocket client, int status)>;
+
+		/**
+		 * Starts the given number of I/O threads and workers.
+		 *
+		 * @param num_threads How many I/O threads.
+		 * @param num_workers How many workers handle the complete requests.
+		 * @param on_request Handles complete requests.
+		 * @param on_reject Turns clients away.
+		 */
+		RequestReader(int num_threads, int num_workers, Handler on_request, Rejecter on_reject);
+
+		// copying would duplicate the I/O threads, so don't allow it
+		RequestReader(const RequestReader&) = delete;
+		void operator=(const RequestReader&) = delete;
+
+		/**
+		 * Takes over a client whose request isn't complete yet. Ownership of
+		 * the client passes to the reader.
+		 *
+		 * @param client The client.
+		 * @param received What has been received of its request so far.
+		 * @param started When receiving the request started (the timeout
+		 * counts from there).
+		 */
+		void submit(ClientSocket client, std::string_view received, Clock::time_point started);
+
+		/**
+		 * @return How many clients are waited on right now.
+		 */
+		size_t numWaiting() const { return num_waiting; }
+
+	private:
+		struct IOThread;
+
+		// a client whose request is still coming in
+		struct PendingRead {
+			explicit PendingRead(ClientSocket client) : client(client) {}
+
+			ClientSocket client;
+			std::string received;
+			HeaderBudget::Reservation reserved; // for this and received
+			Clock::time_point deadline;
+			std::list<PendingRead*>::iterator position; // in IOThread::by_deadline
+		};
+
+		// state owned by a single I/O thread
+		struct IOThread {
+			int epoll_fd;
+			int wakeup_fd; // eventfd used to announce new clients
+			std::mutex incoming_mutex;
+			std::vector<PendingRead*> incoming;
+
+			// the thread's clients, soonest deadline first (they all get the
+			// same timeout, so that's the order they came in)
+			std::list<PendingRead*> by_deadline;
+			std::thread thread;
+		};
+
+		Handler on_request;
+		Rejecter on_reject;
+		std::vector<std::unique_ptr<IOThread>> io_threads;
+		std::atomic<size_t> next_thread{0};
+		std::atomic<size_t> num_waiting{0};
+
+		// complete requests, waiting for a worker (oldest first)
+		std::mutex complete_mutex;
+		std::condition_variable complete_available;
+		std::deque<PendingRead*> complete;
+		std::vector<std::thread> workers;
+
+		void runIOThread(IOThread& io);
+		void runWorker();
+		void readSome(IOThread& io, PendingRead* pending);
+		void finish(IOThread& io, PendingRead* pending, int status);
+};
+#endif
@@ -0,0 +1,292 @@
+/**
+ * File: ResponseWriter.cpp
+ *
+ * Implementation of the ResponseWriter class.
+ * See the associated header file (ResponseWriter.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <utility>
+#include <algorithm>
+
+#include "ResponseWriter.hpp"
+#include "LargeFile.hpp"
+#include "ReverseProxy.hpp"
+#include "Profiler.hpp"
+
+// maximum number of events handled per call to epoll_wait
+static const int MAX_EVENTS = 64;
+
+/**
+ * Constructor that starts the given number of I/O threads, each with its own
+ * epoll instance.
+ *
+ * @param num_threads The number of I/O threads to start.
+ */
+ResponseWriter::ResponseWriter(int num_threads) : next_thread(0) {
+	for (int i = 0; i < num_threads; i++) {
+		auto io = std::make_unique<IOThread>();
+
+		io->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+		io->wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (io->epoll_fd < 0 || io->wakeup_fd < 0) {
+			perror("Creating response writer failed");
+			exit(1);
+		}
+
+		// a null data pointer marks the wakeup event
+		struct epoll_event ev = {};
+		ev.events = EPOLLIN;
+		ev.data.ptr = nullptr;
+		epoll_ctl(io->epoll_fd, EPOLL_CTL_ADD, io->wakeup_fd, &ev);
+
+		io->thread = std::thread(&ResponseWriter::runIOThread, this, std::ref(*io));
+		io_threads.push_back(std::move(io));
+	}
+}
+
+void ResponseWriter::submit(ClientSocket client, HttpResponse response) {
+	int fd = client.getFd();
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	PendingWrite *pending = new PendingWrite{client, std::move(response)};
+	if (pending->response.stream) {
+		pending->stream_wait_fd = pending->response.stream->makeNonBlocking();
+	}
+
+	// Most responses fit in the socket's send buffer, so try to write it all
+	// right here and only bother an I/O thread with what is left over.
+	if (writeSome(*pending)) {
+		finish(pending);
+		return;
+	}
+
+	IOThread& io = *io_threads[next_thread++ % io_threads.size()];
+	{
+		std::unique_lock<std::mutex> lock(io.incoming_mutex);
+		io.incoming.push_back(pending);
+	}
+
+	uint64_t one = 1;
+	if (write(io.wakeup_fd, &one, sizeof(one)) < 0) {
+		perror("Waking up response writer failed");
+	}
+}
+
+/**
+ * Writes as much of the pending response as the socket will currently take.
+ *
+ * @param pending The response to make progress on.
+ * @return true if the response is done (fully sent or the client is gone),
+ * false if we need to wait for the socket to become writable again.
+ */
+bool ResponseWriter::writeSome(PendingWrite& pending) {
+	int fd = pending.client.getFd();
+	HttpResponse& response = pending.response;
+	std::string_view header = response.headerData();
+	std::string_view body = response.bodyData();
+	size_t body_size = body.size();
+
+	// header and in-memory body go out together in a single system call
+	while (pending.header_sent < header.size() || pending.body_sent < body_size) {
+		struct iovec iov[2];
+		int iov_count = 0;
+
+		if (pending.header_sent < header.size()) {
+			iov[iov_count].iov_base = const_cast<char*>(header.data()) + pending.header_sent;
+			iov[iov_count].iov_len = header.size() - pending.header_sent;
+			iov_count++;
+		}
+		if (pending.body_sent < body_size) {
+			iov[iov_count].iov_base = const_cast<char*>(body.data()) + pending.body_sent;
+			iov[iov_count].iov_len = body_size - pending.body_sent;
+			iov_count++;
+		}
+
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = iov_count;
+
+		ssize_t num_bytes_sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+		if (num_bytes_sent < 0) {
+			if (errno == EINTR) continue;
+			return errno != EAGAIN && errno != EWOULDBLOCK;
+		}
+
+		size_t header_part = std::min(size_t(num_bytes_sent), header.size() - pending.header_sent);
+		pending.header_sent += header_part;
+		pending.body_sent += num_bytes_sent - header_part;
+	}
+
+	// a streamed body is produced one piece at a time, as the socket drains
+	while (response.stream) {
+		// ... except for a proxied one, which goes from the backend's socket to
+		// the client's through a pipe, whenever either of them is ready
+		if (UpstreamBody *upstream = response.stream->spliceable()) {
+			if (upstream->finished()) break; // the body goes back to the pool in finish
+			if (upstream->spliceTo(fd) < 0) {
+				if (errno == EINTR) continue;
+				return errno != EAGAIN && errno != EWOULDBLOCK;
+			}
+			continue;
+		}
+
+		if (pending.piece_sent == pending.piece.size()) {
+			pending.piece.clear();
+			pending.piece_sent = 0;
+			if (!response.stream->next(pending.piece)) {
+				endStream(pending);
+				break;
+			}
+
+			// nothing ready yet: wait for the body (it's in the epoll set)
+			if (pending.piece.empty() && pending.stream_wait_fd >= 0) {
+				return false;
+			}
+			continue;
+		}
+
+		ssize_t num_bytes_sent = send(fd, pending.piece.data() + pending.piece_sent,
+				pending.piece.size() - pending.piece_sent, MSG_NOSIGNAL);
+		if (num_bytes_sent < 0) {
+			if (errno == EINTR) continue;
+			return errno != EAGAIN && errno != EWOULDBLOCK;
+		}
+		pending.piece_sent += num_bytes_sent;
+	}
+
+	// the file body is sent straight from the page cache
+	while (response.file_fd != -1 && response.file_length > 0) {
+		off_t old_offset = response.file_offset;
+		ssize_t num_bytes_sent = sendfile(fd, response.file_fd,
+				&response.file_offset, response.file_length);
+		if (response.drop_behind && num_bytes_sent > 0) {
+			dropPassedPages(response.file_fd, old_offset, response.file_offset);
+		}
+		if (num_bytes_sent < 0) {
+			if (errno == EINTR) continue;
+			return errno != EAGAIN && errno != EWOULDBLOCK;
+		}
+		if (num_bytes_sent == 0) {
+			// file shrank after we sent the header; nothing more we can do
+			return true;
+		}
+		response.file_length -= num_bytes_sent;
+	}
+
+	return true;
+}
+
+/**
+ * Lets go of a streamed body, after taking what it waits on out of the epoll
+ * set: a pooled backend connection mustn't stay registered with us.
+ *
+ * @param pending The response whose body is done with.
+ */
+void ResponseWriter::endStream(PendingWrite& pending) {
+	if (pending.stream_epoll_fd >= 0) {
+		epoll_ctl(pending.stream_epoll_fd, EPOLL_CTL_DEL, pending.stream_wait_fd, nullptr);
+		pending.stream_epoll_fd = -1;
+	}
+	pending.response.stream.reset();
+}
+
+/**
+ * Releases everything held by a finished response.
+ *
+ * @param pending The response that is done.
+ */
+void ResponseWriter::finish(PendingWrite* pending) {
+	endStream(*pending);
+	if (pending->response.file_fd != -1) {
+		close(pending->response.file_fd);
+	}
+	pending->client.close();
+	delete pending;
+}
+
+/**
+ * Body of an I/O thread: waits for its clients to become writable and pushes
+ * their responses along until they are finished.
+ *
+ * @param io The state belonging to this I/O thread.
+ */
+void ResponseWriter::runIOThread(IOThread& io) {
+	Profiler::nameThread("writer");
+	struct epoll_event events[MAX_EVENTS];
+	std::vector<PendingWrite*> finished;
+
+	while (true) {
+		int num_events = epoll_wait(io.epoll_fd, events, MAX_EVENTS, -1);
+		if (num_events < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait failed");
+			exit(1);
+		}
+
+		for (int i = 0; i < num_events; i++) {
+			PendingWrite *pending = static_cast<PendingWrite*>(events[i].data.ptr);
+
+			if (pending == nullptr) {
+				// new pending writes were handed to us
+				uint64_t count;
+				while (read(io.wakeup_fd, &count, sizeof(count)) > 0);
+
+				std::vector<PendingWrite*> incoming;
+				{
+					std::unique_lock<std::mutex> lock(io.incoming_mutex);
+					incoming.swap(io.incoming);
+				}
+
+				for (PendingWrite *p : incoming) {
+					struct epoll_event ev = {};
+					ev.events = EPOLLOUT | EPOLLET;
+					ev.data.ptr = p;
+					if (epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, p->client.getFd(), &ev) < 0) {
+						finish(p);
+						continue;
+					}
+
+					if (p->response.stream && p->stream_wait_fd >= 0) {
+						ev.events = EPOLLIN | EPOLLRDHUP | EPOLLET;
+						if (epoll_ctl(io.epoll_fd, EPOLL_CTL_ADD, p->stream_wait_fd, &ev) < 0) {
+							finish(p);
+							continue;
+						}
+						p->stream_epoll_fd = io.epoll_fd;
+					}
+				}
+				continue;
+			}
+
+			// a streamed response can show up twice in a batch (once for the
+			// client, once for what its body waits on), so it is only
+			// finished after the whole batch
+			if (!pending->done && writeSome(*pending)) {
+				pending->done = true;
+				finished.push_back(pending);
+			}
+		}
+
+		// closing the socket also removes it from the epoll set
+		for (PendingWrite *pending : finished) {
+			finish(pending);
+		}
+		finished.clear();
+	}
+}
@@ -0,0 +1,84 @@
+#ifndef RESPONSEWRITER_HPP
+#define RESPONSEWRITER_HPP
+
+/**
+ * File: ResponseWriter.hpp
+ *
+ * Header file for the ResponseWriter class.
+ */
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <memory>
+
+#include "ClientSocket.hpp"
+#include "HttpResponse.hpp"
+
+/**
+ * Class that owns a small set of I/O threads which stream responses out to
+ * clients without blocking.
+ *
+ * Workers resolve a request into an HttpResponse and hand it off with
+ * submit(). The response is written out as far as the socket allows right
+ * away; whatever is left over is finished by one of the I/O threads, each of
+ * which waits on its own epoll instance for clients to become writable. This
+ * way a slow client only ever holds on to a socket buffer, never a worker.
+ */
+class ResponseWriter {
+  public:
+	  ResponseWriter(int num_threads);
+
+	  // copying would duplicate the I/O threads, so don't allow it
+	  ResponseWriter(const ResponseWriter&) = delete;
+	  void operator=(const ResponseWriter&) = delete;
+
+	  /**
+	   * Sends the given response to the client and then closes the client.
+	   * Ownership of the client and of response.file_fd passes to the writer.
+	   *
+	   * @param client The client to respond to.
+	   * @param response The response to send.
+	   */
+	  void submit(ClientSocket client, HttpResponse response);
+
+  private:
+	  // a response that has been partially written out
+	  struct PendingWrite {
+		  ClientSocket client;
+		  HttpResponse response;
+		  size_t header_sent = 0;
+		  size_t body_sent = 0;
+
+		  // latest piece produced by response.stream
+		  std::string piece{};
+		  size_t piece_sent = 0;
+
+		  // what a streamed body waits on (e.g. a proxied body's backend
+		  // socket, see ReverseProxy.hpp) is watched too, by this epoll
+		  // instance once it is registered
+		  int stream_wait_fd = -1;
+		  int stream_epoll_fd = -1;
+		  bool done = false;
+	  };
+
+	  // state owned by a single I/O thread
+	  struct IOThread {
+		  int epoll_fd;
+		  int wakeup_fd; // eventfd used to announce new pending writes
+		  std::mutex incoming_mutex;
+		  std::vector<PendingWrite*> incoming;
+		  std::thread thread;
+	  };
+
+	  std::vector<std::unique_ptr<IOThread>> io_threads;
+	  std::atomic<size_t> next_thread;
+
+	  void runIOThread(IOThread& io);
+
+	  static bool writeSome(PendingWrite& pending);
+	  static void endStream(PendingWrite& pending);
+	  static void finish(PendingWrite* pending);
+};
+#endif
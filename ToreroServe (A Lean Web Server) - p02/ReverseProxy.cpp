@@ -0,0 +1,574 @@
+/**
+ * File: ReverseProxy.cpp
+ *
+ * Implementation of the ReverseProxy and UpstreamBody classes.
+ * See the associated header file (ReverseProxy.hpp) for the declaration of
+ * these classes.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+// C++ standard library
+#include <thread>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include "ReverseProxy.hpp"
+#include "Profiler.hpp"
+
+using std::string;
+using std::string_view;
+
+// how long to wait for a backend to accept a connection, and then for each
+// part of its response
+static const int CONNECT_TIMEOUT_MS = 1000;
+static const int RESPONSE_TIMEOUT_MS = 10000;
+
+// biggest response header taken from a backend
+static const size_t MAX_HEADER_SIZE = 16384;
+
+// the health checks run this often, each giving a backend this long to answer
+static const auto HEALTH_CHECK_INTERVAL = std::chrono::seconds(1);
+static const int HEALTH_CHECK_TIMEOUT_MS = 1000;
+
+// most bytes moved through the pipe per splice
+static const size_t SPLICE_SIZE = 65536;
+
+/**
+ * Waits for a non-blocking socket to become ready.
+ *
+ * @return false if it didn't within the timeout.
+ */
+static bool waitFor(int fd, short events, int timeout_ms) {
+	struct pollfd p = {fd, events, 0};
+	int result;
+	while ((result = poll(&p, 1, timeout_ms)) < 0 && errno == EINTR) {}
+	return result > 0;
+}
+
+/**
+ * Sends all of data on a non-blocking socket.
+ *
+ * @return false if the socket failed (or stayed full for too long).
+ */
+static bool sendAll(int fd, string_view data) {
+	while (!data.empty()) {
+		ssize_t num_sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+		if (num_sent < 0) {
+			if (errno == EINTR) continue;
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && waitFor(fd, POLLOUT, RESPONSE_TIMEOUT_MS)) {
+				continue;
+			}
+			return false;
+		}
+		data.remove_prefix(num_sent);
+	}
+	return true;
+}
+
+/**
+ * @return Whether a header line has the given (lower case) name.
+ */
+static bool hasName(string_view line, const char* name) {
+	size_t length = strlen(name);
+	return line.size() > length && line[length] == ':' && strncasecmp(line.data(), name, length) == 0;
+}
+
+/**
+ * @return Whether a comma separated header value contains the given (lower
+ * case) token, e.g. "chunked" in "gzip, chunked".
+ */
+static bool hasToken(string_view line, const char* token) {
+	string value(line.substr(line.find(':') + 1));
+	std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+	return value.find(token) != string::npos;
+}
+
+/**
+ * Builds a response with no body for when the proxy itself has to answer.
+ *
+ * @param status The status code and reason (e.g. "502 BAD GATEWAY").
+ * @return The response to send.
+ */
+static HttpResponse respondWithStatus(const char* status) {
+	HttpResponse response;
+	response.header = string("HTTP/1.0 ") + status + "\r\nContent-Length: 0\r\n\r\n";
+	return response;
+}
+
+ReverseProxy::ReverseProxy(Settings settings) : settings(std::move(settings)) {
+	for (const string& name : this->settings.backends) {
+		size_t colon = name.rfind(':');
+		string host = name.substr(0, colon);
+		string port = colon == string::npos ? "" : name.substr(colon + 1);
+
+		struct addrinfo hints = {};
+		hints.ai_family = AF_INET;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo *found;
+		if (host.empty() || port.empty() || getaddrinfo(host.c_str(), port.c_str(), &hints, &found) != 0) {
+			std::cerr << "ERROR: Can't find proxy backend " << name << " (expected host:port)\n";
+			exit(1);
+		}
+
+		auto backend = std::make_unique<Backend>();
+		backend->name = name;
+		memcpy(&backend->address, found->ai_addr, sizeof(backend->address));
+		freeaddrinfo(found);
+		backends.push_back(std::move(backend));
+	}
+}
+
+ReverseProxy::~ReverseProxy() {
+	for (auto& backend : backends) {
+		for (Connection& connection : backend->idle) {
+			closeConnection(connection);
+		}
+	}
+}
+
+void ReverseProxy::startHealthChecks() {
+	std::thread(&ReverseProxy::runHealthChecks, this).detach();
+}
+
+HttpResponse ReverseProxy::forward(const HttpRequest& request) {
+	// a keep-alive request, so that the connection can be used again
+	string upstream_request = "GET " + request.resource
+		+ (request.query.empty() ? "" : "?" + request.query) + " HTTP/1.1\r\n";
+
+	// a backend we can't connect to is marked down, and the next one tried
+	for (size_t attempt = 0; attempt < backends.size(); attempt++) {
+		Backend *backend = pickBackend();
+		if (backend == nullptr) break;
+
+		string message = upstream_request + "Host: " + backend->name + "\r\n\r\n";
+		backend->outstanding++;
+		backend->num_requests++;
+
+		// pooled connections the backend has since closed fail without an
+		// answer; those are dropped and the request sent again
+		Connection connection;
+		bool reused;
+		bool connected;
+		string received;
+		size_t header_end = string::npos;
+		while ((connected = takeConnection(*backend, connection, reused))) {
+			received.clear();
+			if (sendAll(connection.fd, message)) {
+				char buffer[4096];
+				while (header_end == string::npos && received.size() < MAX_HEADER_SIZE) {
+					ssize_t n = recv(connection.fd, buffer, sizeof(buffer), 0);
+					if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+						if (waitFor(connection.fd, POLLIN, RESPONSE_TIMEOUT_MS)) continue;
+						break;
+					}
+					if (n <= 0) break;
+					received.append(buffer, n);
+					header_end = received.find("\r\n\r\n");
+				}
+			}
+
+			if (header_end != string::npos || !reused || !received.empty()) break;
+			closeConnection(connection);
+		}
+
+		if (!connected) {
+			backend->outstanding--;
+			setHealthy(*backend, false);
+			continue;
+		}
+
+		if (header_end == string::npos || received.compare(0, 7, "HTTP/1.") != 0) {
+			closeConnection(connection);
+			backend->num_failures++;
+			backend->outstanding--;
+			return respondWithStatus("502 BAD GATEWAY");
+		}
+
+		// pass the header on, except for what only concerns the connection
+		// between us and the backend
+		HttpResponse response;
+		string_view header(received.data(), header_end + 2);
+		int status = atoi(received.c_str() + 9);
+		bool chunked = false;
+		bool keep_alive = received[7] == '1'; // the default from HTTP/1.1 on
+		long content_length = -1;
+
+		size_t line_start = 0;
+		while (line_start < header.size()) {
+			size_t line_end = header.find("\r\n", line_start);
+			string_view line = header.substr(line_start, line_end - line_start);
+			line_start = line_end + 2;
+
+			if (hasName(line, "connection")) {
+				keep_alive = hasToken(line, "keep-alive") || (keep_alive && !hasToken(line, "close"));
+				continue;
+			}
+			if (hasName(line, "keep-alive")) continue;
+			if (hasName(line, "content-length")) {
+				content_length = atol(string(line.substr(15)).c_str());
+			}
+			else if (hasName(line, "transfer-encoding")) {
+				chunked = hasToken(line, "chunked");
+			}
+			response.header.append(line);
+			response.header += "\r\n";
+		}
+		response.header += "Connection: close\r\n\r\n";
+
+		UpstreamBody::Framing framing = UpstreamBody::Framing::UntilClose;
+		if (status == 204 || status == 304 || (status >= 100 && status < 200)) {
+			framing = UpstreamBody::Framing::Length;
+			content_length = 0;
+		}
+		else if (chunked) {
+			framing = UpstreamBody::Framing::Chunked;
+		}
+		else if (content_length >= 0) {
+			framing = UpstreamBody::Framing::Length;
+		}
+
+		// whatever came along with the header is the start of the body; the
+		// body object looks after the connection (and the count of requests
+		// in progress) from here on
+		auto body = std::make_unique<UpstreamBody>(*this, *backend, connection, framing,
+				content_length, keep_alive);
+		string_view start = string_view(received).substr(header_end + 4);
+		if (framing == UpstreamBody::Framing::Length && start.size() > size_t(content_length)) {
+			start = start.substr(0, content_length);
+		}
+		if (!start.empty()) {
+			response.body = std::make_shared<string>(start);
+			body->consumed(start);
+		}
+		if (!body->finished()) {
+			response.stream = std::move(body);
+		}
+		return response;
+	}
+
+	return respondWithStatus("503 SERVICE UNAVAILABLE");
+}
+
+string ReverseProxy::statisticsJson() const {
+	string json = "[";
+	for (const auto& backend : backends) {
+		size_t num_idle;
+		{
+			std::unique_lock<std::mutex> lock(backend->idle_mutex);
+			num_idle = backend->idle.size();
+		}
+
+		if (json.size() > 1) json += ", ";
+		json += "{\"backend\": \"" + backend->name + "\""
+			+ ", \"healthy\": " + (backend->healthy ? "true" : "false")
+			+ ", \"outstanding\": " + std::to_string(backend->outstanding.load())
+			+ ", \"requests\": " + std::to_string(backend->num_requests.load())
+			+ ", \"connections_opened\": " + std::to_string(backend->num_connects.load())
+			+ ", \"failures\": " + std::to_string(backend->num_failures.load())
+			+ ", \"idle\": " + std::to_string(num_idle) + "}";
+	}
+	return json + "]";
+}
+
+/**
+ * Picks the healthy backend with the fewest requests in progress. The search
+ * starts one further along each time, so that ties are taken in turns.
+ *
+ * @return The backend, or nullptr if none is healthy.
+ */
+ReverseProxy::Backend* ReverseProxy::pickBackend() {
+	size_t start = next_backend++;
+	Backend *best = nullptr;
+	for (size_t i = 0; i < backends.size(); i++) {
+		Backend *backend = backends[(start + i) % backends.size()].get();
+		if (!backend->healthy) continue;
+		if (best == nullptr || backend->outstanding < best->outstanding) {
+			best = backend;
+		}
+	}
+	return best;
+}
+
+/**
+ * Gets a connection to a backend: an idle one from its pool if there is
+ * one, a new one otherwise.
+ *
+ * @param reused Set to whether the connection came from the pool.
+ * @return false if a new connection was needed and couldn't be made.
+ */
+bool ReverseProxy::takeConnection(Backend& backend, Connection& connection, bool& reused) {
+	{
+		std::unique_lock<std::mutex> lock(backend.idle_mutex);
+		if (!backend.idle.empty()) {
+			connection = backend.idle.back();
+			backend.idle.pop_back();
+			reused = true;
+			return true;
+		}
+	}
+
+	reused = false;
+	backend.num_connects++;
+	return connectTo(backend, connection);
+}
+
+/**
+ * Puts a connection back into its backend's pool, or closes it if it can't
+ * be reused or the pool is full.
+ */
+void ReverseProxy::releaseConnection(Backend& backend, Connection connection, bool reusable) {
+	if (reusable && backend.healthy) {
+		std::unique_lock<std::mutex> lock(backend.idle_mutex);
+		if (backend.idle.size() < settings.max_idle) {
+			backend.idle.push_back(connection);
+			return;
+		}
+	}
+	closeConnection(connection);
+}
+
+/**
+ * Takes a backend out of the rotation (dropping its pooled connections) or
+ * puts it back, saying so when that changes anything.
+ */
+void ReverseProxy::setHealthy(Backend& backend, bool healthy) {
+	if (backend.healthy.exchange(healthy) == healthy) return;
+
+	std::cout << "Proxy backend " << backend.name << (healthy ? " is back up" : " is down") << std::endl;
+	if (!healthy) {
+		std::vector<Connection> idle;
+		{
+			std::unique_lock<std::mutex> lock(backend.idle_mutex);
+			idle.swap(backend.idle);
+		}
+		for (Connection& connection : idle) {
+			closeConnection(connection);
+		}
+	}
+}
+
+/**
+ * Asks a backend for the health check page, on a connection of its own.
+ *
+ * @return Whether it answered with anything but a server error.
+ */
+bool ReverseProxy::checkHealth(Backend& backend) {
+	Connection connection;
+	if (!connectTo(backend, connection)) return false;
+
+	string message = "GET " + settings.health_path + " HTTP/1.1\r\nHost: " + backend.name
+		+ "\r\nConnection: close\r\n\r\n";
+	char status_line[16] = {};
+	bool healthy = sendAll(connection.fd, message)
+		&& waitFor(connection.fd, POLLIN, HEALTH_CHECK_TIMEOUT_MS)
+		&& recv(connection.fd, status_line, sizeof(status_line) - 1, 0) >= 12
+		&& strncmp(status_line, "HTTP/1.", 7) == 0 && status_line[9] < '5';
+
+	closeConnection(connection);
+	return healthy;
+}
+
+/**
+ * Body of the health check thread.
+ */
+void ReverseProxy::runHealthChecks() {
+	Profiler::nameThread("health checks");
+	while (true) {
+		std::this_thread::sleep_for(HEALTH_CHECK_INTERVAL);
+		for (auto& backend : backends) {
+			setHealthy(*backend, checkHealth(*backend));
+		}
+	}
+}
+
+/**
+ * Opens a new (non-blocking) connection to a backend.
+ *
+ * @return false if the backend didn't accept it in time.
+ */
+bool ReverseProxy::connectTo(const Backend& backend, Connection& connection) {
+	connection.fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (connection.fd < 0) {
+		perror("Creating a proxy connection failed");
+		return false;
+	}
+
+	// requests go out in a single write, so Nagle would only delay them
+	int enable = 1;
+	setsockopt(connection.fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+	int error = 0;
+	socklen_t error_size = sizeof(error);
+	if (connect(connection.fd, reinterpret_cast<const struct sockaddr*>(&backend.address),
+				sizeof(backend.address)) < 0
+			&& (errno != EINPROGRESS || !waitFor(connection.fd, POLLOUT, CONNECT_TIMEOUT_MS)
+				|| getsockopt(connection.fd, SOL_SOCKET, SO_ERROR, &error, &error_size) < 0
+				|| error != 0)) {
+		closeConnection(connection);
+		return false;
+	}
+	return true;
+}
+
+void ReverseProxy::closeConnection(Connection& connection) {
+	for (int fd : {connection.fd, connection.pipe_fds[0], connection.pipe_fds[1]}) {
+		if (fd >= 0) close(fd);
+	}
+	connection = Connection();
+}
+
+UpstreamBody::UpstreamBody(ReverseProxy& proxy, ReverseProxy::Backend& backend,
+		ReverseProxy::Connection connection, Framing framing, size_t length, bool keep_alive) :
+	proxy(proxy), backend(backend), connection(connection), framing(framing),
+	remaining(length), failed(!keep_alive || framing == Framing::UntilClose) {
+	is_finished = framing == Framing::Length && remaining == 0;
+}
+
+UpstreamBody::~UpstreamBody() {
+	proxy.releaseConnection(backend, connection, is_finished && !failed);
+	backend.outstanding--;
+}
+
+void UpstreamBody::consumed(string_view data) {
+	if (framing == Framing::Length) {
+		remaining -= std::min(remaining, data.size());
+		is_finished = remaining == 0;
+	}
+	else if (framing == Framing::Chunked) {
+		trackChunks(data);
+	}
+}
+
+bool UpstreamBody::next(string& out) {
+	if (is_finished) return false;
+
+	char buffer[16384];
+	size_t wanted = framing == Framing::Length ? std::min(remaining, sizeof(buffer)) : sizeof(buffer);
+	ssize_t num_received;
+	while ((num_received = recv(connection.fd, buffer, wanted, 0)) < 0) {
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			if (non_blocking) return true;
+			if (waitFor(connection.fd, POLLIN, RESPONSE_TIMEOUT_MS)) continue;
+		}
+		break;
+	}
+
+	// the backend closing the connection only ends an UntilClose body well
+	if (num_received <= 0) {
+		failed = true;
+		is_finished = true;
+		return false;
+	}
+
+	out.append(buffer, num_received);
+	consumed(string_view(buffer, num_received));
+	return true;
+}
+
+int UpstreamBody::makeNonBlocking() {
+	non_blocking = true;
+	return connection.fd;
+}
+
+UpstreamBody* UpstreamBody::spliceable() {
+	return framing == Framing::Chunked ? nullptr : this;
+}
+
+ssize_t UpstreamBody::spliceTo(int fd) {
+	if (is_finished) return 0;
+
+	if (connection.pipe_fds[0] < 0 && pipe2(connection.pipe_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+		connection.pipe_fds[0] = connection.pipe_fds[1] = -1;
+		return -1;
+	}
+
+	// refill the pipe from the backend once the client has taken all of it
+	if (in_pipe == 0) {
+		size_t wanted = framing == Framing::Length ? std::min(remaining, SPLICE_SIZE) : SPLICE_SIZE;
+		ssize_t num_moved = splice(connection.fd, nullptr, connection.pipe_fds[1], nullptr, wanted,
+				SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+		if (num_moved < 0) return -1;
+		if (num_moved == 0) {
+			failed = true;
+			is_finished = true;
+			return 0;
+		}
+		in_pipe = num_moved;
+		if (framing == Framing::Length) remaining -= num_moved;
+	}
+
+	ssize_t num_moved = splice(connection.pipe_fds[0], nullptr, fd, nullptr, in_pipe,
+			SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (num_moved < 0) return -1;
+
+	in_pipe -= num_moved;
+	if (in_pipe == 0 && framing == Framing::Length && remaining == 0) {
+		is_finished = true;
+	}
+	return num_moved;
+}
+
+/**
+ * Follows a chunked body along, to find where it ends: a zero-length chunk
+ * and then the (usually empty) trailer, ended by an empty line.
+ */
+void UpstreamBody::trackChunks(string_view data) {
+	for (size_t i = 0; i < data.size() && !is_finished; i++) {
+		char c = data[i];
+		switch (chunk_state) {
+			case ChunkState::Size:
+				if (isxdigit(static_cast<unsigned char>(c))) {
+					chunk_size = chunk_size * 16 + (isdigit(c) ? c - '0' : tolower(c) - 'a' + 10);
+				}
+				else if (c == ';') {
+					chunk_state = ChunkState::Extension;
+				}
+				else if (c == '\n') {
+					chunk_state = chunk_size == 0 ? ChunkState::TrailerStart : ChunkState::Data;
+				}
+				break;
+
+			case ChunkState::Extension:
+				if (c == '\n') {
+					chunk_state = chunk_size == 0 ? ChunkState::TrailerStart : ChunkState::Data;
+				}
+				break;
+
+			case ChunkState::Data: {
+				size_t num_taken = std::min(chunk_size, data.size() - i);
+				chunk_size -= num_taken;
+				i += num_taken - 1;
+				if (chunk_size == 0) chunk_state = ChunkState::DataEnd;
+				break;
+			}
+
+			case ChunkState::DataEnd:
+				if (c == '\n') chunk_state = ChunkState::Size;
+				break;
+
+			case ChunkState::TrailerStart:
+				if (c == '\n') is_finished = true;
+				else if (c != '\r') chunk_state = ChunkState::Trailer;
+				break;
+
+			case ChunkState::Trailer:
+				if (c == '\n') chunk_state = ChunkState::TrailerStart;
+				break;
+		}
+	}
+}
@@ -0,0 +1,213 @@
+#ifndef REVERSEPROXY_HPP
+#define REVERSEPROXY_HPP
+
+/**
+ * File: ReverseProxy.hpp
+ *
+ * Header file for the ReverseProxy and UpstreamBody classes.
+ */
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "BodySource.hpp"
+
+/**
+ * Forwards requests to a group of local backends (e.g. an application server
+ * behind a path prefix) and relays their responses back.
+ *
+ * Connections to the backends are kept alive and pooled per backend, so a
+ * request normally reuses an idle connection instead of paying for a new one
+ * (and leaving one more socket in TIME_WAIT). A pooled connection that the
+ * backend has closed in the meantime is only noticed when it is used; the
+ * request is then retried once on a fresh connection.
+ *
+ * Each request goes to the healthy backend with the fewest requests in
+ * progress. A backend is taken out of the rotation when connecting to it
+ * fails, and a health check thread (see startHealthChecks) keeps asking every
+ * backend for a page, putting it back once it answers again.
+ *
+ * The backend's response header is rewritten a little (the client
+ * connection is closed after the response, the backend's isn't) and its body
+ * is passed on unchanged, as an UpstreamBody.
+ */
+class ReverseProxy {
+	public:
+		struct Settings {
+			std::vector<std::string> backends; // "host:port" each
+			std::string health_path = "/";     // what the health checks ask for
+			size_t max_idle = 32;              // pooled connections per backend (0: no pooling)
+		};
+
+		/**
+		 * Looks up the backends, exiting with an error message if one of them
+		 * can't be.
+		 *
+		 * @param settings The backends and how to treat them.
+		 */
+		ReverseProxy(Settings settings);
+		~ReverseProxy();
+
+		ReverseProxy(const ReverseProxy&) = delete;
+		void operator=(const ReverseProxy&) = delete;
+
+		/**
+		 * Starts the thread that checks on the backends every second. Like
+		 * the pool, it belongs to the process that starts it, so prefork
+		 * workers each start their own.
+		 */
+		void startHealthChecks();
+
+		/**
+		 * Sends a request to one of the backends and waits for the header of
+		 * its response. The rest of the body (if any) follows as the
+		 * response's stream.
+		 *
+		 * @param request The request, whose path is forwarded as is.
+		 * @return The response to send: the backend's, or a 502 (the backend
+		 * failed us) or 503 (no backend is up).
+		 */
+		HttpResponse forward(const HttpRequest& request);
+
+		/**
+		 * @return A JSON array with the state and counters of each backend.
+		 */
+		std::string statisticsJson() const;
+
+	private:
+		friend class UpstreamBody;
+
+		// a keep-alive connection to a backend, plus the pipe its bodies are
+		// spliced through (created the first time one is)
+		struct Connection {
+			int fd = -1;
+			int pipe_fds[2] = {-1, -1};
+		};
+
+		struct Backend {
+			std::string name; // as given, "host:port"
+			struct sockaddr_in address;
+
+			std::atomic<bool> healthy{true};
+			std::atomic<int> outstanding{0}; // requests in progress
+
+			std::mutex idle_mutex;
+			std::vector<Connection> idle;
+
+			std::atomic<size_t> num_requests{0};
+			std::atomic<size_t> num_connects{0};
+			std::atomic<size_t> num_failures{0};
+		};
+
+		Settings settings;
+		std::vector<std::unique_ptr<Backend>> backends;
+		std::atomic<size_t> next_backend{0};
+
+		Backend* pickBackend();
+		bool takeConnection(Backend& backend, Connection& connection, bool& reused);
+		void releaseConnection(Backend& backend, Connection connection, bool reusable);
+		void setHealthy(Backend& backend, bool healthy);
+		bool checkHealth(Backend& backend);
+		void runHealthChecks();
+
+		static bool connectTo(const Backend& backend, Connection& connection);
+		static void closeConnection(Connection& connection);
+};
+
+/**
+ * Body of a proxied response that is still on its way from the backend.
+ *
+ * Bodies with a Content-Length, or ended by the backend closing the
+ * connection, can be spliced from the backend's socket into the client's
+ * through a pipe, so they never pass through user space (see spliceTo);
+ * that's what the ResponseWriter does. Everyone else reads them with next(),
+ * like any other stream. Chunked bodies always take that road, since their
+ * end can only be found by looking at them (the ResponseWriter then makes
+ * them non-blocking and waits for the backend's socket itself).
+ *
+ * Once the body is done with, the connection goes back to the backend's
+ * pool, provided that all of the body was read.
+ */
+class UpstreamBody : public BodySource {
+	public:
+		enum class Framing {
+			Length,     // Content-Length bytes
+			Chunked,    // Transfer-Encoding: chunked
+			UntilClose, // up to the backend closing the connection
+		};
+
+		/**
+		 * @param proxy The proxy the connection came from.
+		 * @param backend The backend on the other end.
+		 * @param connection The connection, which the body now owns.
+		 * @param framing How the end of the body is found.
+		 * @param length The Content-Length (Framing::Length only).
+		 * @param keep_alive Whether the backend keeps the connection open
+		 * after the response.
+		 */
+		UpstreamBody(ReverseProxy& proxy, ReverseProxy::Backend& backend,
+				ReverseProxy::Connection connection, Framing framing, size_t length,
+				bool keep_alive);
+		~UpstreamBody();
+
+		/**
+		 * Takes note of body bytes that were received along with the header
+		 * (and are sent as the response's in-memory body).
+		 */
+		void consumed(std::string_view data);
+
+		bool next(std::string& out) override;
+		int makeNonBlocking() override;
+		UpstreamBody* spliceable() override;
+
+		/**
+		 * Moves the next part of the body to the given socket, without
+		 * blocking on either end.
+		 *
+		 * @param fd The client's (non-blocking) socket.
+		 * @return How many bytes moved (0 once the body is finished), or -1
+		 * with errno set; EAGAIN means that either the client or the backend
+		 * isn't ready, so wait for both.
+		 */
+		ssize_t spliceTo(int fd);
+
+		/**
+		 * @return Whether the whole body has been passed on (or the backend
+		 * let us down).
+		 */
+		bool finished() const { return is_finished; }
+
+		/**
+		 * @return The socket to the backend, for waiting on.
+		 */
+		int socketFd() const { return connection.fd; }
+
+	private:
+		// where in the chunked format the next byte is
+		enum class ChunkState { Size, Extension, Data, DataEnd, TrailerStart, Trailer };
+
+		ReverseProxy& proxy;
+		ReverseProxy::Backend& backend;
+		ReverseProxy::Connection connection;
+		Framing framing;
+		size_t remaining;
+
+		ChunkState chunk_state = ChunkState::Size;
+		size_t chunk_size = 0;
+		size_t in_pipe = 0; // bytes spliced into the pipe but not out yet
+
+		bool is_finished = false;
+		bool failed; // the connection can't be reused
+		bool non_blocking = false; // see makeNonBlocking
+
+		void trackChunks(std::string_view data);
+};
+#endif
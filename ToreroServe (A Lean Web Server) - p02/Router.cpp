@@ -0,0 +1,138 @@
+/**
+ * File: Router.cpp
+ *
+ * Implementation of the Router class.
+ * See the associated header file (Router.hpp) for the declaration of this
+ * class.
+ */
+
+// C++ standard library
+#include <algorithm>
+#include <stdexcept>
+
+#include "Router.hpp"
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+
+struct Router::Node {
+	// children by literal segment, sorted for binary search
+	std::vector<std::pair<string, unique_ptr<Node>>> children;
+
+	// the child for a ":name" segment, if any
+	unique_ptr<Node> parameter_child;
+
+	// handlers for the path ending here, and for anything below it ("/*")
+	unique_ptr<Handler> exact;
+	unique_ptr<Handler> prefix;
+};
+
+/**
+ * Splits off the first segment of a path.
+ *
+ * @param path The path, with or without a leading '/'; left with the rest.
+ * @return The first segment.
+ */
+static string_view nextSegment(string_view& path) {
+	if (!path.empty() && path[0] == '/') path.remove_prefix(1);
+
+	size_t end = std::min(path.find('/'), path.size());
+	string_view segment = path.substr(0, end);
+	path.remove_prefix(end);
+	return segment;
+}
+
+Router::Router() : root(std::make_unique<Node>()) {}
+
+Router::~Router() = default;
+
+void Router::add(string_view pattern, Handler handler) {
+	Node *node = root.get();
+	size_t num_parameters = 0;
+
+	while (!pattern.empty() && pattern != "/") {
+		string_view segment = nextSegment(pattern);
+
+		if (segment == "*") {
+			if (!pattern.empty()) {
+				throw std::invalid_argument("'*' has to be the last segment of a route");
+			}
+			node->prefix = std::make_unique<Handler>(std::move(handler));
+			return;
+		}
+
+		if (!segment.empty() && segment[0] == ':') {
+			if (++num_parameters > RequestView::MAX_PARAMETERS) {
+				throw std::invalid_argument("too many parameters in a route");
+			}
+			if (!node->parameter_child) {
+				node->parameter_child = std::make_unique<Node>();
+			}
+			node = node->parameter_child.get();
+			continue;
+		}
+
+		auto& children = node->children;
+		auto found = std::lower_bound(children.begin(), children.end(), segment,
+				[](const auto& child, string_view s) { return string_view(child.first) < s; });
+		if (found == children.end() || found->first != segment) {
+			found = children.insert(found, {string(segment), std::make_unique<Node>()});
+		}
+		node = found->second.get();
+	}
+
+	node->exact = std::make_unique<Handler>(std::move(handler));
+}
+
+const Router::Handler* Router::find(RequestView& view) const {
+	view.num_parameters = 0;
+	view.rest_of_path = string_view();
+	return findFrom(*root, view.request.resource, view);
+}
+
+bool Router::matches(string_view path) const {
+	HttpRequest request;
+	RequestView view(request);
+	return findFrom(*root, path, view) != nullptr;
+}
+
+/**
+ * Matches what is left of a path against the subtree of a node.
+ */
+const Router::Handler* Router::findFrom(const Node& node, string_view path, RequestView& view) {
+	if (path.empty() || path == "/") {
+		if (node.exact) return node.exact.get();
+		if (node.prefix) {
+			view.rest_of_path = string_view();
+			return node.prefix.get();
+		}
+		return nullptr;
+	}
+
+	string_view rest = path;
+	string_view segment = nextSegment(rest);
+
+	// the most specific match first: a literal segment ...
+	auto found = std::lower_bound(node.children.begin(), node.children.end(), segment,
+			[](const auto& child, string_view s) { return string_view(child.first) < s; });
+	if (found != node.children.end() && found->first == segment) {
+		const Handler *handler = findFrom(*found->second, rest, view);
+		if (handler != nullptr) return handler;
+	}
+
+	// ... then a parameter ...
+	if (node.parameter_child && !segment.empty() && view.num_parameters < RequestView::MAX_PARAMETERS) {
+		view.parameters[view.num_parameters++] = segment;
+		const Handler *handler = findFrom(*node.parameter_child, rest, view);
+		if (handler != nullptr) return handler;
+		view.num_parameters--;
+	}
+
+	// ... and last of all a prefix
+	if (node.prefix) {
+		view.rest_of_path = path.substr(path[0] == '/' ? 1 : 0);
+		return node.prefix.get();
+	}
+	return nullptr;
+}
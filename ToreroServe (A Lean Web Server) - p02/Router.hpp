@@ -0,0 +1,110 @@
+#ifndef ROUTER_HPP
+#define ROUTER_HPP
+
+/**
+ * File: Router.hpp
+ *
+ * Header file for the Router class.
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstddef>
+
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+
+/**
+ * What a route handler gets: the parsed request plus the parts of its path
+ * that the route's pattern captured. The captures point into the request's
+ * resource, so the view is only good while the request is.
+ */
+class RequestView {
+	public:
+		static const size_t MAX_PARAMETERS = 8;
+
+		RequestView(const HttpRequest& request) : request(request) {}
+
+		const HttpRequest& request;
+
+		/**
+		 * @return The i-th ":name" segment of the path, in pattern order.
+		 */
+		std::string_view parameter(size_t i) const {
+			return i < num_parameters ? parameters[i] : std::string_view();
+		}
+
+		/**
+		 * @return For a prefix route (ending in a "*" segment), the rest of the path after
+		 * the prefix (without the leading '/').
+		 */
+		std::string_view rest() const { return rest_of_path; }
+
+	private:
+		friend class Router;
+
+		std::string_view parameters[MAX_PARAMETERS];
+		size_t num_parameters = 0;
+		std::string_view rest_of_path;
+};
+
+/**
+ * Maps request paths to handlers for the few dynamic endpoints the server
+ * has; anything without a route is served from the file system as before.
+ *
+ * Routes are set up once, before serving, with patterns made of '/'
+ * separated segments. A plain pattern ("/health") matches just that path; a
+ * ":name" segment ("/stats/worker/:n") matches any single segment there; and
+ * a final "*" segment makes a prefix route, matching the path before it and
+ * everything below it.
+ *
+ * The patterns are compiled into a trie with a node per segment, so a lookup
+ * walks the path once, doing a binary search among each node's literal
+ * children. What it costs depends on how deep the path is, not on how many
+ * routes there are, and it never allocates. Literal segments beat
+ * parameters, which beat prefixes; when a more specific branch dead-ends,
+ * the lookup backs up and tries the next.
+ */
+class Router {
+	public:
+		using Handler = std::function<HttpResponse(const RequestView&)>;
+
+		Router();
+		~Router();
+
+		Router(const Router&) = delete;
+		void operator=(const Router&) = delete;
+
+		/**
+		 * Adds a route (replacing any with the same pattern). Not thread
+		 * safe: all routes have to be added before serving starts.
+		 *
+		 * @param pattern The pattern (see above).
+		 * @param handler What builds the response.
+		 */
+		void add(std::string_view pattern, Handler handler);
+
+		/**
+		 * Looks up the handler for a request, filling in the view's
+		 * captures.
+		 *
+		 * @param view The request; its captures are set on a match.
+		 * @return The handler, or nullptr if no route matches.
+		 */
+		const Handler* find(RequestView& view) const;
+
+		/**
+		 * @return Whether any route matches the given path.
+		 */
+		bool matches(std::string_view path) const;
+
+	private:
+		struct Node;
+		std::unique_ptr<Node> root;
+
+		static const Handler* findFrom(const Node& node, std::string_view path, RequestView& view);
+};
+#endif
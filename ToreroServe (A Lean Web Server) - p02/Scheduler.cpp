@@ -0,0 +1,117 @@
+/**
+ * File: Scheduler.cpp
+ *
+ * Implementation of the Scheduler class.
+ * See the associated header file (Scheduler.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <unistd.h>
+#include <sys/epoll.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard libraries
+#include <algorithm>
+
+#include "Scheduler.hpp"
+
+// maximum number of events handled per call to epoll_wait
+static const int MAX_EVENTS = 64;
+
+Scheduler::Scheduler() {
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0) {
+		perror("Creating scheduler failed");
+		exit(1);
+	}
+}
+
+Scheduler::~Scheduler() { close(epoll_fd); }
+
+void Scheduler::watch(int fd, IOWaiters* waiters, uint32_t events) {
+	struct epoll_event ev = {};
+	ev.events = events;
+	ev.data.ptr = waiters;
+
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		perror("Watching file descriptor failed");
+	}
+}
+
+void Scheduler::unwatch(int fd) {
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+Scheduler::Timer Scheduler::startTimer(Clock::time_point deadline, IOWaiters* waiters) {
+	return timers.emplace(deadline, waiters);
+}
+
+void Scheduler::stopTimer(Timer timer) {
+	timers.erase(timer);
+}
+
+/**
+ * Resumes the coroutines whose timers have gone off.
+ */
+void Scheduler::fireTimers() {
+	Clock::time_point now = Clock::now();
+	while (!timers.empty() && timers.begin()->first <= now) {
+		IOWaiters *waiters = timers.begin()->second;
+		timers.erase(timers.begin());
+		waiters->timed_out = true;
+
+		// as in run: a resumed coroutine may free waiters
+		std::coroutine_handle<> reader = waiters->reader, writer = waiters->writer;
+		waiters->reader = nullptr;
+		waiters->writer = nullptr;
+		if (reader) reader.resume();
+		if (writer) writer.resume();
+	}
+}
+
+void Scheduler::run() {
+	struct epoll_event events[MAX_EVENTS];
+
+	while (true) {
+		// sleep no longer than until the next timer goes off
+		int timeout_ms = -1;
+		if (!timers.empty()) {
+			auto left = timers.begin()->first - Clock::now();
+			timeout_ms = std::max(0L, long(std::chrono::ceil<std::chrono::milliseconds>(left).count()));
+		}
+
+		int num_events = epoll_wait(epoll_fd, events, MAX_EVENTS, timeout_ms);
+		if (num_events < 0) {
+			if (errno == EINTR) continue;
+			perror("epoll_wait failed");
+			exit(1);
+		}
+
+		for (int i = 0; i < num_events; i++) {
+			IOWaiters *waiters = static_cast<IOWaiters*>(events[i].data.ptr);
+			uint32_t ready = events[i].events;
+
+			// Take both handles before resuming either: a resumed coroutine
+			// may finish and free the memory that waiters points to.
+			std::coroutine_handle<> reader, writer;
+			if (ready & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+				reader = waiters->reader;
+				waiters->reader = nullptr;
+			}
+			if (ready & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+				writer = waiters->writer;
+				waiters->writer = nullptr;
+			}
+
+			if (reader) reader.resume();
+			if (writer) writer.resume();
+		}
+
+		fireTimers();
+	}
+}
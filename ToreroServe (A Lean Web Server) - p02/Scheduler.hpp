@@ -0,0 +1,105 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+/**
+ * File: Scheduler.hpp
+ *
+ * Header file for the Scheduler class.
+ */
+
+#include <cstdint>
+#include <chrono>
+#include <coroutine>
+#include <map>
+
+/**
+ * The coroutines (if any) waiting for a file descriptor to become readable
+ * or writable.
+ */
+struct IOWaiters {
+	std::coroutine_handle<> reader;
+	std::coroutine_handle<> writer;
+	bool timed_out = false; // set when a timer on these waiters went off
+};
+
+/**
+ * Awaitable that suspends the current coroutine until its file descriptor is
+ * ready (see AsyncSocket::readable and AsyncSocket::writable).
+ */
+struct IOReady {
+	IOWaiters *waiters;
+	bool for_writing;
+
+	bool await_ready() { return false; }
+
+	void await_suspend(std::coroutine_handle<> waiting) {
+		if (for_writing) waiters->writer = waiting;
+		else waiters->reader = waiting;
+	}
+
+	void await_resume() {}
+};
+
+/**
+ * Event loop that resumes coroutines when the file descriptors they are
+ * waiting on become ready. Each scheduler runs on a single thread and
+ * watches its file descriptors through its own epoll instance.
+ *
+ * File descriptors are watched edge-triggered, so a coroutine must only wait
+ * after an operation has failed with EAGAIN.
+ *
+ * Waiters may also be given a deadline (see startTimer): once it passes,
+ * their coroutines are resumed with timed_out set, ready or not. The soonest
+ * deadline bounds how long epoll_wait sleeps.
+ */
+class Scheduler {
+	public:
+		using Clock = std::chrono::steady_clock;
+		using Timer = std::multimap<Clock::time_point, IOWaiters*>::iterator;
+
+		Scheduler();
+		~Scheduler();
+
+		Scheduler(const Scheduler&) = delete;
+		void operator=(const Scheduler&) = delete;
+
+		/**
+		 * Starts watching fd, resuming the coroutines in waiters when it
+		 * becomes ready.
+		 *
+		 * @param fd The file descriptor to watch.
+		 * @param waiters Where waiting coroutines will be recorded. Must stay
+		 * valid until unwatch is called (or fd is closed).
+		 * @param events The epoll events to watch for.
+		 */
+		void watch(int fd, IOWaiters* waiters, uint32_t events);
+		void unwatch(int fd);
+
+		/**
+		 * Starts a timer that goes off at deadline, resuming whatever
+		 * coroutines are in waiters with waiters->timed_out set.
+		 *
+		 * @param deadline When to go off.
+		 * @param waiters The waiters to resume. Must stay valid until the
+		 * timer goes off or is stopped.
+		 * @return The timer, for stopTimer.
+		 */
+		Timer startTimer(Clock::time_point deadline, IOWaiters* waiters);
+
+		/**
+		 * Stops a timer that hasn't gone off yet.
+		 */
+		void stopTimer(Timer timer);
+
+		/**
+		 * Runs the event loop forever.
+		 */
+		void run();
+
+	private:
+		int epoll_fd;
+		std::multimap<Clock::time_point, IOWaiters*> timers; // soonest first
+
+		void fireTimers();
+};
+#endif
@@ -0,0 +1,251 @@
+/**
+ * File: ServerConfig.cpp
+ *
+ * Implementation of command line option handling for ServerConfig.
+ */
+
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+#include "ServerConfig.hpp"
+#include "CpuAffinity.hpp"
+
+using std::string;
+
+bool ServerConfig::setOption(const string& option) {
+	if (option.rfind("--", 0) != 0) {
+		return false;
+	}
+
+	size_t equals = option.find('=');
+	if (equals == string::npos) {
+		return false;
+	}
+
+	string name = option.substr(2, equals - 2);
+	string value = option.substr(equals + 1);
+
+	if (name == "engine") {
+		if (value == "threads") {
+			engine = Engine::Threads;
+		}
+		else if (value == "coroutines") {
+			engine = Engine::Coroutines;
+		}
+		else if (value == "io_uring") {
+			engine = Engine::IoUring;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "model") {
+		if (value == "queue") {
+			model = WorkerModel::Queue;
+		}
+		else if (value == "leader-follower") {
+			model = WorkerModel::LeaderFollower;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "socket-profile") {
+		if (value == "default") {
+			socket_profile = SocketProfile::Default;
+		}
+		else if (value == "latency") {
+			socket_profile = SocketProfile::Latency;
+		}
+		else if (value == "throughput") {
+			socket_profile = SocketProfile::Throughput;
+		}
+		else if (value == "many-connections") {
+			socket_profile = SocketProfile::ManyConnections;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "large-file-io") {
+		if (value == "sendfile") {
+			large_file_direct = false;
+		}
+		else if (value == "direct") {
+			large_file_direct = true;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "align-workers") {
+		if (value == "off") {
+			align_incoming_cpu = false;
+		}
+		else if (value == "incoming-cpu") {
+			align_incoming_cpu = true;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "file-cache-replicas") {
+		if (value == "off") {
+			file_cache_replicas = false;
+		}
+		else if (value == "numa") {
+			file_cache_replicas = true;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	if (name == "worker-cpus") {
+		worker_cpus = CpuAffinity::parseList(value);
+		return !worker_cpus.empty();
+	}
+
+	if (name == "admin-path") {
+		admin_path = value;
+		while (!admin_path.empty() && admin_path.back() == '/') admin_path.pop_back();
+		return !admin_path.empty() && admin_path[0] == '/';
+	}
+
+	if (name == "proxy") {
+		// PREFIX=BACKEND[,BACKEND...]; the value's own '=' splits the two
+		size_t split = value.find('=');
+		if (split == string::npos) return false;
+
+		ProxyRoute route;
+		route.prefix = value.substr(0, split);
+		while (!route.prefix.empty() && route.prefix.back() == '/') route.prefix.pop_back();
+
+		size_t start = split + 1;
+		while (start <= value.size()) {
+			size_t comma = std::min(value.find(',', start), value.size());
+			if (comma == start) return false;
+			route.backends.push_back(value.substr(start, comma - start));
+			start = comma + 1;
+		}
+
+		proxy_routes.push_back(std::move(route));
+		return value[0] == '/';
+	}
+
+	if (name == "proxy-health-path") {
+		proxy_health_path = value;
+		return !value.empty() && value[0] == '/';
+	}
+
+	if (name == "tls-cert") {
+		tls_cert = value;
+		return !value.empty();
+	}
+
+	if (name == "tls-key") {
+		tls_key = value;
+		return !value.empty();
+	}
+
+	if (name == "unix-socket") {
+		unix_socket = value;
+		return !value.empty();
+	}
+
+	if (name == "access-log") {
+		access_log = value;
+		return !value.empty();
+	}
+
+	if (name == "error-pages") {
+		error_pages = value;
+		return !value.empty();
+	}
+
+	try {
+		size_t parsed;
+		if (name == "rate-limit") {
+			rate_limit = std::stod(value, &parsed);
+			return parsed == value.size() && rate_limit >= 0;
+		}
+		if (name == "rate-burst") {
+			rate_burst = std::stod(value, &parsed);
+			return parsed == value.size() && rate_burst >= 1;
+		}
+		if (name == "max-conns-per-ip") {
+			max_connections_per_ip = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "acceptor-cpu") {
+			acceptor_cpu = std::stoi(value, &parsed);
+			return parsed == value.size() && acceptor_cpu >= 0;
+		}
+		if (name == "processes") {
+			processes = std::stoul(value, &parsed);
+			return parsed == value.size() && processes >= 1 && processes <= 256;
+		}
+		if (name == "unix-peer-uid") {
+			unix_peer_uid = std::stol(value, &parsed);
+			return parsed == value.size() && unix_peer_uid >= 0;
+		}
+		if (name == "warm-up-threads") {
+			warm_up_threads = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "drain-timeout") {
+			drain_timeout = std::stod(value, &parsed);
+			return parsed == value.size() && drain_timeout >= 0;
+		}
+		if (name == "warm-up-deadline") {
+			warm_up_deadline = std::stod(value, &parsed);
+			return parsed == value.size() && warm_up_deadline >= 0;
+		}
+		if (name == "hot-files") {
+			hot_files = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "file-cache") {
+			file_cache_mib = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "proxy-pool") {
+			proxy_pool = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "large-file") {
+			large_file_mib = std::stoul(value, &parsed);
+			return parsed == value.size();
+		}
+		if (name == "max-header-size") {
+			max_header_size = std::stoul(value, &parsed);
+			return parsed == value.size() && max_header_size > 0;
+		}
+		if (name == "header-timeout") {
+			header_timeout = std::stod(value, &parsed);
+			return parsed == value.size() && header_timeout > 0;
+		}
+		if (name == "header-memory") {
+			header_memory_mib = std::stoul(value, &parsed);
+			return parsed == value.size() && header_memory_mib > 0;
+		}
+	}
+	catch (const std::logic_error&) {
+		// not a number (or way too big of one)
+		return false;
+	}
+
+	return false;
+}
@@ -0,0 +1,148 @@
+#ifndef SERVERCONFIG_HPP
+#define SERVERCONFIG_HPP
+
+/**
+ * File: ServerConfig.hpp
+ *
+ * Settings that ToreroServe is started with.
+ */
+
+#include <string>
+#include <vector>
+
+/**
+ * How connections get from the listening socket to the workers.
+ */
+enum class WorkerModel {
+	// one acceptor thread hands connections to workers through a BoundedBuffer
+	Queue,
+
+	// workers take turns waiting in accept and handle what they accept
+	LeaderFollower,
+};
+
+/**
+ * What runs the requests.
+ */
+enum class Engine {
+	// blocking calls on a pool of worker threads (organized by WorkerModel)
+	Threads,
+
+	// coroutines on one epoll event loop per thread
+	Coroutines,
+
+	// every system call of a request goes through one io_uring per thread
+	IoUring,
+};
+
+/**
+ * Named sets of options for the listening socket and the sockets accepted
+ * from it (see SocketOptions.hpp).
+ */
+enum class SocketProfile {
+	// a short accept queue and the kernel's defaults otherwise
+	Default,
+
+	// responses out the moment they are written
+	Latency,
+
+	// full segments, few wakeups
+	Throughput,
+
+	// lots of (mostly idle) clients at once
+	ManyConnections,
+};
+
+struct ServerConfig {
+	unsigned short int port = 0;
+	std::string root_dir;
+
+	// listen on this unix domain socket ('@' for the abstract namespace)
+	// instead of the TCP port, optionally only letting in one user (or root)
+	std::string unix_socket;
+	long unix_peer_uid = -1;
+
+	Engine engine = Engine::Threads;
+	WorkerModel model = WorkerModel::Queue;
+	SocketProfile socket_profile = SocketProfile::Default;
+
+	// worker processes, each running the engine (more than 1 means prefork)
+	unsigned processes = 1;
+
+	// CPUs the workers (or worker processes) take in turn, and the
+	// acceptor's (-1: any of the workers'); none means nothing is pinned.
+	// With align_incoming_cpu, each worker process gets the connections that
+	// come in on its CPU (see CpuAffinity.hpp)
+	std::vector<int> worker_cpus;
+	int acceptor_cpu = -1;
+	bool align_incoming_cpu = false;
+
+	// HTTPS is used when a certificate is given; the key defaults to being
+	// in the same file
+	std::string tls_cert;
+	std::string tls_key;
+
+	// per client address limits; 0 turns a limit off
+	double rate_limit = 0;  // requests per second
+	double rate_burst = 0;  // requests allowed back to back (default: rate_limit)
+	unsigned max_connections_per_ip = 0;
+
+	// where requests are logged (nowhere if empty)
+	std::string access_log;
+
+	// startup warm-up: index the tree with this many threads (0 skips it),
+	// loading the files most requested in the access log into memory
+	unsigned warm_up_threads = 0;
+	double warm_up_deadline = 10; // seconds before listening regardless
+	unsigned hot_files = 100;
+
+	// MiB of file contents cached while serving (0 turns the cache off)
+	size_t file_cache_mib = 0;
+
+	// whether hot cached files get a copy on every NUMA node they're read on
+	bool file_cache_replicas = false;
+
+	// directory with STATUS.html bodies for the error responses (empty: the
+	// built-in ones)
+	std::string error_pages;
+
+	// files of at least this many MiB are sent without filling the page
+	// cache (0 turns that off), optionally with O_DIRECT reads
+	size_t large_file_mib = 0;
+	bool large_file_direct = false;
+
+	// where the server's own endpoints (health, stats, ...) live, e.g.
+	// "/_torero" (nowhere if empty)
+	std::string admin_path;
+
+	// requests under a path prefix are forwarded to that prefix's backends
+	// ("host:port" each), keeping up to proxy_pool idle connections to each
+	// one (see ReverseProxy.hpp)
+	struct ProxyRoute {
+		std::string prefix;
+		std::vector<std::string> backends;
+	};
+	std::vector<ProxyRoute> proxy_routes;
+	std::string proxy_health_path = "/";
+	size_t proxy_pool = 32;
+
+	// seconds an upgraded process (see Upgrade.hpp) waits for its open
+	// connections before exiting anyway
+	double drain_timeout = 30;
+
+	// what a request header may cost before it's in (see HeaderBudget.hpp):
+	// its size, the seconds it may take, and the MiB all partial headers
+	// may take together
+	size_t max_header_size = 32768;
+	double header_timeout = 10;
+	size_t header_memory_mib = 64;
+
+	/**
+	 * Applies a single "--name=value" command line option.
+	 *
+	 * @param option The option, as given on the command line.
+	 * @return false if the option is unknown or its value is invalid.
+	 */
+	bool setOption(const std::string& option);
+};
+#endif
@@ -3,19 +3,25 @@
  *
  * Implementation of ServerSocket class.
  *
- * DO NOT MODIFY THIS FILE IN ANY WAY!
- *
  * Author: Sat Garcia (sat@sandiego.edu)
  */
 
 // operating system specific libraries
 #include <sys/socket.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
 #include <netinet/in.h>
 
 // C standard library
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <cstddef>
+#include <cstring>
 
 // C++ standard library
 #include <utility>
@@ -23,11 +29,14 @@
 // This will limit how many clients can be waiting for a connection.
 static const int BACKLOG = 10;
 
+// how long to back off when accept runs out of file descriptors (or memory)
+static const useconds_t RESOURCE_BACKOFF_USEC = 10000;
+
 #include "ClientSocket.hpp"
 #include "ServerSocket.hpp"
 
-ServerSocket::ServerSocket(unsigned short int port_num) : port_num(port_num) {
-    this->socket_fd = socket(AF_INET, SOCK_STREAM, 0);
+ServerSocket::ServerSocket(unsigned short int port_num) : port_num(port_num), backlog(BACKLOG) {
+    this->socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (this->socket_fd < 0) {
         perror("Creating socket failed");
         exit(1);
@@ -57,12 +66,98 @@ ServerSocket::ServerSocket(unsigned short int port_num) : port_num(port_num) {
     }
 };
 
+ServerSocket::ServerSocket(const std::string& unix_path) : unix_path(unix_path), backlog(BACKLOG) {
+	this->socket_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (this->socket_fd < 0) {
+		perror("Creating socket failed");
+		exit(1);
+	}
+
+	// the path has to fit in sun_path, with room for the terminating NUL
+	if (unix_path.empty() || unix_path.size() >= sizeof(sockaddr_un::sun_path)) {
+		fprintf(stderr, "Unix socket path must be 1 to %zu characters long\n",
+				sizeof(sockaddr_un::sun_path) - 1);
+		exit(1);
+	}
+}
+
+ServerSocket ServerSocket::adopt(int listening_fd) {
+	ServerSocket server;
+	server.socket_fd = listening_fd;
+	server.createStopFd();
+
+	// it should be already, but the accept loops depend on it
+	fcntl(listening_fd, F_SETFL, fcntl(listening_fd, F_GETFL) | O_NONBLOCK);
+	return server;
+}
+
 ServerSocket& ServerSocket::operator=(ServerSocket&& other) {
     std::swap(this->socket_fd, other.socket_fd);
+    std::swap(this->port_num, other.port_num);
+    std::swap(this->unix_path, other.unix_path);
+    std::swap(this->peer_uid, other.peer_uid);
+    std::swap(this->backlog, other.backlog);
+    std::swap(this->stop_fd, other.stop_fd);
+    this->accepting = other.accepting.exchange(this->accepting);
     return *this;
 }
 
-ServerSocket::~ServerSocket() { close(this->socket_fd); }
+ServerSocket::~ServerSocket() {
+	close(this->socket_fd);
+	if (this->stop_fd >= 0) close(this->stop_fd);
+}
+
+void ServerSocket::createStopFd() {
+	this->stop_fd = eventfd(0, EFD_CLOEXEC);
+	if (this->stop_fd < 0) {
+		perror("Creating eventfd failed");
+		exit(1);
+	}
+}
+
+/**
+ * Binds a unix domain socket to the given path ('@' for the abstract
+ * namespace), replacing the socket file left behind by a previous run.
+ *
+ * @return The return value of bind.
+ */
+static int bindUnix(int socket_fd, const std::string& path) {
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	memcpy(addr.sun_path, path.data(), path.size());
+
+	socklen_t addr_len = offsetof(struct sockaddr_un, sun_path) + path.size();
+	if (path[0] == '@') {
+		// abstract names start with a NUL and are exactly addr_len long
+		addr.sun_path[0] = '\0';
+	}
+	else {
+		// a stale socket file would make bind fail; don't touch anything else
+		struct stat info;
+		if (lstat(path.c_str(), &info) == 0 && S_ISSOCK(info.st_mode)) {
+			unlink(path.c_str());
+		}
+		addr_len++;
+	}
+
+	return bind(socket_fd, (struct sockaddr*)&addr, addr_len);
+}
+
+void ServerSocket::enableReusePort() {
+	int reuse_true = 1;
+	if (setsockopt(this->socket_fd, SOL_SOCKET, SO_REUSEPORT, &reuse_true, sizeof(reuse_true)) < 0) {
+		perror("Setting socket option failed");
+		exit(1);
+	}
+}
+
+void ServerSocket::setIncomingCpu(int cpu) {
+	// connections still get spread over the group without it, so go on
+	if (setsockopt(this->socket_fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu)) < 0) {
+		perror("Setting SO_INCOMING_CPU failed");
+	}
+}
 
 void ServerSocket::startListening() {
     struct sockaddr_in addr;
@@ -74,7 +169,9 @@ void ServerSocket::startListening() {
 	 * As its name implies, this system call asks the OS to bind the socket to
      * address and port specified above.
 	 */
-    int retval = bind(this->socket_fd, (struct sockaddr*)&addr, sizeof(addr));
+    int retval = this->unix_path.empty()
+        ? bind(this->socket_fd, (struct sockaddr*)&addr, sizeof(addr))
+        : bindUnix(this->socket_fd, this->unix_path);
     if (retval < 0) {
         perror("Error binding to port");
         exit(1);
@@ -83,15 +180,85 @@ void ServerSocket::startListening() {
     /* 
 	 * Now that we've bound to an address and port, we tell the OS that we're
      * ready to start listening for client connections. This effectively
-	 * activates the server socket. BACKLOG (a global constant defined above)
-	 * tells the OS how much space to reserve for incoming connections that have
-	 * not yet been accepted.
+	 * activates the server socket. The backlog (BACKLOG, a global constant
+	 * defined above, unless setBacklog changed it) tells the OS how much space
+	 * to reserve for incoming connections that have not yet been accepted.
 	 */
-    retval = listen(this->socket_fd, BACKLOG);
+    retval = listen(this->socket_fd, this->backlog);
     if (retval < 0) {
         perror("Error listening for connections");
         exit(1);
     }
+
+    /*
+     * The listening socket is non-blocking so that we can drain all of the
+     * connections waiting in the backlog without getting stuck on the last
+     * one. We wait for new connections with poll instead (see
+     * waitForConnection).
+     */
+    fcntl(this->socket_fd, F_SETFL, fcntl(this->socket_fd, F_GETFL) | O_NONBLOCK);
+
+    createStopFd();
+}
+
+/**
+ * Blocks until there is at least one connection waiting to be accepted, or
+ * forever once stopAccepting has been called.
+ */
+void ServerSocket::waitForConnection() {
+	struct pollfd pfds[2];
+	pfds[0].fd = this->socket_fd;
+	pfds[0].events = POLLIN;
+	pfds[1].fd = this->stop_fd;
+	pfds[1].events = POLLIN;
+
+	while (poll(pfds, 2, -1) < 0) {
+		if (errno != EINTR) {
+			perror("Error waiting for connections");
+			exit(1);
+		}
+	}
+
+	if (!this->accepting) {
+		// leave the connections to whoever took the socket over
+		while (true) pause();
+	}
+}
+
+void ServerSocket::stopAccepting() {
+	this->accepting = false;
+
+	// the counter stays non-zero, so every poll on it returns right away
+	uint64_t one = 1;
+	if (write(this->stop_fd, &one, sizeof(one)) < 0) {
+		perror("Waking up the accepting threads failed");
+	}
+}
+
+/**
+ * Tells whether the given accept error only affected that one connection
+ * (e.g. the client gave up before we got to it), in which case we can simply
+ * move on to the next one.
+ */
+static bool isConnectionError(int error) {
+	return error == EINTR || error == ECONNABORTED || error == EPROTO;
+}
+
+/**
+ * Tells whether the given accept error means we're temporarily out of some
+ * resource (e.g. file descriptors). Connections stay in the backlog, so we
+ * back off for a moment rather than give up.
+ */
+static bool isResourceError(int error) {
+	return error == EMFILE || error == ENFILE || error == ENOBUFS || error == ENOMEM;
+}
+
+/**
+ * @return The IPv4 address filled in by accept, or 0 if the client isn't an
+ * IPv4 one (e.g. it came in over a unix domain socket).
+ */
+static uint32_t ipv4Address(const struct sockaddr_in& remote_addr) {
+	return remote_addr.sin_family == AF_INET ? remote_addr.sin_addr.s_addr : 0;
 }
 
 ClientSocket ServerSocket::acceptConnection() {
@@ -110,11 +277,82 @@ ClientSocket ServerSocket::acceptConnection() {
 	 * there are no pending connections in the back log, this function will
 	 * block indefinitely while waiting for a client connection to be made.
 	 */
-	int sock = accept(this->socket_fd, (struct sockaddr*) &remote_addr, &socklen);
-	if (sock < 0) {
-		perror("Error accepting connection");
-		exit(1);
+	if (!this->accepting) {
+		waitForConnection();
+	}
+
+	int sock;
+	while ((sock = accept4(this->socket_fd, (struct sockaddr*) &remote_addr, &socklen, SOCK_CLOEXEC)) < 0
+			|| !isPeerAllowed(sock)) {
+		if (sock >= 0) {
+			close(sock); // someone we don't talk to
+		}
+		else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			waitForConnection();
+		}
+		else if (isResourceError(errno)) {
+			usleep(RESOURCE_BACKOFF_USEC);
+		}
+		else if (!isConnectionError(errno)) {
+			perror("Error accepting connection");
+			exit(1);
+		}
+		socklen = sizeof(remote_addr);
+	}
+
+	return ClientSocket(sock, ipv4Address(remote_addr));
+}
+
+size_t ServerSocket::acceptConnections(std::vector<ClientSocket>& clients, size_t max_clients) {
+	size_t num_accepted = 0;
+
+	while (num_accepted == 0) {
+		waitForConnection();
+		num_accepted = acceptPending(clients, max_clients);
 	}
 
-	return ClientSocket(sock);
+	return num_accepted;
+}
+
+size_t ServerSocket::acceptPending(std::vector<ClientSocket>& clients, size_t max_clients) {
+	size_t num_accepted = 0;
+
+	// drain the backlog; the accepted sockets themselves stay blocking
+	while (num_accepted < max_clients && this->accepting) {
+		// the client's address comes for free here (the rate limiter wants it)
+		struct sockaddr_in remote_addr;
+		socklen_t socklen = sizeof(remote_addr);
+		int sock = accept4(this->socket_fd, (struct sockaddr*) &remote_addr, &socklen, SOCK_CLOEXEC);
+		if (sock < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+			if (isConnectionError(errno)) continue;
+			if (isResourceError(errno)) {
+				if (num_accepted == 0) usleep(RESOURCE_BACKOFF_USEC);
+				break;
+			}
+			perror("Error accepting connection");
+			exit(1);
+		}
+
+		if (!isPeerAllowed(sock)) {
+			close(sock);
+			continue;
+		}
+
+		clients.push_back(ClientSocket(sock, ipv4Address(remote_addr)));
+		num_accepted++;
+	}
+
+	return num_accepted;
+}
+
+bool ServerSocket::isPeerAllowed(int client_fd) const {
+	if (this->peer_uid == (uid_t) -1) return true;
+
+	struct ucred credentials;
+	socklen_t length = sizeof(credentials);
+	if (getsockopt(client_fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length) < 0) {
+		return false;
+	}
+	return credentials.uid == this->peer_uid || credentials.uid == 0;
 }
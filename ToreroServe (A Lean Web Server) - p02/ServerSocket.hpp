@@ -6,11 +6,14 @@
  *
  * Header file for ServerSocket class.
  *
- * DO NOT MODIFY THIS FILE IN ANY WAY!
- *
  * Author: Sat Garcia (sat@sandiego.edu)
  */
 
+#include <atomic>
+#include <vector>
+#include <string>
+#include <sys/types.h>
+
 class ClientSocket; // forward declaration
 
 class ServerSocket {
@@ -19,6 +22,23 @@ class ServerSocket {
 		 * Creates socket that will be bound to the given port number.
 		 */
 		ServerSocket(unsigned short int port_num);
+
+		/*
+		 * Creates a unix domain socket that will be bound to the given path.
+		 * A path starting with '@' names a socket in the abstract namespace,
+		 * which lives only as long as the socket does (no file involved).
+		 */
+		ServerSocket(const std::string& unix_path);
+
+		/**
+		 * Takes over a socket that is already listening (e.g. one handed
+		 * over by another process), options and all. startListening must not
+		 * be called on it.
+		 *
+		 * @param listening_fd The socket, which the ServerSocket now owns.
+		 * @return The ServerSocket.
+		 */
+		static ServerSocket adopt(int listening_fd);
 		
 		// destructor (closes socket)
 		~ServerSocket();
@@ -28,13 +48,42 @@ class ServerSocket {
 		void operator=(const ServerSocket&) = delete;
 
 		// move constructor
-		ServerSocket(ServerSocket&& other) : socket_fd{other.socket_fd} {
+		ServerSocket(ServerSocket&& other) : socket_fd{other.socket_fd},
+				port_num{other.port_num}, unix_path{std::move(other.unix_path)},
+				peer_uid{other.peer_uid}, backlog{other.backlog},
+				stop_fd{other.stop_fd}, accepting{other.accepting.load()} {
 			other.socket_fd = -1;
+			other.stop_fd = -1;
 		}
 
 		// move assignment operator (swap)
 		ServerSocket& operator=(ServerSocket&& other);
 
+		/**
+		 * Lets other sockets listen on the same port (SO_REUSEPORT), with the
+		 * kernel spreading new connections over all of them. Must be called
+		 * before startListening.
+		 */
+		void enableReusePort();
+
+		/**
+		 * In an SO_REUSEPORT group, has the kernel give this socket the
+		 * connections whose packets come in on the given CPU (that is, from
+		 * the NIC receive queue whose interrupts go there), if it is the
+		 * group's socket for that CPU (SO_INCOMING_CPU).
+		 *
+		 * @param cpu The CPU.
+		 */
+		void setIncomingCpu(int cpu);
+
+		/**
+		 * Sets how many connections may wait to be accepted (10 unless set).
+		 * Must be called before startListening.
+		 *
+		 * @param backlog The length of the accept queue.
+		 */
+		void setBacklog(int backlog) { this->backlog = backlog; }
+
 		/**
 		 * Starts listening for incoming connections.
 		 */
@@ -47,8 +96,74 @@ class ServerSocket {
 		 */
 		ClientSocket acceptConnection();
 
+		/**
+		 * Waits for at least one client, then accepts every client that is
+		 * already waiting (up to max_clients) without blocking again.
+		 *
+		 * @param clients Vector that the newly connected clients are appended to.
+		 * @param max_clients The most clients to accept in one call.
+		 * @return The number of clients accepted.
+		 */
+		size_t acceptConnections(std::vector<ClientSocket>& clients, size_t max_clients);
+
+		/**
+		 * Accepts the clients that are already waiting (up to max_clients),
+		 * without waiting for any.
+		 *
+		 * @param clients Vector that the newly connected clients are appended to.
+		 * @param max_clients The most clients to accept in one call.
+		 * @return The number of clients accepted (possibly 0).
+		 */
+		size_t acceptPending(std::vector<ClientSocket>& clients, size_t max_clients);
+
+		/**
+		 * Stops this process from accepting on the socket, for good, without
+		 * touching the socket itself (another process may be accepting from
+		 * it by now). Threads waiting for a connection, and any that start
+		 * waiting later, never get one: they just stay blocked until the
+		 * process exits. acceptPending accepts nothing from then on.
+		 */
+		void stopAccepting();
+
+		/**
+		 * @return The file descriptor of the listening socket.
+		 */
+		int getFd() const { return socket_fd; }
+
+		/**
+		 * Only lets in unix domain clients running as the given user (or as
+		 * root), according to their SO_PEERCRED credentials. Anyone else is
+		 * disconnected right after being accepted.
+		 *
+		 * @param uid The user allowed to connect.
+		 */
+		void requirePeerUid(uid_t uid) { peer_uid = uid; }
+
+		/**
+		 * Checks a newly accepted client against requirePeerUid. For code that
+		 * accepts clients without going through this class (e.g. io_uring).
+		 *
+		 * @param client_fd The accepted client's socket.
+		 * @return false if the client must be disconnected.
+		 */
+		bool isPeerAllowed(int client_fd) const;
+
 	private:
 		int socket_fd;
-		unsigned short int port_num;
+		unsigned short int port_num = 0;
+		std::string unix_path; // empty for TCP sockets
+		uid_t peer_uid = -1;   // -1 means anyone
+		int backlog;
+
+		// eventfd that wakes the threads waiting for connections once we stop
+		// accepting (created when listening starts)
+		int stop_fd = -1;
+		std::atomic<bool> accepting{true};
+
+		// for adopt
+		ServerSocket() : socket_fd(-1), backlog(0) {}
+
+		void createStopFd();
+		void waitForConnection();
 };
 #endif
@@ -0,0 +1,81 @@
+/**
+ * File: ServerStats.cpp
+ *
+ * Implementation of the ServerStats class.
+ * See the associated header file (ServerStats.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <sys/mman.h>
+
+// C standard library
+#include <cstdio>
+#include <cstdlib>
+
+#include "ServerStats.hpp"
+
+ServerStats::ServerStats(int num_workers) : num_workers(num_workers) {
+	// anonymous shared memory starts out zeroed, which is what the counters
+	// (plain lock-free atomics) need
+	void *mapping = mmap(nullptr, sizeof(Counters) * num_workers, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) {
+		perror("Mapping the stats counters failed");
+		exit(1);
+	}
+	slots = static_cast<Counters*>(mapping);
+}
+
+ServerStats::~ServerStats() {
+	munmap(slots, sizeof(Counters) * num_workers);
+}
+
+void ServerStats::record(int status, long num_bytes) {
+	Counters& counters = slots[worker];
+	counters.requests.fetch_add(1, std::memory_order_relaxed);
+	if (num_bytes > 0) {
+		counters.bytes.fetch_add(num_bytes, std::memory_order_relaxed);
+	}
+	if (status >= 100 && status < 600) {
+		counters.by_class[status / 100].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void ServerStats::recordRestart(int worker) {
+	slots[worker].restarts.fetch_add(1, std::memory_order_relaxed);
+}
+
+ServerStats::Totals ServerStats::totals(int worker) const {
+	Totals totals;
+	for (int w = 0; w < num_workers; w++) {
+		if (worker != -1 && w != worker) continue;
+
+		totals.requests += slots[w].requests.load(std::memory_order_relaxed);
+		totals.bytes += slots[w].bytes.load(std::memory_order_relaxed);
+		totals.restarts += slots[w].restarts.load(std::memory_order_relaxed);
+		for (int c = 0; c < 6; c++) {
+			totals.by_class[c] += slots[w].by_class[c].load(std::memory_order_relaxed);
+		}
+	}
+	return totals;
+}
+
+void ServerStats::print(std::ostream& out) const {
+	auto printTotals = [&out](const char* label, const Totals& totals) {
+		out << label << ": " << totals.requests << " requests, " << totals.bytes << " body bytes (";
+		for (int c = 2; c <= 5; c++) {
+			out << c << "xx: " << totals.by_class[c] << (c < 5 ? ", " : ")");
+		}
+		if (totals.restarts > 0) out << ", " << totals.restarts << " restarts";
+		out << "\n";
+	};
+
+	printTotals("total", totals(-1));
+	for (int w = 0; w < num_workers; w++) {
+		char label[32];
+		snprintf(label, sizeof(label), "worker %d", w);
+		printTotals(label, totals(w));
+	}
+	out.flush();
+}
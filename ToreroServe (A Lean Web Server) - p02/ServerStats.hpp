@@ -0,0 +1,89 @@
+#ifndef SERVERSTATS_HPP
+#define SERVERSTATS_HPP
+
+/**
+ * File: ServerStats.hpp
+ *
+ * Header file for the ServerStats class.
+ */
+
+#include <atomic>
+#include <ostream>
+#include <cstdint>
+
+/**
+ * Request counters kept in a shared anonymous mapping, so that they survive
+ * fork: every worker process bumps the counters of its own slot, and the
+ * master (which never touches them otherwise) adds the slots up when asked.
+ *
+ * Each slot has a cache line (or a few) to itself, so processes never fight
+ * over one. Threads of the same process do share their slot; the counters
+ * are relaxed atomics, which keeps that cheap.
+ */
+class ServerStats {
+	public:
+		static const int MAX_WORKERS = 256;
+
+		/**
+		 * Maps the counters, exiting with an error message if that fails.
+		 *
+		 * @param num_workers How many slots to make (1 to MAX_WORKERS).
+		 */
+		ServerStats(int num_workers);
+		~ServerStats();
+
+		ServerStats(const ServerStats&) = delete;
+		void operator=(const ServerStats&) = delete;
+
+		/**
+		 * Picks the slot that this process counts in (call right after fork).
+		 * A restarted worker takes over the slot of the one it replaces.
+		 */
+		void setWorker(int worker) { this->worker = worker; }
+
+		/**
+		 * Counts a request.
+		 *
+		 * @param status The status code of the response.
+		 * @param num_bytes Size of the response body, or -1 if unknown.
+		 */
+		void record(int status, long num_bytes);
+
+		/**
+		 * Counts a restart of the given worker.
+		 */
+		void recordRestart(int worker);
+
+		/**
+		 * Prints the totals, followed by a line per worker.
+		 */
+		void print(std::ostream& out) const;
+
+		struct Totals {
+			uint64_t requests = 0;
+			uint64_t bytes = 0;
+			uint64_t by_class[6] = {};
+			uint64_t restarts = 0;
+		};
+
+		/**
+		 * @param worker The worker, or -1 for all of them together.
+		 * @return What that worker (or the server) has counted so far.
+		 */
+		Totals totals(int worker) const;
+
+		int numWorkers() const { return num_workers; }
+
+	private:
+		struct alignas(64) Counters {
+			std::atomic<uint64_t> requests;
+			std::atomic<uint64_t> bytes;
+			std::atomic<uint64_t> by_class[6]; // index 1 counts 1xx, 2 counts 2xx, ...
+			std::atomic<uint64_t> restarts;
+		};
+
+		Counters *slots;
+		int num_workers;
+		int worker = 0;
+};
+#endif
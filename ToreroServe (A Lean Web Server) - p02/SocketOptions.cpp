@@ -0,0 +1,101 @@
+/**
+ * File: SocketOptions.cpp
+ *
+ * Implementation of SocketOptions.
+ * See the associated header file (SocketOptions.hpp) for the declaration of
+ * this struct.
+ */
+
+// operating system specific libraries
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// C standard library
+#include <cstdio>
+
+#include "SocketOptions.hpp"
+
+SocketOptions SocketOptions::forProfile(SocketProfile profile) {
+	SocketOptions options;
+
+	switch (profile) {
+		case SocketProfile::Default:
+			break;
+
+		// get every response out the moment it is written, and keep what
+		// sits in the socket buffers small
+		case SocketProfile::Latency:
+			options.backlog = 1024;
+			options.fastopen_queue = 256;
+			options.no_delay = true;
+			options.not_sent_low_water = 16384;
+			options.busy_poll_usec = 50;
+			break;
+
+		// full segments and as few wakeups as possible. The low water mark
+		// looks out of place here, but sendfile feeding a short queue beats
+		// one that lets megabytes pile up (about 1.6x for 4 MiB files over
+		// loopback), while a fixed send buffer of any size did worse than
+		// autotuning
+		case SocketProfile::Throughput:
+			options.backlog = 4096;
+			options.defer_accept_seconds = 1;
+			options.fastopen_queue = 256;
+			options.cork = true;
+			options.not_sent_low_water = 16384;
+			break;
+
+		// lots of mostly idle clients: a long accept queue, nobody accepted
+		// before they say something, and a cap on the memory each one can
+		// pin in the kernel
+		case SocketProfile::ManyConnections:
+			options.backlog = 65535;
+			options.defer_accept_seconds = 5;
+			options.fastopen_queue = 1024;
+			options.no_delay = true;
+			options.not_sent_low_water = 16384;
+			options.send_buffer = 65536;
+			break;
+	}
+
+	return options;
+}
+
+/**
+ * Sets one (integer) socket option, complaining if the kernel won't have it.
+ */
+static void setOption(int fd, int level, int name, int value, const char* description) {
+	if (setsockopt(fd, level, name, &value, sizeof(value)) < 0) {
+		fprintf(stderr, "Setting %s on the listener failed: ", description);
+		perror(nullptr);
+	}
+}
+
+void SocketOptions::applyTo(ServerSocket& server, bool is_tcp) const {
+	server.setBacklog(backlog);
+	if (!is_tcp) return;
+
+	int fd = server.getFd();
+	if (defer_accept_seconds > 0) {
+		setOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, defer_accept_seconds, "TCP_DEFER_ACCEPT");
+	}
+	if (fastopen_queue > 0) {
+		setOption(fd, IPPROTO_TCP, TCP_FASTOPEN, fastopen_queue, "TCP_FASTOPEN");
+	}
+	if (no_delay) {
+		setOption(fd, IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+	}
+	if (cork) {
+		setOption(fd, IPPROTO_TCP, TCP_CORK, 1, "TCP_CORK");
+	}
+	if (not_sent_low_water > 0) {
+		setOption(fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, not_sent_low_water, "TCP_NOTSENT_LOWAT");
+	}
+	if (send_buffer > 0) {
+		setOption(fd, SOL_SOCKET, SO_SNDBUF, send_buffer, "SO_SNDBUF");
+	}
+	if (busy_poll_usec > 0) {
+		setOption(fd, SOL_SOCKET, SO_BUSY_POLL, busy_poll_usec, "SO_BUSY_POLL");
+	}
+}
@@ -0,0 +1,74 @@
+#ifndef SOCKETOPTIONS_HPP
+#define SOCKETOPTIONS_HPP
+
+/**
+ * File: SocketOptions.hpp
+ *
+ * Header file for SocketOptions, the socket tuning behind --socket-profile.
+ */
+
+#include "ServerConfig.hpp"
+#include "ServerSocket.hpp"
+
+/**
+ * The options a socket profile sets. They all go on the listening socket:
+ * Linux copies them (TCP_NODELAY, TCP_CORK, TCP_NOTSENT_LOWAT, SO_SNDBUF and
+ * SO_BUSY_POLL included) to every socket accepted from it, so accepted
+ * sockets get tuned without a single system call of their own, whichever
+ * engine accepts them.
+ *
+ * Options a unix domain listener doesn't have (everything TCP) are skipped
+ * for one; the backlog still applies.
+ */
+struct SocketOptions {
+	// accept queue length (capped by net.core.somaxconn)
+	int backlog = 10;
+
+	// TCP_DEFER_ACCEPT: only wake us up for a connection once its request
+	// arrives, waiting up to this long for it (0 for off)
+	int defer_accept_seconds = 0;
+
+	// TCP_FASTOPEN: how many connections may be pending with a request sent
+	// along with their SYN (0 for off; also needs the server bit of
+	// net.ipv4.tcp_fastopen)
+	int fastopen_queue = 0;
+
+	// TCP_NODELAY: send small writes right away instead of waiting for the
+	// ACK of the last one (Nagle)
+	bool no_delay = false;
+
+	// TCP_CORK: only send full segments, until the socket is closed (which
+	// is when every response is done, except on HTTP/2 connections, which
+	// take the cork off)
+	bool cork = false;
+
+	// TCP_NOTSENT_LOWAT: report the socket writable only while less than
+	// this much is waiting to be sent, so that data doesn't queue up in the
+	// kernel (0 to leave it unlimited)
+	int not_sent_low_water = 0;
+
+	// SO_SNDBUF: a fixed send buffer (the kernel doubles it), which turns off
+	// autotuning; 0 leaves the buffer to autotuning
+	int send_buffer = 0;
+
+	// SO_BUSY_POLL: microseconds to busy poll the device queue on a blocking
+	// receive with nothing to read (0 for off; pointless on loopback)
+	int busy_poll_usec = 0;
+
+	/**
+	 * @param profile One of the named profiles.
+	 * @return The options that make up that profile.
+	 */
+	static SocketOptions forProfile(SocketProfile profile);
+
+	/**
+	 * Sets the options on a listener that hasn't started listening yet. An
+	 * option the kernel refuses is reported and skipped, since the server
+	 * works without any of them.
+	 *
+	 * @param server The listener.
+	 * @param is_tcp false for a unix domain listener.
+	 */
+	void applyTo(ServerSocket& server, bool is_tcp) const;
+};
+#endif
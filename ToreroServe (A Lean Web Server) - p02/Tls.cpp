@@ -0,0 +1,222 @@
+/**
+ * File: Tls.cpp
+ *
+ * Implementation of the TlsContext and TlsConnection classes.
+ * See the associated header file (Tls.hpp) for their declarations.
+ */
+
+// operating system specific libraries
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+
+// C++ standard library
+#include <algorithm>
+#include <system_error>
+
+#include <openssl/err.h>
+
+#include "Tls.hpp"
+#include "LargeFile.hpp"
+
+// ciphers that kernel TLS can take over (AES-GCM first, it is the cheapest
+// with AES-NI); anything else would leave encryption in user space
+static const char *TLS13_CIPHERSUITES =
+	"TLS_AES_128_GCM_SHA256:TLS_AES_256_GCM_SHA384:TLS_CHACHA20_POLY1305_SHA256";
+static const char *TLS12_CIPHERS = "ECDHE+AESGCM:ECDHE+CHACHA20";
+
+// protocols we speak, in ALPN wire format and order of preference
+static const unsigned char ALPN_PROTOCOLS[] = "\x02h2\x08http/1.1";
+
+// size of the reads used to send files when kTLS isn't available
+static const size_t FILE_CHUNK_SIZE = 16384;
+
+/**
+ * Prints the given message along with OpenSSL's error queue, then exits.
+ */
+static void exitWithTlsError(const char* what) {
+	fprintf(stderr, "%s\n", what);
+	ERR_print_errors_fp(stderr);
+	exit(1);
+}
+
+/**
+ * ALPN callback: picks our favorite protocol among those the client offers.
+ * Clients that offer none of ours just get no ALPN (and HTTP/1).
+ */
+static int selectProtocol(SSL*, const unsigned char** out, unsigned char* out_length,
+		const unsigned char* offered, unsigned int offered_length, void*) {
+	unsigned char *selected;
+	if (SSL_select_next_proto(&selected, out_length, ALPN_PROTOCOLS, sizeof(ALPN_PROTOCOLS) - 1,
+				offered, offered_length) != OPENSSL_NPN_NEGOTIATED) {
+		return SSL_TLSEXT_ERR_NOACK;
+	}
+	*out = selected;
+	return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::TlsContext(const std::string& cert_file, const std::string& key_file) {
+	ctx = SSL_CTX_new(TLS_server_method());
+	if (ctx == nullptr) {
+		exitWithTlsError("Creating TLS context failed");
+	}
+
+	SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+	SSL_CTX_set_ciphersuites(ctx, TLS13_CIPHERSUITES);
+	SSL_CTX_set_cipher_list(ctx, TLS12_CIPHERS);
+
+	// let OpenSSL install the keys into the kernel once the handshake is done
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS | SSL_OP_CIPHER_SERVER_PREFERENCE);
+
+	// resumption: stateless tickets (encrypted with this context's keys) for
+	// both TLS 1.3 and 1.2, plus the server-side cache for clients without
+	// ticket support. Every connection is a single request, so one ticket is
+	// all a client can use.
+	static const unsigned char session_id_context[] = "torero-serve";
+	SSL_CTX_set_session_id_context(ctx, session_id_context, sizeof(session_id_context) - 1);
+	SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+	SSL_CTX_set_num_tickets(ctx, 1);
+
+	SSL_CTX_set_alpn_select_cb(ctx, selectProtocol, nullptr);
+
+	if (SSL_CTX_use_certificate_chain_file(ctx, cert_file.c_str()) != 1) {
+		exitWithTlsError("Loading TLS certificate failed");
+	}
+	if (SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM) != 1) {
+		exitWithTlsError("Loading TLS private key failed");
+	}
+	if (SSL_CTX_check_private_key(ctx) != 1) {
+		exitWithTlsError("TLS private key does not match the certificate");
+	}
+}
+
+TlsContext::~TlsContext() {
+	SSL_CTX_free(ctx);
+}
+
+bool TlsContext::kernelTlsAvailable() {
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0) {
+		return false;
+	}
+
+	// the ULP is looked up (and its module loaded) before the socket state is
+	// checked, so on an unconnected socket ENOENT means there is no kTLS
+	int result = setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls"));
+	bool available = result == 0 || errno != ENOENT;
+	close(fd);
+	return available;
+}
+
+TlsConnection::TlsConnection(TlsContext& context, int socket_fd) : socket_fd(socket_fd) {
+	ssl = SSL_new(context.get());
+	if (ssl == nullptr || SSL_set_fd(ssl, socket_fd) != 1) {
+		fail("TLS setup failed");
+	}
+}
+
+TlsConnection::~TlsConnection() {
+	// SSL_set_fd doesn't give OpenSSL ownership, so this leaves the socket open
+	SSL_free(ssl);
+}
+
+void TlsConnection::fail(const char* what) {
+	ERR_clear_error();
+	int error = errno != 0 ? errno : EPROTO;
+	std::error_code ec(error, std::generic_category());
+	throw std::system_error(ec, what);
+}
+
+void TlsConnection::handshake() {
+	struct timeval timeout = {HANDSHAKE_TIMEOUT_SEC, 0};
+	setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	setsockopt(socket_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+	errno = 0;
+	if (SSL_accept(ssl) != 1) {
+		fail("TLS handshake failed");
+	}
+}
+
+bool TlsConnection::kernelSends() {
+	return BIO_get_ktls_send(SSL_get_wbio(ssl));
+}
+
+bool TlsConnection::negotiatedHttp2() {
+	const unsigned char *protocol;
+	unsigned int length;
+	SSL_get0_alpn_selected(ssl, &protocol, &length);
+	return length == 2 && protocol[0] == 'h' && protocol[1] == '2';
+}
+
+bool TlsConnection::hasPending() {
+	return SSL_pending(ssl) > 0;
+}
+
+size_t TlsConnection::receive(std::span<char> buffer) {
+	size_t num_bytes = 0;
+	errno = 0;
+	if (SSL_read_ex(ssl, buffer.data(), buffer.size(), &num_bytes) != 1) {
+		if (SSL_get_error(ssl, 0) == SSL_ERROR_ZERO_RETURN) {
+			return 0;
+		}
+		fail("TLS receive failed");
+	}
+	return num_bytes;
+}
+
+void TlsConnection::send(std::span<const char> data) {
+	size_t total_bytes_sent = 0;
+	while (total_bytes_sent < data.size()) {
+		size_t num_bytes_sent = 0;
+		errno = 0;
+		if (SSL_write_ex(ssl, data.data() + total_bytes_sent,
+					data.size() - total_bytes_sent, &num_bytes_sent) != 1) {
+			fail("TLS send failed");
+		}
+		total_bytes_sent += num_bytes_sent;
+	}
+}
+
+void TlsConnection::sendFile(int file_fd, off_t offset, size_t length, bool drop_behind) {
+	if (kernelSends()) {
+		while (length > 0) {
+			errno = 0;
+			ossl_ssize_t num_bytes_sent = SSL_sendfile(ssl, file_fd, offset, length, 0);
+			if (num_bytes_sent <= 0) {
+				fail("TLS sendfile failed");
+			}
+			if (drop_behind) dropPassedPages(file_fd, offset, offset + num_bytes_sent);
+			offset += num_bytes_sent;
+			length -= num_bytes_sent;
+		}
+		return;
+	}
+
+	char buffer[FILE_CHUNK_SIZE];
+	while (length > 0) {
+		ssize_t num_bytes_read = pread(file_fd, buffer, std::min(length, sizeof(buffer)), offset);
+		if (num_bytes_read <= 0) {
+			break; // the file got shorter; nothing more we can send
+		}
+		send(std::span<const char>(buffer, num_bytes_read));
+		if (drop_behind) dropPassedPages(file_fd, offset, offset + num_bytes_read);
+		offset += num_bytes_read;
+		length -= num_bytes_read;
+	}
+}
+
+void TlsConnection::shutdown() {
+	SSL_shutdown(ssl);
+}
+
+void TlsConnection::detach() {
+	SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN);
+}
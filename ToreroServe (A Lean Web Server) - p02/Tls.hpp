@@ -0,0 +1,131 @@
+#ifndef TLS_HPP
+#define TLS_HPP
+
+/**
+ * File: Tls.hpp
+ *
+ * HTTPS support: the handshake is done in user space with OpenSSL, and then
+ * (when the kernel supports it) record encryption is handed over to kernel
+ * TLS. From that point on, plain send and sendfile calls on the socket come
+ * out encrypted, so responses go through the usual (zero-copy) path.
+ */
+
+#include <span>
+#include <string>
+#include <sys/types.h>
+
+#include <openssl/ssl.h>
+
+/**
+ * Server-wide TLS settings: certificate, key, ciphers and session ticket
+ * keys. One context is shared by all workers, which also means that a
+ * ticket issued by one worker can be used to resume with any other.
+ */
+class TlsContext {
+	public:
+		/**
+		 * Loads the certificate (chain) and private key, exiting with an
+		 * error message if either can't be used.
+		 *
+		 * @param cert_file PEM file with the certificate chain.
+		 * @param key_file PEM file with the private key (may be cert_file).
+		 */
+		TlsContext(const std::string& cert_file, const std::string& key_file);
+		~TlsContext();
+
+		TlsContext(const TlsContext&) = delete;
+		void operator=(const TlsContext&) = delete;
+
+		/**
+		 * @return Whether the kernel has the "tls" upper layer protocol, i.e.
+		 * whether connections can hand their records over to it at all.
+		 */
+		static bool kernelTlsAvailable();
+
+		SSL_CTX* get() { return ctx; }
+
+	private:
+		SSL_CTX *ctx;
+};
+
+/**
+ * One TLS connection on top of an accepted (blocking) client socket. The
+ * connection doesn't own the socket: destroying it leaves the socket open,
+ * which is what allows the socket to be handed to the ResponseWriter once
+ * the kernel does the encryption.
+ *
+ * Like ClientSocket, operations throw std::system_error when they fail.
+ */
+class TlsConnection {
+	public:
+		TlsConnection(TlsContext& context, int socket_fd);
+		~TlsConnection();
+
+		TlsConnection(const TlsConnection&) = delete;
+		void operator=(const TlsConnection&) = delete;
+
+		/**
+		 * Performs the server side of the handshake, giving up if the client
+		 * takes longer than HANDSHAKE_TIMEOUT_SEC for any step.
+		 */
+		void handshake();
+
+		/**
+		 * @return Whether records sent on the socket are encrypted by the
+		 * kernel (kTLS), so the socket can be written to directly.
+		 */
+		bool kernelSends();
+
+		/**
+		 * @return Whether the client picked HTTP/2 ("h2") through ALPN.
+		 */
+		bool negotiatedHttp2();
+
+		/**
+		 * @return Whether OpenSSL already has received data buffered, which
+		 * poll on the socket wouldn't tell.
+		 */
+		bool hasPending();
+
+		/**
+		 * Receives whatever application data is available.
+		 *
+		 * @return The number of bytes received (0 if the peer closed).
+		 */
+		size_t receive(std::span<char> buffer);
+
+		/**
+		 * Sends all of the given data.
+		 */
+		void send(std::span<const char> data);
+
+		/**
+		 * Sends length bytes of the given file, starting at offset. With
+		 * kTLS this is a sendfile; otherwise the file is read and encrypted
+		 * in user space. The sent pages are dropped from the page cache if
+		 * asked to (see LargeFile.hpp).
+		 */
+		void sendFile(int file_fd, off_t offset, size_t length, bool drop_behind = false);
+
+		/**
+		 * Sends a close_notify alert (without waiting for the client's).
+		 */
+		void shutdown();
+
+		/**
+		 * Marks the connection as cleanly finished without sending anything,
+		 * for when the socket lives on (with kTLS) after this object is gone.
+		 * Otherwise OpenSSL takes the session to be broken and drops it from
+		 * the session cache.
+		 */
+		void detach();
+
+	private:
+		static const int HANDSHAKE_TIMEOUT_SEC = 10;
+
+		SSL *ssl;
+		int socket_fd;
+
+		[[noreturn]] void fail(const char* what);
+};
+#endif
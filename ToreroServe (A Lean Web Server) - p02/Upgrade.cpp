@@ -0,0 +1,307 @@
+/**
+ * File: Upgrade.cpp
+ *
+ * Implementation of the Upgrade class.
+ * See the associated header file (Upgrade.hpp) for the declaration of this
+ * class.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+// C standard library
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// C++ standard library
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ClientSocket.hpp"
+#include "Upgrade.hpp"
+
+using std::cout;
+using std::string;
+using std::vector;
+
+// environment variable that tells a new process which descriptor the old one
+// is at the other end of
+static const char UPGRADE_FD_VARIABLE[] = "TORERO_UPGRADE_FD";
+
+// how long the new process gets to start serving (the index may have to be
+// built from scratch, if the snapshot can't be used)
+static const int READY_TIMEOUT_MS = 60000;
+
+// how long to let the accepting threads finish what they were doing before
+// counting the connections that are left
+static const useconds_t STOP_GRACE_USEC = 100000;
+
+// what the new process says once it is serving
+static const char READY_MESSAGE = 'R';
+
+// new process: the connection to the old one, until ready() is called
+static int old_process_fd = -1;
+
+bool Upgrade::receive(Handover& handover) {
+	const char *variable = getenv(UPGRADE_FD_VARIABLE);
+	if (variable == nullptr) return false;
+
+	// our own children aren't upgrades
+	old_process_fd = atoi(variable);
+	unsetenv(UPGRADE_FD_VARIABLE);
+	fcntl(old_process_fd, F_SETFD, FD_CLOEXEC);
+
+	// which of the optional descriptors follow the listener
+	char has[2];
+	struct iovec data = { has, sizeof(has) };
+	union {
+		char buffer[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+
+	struct msghdr message = {};
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+
+	ssize_t n;
+	while ((n = recvmsg(old_process_fd, &message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR) {}
+
+	struct cmsghdr *header = n == sizeof(has) ? CMSG_FIRSTHDR(&message) : nullptr;
+	size_t num_fds = 1 + (has[0] != 0) + (has[1] != 0);
+	if (header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS
+			|| header->cmsg_len != CMSG_LEN(num_fds * sizeof(int))) {
+		std::cerr << "ERROR: Receiving the listener from the old process failed\n";
+		exit(1);
+	}
+
+	int fds[3];
+	memcpy(fds, CMSG_DATA(header), num_fds * sizeof(int));
+	size_t next = 0;
+	handover.listener_fd = fds[next++];
+	handover.index_fd = has[0] ? fds[next++] : -1;
+	handover.hot_fd = has[1] ? fds[next++] : -1;
+	return true;
+}
+
+void Upgrade::ready() {
+	if (old_process_fd < 0) return;
+
+	if (write(old_process_fd, &READY_MESSAGE, 1) != 1) {
+		perror("Telling the old process to stop failed");
+	}
+	close(old_process_fd);
+	old_process_fd = -1;
+}
+
+/**
+ * @return The arguments this process was started with (empty if they can't
+ * be read).
+ */
+static vector<string> commandLine() {
+	std::ifstream file("/proc/self/cmdline", std::ios::binary);
+	string all((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+	vector<string> arguments;
+	size_t start = 0;
+	while (start < all.size()) {
+		size_t end = all.find('\0', start);
+		if (end == string::npos) end = all.size();
+		arguments.push_back(all.substr(start, end - start));
+		start = end + 1;
+	}
+	return arguments;
+}
+
+/**
+ * Starts the new binary with the same arguments and the given descriptor for
+ * talking to us.
+ *
+ * @return The new process, or -1 if it couldn't be forked.
+ */
+static pid_t startNewProcess(const vector<string>& arguments, int channel_fd) {
+	// everything is put together before forking: in the child of a threaded
+	// process, only async-signal-safe calls are fine until exec
+	vector<char*> argv;
+	for (const string& argument : arguments) {
+		argv.push_back(const_cast<char*>(argument.c_str()));
+	}
+	argv.push_back(nullptr);
+
+	string variable = string(UPGRADE_FD_VARIABLE) + "=" + std::to_string(channel_fd);
+	vector<char*> envp;
+	for (char **entry = environ; *entry != nullptr; entry++) {
+		envp.push_back(*entry);
+	}
+	envp.push_back(variable.data());
+	envp.push_back(nullptr);
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		// the new process starts from scratch: nothing blocked, and the
+		// channel open across the exec
+		sigset_t none;
+		sigemptyset(&none);
+		sigprocmask(SIG_SETMASK, &none, nullptr);
+		fcntl(channel_fd, F_SETFD, 0);
+
+		execvpe(argv[0], argv.data(), envp.data());
+		_exit(127);
+	}
+	return pid;
+}
+
+/**
+ * Sends the listener, and the index (if any), to the new process.
+ *
+ * @return false if sending failed.
+ */
+static bool sendHandover(int channel_fd, const ServerSocket& server, const FileIndex* index) {
+	int fds[3];
+	size_t num_fds = 0;
+	fds[num_fds++] = server.getFd();
+
+	// the snapshot goes in a memfd, so it costs one descriptor however big
+	// the index is
+	int index_fd = -1;
+	if (index != nullptr) {
+		index_fd = memfd_create("torero-index-snapshot", MFD_CLOEXEC);
+		if (index_fd >= 0 && !index->saveSnapshot(index_fd)) {
+			close(index_fd);
+			index_fd = -1;
+		}
+	}
+	int hot_fd = index != nullptr ? index->hotFd() : -1;
+
+	char has[2] = { index_fd >= 0, index_fd >= 0 && hot_fd >= 0 };
+	if (has[0]) fds[num_fds++] = index_fd;
+	if (has[1]) fds[num_fds++] = hot_fd;
+
+	struct iovec data = { has, sizeof(has) };
+	union {
+		char buffer[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+
+	struct msghdr message = {};
+	message.msg_iov = &data;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = CMSG_SPACE(num_fds * sizeof(int));
+
+	struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+	header->cmsg_level = SOL_SOCKET;
+	header->cmsg_type = SCM_RIGHTS;
+	header->cmsg_len = CMSG_LEN(num_fds * sizeof(int));
+	memcpy(CMSG_DATA(header), fds, num_fds * sizeof(int));
+
+	// the descriptors are the new process's as soon as they are sent
+	bool sent = sendmsg(channel_fd, &message, MSG_NOSIGNAL) == sizeof(has);
+	if (index_fd >= 0) close(index_fd);
+	return sent;
+}
+
+/**
+ * Waits for the new process to say that it is serving.
+ *
+ * @return false if it exits or takes too long instead.
+ */
+static bool waitUntilReady(int channel_fd) {
+	struct pollfd pfd = { channel_fd, POLLIN, 0 };
+	int result;
+	while ((result = poll(&pfd, 1, READY_TIMEOUT_MS)) < 0 && errno == EINTR) {}
+
+	char message = 0;
+	return result > 0 && read(channel_fd, &message, 1) == 1 && message == READY_MESSAGE;
+}
+
+/**
+ * Starts the new process and hands everything over to it.
+ *
+ * @return The new process, once it is serving, or -1 if the upgrade failed.
+ */
+static pid_t handOver(const ServerSocket& server, const FileIndex* index) {
+	vector<string> arguments = commandLine();
+	int channel[2];
+	if (arguments.empty() || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) < 0) {
+		perror("Upgrade failed");
+		return -1;
+	}
+
+	cout << "Upgrading: starting " << arguments[0] << std::endl;
+	pid_t pid = startNewProcess(arguments, channel[1]);
+	close(channel[1]);
+	if (pid < 0) {
+		perror("Upgrade failed");
+		close(channel[0]);
+		return -1;
+	}
+
+	bool ready = sendHandover(channel[0], server, index) && waitUntilReady(channel[0]);
+	close(channel[0]);
+	if (!ready) {
+		// it may be stuck rather than gone
+		kill(pid, SIGKILL);
+		waitpid(pid, nullptr, 0);
+		cout << "Upgrade failed: the new process didn't take over; still serving" << std::endl;
+		return -1;
+	}
+	return pid;
+}
+
+/**
+ * Stops accepting and exits once the open connections are done, or the
+ * deadline passes.
+ */
+[[noreturn]] static void drainAndExit(ServerSocket& server, pid_t new_pid, double drain_seconds) {
+	server.stopAccepting();
+	usleep(STOP_GRACE_USEC);
+
+	cout << "Upgrade: process " << new_pid << " took over; waiting for "
+		<< ClientSocket::numOpen() << " connections" << std::endl;
+
+	auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(drain_seconds));
+	while (ClientSocket::numOpen() > 0 && std::chrono::steady_clock::now() < deadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	if (ClientSocket::numOpen() > 0) {
+		cout << "Drain timeout passed with " << ClientSocket::numOpen()
+			<< " connections still open" << std::endl;
+	}
+	exit(0);
+}
+
+void Upgrade::startHandler(ServerSocket& server, const FileIndex* index, double drain_seconds) {
+	sigset_t upgrade_signal;
+	sigemptyset(&upgrade_signal);
+	sigaddset(&upgrade_signal, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &upgrade_signal, nullptr);
+
+	std::thread([&server, index, drain_seconds, upgrade_signal]() {
+		int signal_number;
+		while (sigwait(&upgrade_signal, &signal_number) == 0) {
+			pid_t new_pid = handOver(server, index);
+			if (new_pid > 0) {
+				drainAndExit(server, new_pid, drain_seconds);
+			}
+		}
+	}).detach();
+}
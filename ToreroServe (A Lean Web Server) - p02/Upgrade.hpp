@@ -0,0 +1,73 @@
+#ifndef UPGRADE_HPP
+#define UPGRADE_HPP
+
+/**
+ * File: Upgrade.hpp
+ *
+ * Header file for the Upgrade class.
+ */
+
+#include "ServerSocket.hpp"
+#include "FileIndex.hpp"
+
+/**
+ * Replaces a running server with a new binary without refusing (or dropping)
+ * a single connection.
+ *
+ * On SIGHUP the server starts its binary again, with the same arguments:
+ * whatever is at that path by then, so deploying means replacing the file
+ * and sending the signal. The new process gets the listening socket over a
+ * unix socket (with SCM_RIGHTS), along with a snapshot of the file index and
+ * the memfd holding the hot files, if the server has an index. It takes the
+ * socket over as it is, so clients that connect during the switch wait in
+ * the very same accept queue, and it loads the index instead of building it,
+ * so it is warm from its first request on.
+ *
+ * Once the new process says that it is serving, the old one stops accepting
+ * and exits as soon as its own connections are done (or the drain timeout
+ * passes). If the new process doesn't get that far, the old one just goes on
+ * serving.
+ *
+ * Only the threads engine, in a single process, can be upgraded: the other
+ * engines would have to stop accepting from inside their event loops, and
+ * in prefork mode the listeners belong to the master.
+ */
+class Upgrade {
+	public:
+		// what a new process gets from the one it replaces
+		struct Handover {
+			int listener_fd = -1;
+			int index_fd = -1; // snapshot of the file index (-1 if none)
+			int hot_fd = -1;   // memfd with the hot files (-1 if none)
+		};
+
+		/**
+		 * Receives what the old process hands over, if this process was
+		 * started by an upgrade. Exits with an error message if that fails,
+		 * which leaves the old process serving.
+		 *
+		 * @param handover Filled in with the descriptors received.
+		 * @return false if this process wasn't started by an upgrade.
+		 */
+		static bool receive(Handover& handover);
+
+		/**
+		 * Tells the old process that this one is serving now. Does nothing in
+		 * a process that wasn't started by an upgrade.
+		 */
+		static void ready();
+
+		/**
+		 * Starts the thread that upgrades the server on SIGHUP. Must run
+		 * before any other thread is started, so that they all inherit the
+		 * blocked signal and leave it to this one.
+		 *
+		 * @param server The listener to hand over.
+		 * @param index The file index to hand over (nullptr if there is none).
+		 * @param drain_seconds How long to wait for the connections that are
+		 * still open once the new process has taken over.
+		 */
+		static void startHandler(ServerSocket& server, const FileIndex* index,
+				double drain_seconds);
+};
+#endif
@@ -0,0 +1,595 @@
+/**
+ * File: UringEngine.cpp
+ *
+ * Implementation of the UringEngine class.
+ * See the associated header file (UringEngine.hpp) for the declaration of
+ * this class.
+ */
+
+// operating system specific libraries
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+// C standard library
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// C++ standard library
+#include <algorithm>
+#include <utility>
+
+#include "UringEngine.hpp"
+#include "torero-serve.hpp"
+#include "LargeFile.hpp"
+#include "Profiler.hpp"
+
+using std::string;
+using std::chrono::steady_clock;
+
+// number of submission queue entries in each ring
+static const unsigned RING_ENTRIES = 256;
+
+// receive buffers (the same request size limit as handleClient)
+static const uint16_t RECV_GROUP = 0;
+static const unsigned NUM_RECV_BUFFERS = 256; // must be a power of 2
+static const unsigned RECV_BUFFER_SIZE = 2048;
+
+// per-connection slots; files that fit in a slot along with their header are
+// read into it and sent in one go, bigger ones are spliced
+static const unsigned NUM_SLOTS = 64;
+static const size_t SLOT_SIZE = 16384;
+
+// how big we'd like the pipes used for splicing to be
+static const int PIPE_SIZE = 1024 * 1024;
+
+uint64_t UringEngine::tag(Connection* conn, Op op) {
+	return reinterpret_cast<uint64_t>(conn) | op;
+}
+
+UringEngine::UringEngine(ServerSocket& server, RateLimiter* limiter, AccessLog* access_log,
+		ServerStats* stats) :
+		server(server), limiter(limiter), access_log(access_log), stats(stats), ring(RING_ENTRIES) {
+	// hand all the receive buffers to the kernel up front
+	recv_ring = ring.setupBufferRing(RECV_GROUP, NUM_RECV_BUFFERS);
+	recv_buffers = new char[NUM_RECV_BUFFERS * RECV_BUFFER_SIZE];
+	for (unsigned i = 0; i < NUM_RECV_BUFFERS; i++) {
+		IoUring::provideBuffer(recv_ring, NUM_RECV_BUFFERS,
+				recv_buffers + i * RECV_BUFFER_SIZE, RECV_BUFFER_SIZE, i);
+	}
+
+	slot_buffers = static_cast<char*>(mmap(nullptr, NUM_SLOTS * SLOT_SIZE,
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (slot_buffers == MAP_FAILED) {
+		perror("Allocating io_uring slots failed");
+		exit(1);
+	}
+
+	// registering pins the memory, which may go over RLIMIT_MEMLOCK; plain
+	// reads into the same buffers work too, just a little slower
+	struct iovec slots[NUM_SLOTS];
+	for (unsigned i = 0; i < NUM_SLOTS; i++) {
+		slots[i].iov_base = slot_buffers + i * SLOT_SIZE;
+		slots[i].iov_len = SLOT_SIZE;
+		free_slots.push_back(NUM_SLOTS - 1 - i);
+	}
+	buffers_registered = ring.registerBuffers(slots, NUM_SLOTS);
+
+	ring.registerSparseFiles(NUM_SLOTS);
+
+	armAccept();
+}
+
+UringEngine::~UringEngine() {
+	munmap(slot_buffers, NUM_SLOTS * SLOT_SIZE);
+	delete[] recv_buffers;
+}
+
+void UringEngine::run() {
+	while (true) {
+		ring.submitAndWait(1);
+
+		struct io_uring_cqe *cqe;
+		while ((cqe = ring.peekCqe()) != nullptr) {
+			uint64_t user_data = cqe->user_data;
+			int result = cqe->res;
+			uint32_t flags = cqe->flags;
+			ring.advanceCq(1);
+
+			Connection *conn = reinterpret_cast<Connection*>(user_data & ~uint64_t(15));
+			switch (Op(user_data & 15)) {
+				case ACCEPT:
+					onAccept(result, flags);
+					break;
+				case RECV:
+					onRecv(conn, result, flags);
+					break;
+				case OPEN:
+					conn->file_opened = result >= 0;
+					if (--conn->resolve_pending == 0) onResolved(conn);
+					break;
+				case STATX:
+					if (result < 0) conn->file_info.stx_mode = 0;
+					if (--conn->resolve_pending == 0) onResolved(conn);
+					break;
+				case NOTE:
+					if (result < 0) conn->failed = true;
+					break;
+				case STEP:
+					onStep(conn, result);
+					break;
+				case CLOSE:
+					onClose(conn);
+					break;
+				case IGNORE:
+					break;
+			}
+		}
+	}
+}
+
+/**
+ * Arms a multishot accept, which keeps producing a completion for every new
+ * connection until the kernel drops it (e.g. when it runs out of memory).
+ */
+void UringEngine::armAccept() {
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = server.getFd();
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+	sqe->user_data = tag(nullptr, ACCEPT);
+}
+
+void UringEngine::onAccept(int result, uint32_t flags) {
+	if (result >= 0 && !server.isPeerAllowed(result)) {
+		close(result); // someone we don't talk to
+	}
+	else if (result >= 0) {
+		Connection *conn = new Connection();
+		conn->fd = result;
+		conn->slot = -1;
+		conn->header_deadline = steady_clock::now()
+			+ std::chrono::duration_cast<steady_clock::duration>(
+					std::chrono::duration<double>(HeaderBudget::limits().timeout_seconds));
+
+		// a multishot accept has nowhere to put the client's address, so ask
+		// for it separately (only when someone cares)
+		conn->peer_address = 0;
+		if (limiter != nullptr || access_log != nullptr) {
+			struct sockaddr_in remote_addr;
+			socklen_t socklen = sizeof(remote_addr);
+			if (getpeername(conn->fd, (struct sockaddr*) &remote_addr, &socklen) == 0
+					&& remote_addr.sin_family == AF_INET) {
+				conn->peer_address = remote_addr.sin_addr.s_addr;
+			}
+		}
+
+		if (!free_slots.empty()) {
+			conn->slot = free_slots.back();
+			free_slots.pop_back();
+		}
+		submitRecv(conn);
+	}
+
+	if (!(flags & IORING_CQE_F_MORE)) {
+		armAccept();
+	}
+}
+
+void UringEngine::submitRecv(Connection* conn) {
+	auto left = conn->header_deadline - steady_clock::now();
+	if (left <= steady_clock::duration::zero()) {
+		sendResponse(conn, respondWithStatus(408));
+		return;
+	}
+	auto left_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+	conn->recv_timeout.tv_sec = left_ns / 1000000000;
+	conn->recv_timeout.tv_nsec = left_ns % 1000000000;
+
+	// never more than it takes to go over the header size limit
+	size_t allowed = HeaderBudget::limits().max_bytes + 1 - conn->partial.size();
+
+	ring.reserve(2);
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = conn->fd;
+	sqe->len = std::min<size_t>(RECV_BUFFER_SIZE, allowed);
+	sqe->flags = IOSQE_BUFFER_SELECT | IOSQE_IO_LINK;
+	sqe->buf_group = RECV_GROUP;
+	sqe->user_data = tag(conn, RECV);
+
+	// cancels the recv (which then fails with -ECANCELED) when time is up
+	sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_LINK_TIMEOUT;
+	sqe->addr = reinterpret_cast<uint64_t>(&conn->recv_timeout);
+	sqe->len = 1;
+	sqe->user_data = tag(nullptr, IGNORE);
+}
+
+/**
+ * Adds what a recv brought to the connection's partial request.
+ *
+ * @return false if the header budget has no memory left for it.
+ */
+bool UringEngine::addToPartial(Connection* conn, std::string_view data) {
+	size_t needed = conn->partial.size() + data.size();
+	if (needed > conn->reserved.size()) {
+		size_t capacity = std::max(needed, 2 * conn->reserved.size());
+		if (!conn->reserved.grow(capacity - conn->reserved.size())) return false;
+		conn->partial.reserve(capacity);
+	}
+	conn->partial.append(data);
+	return true;
+}
+
+void UringEngine::onRecv(Connection* conn, int result, uint32_t flags) {
+	if (result == -ECANCELED) {
+		// the client ran out of time before sending its whole header
+		sendResponse(conn, respondWithStatus(408));
+		return;
+	}
+	if (result <= 0 || !(flags & IORING_CQE_F_BUFFER)) {
+		// error, client hung up, or we ran out of receive buffers (-ENOBUFS)
+		closeConnection(conn);
+		return;
+	}
+
+	unsigned buffer_id = flags >> IORING_CQE_BUFFER_SHIFT;
+	char *data = recv_buffers + buffer_id * RECV_BUFFER_SIZE;
+	std::string_view request(data, result);
+
+	// a request that doesn't come in one piece is put together in the
+	// connection (which frees the receive buffer right away)
+	if (!conn->partial.empty() || !HeaderBudget::isComplete(request)) {
+		size_t checked = conn->partial.size();
+		bool added = addToPartial(conn, request);
+		IoUring::provideBuffer(recv_ring, NUM_RECV_BUFFERS, data, RECV_BUFFER_SIZE, buffer_id);
+		data = nullptr;
+
+		if (!added) {
+			sendResponse(conn, respondWithStatus(503));
+			return;
+		}
+		request = conn->partial;
+		if (!HeaderBudget::isComplete(request, checked)) {
+			if (request.size() > HeaderBudget::limits().max_bytes) {
+				sendResponse(conn, respondWithStatus(431));
+			}
+			else {
+				submitRecv(conn);
+			}
+			return;
+		}
+	}
+
+	// turn away clients over their limits before doing any work for them
+	if (limiter != nullptr && !limiter->admit(conn->peer_address, conn->client_slot)) {
+		if (data != nullptr) {
+			IoUring::provideBuffer(recv_ring, NUM_RECV_BUFFERS, data, RECV_BUFFER_SIZE, buffer_id);
+		}
+		sendResponse(conn, respondWith429());
+		return;
+	}
+
+	conn->request = parseRequest(request);
+	if (data != nullptr) {
+		IoUring::provideBuffer(recv_ring, NUM_RECV_BUFFERS, data, RECV_BUFFER_SIZE, buffer_id);
+	}
+	conn->partial = string();
+	conn->reserved.clear();
+
+	// without a slot (or a valid request, or a file on disk) there is nothing
+	// to be clever about
+	if (conn->request.resource.empty() || conn->slot < 0 || hasRoute(conn->request.resource)
+			|| hasEmbeddedAsset(conn->request.resource)) {
+		sendResponse(conn, buildResponse(conn->request));
+		return;
+	}
+
+	// open the file into this connection's direct descriptor and stat it
+	conn->path = "WWW" + conn->request.resource;
+	conn->resolve_pending = 2;
+
+	ring.reserve(2);
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_OPENAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = reinterpret_cast<uint64_t>(conn->path.c_str());
+	sqe->open_flags = O_RDONLY;
+	sqe->file_index = conn->slot + 1;
+	sqe->flags = IOSQE_IO_LINK;
+	sqe->user_data = tag(conn, OPEN);
+
+	sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_STATX;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = reinterpret_cast<uint64_t>(conn->path.c_str());
+	sqe->len = STATX_TYPE | STATX_SIZE;
+	sqe->off = reinterpret_cast<uint64_t>(&conn->file_info);
+	sqe->user_data = tag(conn, STATX);
+}
+
+/**
+ * Called once both the openat and the statx have completed.
+ */
+void UringEngine::onResolved(Connection* conn) {
+	if (!conn->file_opened || !S_ISREG(conn->file_info.stx_mode)
+			|| isLargeFile(conn->file_info.stx_size)) {
+		if (conn->file_opened) {
+			struct io_uring_sqe *sqe = ring.getSqe();
+			sqe->opcode = IORING_OP_CLOSE;
+			sqe->file_index = conn->slot + 1;
+			sqe->user_data = tag(nullptr, IGNORE);
+		}
+
+		// directories, missing files, large files ... are left to the shared code
+		sendResponse(conn, buildResponse(conn->request));
+		return;
+	}
+
+	size_t file_size = conn->file_info.stx_size;
+	string header = buildOKHeader(getPathExtension(conn->path), file_size);
+
+	conn->file_fd = conn->slot;
+	conn->file_fixed = true;
+	conn->file_offset = 0;
+	conn->file_remaining = file_size;
+
+	if (header.size() + file_size <= SLOT_SIZE) {
+		sendSmallFile(conn, header);
+	}
+	else {
+		HttpResponse response;
+		response.header = std::move(header);
+		sendResponse(conn, std::move(response));
+	}
+}
+
+/**
+ * Reads the whole file into the connection's slot, right behind the header,
+ * and sends both with a single send.
+ */
+void UringEngine::sendSmallFile(Connection* conn, const string& header) {
+	char *buffer = slot_buffers + conn->slot * SLOT_SIZE;
+	memcpy(buffer, header.data(), header.size());
+
+	record(conn, 200, conn->file_remaining);
+
+	ring.reserve(2);
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = buffers_registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	sqe->fd = conn->file_fd;
+	sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe->addr = reinterpret_cast<uint64_t>(buffer + header.size());
+	sqe->len = conn->file_remaining;
+	sqe->off = 0;
+	sqe->buf_index = conn->slot;
+	sqe->user_data = tag(conn, NOTE);
+
+	// a short read breaks the link, so we never send a stale buffer
+	submitSend(conn, buffer, header.size() + conn->file_remaining, false, 0, STEP);
+	conn->file_remaining = 0;
+}
+
+/**
+ * Starts sending a response: its header and in-memory body right away, and
+ * then (from sendNext) its stream and/or file.
+ */
+void UringEngine::sendResponse(Connection* conn, HttpResponse response) {
+	conn->response = std::move(response);
+	HttpResponse& r = conn->response;
+
+	if (r.file_fd != -1) {
+		conn->file_fd = r.file_fd;
+		conn->file_fixed = false;
+		conn->file_offset = r.file_offset;
+		conn->file_remaining = r.file_length;
+		r.file_fd = -1;
+	}
+	if (r.stream) {
+		conn->stream_wait_fd = r.stream->makeNonBlocking();
+	}
+
+	std::string_view body = r.bodyData();
+	bool has_body = !body.empty();
+	bool more_after_body = r.stream || conn->file_remaining > 0;
+
+	std::string_view header = r.headerData();
+	record(conn, r.status(), r.stream ? -1 : body.size() + conn->file_remaining);
+
+	if (has_body) {
+		ring.reserve(2);
+		submitSend(conn, header.data(), header.size(), true, IOSQE_IO_LINK, NOTE);
+		submitSend(conn, body.data(), body.size(), more_after_body, 0, STEP);
+	}
+	else {
+		submitSend(conn, header.data(), header.size(), more_after_body, 0, STEP);
+	}
+}
+
+void UringEngine::onStep(Connection* conn, int result) {
+	if (result < 0 || conn->failed) {
+		closeConnection(conn);
+		return;
+	}
+
+	// a splice into the socket may come up short; the rest is still in the pipe
+	if (conn->splice_length > 0) {
+		conn->pipe_pending = conn->splice_length - result;
+		conn->splice_length = 0;
+	}
+
+	sendNext(conn);
+}
+
+/**
+ * Submits the next piece of the response, or closes the connection if there
+ * is nothing left to send.
+ */
+void UringEngine::sendNext(Connection* conn) {
+	if (conn->pipe_pending > 0) {
+		submitSplice(conn, false, conn->pipe_pending, 0, STEP);
+		return;
+	}
+
+	HttpResponse& r = conn->response;
+	if (r.stream) {
+		conn->piece.clear();
+		if (r.stream->next(conn->piece)) {
+			// nothing ready yet: come back here once there is
+			if (conn->piece.empty() && conn->stream_wait_fd >= 0) {
+				submitPoll(conn, conn->stream_wait_fd, STEP);
+				return;
+			}
+			submitSend(conn, conn->piece.data(), conn->piece.size(), true, 0, STEP);
+			return;
+		}
+		r.stream.reset();
+	}
+
+	if (conn->file_remaining > 0) {
+		if (conn->pipe_fds[0] == -1 && !openPipe(conn)) {
+			closeConnection(conn);
+			return;
+		}
+
+		// one pipe-full per submission: file -> pipe, then pipe -> socket
+		size_t chunk = std::min(conn->file_remaining, conn->pipe_size);
+		ring.reserve(2);
+		submitSplice(conn, true, chunk, IOSQE_IO_LINK, NOTE);
+		submitSplice(conn, false, chunk, 0, STEP);
+		if (conn->response.drop_behind) {
+			dropPassedPages(conn->file_fd, conn->file_offset, conn->file_offset + chunk);
+		}
+		conn->file_offset += chunk;
+		conn->file_remaining -= chunk;
+		return;
+	}
+
+	closeConnection(conn);
+}
+
+/**
+ * Logs the connection's request and counts it in the stats (if those are on).
+ */
+void UringEngine::record(Connection* conn, int status, long num_bytes) {
+	Profiler::countRequest();
+	if (access_log != nullptr) {
+		access_log->record(conn->peer_address, conn->request, status, num_bytes);
+	}
+	if (stats != nullptr) {
+		stats->record(status, num_bytes);
+	}
+}
+
+void UringEngine::submitSend(Connection* conn, const char* data, size_t length, bool more,
+		uint8_t link_flags, Op op) {
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_SEND;
+	sqe->fd = conn->fd;
+	sqe->addr = reinterpret_cast<uint64_t>(data);
+	sqe->len = length;
+
+	// MSG_WAITALL makes io_uring retry short sends itself
+	sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (more ? MSG_MORE : 0);
+	sqe->flags = link_flags;
+	sqe->user_data = tag(conn, op);
+}
+
+/**
+ * Submits a splice either from the file into the connection's pipe, or from
+ * the pipe into the socket.
+ */
+void UringEngine::submitSplice(Connection* conn, bool from_file, size_t length,
+		uint8_t link_flags, Op op) {
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_SPLICE;
+	sqe->len = length;
+	sqe->flags = link_flags;
+	sqe->user_data = tag(conn, op);
+
+	if (from_file) {
+		sqe->splice_fd_in = conn->file_fd;
+		sqe->splice_off_in = conn->file_offset;
+		sqe->splice_flags = conn->file_fixed ? SPLICE_F_FD_IN_FIXED : 0;
+		sqe->fd = conn->pipe_fds[1];
+		sqe->off = -1;
+	}
+	else {
+		sqe->splice_fd_in = conn->pipe_fds[0];
+		sqe->splice_off_in = -1;
+		sqe->fd = conn->fd;
+		sqe->off = -1;
+		conn->splice_length = length;
+	}
+}
+
+/**
+ * Submits a one-shot wait for the given descriptor to become readable.
+ */
+void UringEngine::submitPoll(Connection* conn, int fd, Op op) {
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = tag(conn, op);
+}
+
+bool UringEngine::openPipe(Connection* conn) {
+	if (pipe2(conn->pipe_fds, O_CLOEXEC) < 0) {
+		conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+		return false;
+	}
+
+	// a bigger pipe means fewer submissions per file (if we're allowed one)
+	fcntl(conn->pipe_fds[1], F_SETPIPE_SZ, PIPE_SIZE);
+	conn->pipe_size = fcntl(conn->pipe_fds[1], F_GETPIPE_SZ);
+	return true;
+}
+
+/**
+ * Closes the connection's file and socket. The file close is hard-linked in
+ * front of the socket close so that the direct descriptor slot is free again
+ * by the time the connection is.
+ */
+void UringEngine::closeConnection(Connection* conn) {
+	if (conn->pipe_fds[0] != -1) {
+		close(conn->pipe_fds[0]);
+		close(conn->pipe_fds[1]);
+		conn->pipe_fds[0] = conn->pipe_fds[1] = -1;
+	}
+
+	if (conn->file_fd != -1) {
+		ring.reserve(2);
+		struct io_uring_sqe *sqe = ring.getSqe();
+		sqe->opcode = IORING_OP_CLOSE;
+		if (conn->file_fixed) {
+			sqe->file_index = conn->file_fd + 1;
+		}
+		else {
+			sqe->fd = conn->file_fd;
+		}
+		sqe->flags = IOSQE_IO_HARDLINK;
+		sqe->user_data = tag(nullptr, IGNORE);
+		conn->file_fd = -1;
+	}
+
+	struct io_uring_sqe *sqe = ring.getSqe();
+	sqe->opcode = IORING_OP_CLOSE;
+	sqe->fd = conn->fd;
+	sqe->user_data = tag(conn, CLOSE);
+}
+
+void UringEngine::onClose(Connection* conn) {
+	if (conn->slot >= 0) {
+		free_slots.push_back(conn->slot);
+	}
+	delete conn;
+}
@@ -0,0 +1,155 @@
+#ifndef URINGENGINE_HPP
+#define URINGENGINE_HPP
+
+/**
+ * File: UringEngine.hpp
+ *
+ * Header file for the UringEngine class.
+ */
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <sys/stat.h>
+
+#include "IoUring.hpp"
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "ServerSocket.hpp"
+#include "RateLimiter.hpp"
+#include "AccessLog.hpp"
+#include "ServerStats.hpp"
+#include "HeaderBudget.hpp"
+
+/**
+ * Engine that runs every step of a request through io_uring, so that a
+ * thread never blocks in a system call and a whole request takes only a few
+ * submissions:
+ *
+ *   1. a multishot accept, armed once, produces all the connections;
+ *   2. a recv into a buffer picked by the kernel from a provided-buffer ring;
+ *   3. openat (into a direct file descriptor) linked with statx;
+ *   4. for small files: read into a registered buffer right behind the
+ *      header, then send, then close. For large files: send the header, then
+ *      splice the file through a pipe into the socket, a pipe-full per
+ *      submission.
+ *
+ * Anything that isn't a plain regular file (directories, errors, ...) goes
+ * through the shared buildResponse, and the resulting response is sent with
+ * io_uring as well.
+ *
+ * Clients over their rate limits get a 429 as soon as their request is in,
+ * before anything is opened.
+ *
+ * A request that doesn't arrive in one recv is put together in the
+ * connection, within the header budget. Every recv for a header comes with a
+ * linked timeout for the time the client has left, so a slow client costs a
+ * connection struct until its time is up, never a thread.
+ *
+ * Each engine owns one ring and is driven by one thread.
+ */
+class UringEngine {
+	public:
+		/**
+		 * @param server The listening socket.
+		 * @param limiter Per client address limits, or nullptr for none.
+		 * @param access_log Where to log requests, or nullptr for nowhere.
+		 * @param stats Where to count requests, or nullptr for nowhere.
+		 */
+		UringEngine(ServerSocket& server, RateLimiter* limiter, AccessLog* access_log,
+				ServerStats* stats);
+		~UringEngine();
+
+		UringEngine(const UringEngine&) = delete;
+		void operator=(const UringEngine&) = delete;
+
+		/**
+		 * Runs the engine forever.
+		 */
+		void run();
+
+	private:
+		// what a completion is for; stored in the low bits of user_data
+		enum Op : uint64_t {
+			ACCEPT = 0,
+			RECV,
+			OPEN,
+			STATX,
+			STEP,   // last operation of a chain; decides what to do next
+			NOTE,   // operation in the middle of a chain; only failures matter
+			CLOSE,  // final close of the client; the connection can be freed
+			IGNORE, // nobody cares how this one went (no connection attached)
+		};
+
+		struct alignas(16) Connection {
+			int fd;
+			int slot; // index of this connection's registered buffer and file, or -1
+			uint32_t peer_address;
+			RateLimiter::Slot client_slot;
+
+			// the request, when it took more than one recv to come in
+			std::string partial;
+			HeaderBudget::Reservation reserved; // for partial
+			std::chrono::steady_clock::time_point header_deadline;
+			struct __kernel_timespec recv_timeout; // what's left of it, for the kernel
+			HttpRequest request;
+			std::string path;
+			struct statx file_info;
+			int resolve_pending = 0;
+			bool file_opened = false;
+			bool failed = false;
+
+			// what is left to send
+			HttpResponse response;
+			std::string piece;
+			int stream_wait_fd = -1; // to wait on when the stream has no piece ready
+			int file_fd = -1;        // direct descriptor index if file_fixed
+			bool file_fixed = false;
+			off_t file_offset = 0;
+			size_t file_remaining = 0;
+			size_t splice_length = 0; // bytes expected by the last splice into the socket
+			size_t pipe_pending = 0;  // bytes left in the pipe after a short splice
+			int pipe_fds[2] = {-1, -1};
+			size_t pipe_size = 0;
+		};
+
+		ServerSocket& server;
+		RateLimiter *limiter;
+		AccessLog *access_log;
+		ServerStats *stats;
+		IoUring ring;
+
+		// receive buffers, handed to the kernel through a provided-buffer ring
+		struct io_uring_buf_ring *recv_ring;
+		char *recv_buffers;
+
+		// per-connection slots: a registered buffer and a direct file each
+		char *slot_buffers;
+		bool buffers_registered;
+		std::vector<int> free_slots;
+
+		static uint64_t tag(Connection* conn, Op op);
+
+		void armAccept();
+		void onAccept(int result, uint32_t flags);
+		void onRecv(Connection* conn, int result, uint32_t flags);
+		void onResolved(Connection* conn);
+		void onStep(Connection* conn, int result);
+		void onClose(Connection* conn);
+
+		void submitRecv(Connection* conn);
+		bool addToPartial(Connection* conn, std::string_view data);
+		void sendSmallFile(Connection* conn, const std::string& header);
+		void sendResponse(Connection* conn, HttpResponse response);
+		void sendNext(Connection* conn);
+		void submitSend(Connection* conn, const char* data, size_t length, bool more,
+				uint8_t link_flags, Op op);
+		void submitSplice(Connection* conn, bool from_file, size_t length,
+				uint8_t link_flags, Op op);
+		void submitPoll(Connection* conn, int fd, Op op);
+		bool openPipe(Connection* conn);
+		void closeConnection(Connection* conn);
+		void record(Connection* conn, int status, long num_bytes);
+};
+#endif
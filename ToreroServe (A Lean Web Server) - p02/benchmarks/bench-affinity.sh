@@ -0,0 +1,41 @@
+#!/bin/bash
+
+# Usage: bench-affinity.sh [PORT_NUM] [SECONDS] [CPUS]
+#
+# Runs the server in prefork mode with a worker process per CPU in CPUS
+# (default: all of them, as in 0-N; at least two processes), three ways: unpinned, with each worker
+# process pinned to its CPU, and pinned with the workers aligned to the CPUs
+# their connections come in on (SO_INCOMING_CPU). For each it prints the
+# load generator's results (64 connections to /index.html). Run from the
+# benchmarks directory after building the server (make -C ..) and the load
+# generator (make).
+#
+# Over loopback, a connection "comes in" on the CPU of the client that made
+# it, so alignment only means something with the load generator on another
+# machine (pass its address instead of 127.0.0.1), where the NIC's receive
+# queues and their interrupts decide. Pinning pays off either way on a
+# multi-socket machine, where unpinned workers wander between the sockets.
+
+port_num=${1:-8080}
+seconds=${2:-5}
+cpus=${3:-0-$(($(nproc) - 1))}
+num_cpus=$(echo $cpus | tr ',' '\n' | awk -F- '{n += ($2 == "" ? 1 : $2 - $1 + 1)} END {print n}')
+num_processes=$((num_cpus > 1 ? num_cpus : 2))
+
+for mode in unpinned pinned aligned; do
+	case $mode in
+		unpinned) options="" ;;
+		pinned) options="--worker-cpus=$cpus" ;;
+		aligned) options="--worker-cpus=$cpus --align-workers=incoming-cpu" ;;
+	esac
+	(cd .. && exec ./torero-serve $port_num WWW --processes=$num_processes --socket-profile=latency $options > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== $mode =="
+	./http_bench 127.0.0.1 $port_num /index.html 64 $seconds
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+	port_num=$((port_num + 1))
+done
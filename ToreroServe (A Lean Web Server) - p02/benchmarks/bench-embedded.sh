@@ -0,0 +1,40 @@
+#!/bin/bash
+
+# Usage: bench-embedded.sh [PORT_NUM] [SECONDS]
+#
+# Compares three ways of serving the same small files (/index.html and
+# /tux.png, 16 connections): from the disk, from the startup index with both
+# files hot, and compiled into the embedded build. Run from the benchmarks
+# directory after building the server (make -C .. all embedded) and the
+# load generator (make).
+
+port_num=${1:-8080}
+seconds=${2:-5}
+
+# an access log that makes both files hot
+hot_log=$(mktemp)
+trap "rm -f $hot_log" EXIT
+for resource in /index.html /tux.png; do
+	echo "127.0.0.1 - - [18/Oct/2026:10:00:00 +0000] \"GET $resource HTTP/1.0\" 200 1" >> $hot_log
+done
+
+for mode in disk index embedded; do
+	case $mode in
+		disk) command="./torero-serve $port_num WWW" ;;
+		index) command="./torero-serve $port_num WWW --warm-up-threads=2 --access-log=$hot_log" ;;
+		embedded) command="./torero-serve-embedded $port_num WWW" ;;
+	esac
+	(cd .. && exec $command --socket-profile=latency > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== $mode =="
+	for resource in /index.html /tux.png; do
+		echo "-- $resource"
+		./http_bench 127.0.0.1 $port_num $resource 16 $seconds
+	done
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+	port_num=$((port_num + 1))
+done
@@ -0,0 +1,24 @@
+#!/bin/bash
+
+# Usage: bench-engines.sh [PORT_NUM] [CONNECTIONS] [SECONDS] [PATH]
+#
+# Compares the threads, coroutines and io_uring engines under the same load.
+# Run from the benchmarks directory after building both the server
+# (make -C ..) and the load generator (make).
+
+port_num=${1:-8080}
+connections=${2:-16}
+seconds=${3:-10}
+path=${4:-/index.html}
+
+for engine in threads coroutines io_uring; do
+	(cd .. && exec ./torero-serve $port_num WWW --engine=$engine > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== --engine=$engine, $connections connections, $seconds seconds, $path =="
+	./http_bench localhost $port_num $path $connections $seconds
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+done
@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# Usage: bench-file-cache.sh [FILES] [LOOKUPS_PER_THREAD]
+#
+# Runs the file cache microbenchmark with 1 to 64 threads, once with the
+# cache split into as many shards as its capacity allows and once with a
+# single shard. Run from the benchmarks directory after building the
+# benchmark programs (make). With fewer cores than threads, the larger
+# thread counts only show what oversubscription costs.
+
+num_files=${1:-1000}
+num_lookups=${2:-1000000}
+
+for shards in 0 1; do
+	echo "== $([ $shards = 0 ] && echo sharded || echo "single shard") =="
+	for threads in 1 2 4 8 16 32 64; do
+		./file_cache_bench $threads $num_files $num_lookups $shards
+	done
+done
@@ -0,0 +1,32 @@
+#!/bin/bash
+
+# Usage: bench-prefork.sh [PORT_NUM] [CONNECTIONS] [SECONDS] [PATH]
+#
+# Measures how throughput scales with the number of worker processes
+# (--processes), for each engine, under the same load. Run from the benchmarks
+# directory after building both the server (make -C ..) and the load
+# generator (make). Scaling can't go past the number of CPUs, so compare
+# against nproc.
+
+port_num=${1:-8080}
+connections=${2:-16}
+seconds=${3:-10}
+path=${4:-/index.html}
+
+echo "$(nproc) CPUs"
+for engine in threads coroutines io_uring; do
+	for processes in 1 2 4; do
+		(cd .. && exec ./torero-serve $port_num WWW --engine=$engine --processes=$processes \
+			--warm-up-threads=2 > /dev/null) &
+		SERVER_PID=$!
+		sleep 1
+
+		echo "== --engine=$engine --processes=$processes, $connections connections, $seconds seconds, $path =="
+		./http_bench 127.0.0.1 $port_num $path $connections $seconds
+
+		# the master stops its workers on SIGTERM
+		kill $SERVER_PID
+		wait $SERVER_PID 2> /dev/null || true
+		port_num=$((port_num + 1))
+	done
+done
@@ -0,0 +1,39 @@
+#!/bin/bash
+
+# Usage: bench-proxy.sh [PORT_NUM] [CONNECTIONS] [SECONDS] [BODY_BYTES]
+#
+# Measures the reverse proxy mode against two stand-in backends
+# (proxy_backend), with pooled keep-alive connections to the backends and
+# without (--proxy-pool=0, a new connection per request). The backends print
+# how many connections they accepted for how many requests, which is the
+# connection churn the pool saves. Run from the benchmarks directory after
+# building both the server (make -C ..) and the programs here (make).
+
+port_num=${1:-8080}
+connections=${2:-16}
+seconds=${3:-10}
+body_bytes=${4:-4096}
+
+backend_port=$((port_num + 1000))
+for pool in 32 0; do
+	./proxy_backend $backend_port $body_bytes &
+	BACKEND1_PID=$!
+	./proxy_backend $((backend_port + 1)) $body_bytes &
+	BACKEND2_PID=$!
+
+	(cd .. && exec ./torero-serve $port_num WWW \
+		--proxy=/api=127.0.0.1:$backend_port,127.0.0.1:$((backend_port + 1)) \
+		--proxy-pool=$pool > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== --proxy-pool=$pool, $connections connections, $seconds seconds, $body_bytes byte bodies =="
+	./http_bench 127.0.0.1 $port_num /api/item $connections $seconds
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null
+	kill $BACKEND1_PID $BACKEND2_PID
+	wait $BACKEND1_PID $BACKEND2_PID 2> /dev/null
+	port_num=$((port_num + 1))
+	backend_port=$((backend_port + 2))
+done
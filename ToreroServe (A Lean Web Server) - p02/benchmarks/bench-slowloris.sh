@@ -0,0 +1,43 @@
+#!/bin/bash
+
+# Usage: bench-slowloris.sh [PORT_NUM] [SECONDS] [LORIS_CONNECTIONS] [SERVER]
+#
+# Runs the load generator (16 connections to /index.html) once on its own
+# and once while the slowloris client keeps LORIS_CONNECTIONS (default 1000)
+# connections trickling in request headers a byte every 100 ms. For each run
+# it prints the load generator's results, the slowloris client's tally, and
+# the server's peak memory (VmHWM) and thread count. Run from the benchmarks
+# directory after building the server (make -C ..) and the benchmark
+# programs (make); SERVER (default ../torero-serve) picks another build to
+# compare with.
+#
+# The header timeout is cut to 3 seconds so that the lorises get turned
+# away (and come back) several times during a run.
+
+port_num=${1:-8080}
+seconds=${2:-10}
+num_lorises=${3:-1000}
+server=$(realpath "${4:-../torero-serve}")
+
+for attack in none slowloris; do
+	(cd .. && exec "$server" $port_num WWW --socket-profile=latency --header-timeout=3 > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== $attack =="
+	if [ $attack = slowloris ]; then
+		./slowloris 127.0.0.1 $port_num $num_lorises 100 $((seconds + 2)) &
+		LORIS_PID=$!
+		sleep 2
+	fi
+
+	./http_bench 127.0.0.1 $port_num /index.html 16 $seconds
+	grep -E "VmHWM|Threads" /proc/$SERVER_PID/status
+
+	if [ $attack = slowloris ]; then
+		wait $LORIS_PID
+	fi
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+	port_num=$((port_num + 1))
+done
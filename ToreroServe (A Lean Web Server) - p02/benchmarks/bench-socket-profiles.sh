@@ -0,0 +1,42 @@
+#!/bin/bash
+
+# Usage: bench-socket-profiles.sh [PORT_NUM] [SECONDS] [ENGINE]
+#
+# Runs each --socket-profile under three loads: a small file over 16
+# connections (plus the same with TCP Fast Open), a 4 MiB file over 4
+# connections, and a small file over 512 connections. Run from the
+# benchmarks directory after building both the server (make -C ..) and the
+# load generator (make).
+#
+# Fast Open only takes effect if net.ipv4.tcp_fastopen has both the client
+# (1) and server (2) bits set, e.g. "sysctl -w net.ipv4.tcp_fastopen=3";
+# otherwise the fastopen runs are plain ones.
+
+port_num=${1:-8080}
+seconds=${2:-5}
+engine=${3:-threads}
+
+big_file=../WWW/socket-profile-bench.bin
+head -c $((4 * 1024 * 1024)) /dev/urandom > $big_file
+trap "rm -f $big_file" EXIT
+
+echo "net.ipv4.tcp_fastopen = $(cat /proc/sys/net/ipv4/tcp_fastopen)"
+for profile in default latency throughput many-connections; do
+	(cd .. && exec ./torero-serve $port_num WWW --engine=$engine --socket-profile=$profile > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== --socket-profile=$profile, --engine=$engine =="
+	echo "-- /index.html, 16 connections"
+	./http_bench 127.0.0.1 $port_num /index.html 16 $seconds
+	echo "-- /index.html, 16 connections, fast open"
+	./http_bench 127.0.0.1 $port_num /index.html 16 $seconds fastopen
+	echo "-- 4 MiB file, 4 connections"
+	./http_bench 127.0.0.1 $port_num /socket-profile-bench.bin 4 $seconds
+	echo "-- /index.html, 512 connections"
+	./http_bench 127.0.0.1 $port_num /index.html 512 $seconds
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+	port_num=$((port_num + 1))
+done
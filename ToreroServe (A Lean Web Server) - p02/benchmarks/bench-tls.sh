@@ -0,0 +1,33 @@
+#!/bin/bash
+
+# Usage: bench-tls.sh [PORT_NUM] [CONNECTIONS] [SECONDS] [PATH]
+#
+# Compares plain HTTP with HTTPS, with and without session resumption, on
+# loopback. Run from the benchmarks directory after building both the server
+# (make -C ..) and the load generator (make). A self-signed certificate is
+# made with make-test-cert.sh if there isn't one yet.
+
+port_num=${1:-8443}
+connections=${2:-16}
+seconds=${3:-10}
+path=${4:-/tux.png}
+
+[ -f test-cert.pem ] || ./make-test-cert.sh
+
+for mode in plain tls tls-resume; do
+	if [ $mode = plain ]; then
+		options=""
+	else
+		options="--tls-cert=benchmarks/test-cert.pem"
+	fi
+
+	(cd .. && exec ./torero-serve $port_num WWW $options > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== $mode, $connections connections, $seconds seconds, $path =="
+	./http_bench localhost $port_num $path $connections $seconds $mode
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+done
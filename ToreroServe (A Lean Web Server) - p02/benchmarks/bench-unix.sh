@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# Usage: bench-unix.sh [PORT_NUM] [CONNECTIONS] [SECONDS] [PATH]
+#
+# Compares a TCP loopback listener with an (abstract) unix domain socket
+# listener, for each engine, under the same load. Run from the benchmarks
+# directory after building both the server (make -C ..) and the load
+# generator (make).
+
+port_num=${1:-8080}
+connections=${2:-16}
+seconds=${3:-10}
+path=${4:-/index.html}
+socket_name=@torero-bench-$$
+
+for engine in threads coroutines io_uring; do
+	for listener in tcp unix; do
+		if [ $listener = tcp ]; then
+			options=""
+			host=127.0.0.1
+		else
+			options="--unix-socket=$socket_name"
+			host=$socket_name
+		fi
+
+		(cd .. && exec ./torero-serve $port_num WWW --engine=$engine $options > /dev/null) &
+		SERVER_PID=$!
+		sleep 1
+
+		echo "== --engine=$engine over $listener, $connections connections, $seconds seconds, $path =="
+		./http_bench $host $port_num $path $connections $seconds
+
+		kill $SERVER_PID
+		wait $SERVER_PID 2> /dev/null || true
+	done
+	port_num=$((port_num + 1))
+done
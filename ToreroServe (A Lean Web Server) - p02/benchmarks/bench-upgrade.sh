@@ -0,0 +1,56 @@
+#!/bin/bash
+
+# Usage: bench-upgrade.sh [PORT_NUM] [SECONDS]
+#
+# Deploys the server four times while the load generator runs (16
+# connections to /index.html), once by restarting it (SIGTERM, then starting
+# it again) and once by upgrading it in place (SIGHUP), and prints the load
+# generator's results for each: restarts show up as errors (refused
+# connections) and a latency spike, upgrades shouldn't show up at all. Run
+# from the benchmarks directory after building both the server (make -C ..)
+# and the load generator (make).
+#
+# The latency profile is used for its longer accept queue: with the default
+# one (10), some SYNs get dropped under this load whether or not anything is
+# being deployed, and each drop costs its connection a second.
+
+port_num=${1:-8080}
+seconds=${2:-8}
+
+start_server() {
+	(cd .. && exec ./torero-serve $port_num WWW --warm-up-threads=2 --socket-profile=latency > /dev/null) &
+	sleep 0.2
+}
+
+# the process serving right now (after an upgrade, the newest one)
+current_server() {
+	pgrep -n -x torero-serve
+}
+
+for deploy in restart upgrade; do
+	start_server
+	sleep 1
+
+	./http_bench 127.0.0.1 $port_num /index.html 16 $seconds > bench-upgrade.out &
+	BENCH_PID=$!
+	sleep 1
+	for i in 1 2 3 4; do
+		if [ $deploy = restart ]; then
+			kill $(current_server)
+			while pgrep -x torero-serve > /dev/null; do sleep 0.05; done
+			start_server
+		else
+			kill -HUP $(current_server)
+		fi
+		sleep 1
+	done
+	wait $BENCH_PID
+
+	echo "== $deploy x4 =="
+	cat bench-upgrade.out
+	rm -f bench-upgrade.out
+
+	kill $(current_server)
+	while pgrep -x torero-serve > /dev/null; do sleep 0.05; done
+	port_num=$((port_num + 1))
+done
@@ -0,0 +1,23 @@
+#!/bin/bash
+
+# Usage: bench-worker-models.sh [PORT_NUM] [CONNECTIONS] [SECONDS]
+#
+# Compares the queue (producer/consumer) and leader/follower worker models on
+# short requests. Run from the benchmarks directory after building both the
+# server (make -C ..) and the load generator (make).
+
+port_num=${1:-8080}
+connections=${2:-16}
+seconds=${3:-10}
+
+for model in queue leader-follower; do
+	(cd .. && exec ./torero-serve $port_num WWW --model=$model > /dev/null) &
+	SERVER_PID=$!
+	sleep 1
+
+	echo "== --model=$model, $connections connections, $seconds seconds =="
+	./http_bench localhost $port_num /index.html $connections $seconds
+
+	kill $SERVER_PID
+	wait $SERVER_PID 2> /dev/null || true
+done
@@ -0,0 +1,117 @@
+/*
+ * Microbenchmark for the server's FileCache: how long one lookup takes, from
+ * a number of threads at once, when (nearly) every lookup is a hit.
+ *
+ * It writes the given number of small files to a temporary directory, and
+ * each thread then looks them up at random, leaning towards the first ones
+ * (the square of a uniform pick), the way a few pages of a site get most of
+ * the requests. The cache is big enough for all of them, so after the first
+ * round only hits are measured. With a shard count given, the cache gets
+ * that many shards instead of as many as its capacity allows (1 shows what
+ * a single shard costs).
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../FileCache.hpp"
+
+using std::string;
+using std::vector;
+using std::thread;
+
+using Clock = std::chrono::steady_clock;
+
+namespace fs = std::filesystem;
+
+struct File {
+	string path;
+	int fd;
+	struct stat info;
+};
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " <threads> <files> <lookups per thread> [shards]\n";
+		return 1;
+	}
+	int num_threads = atoi(argv[1]);
+	unsigned num_files = strtoul(argv[2], nullptr, 10);
+	long num_lookups = atol(argv[3]);
+	size_t num_shards = argc > 4 ? strtoul(argv[4], nullptr, 10) : 0;
+
+	char dir_template[] = "/tmp/file_cache_bench.XXXXXX";
+	if (mkdtemp(dir_template) == nullptr) {
+		perror("mkdtemp");
+		return 1;
+	}
+	fs::path dir = dir_template;
+
+	vector<File> files;
+	string contents(4096, 'x');
+	for (unsigned i = 0; i < num_files; i++) {
+		File file;
+		file.path = (dir / ("page" + std::to_string(i) + ".html")).string();
+		int fd = open(file.path.c_str(), O_WRONLY | O_CREAT, 0644);
+		if (fd < 0 || write(fd, contents.data(), contents.size()) < 0) {
+			perror("Writing a test file failed");
+			return 1;
+		}
+		close(fd);
+		file.fd = open(file.path.c_str(), O_RDONLY);
+		fstat(file.fd, &file.info);
+		files.push_back(file);
+	}
+
+	// room for every file
+	FileCache cache(std::max<size_t>(num_files * contents.size() * 2, 64 << 20), false, num_shards);
+	for (File& file : files) {
+		cache.get(file.path, file.fd, file.info);
+	}
+
+	std::atomic<long> num_hits{0};
+	auto start = Clock::now();
+
+	vector<thread> threads;
+	for (int t = 0; t < num_threads; t++) {
+		threads.push_back(thread([&, t]() {
+			uint32_t state = 12345 + t;
+			long hits = 0;
+			for (long i = 0; i < num_lookups; i++) {
+				state = state * 1664525 + 1013904223;
+				double pick = (state >> 8) / double(1 << 24);
+				File& file = files[unsigned(pick * pick * num_files)];
+
+				// the fstat every request makes anyway is left out, so that the
+				// cache is all that's measured
+				if (cache.get(file.path, file.fd, file.info) != nullptr) hits++;
+			}
+			num_hits += hits;
+		}));
+	}
+	for (thread& t : threads) t.join();
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	double total = double(num_threads) * num_lookups;
+
+	printf("%d threads, %u files: %.1f ns per lookup per thread, %.1f M lookups/s overall (%ld hits)\n",
+			num_threads, num_files, seconds * 1e9 * num_threads / total,
+			total / seconds / 1e6, num_hits.load());
+
+	for (File& file : files) {
+		close(file.fd);
+	}
+	fs::remove_all(dir);
+	return 0;
+}
@@ -0,0 +1,263 @@
+/*
+ * A small HTTP load generator for benchmarking ToreroServe.
+ *
+ * Each connection is a thread that repeatedly opens a connection, sends a
+ * GET request, reads the response until the server closes the connection,
+ * and records how long that took. At the end it prints the throughput and a
+ * few latency percentiles.
+ *
+ * With "tls" every connection does a full TLS handshake; with "tls-resume"
+ * each thread resumes the session (ticket) it got on its previous connection.
+ * Certificates aren't verified, since this is meant for loopback testing.
+ *
+ * With "fastopen" the request goes out with the SYN (TCP Fast Open), once the
+ * first connection has fetched a cookie. That needs the client bit of
+ * net.ipv4.tcp_fastopen here and the server bit on the server; without them
+ * it quietly falls back to a normal handshake.
+ *
+ * A host starting with '/' (or '@', for the abstract namespace) is taken to
+ * be a unix domain socket, in which case the port is ignored.
+ */
+
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+using std::cout;
+using std::string;
+using std::vector;
+using std::thread;
+
+using Clock = std::chrono::steady_clock;
+
+// send requests with the SYN ("fastopen" mode)
+static bool use_fastopen = false;
+
+// per-thread results, merged once everyone is done
+struct Results {
+	vector<double> latencies_usec;
+	size_t num_errors = 0;
+	size_t num_bytes = 0;
+	size_t num_resumed = 0;
+};
+
+// TLS state of one connection thread (ctx is nullptr for plain HTTP)
+struct TlsClient {
+	SSL_CTX *ctx = nullptr;
+	bool resume = false;
+	SSL_SESSION *session = nullptr;
+};
+
+/**
+ * Does the request/response exchange over TLS on a connected socket.
+ *
+ * @return The number of bytes received, or -1 on error.
+ */
+static long exchangeTls(int sock, const string& request, TlsClient& tls, Results *results) {
+	SSL *ssl = SSL_new(tls.ctx);
+	SSL_set_fd(ssl, sock);
+	if (tls.resume && tls.session != nullptr) {
+		SSL_set_session(ssl, tls.session);
+	}
+
+	long total = -1;
+	size_t n;
+	if (SSL_connect(ssl) == 1 && SSL_write_ex(ssl, request.data(), request.size(), &n) == 1) {
+		char buffer[65536];
+		total = 0;
+		while (SSL_read_ex(ssl, buffer, sizeof(buffer), &n) == 1) {
+			total += n;
+		}
+
+		if (SSL_session_reused(ssl)) results->num_resumed++;
+
+		// otherwise SSL_free takes the session to be broken and drops it
+		SSL_set_shutdown(ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+
+		// the (TLS 1.3) ticket arrives after the handshake, so grab it now
+		if (tls.resume) {
+			SSL_SESSION_free(tls.session);
+			tls.session = SSL_get1_session(ssl);
+		}
+	}
+	SSL_free(ssl);
+	return total;
+}
+
+/**
+ * Performs a single request.
+ *
+ * @return The number of bytes received, or -1 on error.
+ */
+static long doRequest(const struct addrinfo *server, const string& request,
+		TlsClient& tls, Results *results) {
+	int sock = socket(server->ai_family, server->ai_socktype | SOCK_CLOEXEC, server->ai_protocol);
+	if (sock < 0) return -1;
+
+	if (!use_fastopen && connect(sock, server->ai_addr, server->ai_addrlen) < 0) {
+		close(sock);
+		return -1;
+	}
+
+	long total = 0;
+	ssize_t n = 0;
+	if (tls.ctx != nullptr) {
+		total = exchangeTls(sock, request, tls, results);
+	}
+	else {
+		// with fast open, sendto does the connecting
+		ssize_t num_sent = use_fastopen
+			? sendto(sock, request.data(), request.size(), MSG_NOSIGNAL | MSG_FASTOPEN,
+					server->ai_addr, server->ai_addrlen)
+			: send(sock, request.data(), request.size(), MSG_NOSIGNAL);
+		if (num_sent != (ssize_t)request.size()) {
+			close(sock);
+			return -1;
+		}
+
+		char buffer[65536];
+		while ((n = recv(sock, buffer, sizeof(buffer), 0)) > 0) {
+			total += n;
+		}
+	}
+	close(sock);
+
+	// a response shorter than a status line means something went wrong
+	return (n < 0 || total < 12) ? -1 : total;
+}
+
+/**
+ * Function that each connection thread runs until the deadline.
+ */
+void runConnection(const struct addrinfo *server, string request, TlsClient tls,
+		Clock::time_point deadline, Results *results) {
+	while (Clock::now() < deadline) {
+		auto start = Clock::now();
+		long num_bytes = doRequest(server, request, tls, results);
+		auto end = Clock::now();
+
+		if (num_bytes < 0) {
+			results->num_errors++;
+			continue;
+		}
+		results->num_bytes += num_bytes;
+		results->latencies_usec.push_back(
+				std::chrono::duration<double, std::micro>(end - start).count());
+	}
+	SSL_SESSION_free(tls.session);
+}
+
+int main(int argc, char **argv) {
+	if (argc != 6 && argc != 7) {
+		cout << "Usage: " << argv[0] << " <host> <port> <path> <connections> <seconds>"
+			" [plain|tls|tls-resume|fastopen]\n";
+		exit(1);
+	}
+
+	string host = argv[1];
+	string port = argv[2];
+	string path = argv[3];
+	int num_connections = std::stoi(argv[4]);
+	int num_seconds = std::stoi(argv[5]);
+	string mode = argc == 7 ? argv[6] : "plain";
+
+	TlsClient tls;
+	if (mode == "tls" || mode == "tls-resume") {
+		tls.ctx = SSL_CTX_new(TLS_client_method());
+		tls.resume = mode == "tls-resume";
+
+		// the server closes without a close_notify once the response is out
+		SSL_CTX_set_options(tls.ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+	}
+	else if (mode == "fastopen") {
+		use_fastopen = true;
+	}
+	else if (mode != "plain") {
+		cout << "Unknown mode " << mode << "\n";
+		exit(1);
+	}
+
+	struct addrinfo hints = {};
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *server;
+
+	struct sockaddr_un unix_addr = {};
+	struct addrinfo unix_server = {};
+	if (host[0] == '/' || host[0] == '@') {
+		if (host.size() >= sizeof(unix_addr.sun_path)) {
+			cout << "Unix socket path too long\n";
+			exit(1);
+		}
+		unix_addr.sun_family = AF_UNIX;
+		memcpy(unix_addr.sun_path, host.data(), host.size());
+		unix_server.ai_addrlen = offsetof(struct sockaddr_un, sun_path) + host.size();
+		if (host[0] == '@') unix_addr.sun_path[0] = '\0';
+		else unix_server.ai_addrlen++;
+
+		unix_server.ai_family = AF_UNIX;
+		unix_server.ai_socktype = SOCK_STREAM;
+		unix_server.ai_addr = (struct sockaddr*) &unix_addr;
+		server = &unix_server;
+		host = "localhost"; // for the Host header
+	}
+	else if (getaddrinfo(host.c_str(), port.c_str(), &hints, &server) != 0) {
+		cout << "Could not resolve " << host << "\n";
+		exit(1);
+	}
+
+	string request = "GET " + path + " HTTP/1.0\r\nHost: " + host + "\r\n\r\n";
+	auto deadline = Clock::now() + std::chrono::seconds(num_seconds);
+
+	vector<Results> results(num_connections);
+	vector<thread> threads;
+	for (int i = 0; i < num_connections; i++) {
+		threads.push_back(thread(runConnection, server, request, tls, deadline, &results[i]));
+	}
+	for (size_t i = 0; i < threads.size(); i++) {
+		threads[i].join();
+	}
+	if (server != &unix_server) freeaddrinfo(server);
+
+	Results total;
+	for (Results& r : results) {
+		total.latencies_usec.insert(total.latencies_usec.end(),
+				r.latencies_usec.begin(), r.latencies_usec.end());
+		total.num_errors += r.num_errors;
+		total.num_bytes += r.num_bytes;
+		total.num_resumed += r.num_resumed;
+	}
+
+	vector<double>& lat = total.latencies_usec;
+	std::sort(lat.begin(), lat.end());
+	auto percentile = [&lat](double p) {
+		return lat.empty() ? 0.0 : lat[std::min(lat.size() - 1, size_t(p * lat.size()))];
+	};
+
+	printf("requests: %zu  errors: %zu  req/s: %.0f  MB/s: %.1f\n",
+			lat.size(), total.num_errors, lat.size() / double(num_seconds),
+			total.num_bytes / double(num_seconds) / 1e6);
+	printf("latency usec  p50: %.0f  p90: %.0f  p99: %.0f  max: %.0f\n",
+			percentile(0.50), percentile(0.90), percentile(0.99),
+			lat.empty() ? 0.0 : lat.back());
+	if (tls.ctx != nullptr) {
+		printf("resumed handshakes: %zu\n", total.num_resumed);
+		SSL_CTX_free(tls.ctx);
+	}
+}
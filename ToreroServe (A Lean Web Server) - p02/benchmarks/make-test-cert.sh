@@ -0,0 +1,15 @@
+#!/bin/bash
+
+# Usage: make-test-cert.sh [FILE]
+#
+# Makes a self-signed certificate for localhost (key included in the same
+# file) for trying out and benchmarking HTTPS, e.g.:
+#
+#   ./make-test-cert.sh && (cd .. && ./torero-serve 8443 WWW --tls-cert=benchmarks/test-cert.pem)
+
+file=${1:-test-cert.pem}
+
+openssl req -x509 -newkey ec -pkeyopt ec_paramgen_curve:prime256v1 -nodes \
+	-subj /CN=localhost -days 365 -keyout "$file" -out "$file.crt" 2> /dev/null
+cat "$file.crt" >> "$file"
+rm "$file.crt"
@@ -0,0 +1,118 @@
+/*
+ * A stand-in backend for trying out ToreroServe's reverse proxy mode.
+ *
+ * It answers every GET with a body of the given size (or a chunked body, for
+ * "chunked"), keeping connections open for as long as the client does, with a
+ * thread per connection. On SIGINT or SIGTERM it prints how many connections
+ * it accepted and how many requests it answered, which is how connection
+ * churn between the proxy and its backends shows up.
+ */
+
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+
+using std::string;
+
+static std::atomic<long> num_connections{0};
+static std::atomic<long> num_requests{0};
+
+/**
+ * Answers requests on one connection until the client closes it (or asks
+ * for it to be closed).
+ */
+static void serve(int fd, const string& response) {
+	string received;
+	char buffer[4096];
+	while (true) {
+		size_t end;
+		while ((end = received.find("\r\n\r\n")) == string::npos) {
+			ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+			if (n <= 0) {
+				close(fd);
+				return;
+			}
+			received.append(buffer, n);
+		}
+
+		bool close_after = received.substr(0, end).find("Connection: close") != string::npos;
+		received.erase(0, end + 4);
+		num_requests++;
+
+		if (send(fd, response.data(), response.size(), MSG_NOSIGNAL) < 0 || close_after) {
+			close(fd);
+			return;
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::cerr << "Usage: " << argv[0] << " <port> <body bytes> [chunked]\n";
+		return 1;
+	}
+	int port = atoi(argv[1]);
+	size_t body_size = strtoul(argv[2], nullptr, 10);
+	bool chunked = argc > 3 && strcmp(argv[3], "chunked") == 0;
+
+	string body(body_size, 'x');
+	string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n";
+	if (chunked) {
+		// the body in two chunks, plus the last (empty) one
+		char size[32];
+		snprintf(size, sizeof(size), "%zx", body_size / 2);
+		response += string("Transfer-Encoding: chunked\r\n\r\n") + size + "\r\n"
+			+ body.substr(0, body_size / 2) + "\r\n";
+		snprintf(size, sizeof(size), "%zx", body_size - body_size / 2);
+		response += string(size) + "\r\n" + body.substr(body_size / 2) + "\r\n0\r\n\r\n";
+	}
+	else {
+		response += "Content-Length: " + std::to_string(body_size) + "\r\n\r\n" + body;
+	}
+
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	int enable = 1;
+	setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+	struct sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listener, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0
+			|| listen(listener, 1024) < 0) {
+		perror("Listening failed");
+		return 1;
+	}
+
+	// report on the way out
+	sigset_t stop;
+	sigemptyset(&stop);
+	sigaddset(&stop, SIGINT);
+	sigaddset(&stop, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &stop, nullptr);
+	std::thread([stop, port]() {
+		int signal_number;
+		sigwait(&stop, &signal_number);
+		printf("backend %d: %ld connections, %ld requests\n", port,
+				num_connections.load(), num_requests.load());
+		fflush(stdout);
+		_exit(0);
+	}).detach();
+
+	while (true) {
+		int fd = accept(listener, nullptr, nullptr);
+		if (fd < 0) continue;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+		num_connections++;
+		std::thread(serve, fd, std::cref(response)).detach();
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * Microbenchmark for the server's RateLimiter: how long one admit (plus
+ * giving the connection slot back) takes, from a number of threads at once.
+ *
+ * Each thread checks addresses picked from a pool of the given size, so a
+ * small pool measures the hot path (the address is already in the table)
+ * while a pool bigger than the table also measures expiry and insertion.
+ */
+
+#include <arpa/inet.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "../RateLimiter.hpp"
+
+using std::cout;
+using std::vector;
+using std::thread;
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char** argv) {
+	if (argc < 4) {
+		std::cerr << "Usage: " << argv[0] << " <threads> <addresses> <checks per thread>\n";
+		return 1;
+	}
+	int num_threads = atoi(argv[1]);
+	unsigned num_addresses = strtoul(argv[2], nullptr, 10);
+	long num_checks = atol(argv[3]);
+
+	// generous limits, so that (nearly) every check is admitted
+	RateLimiter::Limits limits;
+	limits.requests_per_second = 1e9;
+	limits.burst = 1e9;
+	limits.max_connections = 1000;
+	RateLimiter limiter(limits);
+
+	std::atomic<long> num_admitted{0};
+	auto start = Clock::now();
+
+	vector<thread> threads;
+	for (int t = 0; t < num_threads; t++) {
+		threads.push_back(thread([&, t]() {
+			uint32_t state = 12345 + t;
+			long admitted = 0;
+			for (long i = 0; i < num_checks; i++) {
+				state = state * 1664525 + 1013904223;
+				uint32_t address = htonl(0x0a000000 + state % num_addresses);
+
+				RateLimiter::Slot slot;
+				if (limiter.admit(address, slot)) admitted++;
+			}
+			num_admitted += admitted;
+		}));
+	}
+	for (thread& t : threads) t.join();
+
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+	double total = double(num_threads) * num_checks;
+
+	printf("%d threads, %u addresses: %.1f ns per check per thread, %.1f M checks/s overall (%ld admitted)\n",
+			num_threads, num_addresses, seconds * 1e9 * num_threads / total,
+			total / seconds / 1e6, num_admitted.load());
+	return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Microbenchmark for the receive path of the threads engine: receiving a
+ * request into a freshly allocated (and zero-filled) vector and copying it
+ * into a string, the way handleClient used to, versus receiving it into a
+ * reused buffer with the span overload of ClientSocket::receiveData.
+ *
+ * The request travels over a unix socket pair, so both versions pay the same
+ * for the system calls and the difference is what they do around them.
+ */
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "../ClientSocket.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+static const char REQUEST[] =
+	"GET /index.html HTTP/1.1\r\n"
+	"Host: localhost:8080\r\n"
+	"User-Agent: receive_bench/1.0\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Language: en-US,en;q=0.5\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Connection: keep-alive\r\n"
+	"\r\n";
+
+/**
+ * Runs one version of the receive path the given number of times.
+ *
+ * @return Nanoseconds per request.
+ */
+template <typename Receive>
+static double measure(int sender, ClientSocket& receiver, long num_requests, Receive receive) {
+	size_t total = 0;
+	auto start = Clock::now();
+	for (long i = 0; i < num_requests; i++) {
+		if (write(sender, REQUEST, sizeof(REQUEST) - 1) < 0) {
+			perror("write");
+			exit(1);
+		}
+		total += receive(receiver);
+	}
+	double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	if (total != num_requests * (sizeof(REQUEST) - 1)) {
+		fprintf(stderr, "lost bytes\n");
+		exit(1);
+	}
+	return seconds * 1e9 / num_requests;
+}
+
+int main(int argc, char** argv) {
+	long num_requests = argc > 1 ? atol(argv[1]) : 1000000;
+	size_t buffer_size = argc > 2 ? strtoul(argv[2], nullptr, 10) : 2048;
+
+	int fds[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+	ClientSocket receiver(fds[1]);
+
+	// just the system calls, for reference
+	char scratch[65536];
+	double syscalls = measure(fds[0], receiver, num_requests, [&](ClientSocket& client) {
+		return (size_t) recv(client.getFd(), scratch, buffer_size, 0);
+	});
+
+	double vector_version = measure(fds[0], receiver, num_requests, [&](ClientSocket& client) {
+		std::vector<char> request = client.receiveData(buffer_size);
+		std::string request_string(request.begin(), request.end());
+		return request_string.size();
+	});
+
+	std::vector<char> pooled(buffer_size);
+	double span_version = measure(fds[0], receiver, num_requests, [&](ClientSocket& client) {
+		return client.receiveData(std::span<char>(pooled));
+	});
+
+	printf("%ld requests of %zu bytes, %zu byte buffer\n", num_requests, sizeof(REQUEST) - 1, buffer_size);
+	printf("  write + recv only:                   %6.1f ns per request\n", syscalls);
+	printf("  receiveData(size_t) + string copy:   %6.1f ns per request (+%.1f)\n",
+			vector_version, vector_version - syscalls);
+	printf("  receiveData(span), reused buffer:    %6.1f ns per request (+%.1f)\n",
+			span_version, span_version - syscalls);
+	return 0;
+}
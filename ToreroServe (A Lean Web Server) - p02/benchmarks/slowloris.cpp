@@ -0,0 +1,124 @@
+/*
+ * A slowloris client for trying out ToreroServe's header budget.
+ *
+ * It keeps the given number of connections open to the server, each sending
+ * nothing for an interval, then the start of a request, and then one more
+ * header byte every interval, never finishing the header. Whenever the
+ * server closes one (or turns it away), it opens a new one in its place. At the end it prints how many
+ * connections it opened and what the server answered them with.
+ */
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+using std::string;
+
+static const char REQUEST_START[] = "GET /index.html HTTP/1.1\r\nHost: localhost\r\n";
+
+static int connectTo(const struct sockaddr_in& addr) {
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (const struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		if (fd >= 0) close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/**
+ * @return The status code of whatever the server sent on the (closed)
+ * connection, or 0 if it sent nothing.
+ */
+static int readStatus(int fd) {
+	char buffer[256];
+	ssize_t n = recv(fd, buffer, sizeof(buffer) - 1, MSG_DONTWAIT);
+	if (n < 12) return 0;
+	buffer[n] = '\0';
+	return atoi(buffer + 9);
+}
+
+int main(int argc, char** argv) {
+	if (argc < 6) {
+		std::cerr << "Usage: " << argv[0] << " <host> <port> <connections> <interval ms> <seconds>\n";
+		exit(1);
+	}
+
+	struct sockaddr_in addr = {};
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(atoi(argv[2]));
+	inet_pton(AF_INET, argv[1], &addr.sin_addr);
+	int num_connections = atoi(argv[3]);
+	auto interval = std::chrono::milliseconds(atoi(argv[4]));
+	auto end = std::chrono::steady_clock::now() + std::chrono::seconds(atoi(argv[5]));
+
+	std::vector<int> fds(num_connections, -1);
+	std::vector<bool> started(num_connections, false);
+	long num_opened = 0;
+	long num_failed = 0;
+	std::map<int, long> answers; // status (0: just closed) -> how many
+
+	while (std::chrono::steady_clock::now() < end) {
+		auto next = std::chrono::steady_clock::now() + interval;
+
+		for (int i = 0; i < num_connections; i++) {
+			int& fd = fds[i];
+
+			// closed (or answered) by the server since the last round?
+			if (fd >= 0) {
+				struct pollfd p = {fd, POLLIN, 0};
+				if (poll(&p, 1, 0) > 0) {
+					answers[readStatus(fd)]++;
+					close(fd);
+					fd = -1;
+				}
+			}
+			if (fd < 0) {
+				fd = connectTo(addr);
+				if (fd < 0) {
+					num_failed++;
+					continue;
+				}
+				num_opened++;
+				started[i] = false;
+				continue;
+			}
+
+			const char *data = started[i] ? "X" : REQUEST_START;
+			started[i] = true;
+			if (send(fd, data, strlen(data), MSG_NOSIGNAL) < 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+
+		std::this_thread::sleep_until(next);
+	}
+
+	long num_open = 0;
+	for (int fd : fds) {
+		if (fd >= 0) {
+			num_open++;
+			close(fd);
+		}
+	}
+
+	std::cout << "slowloris: " << num_opened << " connections opened, "
+		<< num_open << " still open at the end, " << num_failed << " failed to connect\n";
+	for (auto [status, count] : answers) {
+		std::cout << "  " << (status == 0 ? string("closed") : std::to_string(status))
+			<< ": " << count << "\n";
+	}
+	return 0;
+}
@@ -0,0 +1,174 @@
+/**
+ * File: embed-assets.cpp
+ *
+ * Build tool for the embedded server (see EmbeddedAssets.hpp): writes a
+ * source file with every file under a directory as a constexpr array,
+ * header and contents, plus the sorted index of them.
+ *
+ * Usage: embed-assets <root dir> <output file>
+ */
+
+// operating system specific libraries
+#include <sys/stat.h>
+
+// C standard library
+#include <cstdio>
+#include <cstring>
+
+// C++ standard libraries
+#include <map>
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <filesystem>
+
+#include "FileHeader.hpp"
+
+namespace fs = std::filesystem;
+
+using std::string;
+
+// characters of a string literal per line of the generated source
+static const size_t LINE_LENGTH = 76;
+
+/**
+ * Writes data as a C++ string literal, split over as many lines as it takes.
+ * Everything but printable ASCII (and line endings and tabs) is written as a
+ * three digit octal escape, which (unlike \x) can't swallow a digit that
+ * follows it.
+ */
+static void writeLiteral(std::ostream& out, std::string_view data) {
+	string line;
+	for (unsigned char c : data) {
+		if (c == '"' || c == '\\') {
+			line += '\\';
+			line += c;
+		}
+		else if (c == '\r') line += "\\r";
+		else if (c == '\n') line += "\\n";
+		else if (c == '\t') line += "\\t";
+		else if (c >= ' ' && c <= '~') {
+			line += c;
+		}
+		else {
+			char escape[5];
+			snprintf(escape, sizeof(escape), "\\%03o", c);
+			line += escape;
+		}
+
+		// text files keep their lines
+		if (line.size() >= LINE_LENGTH || c == '\n') {
+			out << "\t\"" << line << "\"\n";
+			line.clear();
+		}
+	}
+	if (!line.empty() || data.empty()) {
+		out << "\t\"" << line << "\"\n";
+	}
+}
+
+int main(int argc, char** argv) {
+	if (argc != 3) {
+		std::cerr << "Usage: " << argv[0] << " <root dir> <output file>\n";
+		return 1;
+	}
+	string root = argv[1];
+	if (!fs::is_directory(root)) {
+		std::cerr << "ERROR: " << root << " does not exist or is not a directory\n";
+		return 1;
+	}
+
+	// path of each file (sorted, so that the same tree always makes the same
+	// source) and the file each resource gets, sorted by resource like the
+	// index has to be
+	std::vector<string> files;
+	std::map<string, size_t> resources;
+
+	for (const fs::directory_entry& entry : fs::recursive_directory_iterator(root,
+			fs::directory_options::follow_directory_symlink)) {
+		// symbolic links are followed, like the server does
+		if (entry.is_regular_file()) files.push_back(entry.path().string());
+	}
+	std::sort(files.begin(), files.end());
+
+	for (size_t number = 0; number < files.size(); number++) {
+		string resource = files[number].substr(root.size());
+		if (resource.empty() || resource[0] != '/') resource.insert(0, "/");
+		resources[resource] = number;
+
+		// a directory's index.html is also what the directory itself serves
+		if (fs::path(files[number]).filename() == "index.html") {
+			string directory = resource.substr(0, resource.size() - strlen("index.html"));
+			resources[directory] = number;
+			if (directory != "/") {
+				resources[directory.substr(0, directory.size() - 1)] = number;
+			}
+		}
+	}
+
+	std::ofstream out(argv[2], std::ios::binary | std::ios::trunc);
+	out << "// Generated by embed-assets from " << root << ". Don't edit it: \"make embedded\"\n"
+		<< "// writes it again whenever something in " << root << " changes.\n\n"
+		<< "#include <algorithm>\n#include <iterator>\n\n#include \"EmbeddedAssets.hpp\"\n";
+
+	std::vector<size_t> header_sizes;
+	std::vector<size_t> body_sizes;
+	for (size_t i = 0; i < files.size(); i++) {
+		struct stat info;
+		std::ifstream file(files[i], std::ios::binary);
+		string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+		if (!file.good() && !file.eof()) {
+			std::cerr << "ERROR: reading " << files[i] << " failed\n";
+			return 1;
+		}
+		if (stat(files[i].c_str(), &info) < 0) {
+			perror(files[i].c_str());
+			return 1;
+		}
+
+		// the header describes what was read, should the file have changed
+		info.st_size = contents.size();
+		string header = buildFileHeader(files[i], info);
+		header_sizes.push_back(header.size());
+		body_sizes.push_back(contents.size());
+
+		out << "\n// " << files[i] << "\nstatic constexpr char asset_" << i << "[] =\n";
+		writeLiteral(out, header);
+		writeLiteral(out, contents);
+		out << "\t;\n";
+	}
+
+	out << "\nstatic constexpr EmbeddedAsset assets[] = {\n";
+	for (auto& [resource, number] : resources) {
+		out << "\t{\"";
+		for (char c : resource) {
+			if (c == '"' || c == '\\') out << '\\';
+			out << c;
+		}
+		out << "\", {asset_" << number << ", " << header_sizes[number] << "}, {asset_"
+			<< number << " + " << header_sizes[number] << ", " << body_sizes[number] << "}},\n";
+	}
+	if (resources.empty()) {
+		// an empty array isn't allowed; this one matches no request
+		out << "\t{\"\", {}, {}},\n";
+	}
+	out << "};\n\n"
+		<< "// EmbeddedAssets::find counts on this\n"
+		<< "static_assert(std::adjacent_find(std::begin(assets), std::end(assets),\n"
+		<< "\t\t[](const EmbeddedAsset& a, const EmbeddedAsset& b) { return !(a.resource < b.resource); })\n"
+		<< "\t\t== std::end(assets), \"embedded assets must be sorted by resource, without duplicates\");\n\n"
+		<< "std::span<const EmbeddedAsset> EmbeddedAssets::all() { return assets; }\n";
+
+	out.close();
+	if (!out) {
+		std::cerr << "ERROR: writing " << argv[2] << " failed\n";
+		return 1;
+	}
+
+	std::cout << "Embedded " << files.size() << " files (" << resources.size()
+		<< " resources) from " << root << " in " << argv[2] << std::endl;
+	return 0;
+}
@@ -6,7 +6,89 @@
  * 	1. The port number on which to bind and listen for connections
  * 	2. The directory out of which to serve files.
  *
- * 	DO NOT MODIFY THIS FILE IN ANY WAY!
+ * These may be followed by options of the form --name=value:
+ * 	--engine=threads|coroutines|io_uring
+ * 	                               What runs the requests.
+ * 	--model=queue|leader-follower  How connections reach the workers (threads
+ * 	                               engine only).
+ * 	--socket-profile=default|latency|throughput|many-connections
+ * 	                               Options for the listening and accepted
+ * 	                               sockets (backlog, TCP_NODELAY, ...).
+ * 	--processes=N                  Fork N worker processes, each running the
+ * 	                               engine (prefork mode; SIGUSR1 to the
+ * 	                               master prints request stats).
+ * 	--worker-cpus=LIST             Pin the workers (worker processes, in
+ * 	                               prefork mode) to these CPUs in turn, e.g.
+ * 	                               0-3,8-11; the server keeps to them.
+ * 	--acceptor-cpu=N               Pin the acceptor (queue model) to CPU N.
+ * 	--align-workers=off|incoming-cpu
+ * 	                               With incoming-cpu, each worker process gets
+ * 	                               the connections that come in on its CPU,
+ * 	                               i.e. from the NIC queue whose interrupts go
+ * 	                               there (prefork mode; default off).
+ * 	--unix-socket=PATH             Listen on a unix domain socket instead of
+ * 	                               the port (@NAME for an abstract one).
+ * 	--unix-peer-uid=UID            Only serve unix socket clients running as
+ * 	                               UID (or root), going by SO_PEERCRED.
+ * 	--tls-cert=FILE                Serve HTTPS with this PEM certificate chain
+ * 	                               (threads engine only).
+ * 	--tls-key=FILE                 PEM private key, if not in the cert file.
+ * 	--rate-limit=N                 Requests per second allowed per client
+ * 	                               address (answered with 429 beyond that).
+ * 	--rate-burst=N                 Requests a client may make back to back
+ * 	                               (defaults to the rate limit).
+ * 	--max-conns-per-ip=N           Connections a client address may have
+ * 	                               open at once.
+ * 	--access-log=FILE              Log requests to FILE (Common Log Format).
+ * 	--error-pages=DIR              Take the bodies of error responses from
+ * 	                               DIR/STATUS.html (e.g. DIR/404.html) where
+ * 	                               there is one.
+ * 	--warm-up-threads=N            Before listening, index the served tree
+ * 	                               with N threads and warm up the caches.
+ * 	--warm-up-deadline=SECONDS     Start listening after this long even if
+ * 	                               the warm-up isn't done (default 10).
+ * 	--hot-files=N                  How many of the files most requested in
+ * 	                               the access log to load into memory during
+ * 	                               the warm-up (default 100).
+ * 	--file-cache=MIB               Cache up to MIB of popular files in memory
+ * 	                               while serving (SIGUSR1 prints a report of
+ * 	                               the cache and the most requested paths).
+ * 	--file-cache-replicas=off|numa With numa, hot cached files get a copy on
+ * 	                               each NUMA node they are read on (default
+ * 	                               off).
+ * 	--large-file=MIB               Send files of at least MIB without filling
+ * 	                               the page cache with them.
+ * 	--admin-path=PATH              Serve the server's own endpoints under PATH
+ * 	                               (e.g. /_torero): PATH/health, PATH/stats,
+ * 	                               PATH/stats/worker/N and PATH/index/RESOURCE.
+ * 	--large-file-io=sendfile|direct
+ * 	                               How: sendfile, dropping the pages behind
+ * 	                               each download (default), or O_DIRECT reads.
+ * 	--proxy=PREFIX=HOST:PORT[,HOST:PORT...]
+ * 	                               Forward requests under PREFIX (e.g. /api)
+ * 	                               to these backends, path unchanged (threads
+ * 	                               engine only; may be given more than once).
+ * 	--proxy-health-path=PATH       What the backends' health checks ask for
+ * 	                               (default /).
+ * 	--proxy-pool=N                 Idle connections kept open to each backend
+ * 	                               (default 32; 0 connects per request).
+ * 	--drain-timeout=SECONDS        After an upgrade, how long the old process
+ * 	                               waits for its connections (default 30).
+ * 	--max-header-size=BYTES        Largest request header accepted (default
+ * 	                               32768; bigger ones get a 431).
+ * 	--header-timeout=SECONDS       How long a client has to send its request
+ * 	                               header (default 10; then it gets a 408).
+ * 	--header-memory=MIB            Memory all partially received requests may
+ * 	                               take together (default 64; clients beyond
+ * 	                               it get a 503).
+ *
+ * Built with "make embedded", the server has the WWW tree compiled in and
+ * serves it without touching the disk; the root directory then only needs
+ * to exist for anything that isn't compiled in.
+ *
+ * With the threads engine in a single process, SIGHUP upgrades the server:
+ * the binary is started again and takes over the listening socket (and the
+ * warmed-up index), while the old process finishes what it has and exits.
  */
 
 // C++ standard libraries
@@ -16,18 +98,20 @@
 #include <system_error>
 #include <filesystem>
 
+#include "ServerConfig.hpp"
+
 // shortening std::cout to just cout (and so on)
 using std::cerr;
 using std::string;
 
 namespace fs = std::filesystem;
 
-void runServer(unsigned short int port, string root_dir); // definition located in torero-server.cpp
+void runServer(const ServerConfig& config); // definition located in torero-server.cpp
 
 int main(int argc, char** argv) {
 	/* Make sure the user called our program correctly. */
-	if (argc != 3) {
-		cerr << "Usage: " << argv[0] << " <port> <root dir>\n";
+	if (argc < 3) {
+		cerr << "Usage: " << argv[0] << " <port> <root dir> [--option=value ...]\n";
 		exit(1);
 	}
 
@@ -42,13 +126,29 @@ int main(int argc, char** argv) {
 		exit(1);
 	}
 
-	// Confirm that user gave a valid directory for the root
+	// Confirm that user gave a valid directory for the root (which the
+	// embedded build can do without, see EmbeddedAssets.hpp)
+#ifdef TORERO_EMBEDDED
+	if (fs::exists(argv[2]) && !fs::is_directory(argv[2])) {
+#else
 	if (!fs::is_directory(argv[2])) {
+#endif
 		cerr << "ERROR: " << argv[2] << " does not exist or is not a directory\n";
 		exit(1);
 	}
 
-	runServer(port, string(argv[2]));
+	ServerConfig config;
+	config.port = port;
+	config.root_dir = string(argv[2]);
+
+	for (int i = 3; i < argc; i++) {
+		if (!config.setOption(argv[i])) {
+			cerr << "ERROR: " << argv[i] << " is not a valid option\n";
+			exit(1);
+		}
+	}
+
+	runServer(config);
 
 	return 0;
 }
@@ -7,14 +7,32 @@
  * Author 2: Phillip Banky (pbanky@sandiego.edu)
  */
 
+// operating system specific libraries
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+// C standard library
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+
 // C++ standard libraries
 #include <span>
-#include <array>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <vector>
 #include <thread>
 #include <string>
 #include <iostream>
-#include <fstream>
+#include <memory>
 #include <system_error>
 #include <filesystem>
 #include <regex> // for parsing HTTP requests
@@ -23,6 +41,37 @@
 #include "ClientSocket.hpp"
 #include "ServerSocket.hpp"
 #include "BoundedBuffer.hpp"
+#include "Leadership.hpp"
+#include "ServerConfig.hpp"
+#include "torero-serve.hpp"
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "ResponseWriter.hpp"
+#include "RequestReader.hpp"
+#include "HeaderBudget.hpp"
+#include "DirectoryListing.hpp"
+#include "Coroutines.hpp"
+#include "Scheduler.hpp"
+#include "AsyncSocket.hpp"
+#include "UringEngine.hpp"
+#include "Tls.hpp"
+#include "Http2Connection.hpp"
+#include "RateLimiter.hpp"
+#include "AccessLog.hpp"
+#include "FileIndex.hpp"
+#include "ServerStats.hpp"
+#include "FileCache.hpp"
+#include "LargeFile.hpp"
+#include "Profiler.hpp"
+#include "Router.hpp"
+#include "ReverseProxy.hpp"
+#include "SocketOptions.hpp"
+#include "Upgrade.hpp"
+#include "CpuAffinity.hpp"
+#include "ErrorResponses.hpp"
+#ifdef TORERO_EMBEDDED
+#include "EmbeddedAssets.hpp"
+#endif
 
 // shorten the std::filesystem namespace down to just fs
 namespace fs = std::filesystem;
@@ -30,169 +79,424 @@ namespace fs = std::filesystem;
 // shortening std::cout to just cout (and so on)
 using std::cout;
 using std::string;
-using std::array;
 using std::vector;
 using std::span;
 using std::thread;
 
-void sendResponse(ClientSocket client, string resource);
-void sendFile(ClientSocket client, string file_path);
+HttpResponse respondWith404();
 
-/** 
- * Returns the content type for a given file path.
- * Basically, this function looks at the file extension and
- * returns the appropriate MIME type.
- * For Dr. Sat, the fs::path is useful because it has a function
- * to easily get the file extension ... I'm taking path as a param and 
- * returning a string because that's what the rest of the code uses.
- * 
- * @param path The file path.
- * @return The MIME type as a string.
+// number of I/O threads used to stream responses out to clients
+static const int NUM_WRITER_THREADS = 2;
+
+// number of I/O threads that wait for requests that don't arrive in one piece
+static const int NUM_READER_THREADS = 2;
+
+// number of workers that handle those requests once they are complete
+static const int NUM_READER_WORKERS = 4;
+
+// how long a worker waits for a request to show up before handing the
+// client over to the reader
+static const int FIRST_READ_WAIT_MS = 5;
+
+// most connections accepted per wakeup of the accept loop
+static const size_t MAX_ACCEPT_BATCH = 64;
+
+// most clients a worker takes from the buffer at once (kept small, since a
+// worker may wait up to FIRST_READ_WAIT_MS on each of them in turn)
+static const size_t MAX_CLIENTS_PER_WORKER = 4;
+
+// number of worker threads (or event loop threads, for the coroutine engine)
+static const int NUM_WORKERS = 4;
+
+// requests are received into a per-thread buffer of this size, which grows
+// (up to the header size limit) for requests with bigger headers
+static const size_t INITIAL_READ_BUFFER_SIZE = 2048;
+
+// directory listings bigger than this are streamed instead of sent whole
+static const size_t LISTING_BUFFER_LIMIT = 64 * 1024;
+
+// HTTP/2 connections on the threads engine get a thread each, up to this many
+static const int MAX_HTTP2_CONNECTIONS = 64;
+
+// an HTTP/2 connection with nothing going on for this long is closed
+static const int HTTP2_IDLE_TIMEOUT_MS = 10000;
+
+// most bytes of frames sent between checks for new HTTP/2 requests
+static const size_t HTTP2_WRITE_BATCH = 65536;
+
+static std::atomic<int> num_http2_connections{0};
+
+// per client address limits (nullptr when there are none)
+static std::unique_ptr<RateLimiter> rate_limiter;
+
+// where requests get logged, and the index built at startup (either may be
+// nullptr when not enabled)
+static std::unique_ptr<AccessLog> access_log;
+static std::unique_ptr<FileIndex> file_index;
+
+// request counters shared by the worker processes (prefork mode only)
+static std::unique_ptr<ServerStats> stats;
+
+// contents of popular files, kept while serving (nullptr when disabled)
+static std::unique_ptr<FileCache> file_cache;
+
+// files at least this big are sent in large file mode (0 for never), with
+// O_DIRECT reads if asked for (see LargeFile.hpp)
+static off_t large_file_size = 0;
+static bool large_file_direct = false;
+
+// dynamic endpoints, tried before the file system (nullptr when there are none)
+static std::unique_ptr<Router> router;
+
+// backends that path prefixes are forwarded to, by prefix
+static vector<std::pair<string, std::unique_ptr<ReverseProxy>>> proxies;
+
+// collects requests that don't arrive in one piece (threads engine only)
+static std::unique_ptr<RequestReader> request_reader;
+
+/**
+ * Returns the value of a parameter in a query string (e.g. "limit" in
+ * "sort=name&limit=50").
+ *
+ * @param query The query string, without the leading '?'.
+ * @param name The name of the parameter.
+ * @return The value, or an empty string if the parameter isn't there.
  */
-static std::string getPathExtension(const string& path) {
-	auto ext = fs::path(path).extension().string();
-	if (ext == ".html" || ext == ".htm") return "text/html";
-	if (ext == ".css") return "text/css";
-	if (ext == ".js") return "application/javascript";
-	if (ext == ".png") return "image/png";
-	if (ext == ".jpg" || ext == ".jpeg") return "image/jpeg";
-	if (ext == ".gif") return "image/gif";
-	if (ext == ".pdf") return "application/pdf";
-	if (ext == ".json") return "application/json";
-	if (ext == ".txt") return "text/plain";
-	return "application/octet-stream"; 
+static string getQueryParameter(const string& query, const string& name) {
+	size_t start = 0;
+	while (start < query.size()) {
+		size_t end = query.find('&', start);
+		if (end == string::npos) end = query.size();
+
+		size_t equals = query.find('=', start);
+		if (equals < end && query.compare(start, equals - start, name) == 0
+				&& equals - start == name.size()) {
+			return query.substr(equals + 1, end - equals - 1);
+		}
+		start = end + 1;
+	}
+	return "";
 }
 
 /**
- * Generates the requested directories HTML based on the contents of the directory
- * 
- * @param full_file_path The path to the requested resource being sent including the serving directory.
- * @param resource The path to the requested resource without the serving directory
+ * Reads the sorting and pagination settings for a directory listing out of
+ * the query string: sort=name, order=desc, offset=N and limit=N.
+ *
+ * @param query The query string of the request.
+ * @return The listing options.
+ */
+static DirectoryListing::Options parseListingOptions(const string& query) {
+	DirectoryListing::Options options;
+
+	options.sorted = getQueryParameter(query, "sort") == "name";
+	options.descending = getQueryParameter(query, "order") == "desc";
+
+	string offset = getQueryParameter(query, "offset");
+	if (!offset.empty()) {
+		options.offset = strtoull(offset.c_str(), nullptr, 10);
+	}
+
+	string limit = getQueryParameter(query, "limit");
+	if (!limit.empty() && strtoull(limit.c_str(), nullptr, 10) > 0) {
+		options.limit = strtoull(limit.c_str(), nullptr, 10);
+	}
+
+	return options;
+}
+
+/**
+ * @return Whether a file of the given size is sent in large file mode.
  */
-string generateDirectoryHTML(const string& full_file_path, const string& resource) {
-	// create the intial HTML with the directory name
-	string full_html = "<html>\n<body>\n";
-	full_html += "<h1>Contents of " + resource + ":</h1>\n";
-	full_html += "<ul id=\"fileList\">\n";
+bool isLargeFile(off_t size) {
+	return large_file_size > 0 && size >= large_file_size;
+}
 
-	// loop through the items in the directory and add them to the HTML surrounded by link tags
-	for(auto& entry : fs::directory_iterator(full_file_path)) {
-		string filename = entry.path().filename().string();
-		if(fs::is_directory(entry.path())) {
-			full_html += "<li><a href=\"" + filename + "/\">" + filename + "/</a></li>\n";
-		} else {
-			full_html += "<li><a href=\"" + filename + "\">" + filename + "</a></li>\n";
+/**
+ * Gives a response the body of a large file: read with O_DIRECT if that was
+ * asked for (and the file system allows it), or else sent with sendfile,
+ * dropping the pages behind the download.
+ *
+ * @param response The response.
+ * @param file_fd The file, opened for reading.
+ * @param file_info An fstat of file_fd.
+ */
+static void setLargeFileBody(HttpResponse& response, int file_fd, const struct stat& file_info) {
+	if (large_file_direct) {
+		// Linux lets O_DIRECT be turned on for an open file, which saves
+		// opening it again (and maybe getting a different file)
+		int flags = fcntl(file_fd, F_GETFL);
+		if (flags != -1 && fcntl(file_fd, F_SETFL, flags | O_DIRECT) == 0) {
+			response.stream = std::make_unique<DirectFileBody>(file_fd, file_info.st_size);
+			return;
 		}
 	}
 
-	// close off the end of the HTML 
-	full_html += "</ul>\n";
-	full_html += "</body>\n";
-	full_html += "</html>\n";
+	posix_fadvise(file_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	response.file_fd = file_fd;
+	response.file_length = file_info.st_size;
+	response.drop_behind = true;
+}
 
-	return full_html;
+/**
+ * Gives a response the body of an open file: from the file cache if the file
+ * is (or just got) in it, or else straight from the file, which the writer
+ * then closes.
+ *
+ * @param response The response.
+ * @param file_path The path of the file.
+ * @param file_fd The file, opened for reading.
+ * @param file_info An fstat of file_fd.
+ */
+static void setFileBody(HttpResponse& response, const string& file_path, int file_fd,
+		const struct stat& file_info) {
+	if (isLargeFile(file_info.st_size)) {
+		setLargeFileBody(response, file_fd, file_info);
+		return;
+	}
+	if (file_cache != nullptr) {
+		response.body = file_cache->get(file_path, file_fd, file_info);
+		if (response.body) {
+			close(file_fd);
+			return;
+		}
+	}
+	response.file_fd = file_fd;
+	response.file_length = file_info.st_size;
 }
 
 /**
- * Sends a 200 OK response to the client. It will leverage the getPathExtension method
- * made above to determine the content type of the file being sent. Within an OK header typically
- * the content length is also sent, so that is included as a parameter. We also need the file path
- * to determine the content type. and the client to send the header to.
+ * Builds a 200 OK response whose body is the file at the given path. The file
+ * is opened here, but its contents are not read: the writer sends them straight
+ * from the open file descriptor (and closes it when done). It will leverage the
+ * getPathExtension method made above to determine the content type.
  * 
- * @param client The client to respond to.
  * @param file_path The path to the file being sent.
+ * @return The response, or a 404 response if the file could not be opened.
+ */
+HttpResponse respondWithFile(const string& file_path) {
+	int file_fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file_fd < 0) {
+		return respondWith404();
+	}
+
+	// use the size of the file we actually opened, not the one we checked earlier
+	struct stat file_info;
+	if (fstat(file_fd, &file_info) < 0) {
+		close(file_fd);
+		return respondWith404();
+	}
+
+	HttpResponse response;
+	response.header = buildOKHeader(getPathExtension(file_path), file_info.st_size);
+	setFileBody(response, file_path, file_fd, file_info);
+	return response;
+}
+
+/**
+ * Builds a 200 OK response containing the generated HTML listing of a
+ * directory. Listings that turn out to be small are sent whole, with a
+ * Content-Length. Bigger ones are streamed while the rest of the directory is
+ * still being read: chunked for HTTP/1.1 clients, or ended by closing the
+ * connection for HTTP/1.0 ones.
+ *
+ * @param request The request for the directory.
+ * @param dir_path The path to the directory including the serving directory.
+ * @return The response to send.
  */
-void sendOKHeader(ClientSocket client, const std::string& file_path) {
+HttpResponse respondWithDirectoryListing(const HttpRequest& request, const string& dir_path) {
+	int dir_fd = open(dir_path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (dir_fd < 0) {
+		return respondWith404();
+	}
 
-	//i need the file size to include in the header
-	size_t file_size = fs::file_size(file_path);
+	auto listing = std::make_unique<DirectoryListing>(dir_fd, request.resource,
+			parseListingOptions(request.query));
 
-	//determine the content type based on the file extension
-	string content_type = getPathExtension(file_path);
+	HttpResponse response;
+	auto html = std::make_shared<string>();
+	while (html->size() < LISTING_BUFFER_LIMIT) {
+		if (!listing->next(*html)) {
+			response.header = buildOKHeader("text/html", html->size());
+			response.body = std::move(html);
+			return response;
+		}
+	}
 
-	//build the header
-	string header = 
-		"HTTP/1.0 200 OK\r\n"
-		"Content-Type: " + content_type + "\r\n"
-		"Content-Length: " + std::to_string(file_size) + "\r\n"
-		"\r\n";
+	if (request.minor_version >= 1) {
+		response.header =
+			"HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/html\r\n"
+			"Transfer-Encoding: chunked\r\n"
+			"Connection: close\r\n"
+			"\r\n";
 
-	client.sendData(header);
+		auto first_chunk = std::make_shared<string>();
+		ChunkedBody::appendChunk(*first_chunk, *html);
+		response.body = std::move(first_chunk);
+		response.stream = std::make_unique<ChunkedBody>(std::move(listing));
+	}
+	else {
+		response.header =
+			"HTTP/1.0 200 OK\r\n"
+			"Content-Type: text/html\r\n"
+			"\r\n";
+		response.body = std::move(html);
+		response.stream = std::move(listing);
+	}
+	return response;
 }
 
 /**
- * Sends a 200 OK response. containing the header and either the generated HTML or the file requested
+ * Builds a 200 OK response. containing the header and either the generated HTML or the file requested
  * 
- * @param client The client to respond to.
- * @param resource The path to the requested resource without the serving directory
+ * @param request The request for the resource.
  * @param full_file_path The path to the requested resource being sent including the serving directory.
+ * @return The response to send.
  */
-void respondWith200(ClientSocket client, string resource, string full_file_path) {
+HttpResponse respondWith200(const HttpRequest& request, string full_file_path) {
 	if(fs::is_directory(full_file_path)) {
 		// if the directory has and index.html file display that instead of generated HTML
 		if(fs::exists((full_file_path + "/index.html"))) {
-			sendOKHeader(client, (full_file_path + "/index.html"));
-			sendFile(client, (full_file_path + "/index.html"));
+			return respondWithFile(full_file_path + "/index.html");
 		}
-		// if its a directory without and index.html file build the html and send the header and built html
+		// if its a directory without and index.html file generate the listing
 		else {
-			string html = generateDirectoryHTML(full_file_path, resource);
-			string header = 
-				"HTTP/1.0 200 OK\r\n"
-				"Content-Type: text/html\r\n"
-				"Content-Length: " + std::to_string(html.size()) + "\r\n"
-				"\r\n";
-
-			client.sendData(header);
-			client.sendData(html);
+			return respondWithDirectoryListing(request, full_file_path);
 		}
 	}
 	// if its a regular file send the OK header and the full file
 	else if(fs::is_regular_file(full_file_path)) {
-		sendOKHeader(client, full_file_path);
-		sendFile(client, full_file_path);
+		return respondWithFile(full_file_path);
 	}
+
+	// neither a directory nor a regular file (e.g. a fifo), so don't serve it
+	return respondWith404();
 }
 
 /**
- * Sends a 400 BAD REQUEST response to the client.
+ * Answers with the prebuilt 429 TOO MANY REQUESTS response, for clients over
+ * their limits.
  *
- * @param client The client to respond to.
+ * @return The response to send.
  */
-void respondWith400(ClientSocket client) {
-	client.sendData("HTTP/1.0 400 BAD REQUEST\r\n\r\n");
+HttpResponse respondWith429() {
+	return ErrorResponses::respond(429);
 }
 
 /**
- * Sends a 404 NOT FOUND response to the client.
+ * Answers a client that is turned away before its request is even in.
  *
- * @param client The client to respond to.
+ * @param status 408 (too slow), 431 (header too big) or 503 (out of memory
+ * for partial requests); anything else gets a 400.
+ * @return The response to send.
  */
-void respondWith404(ClientSocket client) {
-	string response = 
-		"<html>\n"
-		"<head>\n"
-		"<title>Ruh-roh! Page not found!</title>\n"
-		"</head>\n"
-		"<body>\n"
-		"404 Page Not Found! :'( :'( :'(\n"
-		"</body>\n"
-		"</html>\n";
-	
-	string response_length = std::to_string(response.size());
+HttpResponse respondWithStatus(int status) {
+	return ErrorResponses::respond(status == 408 || status == 431 || status == 503 ? status : 400);
+}
 
-	string header = 
-		"HTTP/1.0 404 NOT FOUND\r\n"
-		"Content-Type: text/html\r\n"
-		"Content-Length: " + response_length + "\r\n"
-		"\r\n";
-	
-	client.sendData(header);
-	client.sendData(response);
+/**
+ * Checks a client against the per address limits, if there are any.
+ *
+ * @param address The client's IPv4 address.
+ * @param slot Set to the client's connection slot if it may go ahead.
+ * @return false if the client should be turned away.
+ */
+static bool admitClient(uint32_t address, RateLimiter::Slot& slot) {
+	return rate_limiter == nullptr || rate_limiter->admit(address, slot);
+}
+
+/**
+ * Checks another request of an already admitted client (such as a further
+ * stream of its HTTP/2 connection) against its request rate, if there is one.
+ *
+ * @param address The client's IPv4 address.
+ * @return false if the request should be answered with a 429.
+ */
+bool admitRequest(uint32_t address) {
+	return rate_limiter == nullptr || rate_limiter->admitRequest(address);
+}
+
+/**
+ * Logs a request to the access log and counts it in the stats, for those of
+ * the two that are on.
+ */
+static void logRequest(uint32_t address, const HttpRequest& request, const HttpResponse& response) {
+	Profiler::countRequest();
+	if (access_log == nullptr && stats == nullptr) {
+		return;
+	}
+
+	int status = response.status();
+
+	long num_bytes = -1;
+	if (!response.stream) {
+		num_bytes = response.bodyData().size();
+		if (response.file_fd != -1) num_bytes += response.file_length;
+	}
+
+	if (access_log != nullptr) {
+		access_log->record(address, request, status, num_bytes);
+	}
+	if (stats != nullptr) {
+		stats->record(status, num_bytes);
+	}
+}
+
+/**
+ * Builds the response for a file straight from its entry in the startup
+ * index: the header is ready-made, and hot files don't even need opening. A
+ * single stat (or fstat) makes sure the file hasn't changed since it was
+ * indexed.
+ *
+ * @param resource The requested resource.
+ * @param response Set to the response if the index could answer.
+ * @return false if the resource isn't indexed or has changed since.
+ */
+static bool respondFromIndex(const string& resource, HttpResponse& response) {
+	const FileIndex::Entry *entry = file_index->find(resource);
+	if (entry == nullptr) {
+		return false;
+	}
+
+	struct stat file_info;
+	if (entry->is_hot) {
+		if (stat(entry->path.c_str(), &file_info) < 0 || !entry->isCurrent(file_info)) {
+			return false;
+		}
+		response.header = entry->header;
+		response.static_body = file_index->contentsOf(*entry);
+		if (file_cache != nullptr) {
+			file_cache->recordAccess(entry->path);
+		}
+		return true;
+	}
+
+	int file_fd = open(entry->path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (file_fd < 0) {
+		return false;
+	}
+	if (fstat(file_fd, &file_info) < 0 || !entry->isCurrent(file_info)) {
+		close(file_fd);
+		return false;
+	}
+
+	response.header = entry->header;
+	setFileBody(response, entry->path, file_fd, file_info);
+	return true;
+}
+
+/**
+ * Answers with the prebuilt 404 NOT FOUND response (see ErrorResponses).
+ *
+ * @return The response to send.
+ */
+HttpResponse respondWith404() {
+	return ErrorResponses::respond(404);
 }
 
 /**
- * Parses the given HTTP request message and returns the resource requested.
+ * Parses the given HTTP request message and returns the resource requested,
+ * split into its path and query string, along with the HTTP version.
  * First, we're we get the end of the first line (the request line) by looking
  * for the first occurrence of "\r\n". This is where the request line ends.
  * 
@@ -200,152 +504,1450 @@ void respondWith404(ClientSocket client) {
  * Third, if the request line matches the regex, we extract the resource path from the match results.
  *
  * For example, calling this function with the request "GET
- * /apple/varieties.html HTTP/1.1" would return /apple/varieties.html.
+ * /apple/varieties.html?color=red HTTP/1.1" would return /apple/varieties.html
+ * as the resource, color=red as the query and 1 as the minor version.
  *
  * @param http_request_message
+ * @return The parsed request; its resource is empty if the request is bad
+ * (and its rejection says how).
  */
-string parseRequest(string http_request_message) {
-	// first, read the first line of the http request
+HttpRequest parseRequest(std::string_view http_request_message) {
+	HttpRequest request;
+
+	// first, read the first line of the http request (a view, not a copy)
 	size_t endOfFirstLine = http_request_message.find("\r\n");
-	string first_line = (endOfFirstLine == string::npos) ? http_request_message : http_request_message.substr(0, endOfFirstLine);
+	std::string_view first_line = http_request_message.substr(0, endOfFirstLine);
 
 	// second, use regex to parse the first line
-	static const std::regex requestLine_regex(R"(GET\s+([^\s]+)\s+HTTP\/\d\.\d)"); 
-	std::smatch results; //STRING MATCHING RESULTS, keeps track of what was matched and allows access to sub-matches when you say results[1], [2], etc
+	static const std::regex requestLine_regex(R"(([A-Z]+)\s+([^\s]+)\s+HTTP\/\d\.(\d))"); 
+	std::cmatch results; //MATCHING RESULTS, keeps track of what was matched and allows access to sub-matches when you say results[1], [2], etc
 	// if the request doesn't match the regex, it's a bad request
-	if(std::regex_match(first_line, results, requestLine_regex) == false) {
-		return ""; // bad request
+	if(std::regex_match(first_line.begin(), first_line.end(), results, requestLine_regex) == false) {
+		return request; // bad request
+	}
+
+	//third, extract the method and resource path from the match results
+	if(results.size() != 4) { // we expect 4 matches: the whole line, the method, the resource path and the minor version
+		return request; // bad request
 	}
+	request.minor_version = results[3].str()[0] - '0';
 
-	//third, extract the resource path from the match results
-	if(results.size() != 2) { // we expect 2 matches: the whole line and the resource path
-		return ""; // bad request
+	if (results[1] != "GET") {
+		request.rejection = 405;
+		return request;
 	}
+	setTarget(request, results[2]);
 
-	return results[1]; // return the resource path
+	return request;
 }
 
 /**
- * Sends an appropriate HTTP response to the specified client based on the
- * requested resource.
+ * Fills in a request's resource and query from the target it asked for
+ * (e.g. "/misc/?sort=name"), unless the path climbs out of WWW with "..",
+ * in which case the request is turned away with a 403.
  *
- * @param client The client to respond to
- * @param resource The resource (e.g. "/index.html") requested by the client.
+ * @param request The request.
+ * @param target The requested target.
  */
-void sendResponse(ClientSocket client, string resource) {
-	string full_file_path = "WWW" + resource;
-	
-	//handle a 400
-	if(resource.empty()){ 
-		respondWith400(client);
+void setTarget(HttpRequest& request, const string& target) {
+	size_t question_mark = target.find('?');
+	string path = target.substr(0, question_mark);
+	if (("/" + path + "/").find("/../") != string::npos) {
+		request.rejection = 403;
 		return;
 	}
 
+	request.resource = std::move(path);
+	if (question_mark != string::npos) {
+		request.query = target.substr(question_mark + 1);
+	}
+}
+
+/**
+ * Builds an appropriate HTTP response based on the requested resource.
+ *
+ * @param request The request (e.g. for "/index.html") made by the client.
+ * @return The response to send.
+ */
+HttpResponse buildResponse(const HttpRequest& request) {
+	//handle a 400 (or a 403 or 405, see parseRequest)
+	if(request.resource.empty()){ 
+		return ErrorResponses::respond(request.rejection);
+	}
+
+	// dynamic endpoints come first; static files are the fallback
+	if (router != nullptr) {
+		RequestView view(request);
+		const Router::Handler *handler = router->find(view);
+		if (handler != nullptr) {
+			return (*handler)(view);
+		}
+	}
+
+#ifdef TORERO_EMBEDDED
+	// files compiled into the binary need neither the disk nor a copy
+	if (const EmbeddedAsset *asset = EmbeddedAssets::find(request.resource)) {
+		HttpResponse response;
+		response.header = asset->header;
+		response.static_body = asset->body;
+		return response;
+	}
+#endif
+
+	string full_file_path = "WWW" + request.resource;
+
+	// files indexed at startup skip the checks below
+	HttpResponse indexed_response;
+	if (file_index != nullptr && respondFromIndex(request.resource, indexed_response)) {
+		return indexed_response;
+	}
+
 	//handle a 404
 	if(fs::exists(full_file_path) == false){
-		respondWith404(client);
-		return;
+		return respondWith404();
 	}
 
 	//handle a 200
-	respondWith200(client, resource, full_file_path);
+	return respondWith200(request, full_file_path);
 }
 
 /**
- * Sends the file at the given path to the client, sending at most 4096 bytes
- * at a time.
- *
- * @param client The client to send the data to.
- * @param file_path Path to the file (including the file name)
+ * @return Whether a dynamic endpoint (rather than a file) answers the
+ * given resource.
  */
-void sendFile(ClientSocket client, string file_path) {
-	// open the file in binary mode (works for both text and binary files)
-	std::ifstream file(file_path, std::ios::binary);
+bool hasRoute(const string& resource) {
+	return router != nullptr && router->matches(resource);
+}
 
-	// create C++-style array of characters (to store file data)
-	array<char, 4096> file_data;
+/**
+ * @return Whether the given resource is compiled into the binary (which
+ * buildResponse serves instead of anything on disk).
+ */
+bool hasEmbeddedAsset([[maybe_unused]] const string& resource) {
+#ifdef TORERO_EMBEDDED
+	return EmbeddedAssets::find(resource) != nullptr;
+#else
+	return false;
+#endif
+}
 
-	// keep reading while we haven't reached the end of the file (EOF)
-	while (!file.eof()) {
-		file.read(file_data.data(), file_data.size()); // read up to 4096 bytes into file_data
-		int bytes_read = file.gcount(); // find out how many bytes we actually read
+/**
+ * Builds a 200 OK response with a JSON body.
+ *
+ * @param json The body.
+ * @return The response to send.
+ */
+static HttpResponse respondWithJson(string json) {
+	HttpResponse response;
+	response.header = buildOKHeader("application/json", json.size());
+	response.body = std::make_shared<string>(std::move(json));
+	return response;
+}
 
-		// send the up to 4096 byte chunk of data we have read  
-		if(bytes_read > 0) {
-			cout << "Read " << bytes_read << " bytes from file: " << file_path << "\n";
-			client.sendData(span(file_data.begin(), bytes_read));
+/**
+ * @return The given text as a JSON string literal.
+ */
+static string jsonString(std::string_view text) {
+	string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\') {
+			quoted += '\\';
+			quoted += c;
+		}
+		else if (static_cast<unsigned char>(c) < 0x20) {
+			char escaped[8];
+			snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+			quoted += escaped;
+		}
+		else {
+			quoted += c;
 		}
 	}
-	file.close();
+	return quoted + "\"";
+}
+
+/**
+ * @return The given request counters as a JSON object.
+ */
+static string statsJson(const ServerStats::Totals& totals) {
+	string json = "{\"requests\": " + std::to_string(totals.requests)
+		+ ", \"body_bytes\": " + std::to_string(totals.bytes) + ", \"status\": {";
+	for (int c = 1; c <= 5; c++) {
+		json += "\"" + std::to_string(c) + "xx\": " + std::to_string(totals.by_class[c])
+			+ (c < 5 ? ", " : "}");
+	}
+	return json + ", \"restarts\": " + std::to_string(totals.restarts) + "}";
+}
+
+/**
+ * Sets up the server's own endpoints under the given path:
+ *   PATH/health            "ok", for load balancers and the like
+ *   PATH/stats             request counters (and file cache and proxy
+ *                          backend ones) as JSON
+ *   PATH/stats/worker/:n   request counters of one worker process
+ *   PATH/index/RESOURCE    what the startup index knows about a resource
+ *
+ * @param router The router to add them to.
+ * @param admin_path Where to put them (e.g. "/_torero").
+ */
+static void addAdminRoutes(Router& router, const string& admin_path) {
+	router.add(admin_path + "/health", [](const RequestView&) {
+		HttpResponse response;
+		response.header = buildOKHeader("text/plain", 3);
+		response.static_body = "ok\n";
+		return response;
+	});
+
+	router.add(admin_path + "/stats", [](const RequestView&) {
+		string json = "{\"workers\": " + std::to_string(stats->numWorkers())
+			+ ", \"total\": " + statsJson(stats->totals(-1));
+		if (file_cache != nullptr) {
+			FileCache::Statistics cache = file_cache->statistics();
+			json += ", \"file_cache\": {\"files\": " + std::to_string(cache.num_files)
+				+ ", \"bytes\": " + std::to_string(cache.used)
+				+ ", \"capacity\": " + std::to_string(cache.capacity)
+				+ ", \"hits\": " + std::to_string(cache.num_hits)
+				+ ", \"misses\": " + std::to_string(cache.num_misses)
+				+ ", \"not_admitted\": " + std::to_string(cache.num_rejected)
+				+ ", \"evicted\": " + std::to_string(cache.num_evicted)
+				+ ", \"shards\": " + std::to_string(cache.num_shards)
+				+ ", \"numa_replicas\": " + std::to_string(cache.num_replicas) + "}";
+		}
+		if (!proxies.empty()) {
+			json += ", \"proxy\": {";
+			for (size_t i = 0; i < proxies.size(); i++) {
+				json += (i > 0 ? ", " : "") + jsonString(proxies[i].first) + ": "
+					+ proxies[i].second->statisticsJson();
+			}
+			json += "}";
+		}
+		return respondWithJson(json + "}\n");
+	});
+
+	router.add(admin_path + "/stats/worker/:n", [](const RequestView& view) {
+		string n(view.parameter(0));
+		if (n.empty() || n.find_first_not_of("0123456789") != string::npos
+				|| n.size() > 3 || std::stoi(n) >= stats->numWorkers()) {
+			return respondWith404();
+		}
+		return respondWithJson(statsJson(stats->totals(std::stoi(n))) + "\n");
+	});
+
+	router.add(admin_path + "/index/*", [](const RequestView& view) {
+		string resource = "/" + string(view.rest());
+		const FileIndex::Entry *entry = file_index ? file_index->find(resource) : nullptr;
+		if (entry == nullptr) {
+			return respondWith404();
+		}
+		return respondWithJson("{\"resource\": " + jsonString(resource)
+			+ ", \"path\": " + jsonString(entry->path)
+			+ ", \"size\": " + std::to_string(entry->size)
+			+ ", \"modified\": " + std::to_string(entry->modified.tv_sec)
+			+ ", \"hot\": " + (entry->is_hot ? "true" : "false") + "}\n");
+	});
 }
 
 /**
- * Receives a request from a connected HTTP client and sends back the
- * appropriate response.
+ * Sets up a reverse proxy for each of the configured path prefixes, with a
+ * prefix route that forwards whatever is under it.
  *
- * @note After this function returns, client will have been closed (i.e.  may
- * not be used again).
+ * @param router The router to add the routes to.
+ * @param config The settings, with the prefixes and their backends.
+ */
+static void addProxyRoutes(Router& router, const ServerConfig& config) {
+	for (const ServerConfig::ProxyRoute& route : config.proxy_routes) {
+		ReverseProxy::Settings settings;
+		settings.backends = route.backends;
+		settings.health_path = config.proxy_health_path;
+		settings.max_idle = config.proxy_pool;
+		proxies.push_back({route.prefix.empty() ? "/" : route.prefix,
+				std::make_unique<ReverseProxy>(settings)});
+
+		ReverseProxy *proxy = proxies.back().second.get();
+		router.add(route.prefix + "/*", [proxy](const RequestView& view) {
+			return proxy->forward(view.request);
+		});
+	}
+}
+
+/**
+ * Runs an HTTP/2 connection on the calling thread until the client closes
+ * it, goes idle or breaks the protocol. Between batches of frames it checks
+ * (without waiting) for new requests, so that they join the rotation while
+ * earlier responses are still going out.
  *
- * @param client The client with whom to communicate.
+ * @param client The client, which is closed at the end.
+ * @param tls The TLS connection of the client, or nullptr for h2c.
+ * @param received What has been received from the client so far.
+ * @param slot The client's connection slot, held until the end.
  */
-void handleClient(ClientSocket client) {
+void serveHttp2(ClientSocket client, std::unique_ptr<TlsConnection> tls, string received,
+		[[maybe_unused]] RateLimiter::Slot slot) {
+	Http2Connection connection(client.getPeerAddress());
+	connection.receive(received);
 
-	// Step 1: Receive the request message from the client
-	vector<char> request = client.receiveData(2048);
+	// frames are already batched, so don't let Nagle hold back the tail of a
+	// batch (which, with delayed ACKs, stalls every flow control round trip),
+	// nor a cork from the socket profile, which only comes off at close
+	int enable = 1, disable = 0;
+	setsockopt(client.getFd(), IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	setsockopt(client.getFd(), IPPROTO_TCP, TCP_CORK, &disable, sizeof(disable));
 
-	// Create a string out of the received data
-	string request_string(request.begin(), request.end());
-	
-	// Step 2: Parse the request string to determine what response to generate.
-	string resource = parseRequest(request_string);
-	
-	// Step 3: Genereate and send an appropriate response to the client
-	sendResponse(client, resource);
-	
-	// Step 4: Close connection with client.
+	string out;
+	char buffer[16384];
+
+	try {
+		while (!connection.finished()) {
+			if (connection.wantsWrite()) {
+				out.clear();
+				connection.produce(out, HTTP2_WRITE_BATCH);
+				if (tls) tls->send(out);
+				else client.sendData(out);
+
+				if (connection.finished()) break;
+			}
+
+			struct pollfd client_poll = {client.getFd(), POLLIN, 0};
+			int timeout = connection.wantsWrite() ? 0 : HTTP2_IDLE_TIMEOUT_MS;
+			bool readable = (tls && tls->hasPending()) || poll(&client_poll, 1, timeout) > 0;
+			if (!readable) {
+				if (!connection.wantsWrite()) connection.goAway(); // idle
+				continue;
+			}
+
+			size_t num_bytes;
+			if (tls) {
+				num_bytes = tls->receive(buffer);
+			}
+			else {
+				num_bytes = client.receiveData(span<char>(buffer));
+			}
+			if (num_bytes == 0) break; // the client closed the connection
+
+			connection.receive(span<const char>(buffer, num_bytes));
+		}
+
+		if (tls) tls->shutdown();
+	}
+	catch (const std::system_error&) {
+		// the client went away; nothing to do but clean up
+	}
+
+	tls.reset();
 	client.close();
+	num_http2_connections--;
 }
 
+/**
+ * Hands an HTTP/2 connection over to a thread of its own, since it lives for
+ * as long as the client keeps it open. Beyond MAX_HTTP2_CONNECTIONS the
+ * client is just disconnected.
+ *
+ * @param client The client.
+ * @param tls The TLS connection of the client, or nullptr for h2c.
+ * @param received What has been received from the client so far.
+ * @param slot The client's connection slot with the rate limiter.
+ */
+void startHttp2(ClientSocket client, std::unique_ptr<TlsConnection> tls, string received,
+		RateLimiter::Slot slot) {
+	if (num_http2_connections.fetch_add(1) >= MAX_HTTP2_CONNECTIONS) {
+		num_http2_connections--;
+		tls.reset();
+		client.close();
+		return;
+	}
 
-/** 
- * Function that continuously consumes clients from the bounded buffer and handles them.
- * Gets an item from a shared bounded buffer that contains clientsockets and then calls handleClient
- * 
- * @param buffer The bounded buffer from which to consume clients.
+	thread(serveHttp2, client, std::move(tls), std::move(received), std::move(slot)).detach();
+}
+
+/**
+ * Sends a response over a TLS connection whose records are encrypted in user
+ * space, i.e. without the help of the writer.
+ *
+ * @param tls The connection to send on.
+ * @param response The response to send.
  */
-void consumeClients(BoundedBuffer& buffer) {
-	while(true) {
-		ClientSocket client = buffer.getItem(); // get a client from the buffer
-		handleClient(client); // handle the client
+void sendTlsResponse(TlsConnection& tls, HttpResponse& response) {
+	tls.send(response.headerData());
+	if (!response.bodyData().empty()) {
+		tls.send(response.bodyData());
+	}
+	if (response.stream) {
+		string piece;
+		while (response.stream->next(piece)) {
+			tls.send(piece);
+			piece.clear();
+		}
+	}
+	if (response.file_fd != -1) {
+		tls.sendFile(response.file_fd, response.file_offset, response.file_length,
+				response.drop_behind);
 	}
+	tls.shutdown();
 }
 
 /**
- * Runs the webserver on the given port, serving the files in the given
- * directory.
+ * Receives a request over TLS, a record at a time until its header is in,
+ * within the header budget. OpenSSL's reads block the worker, so here it's
+ * the time limit (applied through SO_RCVTIMEO) that keeps a slow client from
+ * holding on to the worker for long: a client that runs out of time fails
+ * like one that went away.
  *
- * @param port The port on which to listen for connections.
- * @param root_dir The directory where the files to serve are located.
+ * @param tls The connection to receive on.
+ * @param socket_fd Its socket.
+ * @param request Set to the request.
+ * @param reserved The memory taken for the request.
+ * @return 0 once the request is in, or the status to turn the client away
+ * with (431 or 503).
  */
-void runServer(unsigned short port, string root_dir) {
-	cout << "Serving " << root_dir << " on port " << port << std::endl;
+static int receiveTlsRequest(TlsConnection& tls, int socket_fd, string& request,
+		HeaderBudget::Reservation& reserved) {
+	const HeaderBudget::Limits& limits = HeaderBudget::limits();
+	auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::duration<double>(limits.timeout_seconds));
 
-	BoundedBuffer clientsBuffer(5); //9, create a bounded buffer i think dr. sat always uses 5 for the buffer size
+	char chunk[2048];
+	size_t checked = 0;
+	while (!HeaderBudget::isComplete(request, checked)) {
+		if (request.size() > limits.max_bytes) return 431;
 
-	//create 4 workers, each running the consumeClients function
-	thread t1(consumeClients, std::ref(clientsBuffer));
-	thread t2(consumeClients, std::ref(clientsBuffer));
-	thread t3(consumeClients, std::ref(clientsBuffer));
-	thread t4(consumeClients, std::ref(clientsBuffer));
+		auto left = std::chrono::duration_cast<std::chrono::microseconds>(
+				deadline - std::chrono::steady_clock::now()).count();
+		struct timeval timeout = {std::max(left, 1L) / 1000000, std::max(left, 1L) % 1000000};
+		setsockopt(socket_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
 
-	/* Create a socket and start listening for new connections on the
-	 * specified port. */
-	ServerSocket server(port);
-	server.startListening();
+		// never more than it takes to go over the limit
+		size_t num_received = tls.receive(span<char>(chunk).first(
+					std::min(sizeof(chunk), limits.max_bytes + 1 - request.size())));
+		if (num_received == 0) {
+			throw std::system_error(ECONNRESET, std::generic_category(), "Client closed");
+		}
+		if (!reserved.grow(num_received)) return 503;
+
+		checked = request.size();
+		request.append(chunk, num_received);
+	}
+	return 0;
+}
+
+/**
+ * HTTPS version of handleClient. The handshake and the request are handled
+ * by OpenSSL; if the connection then got kernel TLS, the response goes
+ * through the writer like any other (sendfile included), since the kernel
+ * encrypts whatever is written to the socket. Otherwise it is encrypted and
+ * sent right here. Clients that pick HTTP/2 through ALPN are handed over to
+ * serveHttp2.
+ *
+ * Clients over their limits are disconnected before the handshake, which is
+ * the expensive part (and without which they couldn't read a 429 anyway).
+ *
+ * @param client The client with whom to communicate.
+ * @param writer The writer that sends kTLS responses and closes the client.
+ * @param context The server's TLS settings.
+ */
+void handleTlsClient(ClientSocket client, ResponseWriter& writer, TlsContext& context) {
+	HttpResponse response;
+
+	if (!admitClient(client.getPeerAddress(), response.client_slot)) {
+		client.close();
+		return;
+	}
+
+	try {
+		auto tls = std::make_unique<TlsConnection>(context, client.getFd());
+		tls->handshake();
+
+		if (tls->negotiatedHttp2()) {
+			startHttp2(client, std::move(tls), "", std::move(response.client_slot));
+			return;
+		}
+
+		string request;
+		HeaderBudget::Reservation reserved;
+		HttpRequest parsed_request;
+		RateLimiter::Slot slot = std::move(response.client_slot);
+		if (int status = receiveTlsRequest(*tls, client.getFd(), request, reserved)) {
+			response = respondWithStatus(status);
+		}
+		else {
+			parsed_request = parseRequest(request);
+			response = buildResponse(parsed_request);
+		}
+		response.client_slot = std::move(slot);
+		logRequest(client.getPeerAddress(), parsed_request, response);
+
+		if (tls->kernelSends()) {
+			tls->detach();
+			writer.submit(client, std::move(response));
+			return;
+		}
+		sendTlsResponse(*tls, response);
+	}
+	catch (const std::system_error&) {
+		// failed handshake or the client went away; just clean up
+	}
+
+	if (response.file_fd != -1) {
+		close(response.file_fd);
+	}
+	client.close();
+}
+
+// how far a worker got in receiving a request
+enum class Received { Complete, Partial, TooBig, Gone };
+
+/**
+ * Receives whatever a client has sent of its request into the calling
+ * thread's read buffer, waiting only briefly (FIRST_READ_WAIT_MS) for it to
+ * show up. The buffer is kept from one request to the next and only ever
+ * grows (when a request's headers don't fit), so receiving normally
+ * allocates nothing.
+ *
+ * @param client The client.
+ * @param request Set to what was received, valid until the thread's next
+ * call.
+ * @return Complete if the header is all there, Partial if the client has to
+ * be waited on (see RequestReader), TooBig if the header went over the size
+ * limit, Gone if the client closed the connection or failed.
+ */
+static Received receiveRequest(ClientSocket& client, span<const char>& request) {
+	static thread_local vector<char> buffer(INITIAL_READ_BUFFER_SIZE);
+	size_t max_bytes = HeaderBudget::limits().max_bytes;
+	size_t num_received = 0;
+	bool waited = false;
 
-	/* Now let's start accepting connections. */
 	while (true) {
-		ClientSocket client = server.acceptConnection();
-		clientsBuffer.putItem(client);
+		// a full buffer without the end of the headers means there is more to come
+		if (num_received == buffer.size()) {
+			buffer.resize(std::min(buffer.size() * 2, max_bytes + 1));
+		}
+
+		// never more than it takes to go over the limit
+		ssize_t num_more = recv(client.getFd(), buffer.data() + num_received,
+				std::min(buffer.size(), max_bytes + 1) - num_received, MSG_DONTWAIT);
+		if (num_more < 0) {
+			if (errno == EINTR) continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK) return Received::Gone;
+			if (waited) return Received::Partial;
+
+			struct pollfd client_poll = {client.getFd(), POLLIN, 0};
+			poll(&client_poll, 1, FIRST_READ_WAIT_MS);
+			waited = true;
+			continue;
+		}
+		if (num_more == 0) return Received::Gone;
+
+		size_t checked = num_received;
+		num_received += num_more;
+		request = span<const char>(buffer.data(), num_received);
+
+		if (HeaderBudget::isComplete(std::string_view(request.data(), num_received), checked)) {
+			return Received::Complete;
+		}
+		if (num_received > max_bytes) return Received::TooBig;
 	}
 }
+
+/**
+ * Turns away a client before its request is in.
+ *
+ * @param client The client.
+ * @param status The status to give it (see respondWithStatus).
+ * @param writer The writer that will send the response and close the client.
+ */
+static void rejectClient(ClientSocket client, int status, ResponseWriter& writer) {
+	HttpResponse response = respondWithStatus(status);
+	logRequest(client.getPeerAddress(), HttpRequest(), response);
+	writer.submit(client, std::move(response));
+}
+
+/**
+ * Hands the appropriate response to a request that is all in off to the
+ * writer. Runs on a worker, or on one of the reader's for requests that came
+ * in slowly.
+ *
+ * @param client The client with whom to communicate.
+ * @param request The request, header complete.
+ * @param writer The writer that will send the response and close the client.
+ */
+static void handleRequest(ClientSocket client, std::string_view request, ResponseWriter& writer) {
+	// Turn away clients over their limits before doing any work for them
+	RateLimiter::Slot slot;
+	if (!admitClient(client.getPeerAddress(), slot)) {
+		HttpResponse response = respondWith429();
+		logRequest(client.getPeerAddress(), HttpRequest(), response);
+		writer.submit(client, std::move(response));
+		return;
+	}
+
+	// HTTP/2 with prior knowledge (h2c) starts with the connection preface
+	if (Http2Connection::looksLikePreface(span<const char>(request.data(), request.size()))) {
+		startHttp2(client, nullptr, string(request), std::move(slot));
+		return;
+	}
+	
+	// Step 2: Parse the request to determine what response to generate.
+	HttpRequest parsed_request = parseRequest(request);
+	
+	// Step 3: Genereate an appropriate response for the client
+	HttpResponse response = buildResponse(parsed_request);
+	response.client_slot = std::move(slot);
+	logRequest(client.getPeerAddress(), parsed_request, response);
+	
+	// Step 4: Let the writer send it and close the connection, so that a slow
+	// client never holds on to this worker.
+	writer.submit(client, std::move(response));
+}
+
+/**
+ * Receives a request from a connected HTTP client and hands the appropriate
+ * response off to the writer. If the request doesn't come in right away (or
+ * not all at once), the client is handed to the reader instead, which sees
+ * it through once the rest is in.
+ *
+ * @note After this function returns, client belongs to the writer or the
+ * reader (i.e. may not be used again).
+ *
+ * @param client The client with whom to communicate.
+ * @param writer The writer that will send the response and close the client.
+ * @param tls The server's TLS settings, or nullptr when serving plain HTTP.
+ */
+void handleClient(ClientSocket client, ResponseWriter& writer, TlsContext* tls) {
+	if (tls != nullptr) {
+		handleTlsClient(client, writer, *tls);
+		return;
+	}
+
+
+	// Step 1: Receive the request message from the client (into this
+	// thread's read buffer, so no allocating or copying)
+	auto started = RequestReader::Clock::now();
+	span<const char> request;
+	switch (receiveRequest(client, request)) {
+		case Received::Complete:
+			break;
+		case Received::Partial:
+			request_reader->submit(client, std::string_view(request.data(), request.size()), started);
+			return;
+		case Received::TooBig:
+			rejectClient(client, 431, writer);
+			return;
+		case Received::Gone:
+			client.close();
+			return;
+	}
+
+	handleRequest(client, std::string_view(request.data(), request.size()), writer);
+}
+
+
+/** 
+ * Function that continuously consumes clients from the bounded buffer and handles them.
+ * Gets an item from a shared bounded buffer that contains clientsockets and then calls handleClient
+ * 
+ * @param buffer The bounded buffer from which to consume clients.
+ * @param writer The writer that responses are handed off to.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void consumeClients(BoundedBuffer& buffer, ResponseWriter& writer, TlsContext* tls) {
+	Profiler::nameThread("worker");
+	CpuAffinity::pinWorker();
+	while(true) {
+		// get a few clients from the buffer at once so that a connection storm
+		// costs one lock acquisition per batch instead of one per client
+		vector<ClientSocket> clients = buffer.getItems(MAX_CLIENTS_PER_WORKER);
+		for (ClientSocket client : clients) {
+			handleClient(client, writer, tls); // handle the client
+		}
+	}
+}
+
+/**
+ * Function that continuously takes turns leading: while it is the leader it
+ * waits for a connection, then promotes a follower and handles the
+ * connection itself. There is no buffer (and no hand-off to another thread)
+ * between accepting a connection and handling it.
+ *
+ * @param server The listening socket shared by all workers.
+ * @param leadership Decides which worker gets to accept next.
+ * @param writer The writer that responses are handed off to.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void leadAndFollow(ServerSocket& server, Leadership& leadership, ResponseWriter& writer,
+		TlsContext* tls) {
+	Profiler::nameThread("worker");
+	CpuAffinity::pinWorker();
+	while(true) {
+		leadership.becomeLeader();
+		ClientSocket client = server.acceptConnection();
+		leadership.promoteFollower();
+
+		handleClient(client, writer, tls);
+	}
+}
+
+/**
+ * Runs the producer/consumer model: this thread accepts connections and
+ * hands them to the workers through a bounded buffer.
+ *
+ * @param server The listening socket.
+ * @param writer The writer that responses are handed off to.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void runQueueModel(ServerSocket& server, ResponseWriter& writer, TlsContext* tls) {
+	// room for two whole accept batches, so that a batch normally goes in
+	// with a single lock acquisition even while the workers are busy
+	BoundedBuffer clientsBuffer(2 * MAX_ACCEPT_BATCH, MAX_CLIENTS_PER_WORKER);
+
+	//create 4 workers, each running the consumeClients function
+	thread t1(consumeClients, std::ref(clientsBuffer), std::ref(writer), tls);
+	thread t2(consumeClients, std::ref(clientsBuffer), std::ref(writer), tls);
+	thread t3(consumeClients, std::ref(clientsBuffer), std::ref(writer), tls);
+	thread t4(consumeClients, std::ref(clientsBuffer), std::ref(writer), tls);
+
+	/* Now let's start accepting connections, taking everyone who is waiting
+	 * each time we wake up and handing them over as a single batch. */
+	Profiler::nameThread("acceptor");
+	CpuAffinity::pinAcceptor();
+	vector<ClientSocket> clients;
+	while (true) {
+		server.acceptConnections(clients, MAX_ACCEPT_BATCH);
+		clientsBuffer.putItems(clients);
+		clients.clear();
+	}
+}
+
+/**
+ * Runs the leader/follower model: the workers accept connections themselves,
+ * one at a time.
+ *
+ * @param server The listening socket.
+ * @param writer The writer that responses are handed off to.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void runLeaderFollowerModel(ServerSocket& server, ResponseWriter& writer, TlsContext* tls) {
+	Leadership leadership;
+
+	//create 4 workers, each running the leadAndFollow function
+	thread t1(leadAndFollow, std::ref(server), std::ref(leadership), std::ref(writer), tls);
+	thread t2(leadAndFollow, std::ref(server), std::ref(leadership), std::ref(writer), tls);
+	thread t3(leadAndFollow, std::ref(server), std::ref(leadership), std::ref(writer), tls);
+	thread t4(leadAndFollow, std::ref(server), std::ref(leadership), std::ref(writer), tls);
+
+	// the workers never return, so this just keeps the shared state alive
+	t1.join();
+}
+
+/**
+ * Coroutine version of serveHttp2.
+ *
+ * @param client The client.
+ * @param address The client's IPv4 address.
+ * @param received What has been received from the client so far.
+ * @return Whether the connection ended with a GOAWAY (rather than the client
+ * just closing it).
+ */
+Task<bool> serveHttp2Async(AsyncSocket& client, uint32_t address, string received) {
+	Http2Connection connection(address);
+	connection.receive(received);
+
+	int enable = 1, disable = 0;
+	setsockopt(client.getFd(), IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+	setsockopt(client.getFd(), IPPROTO_TCP, TCP_CORK, &disable, sizeof(disable));
+
+	string out;
+	char buffer[8192];
+
+	while (!connection.finished()) {
+		if (connection.wantsWrite()) {
+			out.clear();
+			connection.produce(out, HTTP2_WRITE_BATCH);
+			co_await client.send(out);
+
+			// pick up any new requests without waiting for them
+			ssize_t num_bytes = recv(client.getFd(), buffer, sizeof(buffer), MSG_DONTWAIT);
+			if (num_bytes > 0) {
+				connection.receive(span<const char>(buffer, num_bytes));
+			}
+			else if (num_bytes == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+				co_return false;
+			}
+			continue;
+		}
+
+		client.setDeadline(Scheduler::Clock::now() + std::chrono::milliseconds(HTTP2_IDLE_TIMEOUT_MS));
+		size_t num_bytes = 0;
+		bool idle = false;
+		try {
+			num_bytes = co_await client.receive(buffer);
+		}
+		catch (const std::system_error& e) {
+			if (e.code() != std::errc::timed_out) throw;
+			idle = true;
+		}
+		client.clearDeadline();
+
+		if (idle) {
+			connection.goAway();
+			continue;
+		}
+		if (num_bytes == 0) {
+			co_return false;
+		}
+		connection.receive(span<const char>(buffer, num_bytes));
+	}
+	co_return true;
+}
+
+/**
+ * Coroutine version of handleClient: receives a request from a connected HTTP
+ * client and sends back the appropriate response, without blocking the
+ * thread while waiting on the client.
+ *
+ * A request that doesn't arrive in one piece is put together within the
+ * header budget's limits, like with the other engines: a client that hasn't
+ * sent its whole header in time is turned away with a 408.
+ *
+ * @note After this coroutine finishes, client will have been closed.
+ *
+ * @param socket The client with whom to communicate.
+ * @param scheduler The scheduler of the current thread.
+ */
+DetachedTask serveClient(ClientSocket socket, Scheduler& scheduler) {
+	AsyncSocket client(socket.getFd(), scheduler);
+	HttpResponse response;
+	HeaderBudget::Reservation reserved;
+
+	try {
+		// Step 1: Receive the request message from the client, usually in
+		// one go, otherwise a piece at a time (put together in partial)
+		char request_data[2048];
+		size_t request_size = 0;
+		std::string_view request;
+		string partial;
+		size_t checked = 0;
+		int status = 0;
+
+		client.setDeadline(Scheduler::Clock::now()
+				+ std::chrono::duration_cast<Scheduler::Clock::duration>(
+					std::chrono::duration<double>(HeaderBudget::limits().timeout_seconds)));
+		try {
+			request_size = co_await client.receive(span<char>(request_data).first(
+						std::min(sizeof(request_data), HeaderBudget::limits().max_bytes + 1)));
+			request = std::string_view(request_data, request_size);
+
+			while (request_size > 0 && !HeaderBudget::isComplete(request, checked)) {
+				if (request.size() > HeaderBudget::limits().max_bytes) {
+					status = 431;
+					break;
+				}
+				if (partial.empty()) {
+					if (!reserved.grow(request.size())) {
+						status = 503;
+						break;
+					}
+					partial.assign(request);
+				}
+
+				checked = partial.size();
+				request_size = co_await client.receive(span<char>(request_data).first(
+							std::min(sizeof(request_data), HeaderBudget::limits().max_bytes + 1 - checked)));
+				if (!reserved.grow(request_size)) {
+					status = 503;
+					break;
+				}
+				partial.append(request_data, request_size);
+				request = partial;
+			}
+		}
+		catch (const std::system_error& e) {
+			if (e.code() != std::errc::timed_out) throw;
+			status = 408;
+		}
+		client.clearDeadline();
+
+		if (request_size == 0 && status == 0) {
+			client.close(); // gone before its request was in
+			co_return;
+		}
+		if (status != 0) {
+			response = respondWithStatus(status);
+			logRequest(socket.getPeerAddress(), HttpRequest(), response);
+			co_await client.send(response.headerData(), response.bodyData());
+			client.close();
+			co_return;
+		}
+
+		// turn away clients over their limits before doing any work for them
+		if (!admitClient(socket.getPeerAddress(), response.client_slot)) {
+			response = respondWith429();
+			logRequest(socket.getPeerAddress(), HttpRequest(), response);
+			co_await client.send(response.headerData(), response.bodyData());
+			client.close();
+			co_return;
+		}
+
+		// HTTP/2 with prior knowledge (h2c) starts with the connection preface
+		if (Http2Connection::looksLikePreface(span<const char>(request.data(), request.size()))) {
+			co_await serveHttp2Async(client, socket.getPeerAddress(), string(request));
+			client.close();
+			co_return;
+		}
+
+		// Step 2: Parse the request string to determine what response to generate.
+		HttpRequest parsed_request = parseRequest(request);
+		reserved.clear();
+
+		// Step 3: Genereate and send an appropriate response to the client
+		RateLimiter::Slot slot = std::move(response.client_slot);
+		response = buildResponse(parsed_request);
+		response.client_slot = std::move(slot);
+		logRequest(socket.getPeerAddress(), parsed_request, response);
+
+		co_await client.send(response.headerData(), response.bodyData());
+		if (response.stream) {
+			string piece;
+			while (response.stream->next(piece)) {
+				co_await client.send(piece);
+				piece.clear();
+			}
+		}
+		if (response.file_fd != -1) {
+			co_await client.sendFile(response.file_fd, response.file_offset, response.file_length,
+					response.drop_behind);
+		}
+	}
+	catch (const std::system_error&) {
+		// the client went away; nothing to do but clean up
+	}
+
+	// Step 4: Close connection with client.
+	if (response.file_fd != -1) {
+		close(response.file_fd);
+	}
+	client.close();
+}
+
+/**
+ * Coroutine that accepts clients on this thread's scheduler for as long as
+ * the server runs, starting a serveClient coroutine for each one.
+ *
+ * @param server The listening socket shared by all event loop threads.
+ * @param scheduler The scheduler of the current thread.
+ */
+DetachedTask acceptClients(ServerSocket& server, Scheduler& scheduler) {
+	// every thread watches the listener; EPOLLEXCLUSIVE wakes just one of them
+	AsyncSocket listener(server.getFd(), scheduler, EPOLLIN | EPOLLET | EPOLLEXCLUSIVE);
+
+	vector<ClientSocket> clients;
+	while (true) {
+		size_t num_accepted = server.acceptPending(clients, MAX_ACCEPT_BATCH);
+		for (ClientSocket client : clients) {
+			serveClient(client, scheduler);
+		}
+		clients.clear();
+
+		// only wait once the backlog has been drained (edge-triggered)
+		if (num_accepted < MAX_ACCEPT_BATCH) {
+			co_await listener.readable();
+		}
+	}
+}
+
+/**
+ * Function that each thread of the coroutine engine runs: an event loop
+ * that both accepts and serves clients.
+ *
+ * @param server The listening socket.
+ */
+void runEventLoop(ServerSocket& server) {
+	Profiler::nameThread("event loop");
+	CpuAffinity::pinWorker();
+	Scheduler scheduler;
+	acceptClients(server, scheduler);
+	scheduler.run();
+}
+
+/**
+ * Runs the coroutine engine: one event loop per thread, each accepting its
+ * own share of the connections.
+ *
+ * @param server The listening socket.
+ */
+void runCoroutineEngine(ServerSocket& server) {
+	vector<thread> loops;
+	for (int i = 0; i < NUM_WORKERS; i++) {
+		loops.push_back(thread(runEventLoop, std::ref(server)));
+	}
+
+	// the event loops never return, so this just keeps the server alive
+	loops[0].join();
+}
+
+/**
+ * Function that each thread of the io_uring engine runs.
+ *
+ * @param server The listening socket.
+ */
+void runUringLoop(ServerSocket& server) {
+	Profiler::nameThread("ring");
+	CpuAffinity::pinWorker();
+	UringEngine engine(server, rate_limiter.get(), access_log.get(), stats.get());
+	engine.run();
+}
+
+/**
+ * Runs the io_uring engine: one ring per thread, each with its own multishot
+ * accept on the shared listening socket.
+ *
+ * @param server The listening socket.
+ */
+void runUringEngine(ServerSocket& server) {
+	vector<thread> loops;
+	for (int i = 0; i < NUM_WORKERS; i++) {
+		loops.push_back(thread(runUringLoop, std::ref(server)));
+	}
+
+	// the rings never return, so this just keeps the server alive
+	loops[0].join();
+}
+
+/**
+ * Creates the listening socket the config asks for, tuned with its socket
+ * profile (without starting to listen yet).
+ *
+ * @param config The settings.
+ * @return The socket.
+ */
+ServerSocket createListener(const ServerConfig& config) {
+	ServerSocket server = config.unix_socket.empty()
+		? ServerSocket(config.port) : ServerSocket(config.unix_socket);
+	if (config.unix_peer_uid >= 0) {
+		server.requirePeerUid(config.unix_peer_uid);
+	}
+	SocketOptions::forProfile(config.socket_profile).applyTo(server, config.unix_socket.empty());
+	return server;
+}
+
+/**
+ * Starts a thread that prints the file cache report whenever the process
+ * gets SIGUSR1. Must run before any other thread is started, so that they
+ * all inherit the blocked signal and leave it to this one.
+ */
+static void startCacheReporter() {
+	sigset_t report_signal;
+	sigemptyset(&report_signal);
+	sigaddset(&report_signal, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &report_signal, nullptr);
+
+	thread([report_signal]() {
+		int signal_number;
+		while (sigwait(&report_signal, &signal_number) == 0) {
+			file_cache->printReport(cout);
+		}
+	}).detach();
+}
+
+/**
+ * Runs the engine the config asks for on the given listener, forever.
+ *
+ * @param config The settings.
+ * @param server The listening socket.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void runEngine(const ServerConfig& config, ServerSocket& server, TlsContext* tls) {
+	// the signal handling threads have to come before any other thread (see
+	// startReporter)
+	Profiler::startReporter();
+	if (file_cache != nullptr) {
+		startCacheReporter();
+	}
+	if (config.engine == Engine::Threads && config.processes == 1) {
+		Upgrade::startHandler(server, file_index.get(), config.drain_timeout);
+	}
+	for (auto& [prefix, proxy] : proxies) {
+		proxy->startHealthChecks();
+	}
+
+	if (config.engine == Engine::Coroutines) {
+		runCoroutineEngine(server);
+		return;
+	}
+	if (config.engine == Engine::IoUring) {
+		runUringEngine(server);
+		return;
+	}
+
+	// I/O threads that drain responses to slow clients so workers don't have
+	// to, and ones that wait for slow clients' requests
+	ResponseWriter writer(NUM_WRITER_THREADS);
+	request_reader = std::make_unique<RequestReader>(NUM_READER_THREADS, NUM_READER_WORKERS,
+			[&writer](ClientSocket client, std::string_view request) {
+				handleRequest(client, request, writer);
+			},
+			[&writer](ClientSocket client, int status) {
+				rejectClient(client, status, writer);
+			});
+
+	// if we replace another process, it can stop accepting now: connections
+	// only wait in the accept queue until the threads below get to them
+	Upgrade::ready();
+
+	if (config.model == WorkerModel::LeaderFollower) {
+		runLeaderFollowerModel(server, writer, tls);
+	}
+	else {
+		runQueueModel(server, writer, tls);
+	}
+}
+
+/**
+ * Runs the prefork mode: the calling (master) process forks the given number
+ * of worker processes, each running the configured engine, and then just
+ * looks after them. Everything set up before this (the index and its hot
+ * file mapping, the TLS context, the access log) is inherited by the workers.
+ *
+ * Each worker has a listener of its own in an SO_REUSEPORT group, so the
+ * kernel spreads connections over the workers without them sharing an accept
+ * queue (a unix socket can't do that, so there all workers share one). The
+ * master keeps every listener open: when a worker dies, new connections
+ * simply wait on its listener until the replacement picks them up.
+ *
+ * SIGUSR1 makes the master print the stats (and the workers their file
+ * cache reports); SIGTERM or SIGINT stop the workers, print the stats and
+ * exit.
+ *
+ * @param config The settings.
+ * @param tls The server's TLS settings, or nullptr for plain HTTP.
+ */
+void runPrefork(const ServerConfig& config, TlsContext* tls) {
+	int num_workers = config.processes;
+
+	vector<ServerSocket> listeners;
+	int num_listeners = config.unix_socket.empty() ? num_workers : 1;
+	for (int i = 0; i < num_listeners; i++) {
+		listeners.push_back(createListener(config));
+		if (config.unix_socket.empty()) {
+			listeners.back().enableReusePort();
+		}
+		if (config.align_incoming_cpu) {
+			listeners.back().setIncomingCpu(CpuAffinity::workerCpu(i));
+		}
+		listeners.back().startListening();
+	}
+
+	// the master takes its signals synchronously (the workers get the
+	// original mask back)
+	sigset_t master_signals, original_signals;
+	sigemptyset(&master_signals);
+	sigaddset(&master_signals, SIGCHLD);
+	sigaddset(&master_signals, SIGTERM);
+	sigaddset(&master_signals, SIGINT);
+	sigaddset(&master_signals, SIGUSR1);
+	if (Profiler::ENABLED) {
+		sigaddset(&master_signals, SIGUSR2);
+	}
+	sigprocmask(SIG_BLOCK, &master_signals, &original_signals);
+
+	// workers with a file cache take SIGUSR1 from the start (see
+	// startCacheReporter), so that one sent right after a fork can't kill them
+	sigset_t worker_signals = original_signals;
+	if (file_cache != nullptr) {
+		sigaddset(&worker_signals, SIGUSR1);
+	}
+
+	// in profiling builds, the master passes SIGUSR2 on to the workers,
+	// whose reporters (see Profiler) print their profiles, as on SIGTERM
+	if (Profiler::ENABLED) {
+		sigaddset(&worker_signals, SIGUSR2);
+		sigaddset(&worker_signals, SIGTERM);
+		sigaddset(&worker_signals, SIGINT);
+	}
+
+	vector<pid_t> workers(num_workers, -1);
+	vector<std::chrono::steady_clock::time_point> started(num_workers);
+
+	auto startWorker = [&](int worker) {
+		pid_t pid;
+		while ((pid = fork()) < 0) {
+			perror("Forking a worker failed");
+			sleep(1);
+		}
+
+		if (pid == 0) {
+			sigprocmask(SIG_SETMASK, &worker_signals, nullptr);
+
+			// don't outlive the master, even if it is killed with SIGKILL
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			if (getppid() == 1) exit(0);
+
+			stats->setWorker(worker);
+			CpuAffinity::pinWorkerProcess(worker);
+			runEngine(config, listeners[worker % num_listeners], tls);
+			exit(0);
+		}
+
+		workers[worker] = pid;
+		started[worker] = std::chrono::steady_clock::now();
+	};
+
+	for (int i = 0; i < num_workers; i++) {
+		startWorker(i);
+	}
+	cout << "Started " << num_workers << " worker processes" << std::endl;
+
+	while (true) {
+		int signal_number = sigwaitinfo(&master_signals, nullptr);
+
+		if (signal_number == SIGUSR2) {
+			for (pid_t pid : workers) {
+				kill(pid, SIGUSR2);
+			}
+		}
+		else if (signal_number == SIGUSR1) {
+			stats->print(cout);
+			if (file_cache != nullptr) {
+				for (pid_t pid : workers) {
+					kill(pid, SIGUSR1);
+				}
+			}
+		}
+		else if (signal_number == SIGTERM || signal_number == SIGINT) {
+			for (pid_t pid : workers) {
+				kill(pid, SIGTERM);
+			}
+			while (wait(nullptr) > 0) {}
+			stats->print(cout);
+			exit(0);
+		}
+		else if (signal_number == SIGCHLD) {
+			pid_t pid;
+			int status;
+			while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+				int worker = std::find(workers.begin(), workers.end(), pid) - workers.begin();
+				if (worker == num_workers) continue;
+
+				if (WIFSIGNALED(status)) {
+					cout << "Worker " << worker << " (pid " << pid << ") was killed by signal "
+						<< WTERMSIG(status) << "; restarting it" << std::endl;
+				}
+				else {
+					cout << "Worker " << worker << " (pid " << pid << ") exited with status "
+						<< WEXITSTATUS(status) << "; restarting it" << std::endl;
+				}
+
+				// one that dies right away would otherwise be restarted in a tight loop
+				if (std::chrono::steady_clock::now() - started[worker] < std::chrono::seconds(1)) {
+					sleep(1);
+				}
+				stats->recordRestart(worker);
+				startWorker(worker);
+			}
+		}
+	}
+}
+
+/**
+ * Indexes the served tree and warms up the caches (see FileIndex), giving up
+ * once the deadline passes.
+ *
+ * @param config The settings, for the number of threads and the deadline.
+ * @param hot_resources Resources to load into memory.
+ */
+void warmUp(const ServerConfig& config, const vector<string>& hot_resources) {
+	auto start = std::chrono::steady_clock::now();
+	auto deadline = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+			std::chrono::duration<double>(config.warm_up_deadline));
+
+	// the same root that buildResponse serves from
+	file_index = std::make_unique<FileIndex>("WWW");
+	bool finished = file_index->build(config.warm_up_threads, deadline, hot_resources);
+
+	auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - start);
+	cout << (finished ? "Warm-up done: " : "Warm-up deadline passed: ")
+		<< file_index->numFiles() << " files indexed, "
+		<< file_index->numHotFiles() << " hot ones in memory ("
+		<< file_index->hotBytes() << " bytes) in " << elapsed.count() << " ms" << std::endl;
+}
+
+/**
+ * Takes over the index of the process this one replaces, if it handed one
+ * over and the config asks for an index at all.
+ *
+ * @param config The settings.
+ * @param handover What the old process handed over.
+ * @return Whether there is an index now.
+ */
+static bool takeOverIndex(const ServerConfig& config, const Upgrade::Handover& handover) {
+	if (handover.index_fd < 0) return false;
+	if (config.warm_up_threads == 0) {
+		close(handover.index_fd);
+		if (handover.hot_fd >= 0) close(handover.hot_fd);
+		return false;
+	}
+
+	file_index = std::make_unique<FileIndex>("WWW");
+	bool loaded = file_index->loadSnapshot(handover.index_fd, handover.hot_fd);
+	close(handover.index_fd);
+	if (!loaded) {
+		cout << "Index snapshot unusable; warming up again" << std::endl;
+		file_index.reset();
+		return false;
+	}
+
+	cout << "Index taken over: " << file_index->numFiles() << " files indexed, "
+		<< file_index->numHotFiles() << " hot ones in memory ("
+		<< file_index->hotBytes() << " bytes)" << std::endl;
+	return true;
+}
+
+/**
+ * Runs the webserver on the given port, serving the files in the given
+ * directory.
+ *
+ * @param config The settings (port, root directory, worker model, ...) to
+ * run with.
+ */
+void runServer(const ServerConfig& config) {
+	if (config.unix_socket.empty()) {
+		cout << "Serving " << config.root_dir << " on port " << config.port << std::endl;
+	}
+	else {
+		cout << "Serving " << config.root_dir << " on unix socket " << config.unix_socket << std::endl;
+
+		// unix clients have no address, so they all share one set of limits
+		if (config.rate_limit > 0 || config.max_connections_per_ip > 0) {
+			cout << "Rate limits apply to all unix socket clients together" << std::endl;
+		}
+	}
+
+#ifdef TORERO_EMBEDDED
+	cout << EmbeddedAssets::all().size() << " resources are compiled in" << std::endl;
+#endif
+
+	// the writer threads send on sockets that clients may have already closed
+	signal(SIGPIPE, SIG_IGN);
+
+	if (config.file_cache_replicas && config.file_cache_mib == 0) {
+		std::cerr << "ERROR: --file-cache-replicas needs --file-cache\n";
+		exit(1);
+	}
+
+	// before any thread starts, so they all stay on the configured CPUs
+	if (config.acceptor_cpu >= 0 && config.worker_cpus.empty()) {
+		std::cerr << "ERROR: --acceptor-cpu needs --worker-cpus\n";
+		exit(1);
+	}
+	if (config.align_incoming_cpu && (config.processes == 1 || config.worker_cpus.empty()
+				|| !config.unix_socket.empty())) {
+		// only prefork mode has a listener per worker for the kernel to pick from
+		std::cerr << "ERROR: --align-workers=incoming-cpu needs --processes, --worker-cpus and a TCP port\n";
+		exit(1);
+	}
+	CpuAffinity::configure(config.worker_cpus, config.acceptor_cpu);
+
+	std::unique_ptr<TlsContext> tls;
+	if (!config.tls_cert.empty()) {
+		if (config.engine != Engine::Threads) {
+			std::cerr << "ERROR: HTTPS is only supported by the threads engine\n";
+			exit(1);
+		}
+		tls = std::make_unique<TlsContext>(config.tls_cert,
+				config.tls_key.empty() ? config.tls_cert : config.tls_key);
+
+		if (!TlsContext::kernelTlsAvailable()) {
+			cout << "Kernel TLS is not available; encrypting in user space" << std::endl;
+		}
+	}
+
+	if (config.rate_limit > 0 || config.max_connections_per_ip > 0) {
+		RateLimiter::Limits limits;
+		limits.requests_per_second = config.rate_limit;
+		limits.burst = config.rate_burst > 0 ? config.rate_burst : std::max(config.rate_limit, 1.0);
+		limits.max_connections = config.max_connections_per_ip;
+		rate_limiter = std::make_unique<RateLimiter>(limits);
+	}
+
+	// a process started by an upgrade gets the listener (and the index, if
+	// there is one) from the process it replaces
+	Upgrade::Handover handover;
+	bool upgrading = Upgrade::receive(handover);
+	bool warm_up = config.warm_up_threads > 0 && !(upgrading && takeOverIndex(config, handover));
+
+	if (!config.access_log.empty()) {
+		// read the previous run's log before adding to it
+		vector<string> hot_resources;
+		if (warm_up && config.hot_files > 0) {
+			hot_resources = AccessLog::mostRequested(config.access_log, config.hot_files);
+		}
+		access_log = std::make_unique<AccessLog>(config.access_log);
+
+		if (warm_up) {
+			warmUp(config, hot_resources);
+		}
+	}
+	else if (warm_up) {
+		warmUp(config, {});
+	}
+
+	large_file_size = config.large_file_mib * 1024 * 1024;
+	large_file_direct = config.large_file_direct;
+
+	HeaderBudget::Limits header_limits;
+	header_limits.max_bytes = config.max_header_size;
+	header_limits.timeout_seconds = config.header_timeout;
+	header_limits.memory = config.header_memory_mib * 1024 * 1024;
+	HeaderBudget::setLimits(header_limits);
+
+	// built before the fork, so the worker processes share them
+	ErrorResponses::load(config.error_pages);
+
+	// counters shared by all processes, for prefork mode and the stats endpoint
+	if (config.processes > 1 || !config.admin_path.empty()) {
+		stats = std::make_unique<ServerStats>(config.processes);
+	}
+	if (!config.admin_path.empty()) {
+		router = std::make_unique<Router>();
+		addAdminRoutes(*router, config.admin_path);
+	}
+	if (!config.proxy_routes.empty()) {
+		// the other engines would wait on the backends in their event loops
+		if (config.engine != Engine::Threads) {
+			std::cerr << "ERROR: The reverse proxy is only supported by the threads engine\n";
+			exit(1);
+		}
+		if (router == nullptr) router = std::make_unique<Router>();
+		addProxyRoutes(*router, config);
+	}
+
+	// each worker process gets a cache of its own
+	if (config.file_cache_mib > 0) {
+		file_cache = std::make_unique<FileCache>(config.file_cache_mib * 1024 * 1024,
+				config.file_cache_replicas);
+	}
+
+	if (config.processes > 1) {
+		runPrefork(config, tls.get());
+		return;
+	}
+
+	/* Create a socket and start listening for new connections on the
+	 * specified port. The warm-up is done by now, so that the first clients
+	 * already find everything in memory. A socket handed over in an upgrade
+	 * is listening already, with its options set. */
+	if (upgrading) {
+		ServerSocket server = ServerSocket::adopt(handover.listener_fd);
+		if (config.unix_peer_uid >= 0) {
+			server.requirePeerUid(config.unix_peer_uid);
+		}
+		runEngine(config, server, tls.get());
+		return;
+	}
+
+	ServerSocket server = createListener(config);
+	server.startListening();
+
+	runEngine(config, server, tls.get());
+}
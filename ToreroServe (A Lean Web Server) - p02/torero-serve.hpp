@@ -0,0 +1,28 @@
+#ifndef TORERO_SERVE_HPP
+#define TORERO_SERVE_HPP
+
+/**
+ * File: torero-serve.hpp
+ *
+ * Request handling functions from torero-serve.cpp that the engines living
+ * in other files share.
+ */
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+
+#include "HttpRequest.hpp"
+#include "HttpResponse.hpp"
+#include "FileHeader.hpp"
+
+HttpRequest parseRequest(std::string_view http_request_message);
+void setTarget(HttpRequest& request, const std::string& target);
+HttpResponse buildResponse(const HttpRequest& request);
+HttpResponse respondWith429();
+HttpResponse respondWithStatus(int status);
+bool admitRequest(uint32_t address);
+bool isLargeFile(off_t size);
+bool hasRoute(const std::string& resource);
+bool hasEmbeddedAsset(const std::string& resource);
+#endif